@@ -0,0 +1,168 @@
+<#
+bench/run.ps1
+Runs the bench/*.pre workloads and writes wall-time and peak-memory figures
+as JSON, so two builds (or the two execution engines) can be compared
+commit to commit.
+
+Each script runs once untimed (this also refreshes the .prec module cache)
+and then -Runs timed times per engine.  Scripts that use the worker pool
+(parfor_* and tensor_conv) are additionally run once per -Threads value.
+Reported per combination: median and p95 wall time in milliseconds and the
+largest peak working set seen, in bytes.
+
+Works under Windows PowerShell 5.1 and under pwsh on Linux and macOS.
+Usage (from Prefix-C folder, after build.ps1):
+    powershell -ExecutionPolicy Bypass -File .\bench\run.ps1
+    pwsh bench/run.ps1 -Prefix ./prefix -Engines vm -Filter map_* -Runs 9
+    .\build.ps1 -Bench
+Exits non-zero when any run fails.
+#>
+
+param(
+    [string]$Prefix = "",
+    [int]$Runs = 5,
+    [string[]]$Engines = @("tree", "vm"),
+    [string]$Filter = "*",
+    [int[]]$Threads = @(),
+    [string]$Out = ""
+)
+
+$script = Split-Path -Parent $MyInvocation.MyCommand.Definition
+$repo = Split-Path -Parent $script
+
+if (-not $Prefix) {
+    $Prefix = Join-Path $repo "prefix.exe"
+    if (-not (Test-Path $Prefix)) { $Prefix = Join-Path $repo "prefix" }
+}
+if (-not (Test-Path $Prefix)) {
+    Write-Error "Interpreter not found: $Prefix (build it first or pass -Prefix)"
+    exit 1
+}
+# IMPORT searches next to the executable, so always launch it by full path.
+$Prefix = (Resolve-Path $Prefix).Path
+if (-not $Out) { $Out = Join-Path $repo "bench_output.json" }
+if ($Runs -lt 1) { $Runs = 1 }
+if ($Threads.Count -eq 0) {
+    $cpus = [Environment]::ProcessorCount
+    $Threads = @(1)
+    for ($t = 2; $t -lt $cpus; $t *= 2) { $Threads += $t }
+    if ($cpus -gt 1) { $Threads += $cpus }
+}
+
+function Invoke-Once([string[]]$argv) {
+    $psi = New-Object System.Diagnostics.ProcessStartInfo
+    $psi.FileName = $Prefix
+    $psi.Arguments = ($argv | ForEach-Object { '"' + $_ + '"' }) -join ' '
+    $psi.WorkingDirectory = $repo
+    $psi.UseShellExecute = $false
+    $psi.RedirectStandardOutput = $true
+    $psi.RedirectStandardError = $true
+
+    $watch = [System.Diagnostics.Stopwatch]::StartNew()
+    $p = [System.Diagnostics.Process]::Start($psi)
+    $stdout = $p.StandardOutput.ReadToEndAsync()
+    $stderr = $p.StandardError.ReadToEndAsync()
+    $peak = [long]0
+    # Peak working set is only readable while the process is alive, so poll
+    # it; WaitForExit returns as soon as the process ends, which keeps the
+    # polling out of the wall time.
+    while (-not $p.WaitForExit(5)) {
+        try {
+            $p.Refresh()
+            if ($p.PeakWorkingSet64 -gt $peak) { $peak = $p.PeakWorkingSet64 }
+        } catch { }
+    }
+    $p.WaitForExit()
+    $watch.Stop()
+    [void]$stdout.Result
+    $err = $stderr.Result
+    return [pscustomobject]@{
+        ms = $watch.Elapsed.TotalMilliseconds
+        peak = $peak
+        code = $p.ExitCode
+        err = $err
+    }
+}
+
+function Get-Rank([double[]]$sorted, [double]$q) {
+    # Nearest-rank percentile.
+    $i = [int][Math]::Ceiling($q * $sorted.Count) - 1
+    if ($i -lt 0) { $i = 0 }
+    return $sorted[$i]
+}
+
+$scripts = Get-ChildItem -Path $script -Filter "$Filter.pre" -File | Sort-Object Name
+if ($scripts.Count -eq 0) {
+    Write-Error "No bench scripts match '$Filter'"
+    exit 1
+}
+
+$commit = ""
+try { $commit = (& git -C $repo rev-parse --short HEAD 2>$null) } catch { }
+
+$results = @()
+$failed = 0
+foreach ($s in $scripts) {
+    $rel = "bench/" + $s.Name
+    $threadSet = @(0)
+    if ($s.BaseName -like "parfor_*" -or $s.BaseName -eq "tensor_conv") { $threadSet = $Threads }
+    foreach ($engine in $Engines) {
+        foreach ($t in $threadSet) {
+            $argv = @()
+            if ($engine -eq "vm") { $argv += "-vm" }
+            if ($t -gt 0) { $argv += "-threads=$t" }
+            $argv += $rel
+
+            $label = "$rel [$engine" + $(if ($t -gt 0) { ", $t threads" } else { "" }) + "]"
+            $warm = Invoke-Once $argv
+            $ok = $warm.code -eq 0
+            $times = @()
+            $peak = $warm.peak
+            if ($ok) {
+                for ($r = 0; $r -lt $Runs; $r++) {
+                    $run = Invoke-Once $argv
+                    if ($run.code -ne 0) { $ok = $false; $warm = $run; break }
+                    $times += $run.ms
+                    if ($run.peak -gt $peak) { $peak = $run.peak }
+                }
+            }
+
+            $entry = [ordered]@{
+                script = $rel
+                engine = $engine
+                threads = $t
+                ok = $ok
+            }
+            if ($ok) {
+                $sorted = [double[]]($times | Sort-Object)
+                $entry.runs = $sorted.Count
+                $entry.median_ms = [Math]::Round((Get-Rank $sorted 0.5), 2)
+                $entry.p95_ms = [Math]::Round((Get-Rank $sorted 0.95), 2)
+                $entry.peak_rss_bytes = $peak
+                Write-Host ("{0,-48} median {1,10:N1} ms  p95 {2,10:N1} ms  peak {3,8:N1} MiB" -f $label, $entry.median_ms, $entry.p95_ms, ($peak / 1MB))
+            } else {
+                $failed++
+                $entry.exit_code = $warm.code
+                $entry.error = $warm.err.Trim()
+                Write-Host ("{0,-48} FAILED (exit {1})" -f $label, $warm.code)
+            }
+            $results += [pscustomobject]$entry
+        }
+    }
+}
+
+$report = [ordered]@{
+    commit = $commit
+    date = (Get-Date).ToString("o")
+    interpreter = $Prefix
+    runs = $Runs
+    results = $results
+}
+$report | ConvertTo-Json -Depth 4 | Set-Content -Path $Out -Encoding UTF8
+Write-Host "Wrote $Out"
+
+if ($failed -gt 0) {
+    Write-Error "$failed benchmark configuration(s) failed"
+    exit 1
+}
+exit 0
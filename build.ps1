@@ -7,8 +7,12 @@ and compiles each one into a dynamic library next to its source file.
 Requires: run from a Developer Command Prompt for Visual Studio where cl.exe is on PATH.
 Usage (from Prefix-C folder):
     powershell -ExecutionPolicy Bypass -File .\build.ps1
+    powershell -ExecutionPolicy Bypass -File .\build.ps1 -Bench
+-Bench runs bench\run.ps1 against the fresh build and writes bench_output.json.
 #>
 
+param([switch]$Bench)
+
 $script = Split-Path -Parent $MyInvocation.MyCommand.Definition
 $src = Join-Path $script "src"
 $extRoots = @(
@@ -133,4 +137,9 @@ try {
 }
 
 Write-Host "Build succeeded and exe copied to: $(Join-Path $script 'prefix.exe')"
+
+if ($Bench) {
+    & (Join-Path $script "bench\run.ps1") -Prefix (Join-Path $script "prefix.exe")
+    exit $LASTEXITCODE
+}
 exit 0
@@ -33,6 +33,7 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <time.h>
 typedef int SOCKET;
 #define INVALID_SOCKET (-1)
@@ -45,20 +46,26 @@ typedef int SOCKET;
 typedef struct {
 	int id;
 	SOCKET sock;
+	int nonblocking;
 } NetHandle;
 
 typedef struct {
-	NetHandle* tcp;
-	size_t tcp_count;
-	size_t tcp_cap;
-	NetHandle* udp;
-	size_t udp_count;
-	size_t udp_cap;
+	NetHandle* items;
+	size_t count;
+	size_t cap;
+} HandleTable;
+
+typedef struct {
+	HandleTable tcp;
+	HandleTable udp;
 	int next_id;
 	int sockets_ready;
 } NetState;
 
 static NetState g_state = {0};
+/* Guards g_state's tables: NET_POLL in one THR may run alongside sends
+ * and closes in another. */
+static mtx_t g_handles_lock;
 
 #define RUNTIME_ERROR(interp, msg, line, col) \
 	do { \
@@ -133,80 +140,147 @@ static int set_socket_timeout_ms(SOCKET s, int timeout_ms) {
 	return 0;
 }
 
-static int reserve_handles(NetHandle** arr, size_t* cap, size_t need) {
-	if (*cap >= need) return 0;
-	size_t next = (*cap == 0) ? 8 : (*cap * 2);
+static int set_socket_nonblocking(SOCKET s, int on) {
+#ifdef _WIN32
+	u_long mode = on ? 1 : 0;
+	return ioctlsocket(s, FIONBIO, &mode) == 0 ? 0 : -1;
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	if (flags < 0) return -1;
+	flags = on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	return fcntl(s, F_SETFL, flags) == 0 ? 0 : -1;
+#endif
+}
+
+/* True when the last socket call failed only because a non-blocking
+ * socket had nothing to give (or no room to take) yet. */
+static int net_would_block(void) {
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+static int reserve_handles(HandleTable* t, size_t need) {
+	if (t->cap >= need) return 0;
+	size_t next = (t->cap == 0) ? 8 : (t->cap * 2);
 	while (next < need) next *= 2;
-	NetHandle* p = (NetHandle*)realloc(*arr, next * sizeof(NetHandle));
+	NetHandle* p = (NetHandle*)realloc(t->items, next * sizeof(NetHandle));
 	if (!p) return -1;
-	*arr = p;
-	*cap = next;
+	t->items = p;
+	t->cap = next;
 	return 0;
 }
 
-static int add_handle(NetHandle** arr, size_t* count, size_t* cap, SOCKET sock) {
-	if (reserve_handles(arr, cap, *count + 1) != 0) return -1;
-	int id = g_state.next_id++;
-	(*arr)[*count].id = id;
-	(*arr)[*count].sock = sock;
-	(*count)++;
+static int add_handle(HandleTable* t, SOCKET sock) {
+	int id = -1;
+	mtx_lock(&g_handles_lock);
+	if (reserve_handles(t, t->count + 1) == 0) {
+		id = g_state.next_id++;
+		t->items[t->count].id = id;
+		t->items[t->count].sock = sock;
+		t->items[t->count].nonblocking = 0;
+		t->count++;
+	}
+	mtx_unlock(&g_handles_lock);
 	return id;
 }
 
-static SOCKET find_handle(NetHandle* arr, size_t count, int id) {
-	for (size_t i = 0; i < count; i++) {
-		if (arr[i].id == id) return arr[i].sock;
+/* Copies the entry for `id` into *out; 0 if found. */
+static int get_handle(HandleTable* t, int id, NetHandle* out) {
+	int rc = -1;
+	mtx_lock(&g_handles_lock);
+	for (size_t i = 0; i < t->count; i++) {
+		if (t->items[i].id == id) {
+			*out = t->items[i];
+			rc = 0;
+			break;
+		}
+	}
+	mtx_unlock(&g_handles_lock);
+	return rc;
+}
+
+/* TCP and UDP handles share one id space. */
+static HandleTable* table_of(int id, NetHandle* out) {
+	if (get_handle(&g_state.tcp, id, out) == 0) return &g_state.tcp;
+	if (get_handle(&g_state.udp, id, out) == 0) return &g_state.udp;
+	return NULL;
+}
+
+static int remove_handle(HandleTable* t, int id, SOCKET* out) {
+	int rc = -1;
+	mtx_lock(&g_handles_lock);
+	for (size_t i = 0; i < t->count; i++) {
+		if (t->items[i].id == id) {
+			*out = t->items[i].sock;
+			t->items[i] = t->items[t->count - 1];
+			t->count--;
+			rc = 0;
+			break;
+		}
 	}
-	return INVALID_SOCKET;
+	mtx_unlock(&g_handles_lock);
+	return rc;
 }
 
-static int remove_handle(NetHandle* arr, size_t* count, int id, SOCKET* out) {
-	for (size_t i = 0; i < *count; i++) {
-		if (arr[i].id == id) {
-			*out = arr[i].sock;
-			arr[i] = arr[*count - 1];
-			(*count)--;
-			return 0;
+static int set_handle_nonblocking(HandleTable* t, int id, int on) {
+	int rc = -1;
+	mtx_lock(&g_handles_lock);
+	for (size_t i = 0; i < t->count; i++) {
+		if (t->items[i].id == id) {
+			t->items[i].nonblocking = on;
+			rc = 0;
+			break;
 		}
 	}
-	return -1;
+	mtx_unlock(&g_handles_lock);
+	return rc;
 }
 
+/* Tensor buffer access from the init context, so byte payloads are
+ * written straight into / read straight out of packed INT storage. */
+static int (*g_tns_acquire)(Value* tensor, int flags, TnsBuffer* out);
+static void (*g_tns_release)(TnsBuffer* buf);
+static Value (*g_tns_alloc)(DeclType elem_type, size_t ndim, const size_t* shape, TnsBuffer* out);
+
 static Value bytes_to_tns(const unsigned char* data, size_t len) {
 	size_t shape = (len == 0) ? 1 : len;
-	Value* items = (Value*)malloc(sizeof(Value) * shape);
-	if (!items) return value_null();
-	if (len == 0) {
-		items[0] = value_int(0);
-	} else {
-		for (size_t i = 0; i < len; i++) items[i] = value_int((int64_t)data[i]);
-	}
-	Value t = value_tns_from_values(TYPE_INT, 1, &shape, items, shape);
-	free(items);
+	TnsBuffer buf;
+	Value t = g_tns_alloc(TYPE_INT, 1, &shape, &buf);
+	if (t.type != VAL_TNS) return value_null();
+	for (size_t i = 0; i < len; i++) buf.ints[i] = (int64_t)data[i];
+	g_tns_release(&buf);
 	return t;
 }
 
 static int tns_to_bytes(Value v, unsigned char** out_data, size_t* out_len) {
 	if (v.type != VAL_TNS || !v.as.tns) return -1;
-	Tensor* t = v.as.tns;
-	if (t->ndim != 1) return -1;
-	unsigned char* buf = (unsigned char*)malloc(t->length == 0 ? 1 : t->length);
-	if (!buf) return -1;
-	for (size_t i = 0; i < t->length; i++) {
-		Value e = t->data[i];
-		if (e.type != VAL_INT) {
-			free(buf);
-			return -1;
-		}
-		int64_t b = e.as.i;
+	if (v.as.tns->ndim != 1) return -1;
+	TnsBuffer tb;
+	if (g_tns_acquire(&v, PREFIX_TNS_CONTIGUOUS, &tb) != 0) return -1;
+	if (tb.elem_type != TYPE_INT) {
+		g_tns_release(&tb);
+		return -1;
+	}
+	unsigned char* buf = (unsigned char*)malloc(tb.length == 0 ? 1 : tb.length);
+	if (!buf) {
+		g_tns_release(&tb);
+		return -1;
+	}
+	for (size_t i = 0; i < tb.length; i++) {
+		int64_t b = tb.ints[i];
 		if (b < 0 || b > 255) {
 			free(buf);
+			g_tns_release(&tb);
 			return -1;
 		}
 		buf[i] = (unsigned char)b;
 	}
 	*out_data = buf;
-	*out_len = t->length;
+	*out_len = tb.length;
+	g_tns_release(&tb);
 	return 0;
 }
 
@@ -497,6 +571,894 @@ static int bridge_call(const char* op, const char** args, int arg_count, unsigne
 #endif
 }
 
+/* ---- Connections ----
+ * Native FTP, SMTP and (off Windows) HTTP run over plain sockets read
+ * through a SockReader.  A connection that ends a call in a clean state
+ * goes to a small idle pool keyed by protocol, host, port and credentials,
+ * so the next call to the same server skips the TCP connect and, for FTP
+ * and SMTP, the login.  Pooled connections are revalidated (NOOP / RSET)
+ * or retried once on failure, since servers drop idle clients. */
+
+#ifdef _WIN32
+typedef int net_socklen_t;
+#else
+typedef socklen_t net_socklen_t;
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define NET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define NET_SEND_FLAGS 0
+#endif
+
+#define NET_POOL_MAX 8
+
+typedef struct {
+	SOCKET sock;
+	unsigned char buf[4096];
+	size_t pos;
+	size_t len;
+} SockReader;
+
+typedef struct {
+	char* key;
+	SockReader rd;
+} NetConn;
+
+typedef struct {
+	unsigned char* data;
+	size_t len;
+	size_t cap;
+} ByteBuf;
+
+static NetConn* g_idle[NET_POOL_MAX];
+static size_t g_idle_count = 0;
+static mtx_t g_pool_lock;
+static bool g_pool_ready = false;
+
+static int bb_append(ByteBuf* b, const void* data, size_t n) {
+	if (b->len + n + 1 > b->cap) {
+		size_t nc = b->cap ? b->cap * 2 : 4096;
+		while (nc < b->len + n + 1) nc *= 2;
+		unsigned char* p = (unsigned char*)realloc(b->data, nc);
+		if (!p) return -1;
+		b->data = p;
+		b->cap = nc;
+	}
+	if (n) memcpy(b->data + b->len, data, n);
+	b->len += n;
+	b->data[b->len] = 0;
+	return 0;
+}
+
+static int bb_puts(ByteBuf* b, const char* s) {
+	return bb_append(b, s, strlen(s));
+}
+
+static SOCKET tcp_open(const char* host, int64_t port, int timeout_ms) {
+	char port_buf[32];
+	snprintf(port_buf, sizeof(port_buf), "%lld", (long long)port);
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_family = AF_UNSPEC;
+	struct addrinfo* res = NULL;
+	if (getaddrinfo(host, port_buf, &hints, &res) != 0 || !res) return INVALID_SOCKET;
+
+	SOCKET s = INVALID_SOCKET;
+	for (struct addrinfo* it = res; it; it = it->ai_next) {
+		s = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+		if (s == INVALID_SOCKET) continue;
+		set_socket_timeout_ms(s, timeout_ms);
+		if (connect(s, it->ai_addr, (int)it->ai_addrlen) == 0) {
+			break;
+		}
+		closesocket(s);
+		s = INVALID_SOCKET;
+	}
+	freeaddrinfo(res);
+	return s;
+}
+
+static int send_all(SOCKET s, const void* data, size_t len) {
+	const char* p = (const char*)data;
+	while (len > 0) {
+		int chunk = len > 65536 ? 65536 : (int)len;
+		int n = send(s, p, chunk, NET_SEND_FLAGS);
+		if (n == SOCKET_ERROR || n <= 0) return -1;
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+static int send_str(SOCKET s, const char* text) {
+	return send_all(s, text, strlen(text));
+}
+
+static int sr_fill(SockReader* rd) {
+	if (rd->pos < rd->len) return 1;
+	int n = recv(rd->sock, (char*)rd->buf, (int)sizeof(rd->buf), 0);
+	if (n == SOCKET_ERROR || n < 0) return -1;
+	rd->pos = 0;
+	rd->len = (size_t)n;
+	return n > 0 ? 1 : 0;
+}
+
+/* Next line without its CR LF, in a malloc'd string; NULL at end of stream
+ * or on error. */
+static char* sr_line(SockReader* rd) {
+	ByteBuf b = {0};
+	for (;;) {
+		int r = sr_fill(rd);
+		if (r <= 0) {
+			if (r == 0 && b.len > 0) break;
+			free(b.data);
+			return NULL;
+		}
+		unsigned char* start = rd->buf + rd->pos;
+		unsigned char* nl = (unsigned char*)memchr(start, '\n', rd->len - rd->pos);
+		size_t take = nl ? (size_t)(nl - start) + 1 : rd->len - rd->pos;
+		if (bb_append(&b, start, take) != 0) {
+			free(b.data);
+			return NULL;
+		}
+		rd->pos += take;
+		if (nl) break;
+	}
+	if (!b.data && bb_append(&b, "", 0) != 0) return NULL;
+	while (b.len > 0 && (b.data[b.len - 1] == '\n' || b.data[b.len - 1] == '\r')) b.data[--b.len] = 0;
+	return (char*)b.data;
+}
+
+#ifndef _WIN32
+/* Exactly `n` bytes; only the HTTP client needs framed reads. */
+static int sr_read(SockReader* rd, ByteBuf* out, size_t n) {
+	while (n > 0) {
+		if (sr_fill(rd) <= 0) return -1;
+		size_t take = rd->len - rd->pos;
+		if (take > n) take = n;
+		if (bb_append(out, rd->buf + rd->pos, take) != 0) return -1;
+		rd->pos += take;
+		n -= take;
+	}
+	return 0;
+}
+#endif
+
+static int sr_read_to_end(SockReader* rd, ByteBuf* out) {
+	for (;;) {
+		int r = sr_fill(rd);
+		if (r < 0) return -1;
+		if (r == 0) return 0;
+		if (bb_append(out, rd->buf + rd->pos, rd->len - rd->pos) != 0) return -1;
+		rd->pos = rd->len;
+	}
+}
+
+static NetConn* conn_open(const char* key, const char* host, int64_t port, int timeout_ms) {
+	SOCKET s = tcp_open(host, port, timeout_ms);
+	if (s == INVALID_SOCKET) return NULL;
+	NetConn* c = (NetConn*)calloc(1, sizeof(NetConn));
+	if (c) c->key = strdup(key);
+	if (!c || !c->key) {
+		if (c) free(c);
+		closesocket(s);
+		return NULL;
+	}
+	c->rd.sock = s;
+	return c;
+}
+
+static void conn_close(NetConn* c) {
+	if (!c) return;
+	closesocket(c->rd.sock);
+	free(c->key);
+	free(c);
+}
+
+/* Take an idle connection for `key`, or NULL if there is none. */
+static NetConn* pool_take(const char* key, int timeout_ms) {
+	NetConn* c = NULL;
+	mtx_lock(&g_pool_lock);
+	for (size_t i = g_idle_count; i-- > 0;) {
+		if (strcmp(g_idle[i]->key, key) == 0) {
+			c = g_idle[i];
+			g_idle[i] = g_idle[--g_idle_count];
+			break;
+		}
+	}
+	mtx_unlock(&g_pool_lock);
+	if (c) set_socket_timeout_ms(c->rd.sock, timeout_ms);
+	return c;
+}
+
+/* Return a connection in a clean state to the pool, evicting the oldest
+ * idle one when it is full. */
+static void pool_put(NetConn* c) {
+	NetConn* evicted = NULL;
+	mtx_lock(&g_pool_lock);
+	if (g_idle_count == NET_POOL_MAX) {
+		evicted = g_idle[0];
+		memmove(g_idle, g_idle + 1, (NET_POOL_MAX - 1) * sizeof(NetConn*));
+		g_idle_count--;
+	}
+	g_idle[g_idle_count++] = c;
+	mtx_unlock(&g_pool_lock);
+	conn_close(evicted);
+}
+
+static char* net_error(const char* what, const char* detail) {
+	char buf[512];
+	snprintf(buf, sizeof(buf), "%s%s%s", what, detail && detail[0] ? ": " : "", detail ? detail : "");
+	return strdup(buf);
+}
+
+/* FTP and SMTP commands and HTTP request and header lines end at CR LF, so
+ * an argument carrying CR or LF would add a command or header of its own,
+ * and one carrying NUL would be cut short.  NULL when STR `v` is safe to
+ * put in such a line, else a net_error naming `field`. */
+static char* net_line_field_error(Value v, const char* field) {
+	const char* s = as_cstr(v);
+	if (strpbrk(s, "\r\n") || (v.as.s && strlen(s) != value_str_len(v.as.s))) {
+		return net_error("line break or NUL in field", field);
+	}
+	return NULL;
+}
+
+#define EXPECT_LINE_FIELD_AT(args, idx, opname, field) \
+	do { \
+		char* _ferr = net_line_field_error((args)[(idx)], field); \
+		if (_ferr) { \
+			char _buf[160]; \
+			snprintf(_buf, sizeof(_buf), "%s failed: %s", opname, _ferr); \
+			free(_ferr); \
+			RUNTIME_ERROR(interp, _buf, line, col); \
+		} \
+	} while (0)
+
+/* `a`, `b` and `c` joined into a malloc'd string; NULL when out of memory. */
+static char* str_join3(const char* a, const char* b, const char* c) {
+	size_t la = strlen(a), lb = strlen(b), lc = strlen(c);
+	char* out = (char*)malloc(la + lb + lc + 1);
+	if (!out) return NULL;
+	memcpy(out, a, la);
+	memcpy(out + la, b, lb);
+	memcpy(out + la + lb, c, lc + 1);
+	return out;
+}
+
+/* ---- FTP / SMTP commands ---- */
+
+/* Read one reply (all lines of a multi-line one) and return its code, or -1
+ * if the connection failed.  *text, when given, receives the last line. */
+static int proto_reply(NetConn* c, char** text) {
+	char* ln = sr_line(&c->rd);
+	if (!ln || strlen(ln) < 3) {
+		free(ln);
+		return -1;
+	}
+	int code = atoi(ln);
+	if (ln[3] == '-') {
+		char end[5];
+		memcpy(end, ln, 3);
+		end[3] = ' ';
+		end[4] = '\0';
+		for (;;) {
+			free(ln);
+			ln = sr_line(&c->rd);
+			if (!ln) return -1;
+			if (strncmp(ln, end, 4) == 0) break;
+		}
+	}
+	if (text) *text = ln;
+	else free(ln);
+	return code;
+}
+
+/* Send `cmd` and read the reply.  On a reply outside [lo, hi] (or a broken
+ * connection) returns -1 with *err describing it. */
+static int proto_cmd(NetConn* c, const char* cmd, int lo, int hi, char** err) {
+	if (cmd) {
+		ByteBuf line = {0};
+		if (bb_puts(&line, cmd) != 0 || bb_append(&line, "\r\n", 2) != 0) {
+			free(line.data);
+			*err = net_error("out of memory", NULL);
+			return -1;
+		}
+		int rc = send_all(c->rd.sock, line.data, line.len);
+		free(line.data);
+		if (rc != 0) {
+			*err = net_error("connection lost", NULL);
+			return -1;
+		}
+	}
+	char* text = NULL;
+	int code = proto_reply(c, &text);
+	if (code < lo || code > hi) {
+		*err = net_error(code < 0 ? "connection lost" : "server replied", text);
+		free(text);
+		return -1;
+	}
+	free(text);
+	return code;
+}
+
+static char* base64_encode(const unsigned char* data, size_t len) {
+	static const char* tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char* out = (char*)malloc((len + 2) / 3 * 4 + 1);
+	if (!out) return NULL;
+	size_t o = 0;
+	for (size_t i = 0; i < len; i += 3) {
+		uint32_t v = (uint32_t)data[i] << 16;
+		if (i + 1 < len) v |= (uint32_t)data[i + 1] << 8;
+		if (i + 2 < len) v |= data[i + 2];
+		out[o++] = tbl[(v >> 18) & 63];
+		out[o++] = tbl[(v >> 12) & 63];
+		out[o++] = (i + 1 < len) ? tbl[(v >> 6) & 63] : '=';
+		out[o++] = (i + 2 < len) ? tbl[v & 63] : '=';
+	}
+	out[o] = '\0';
+	return out;
+}
+
+/* Pool key of a logged-in session, malloc'd; NULL when out of memory.  The
+ * fields are free of line breaks (net_line_field_error), so distinct
+ * sessions never share a key. */
+static char* session_key(const char* proto, const char* host, int64_t port, const char* user, const char* pwd) {
+	ByteBuf b = {0};
+	char num[32];
+	snprintf(num, sizeof(num), "\n%lld\n", (long long)port);
+	if (bb_puts(&b, proto) != 0 || bb_puts(&b, "\n") != 0 || bb_puts(&b, host) != 0 ||
+		bb_puts(&b, num) != 0 || bb_puts(&b, user) != 0 || bb_puts(&b, "\n") != 0 ||
+		bb_puts(&b, pwd) != 0) {
+		free(b.data);
+		return NULL;
+	}
+	return (char*)b.data;
+}
+
+/* "VERB arg", or just "VERB" when arg is empty; malloc'd. */
+static char* ftp_command(const char* verb, const char* arg) {
+	return arg[0] ? str_join3(verb, " ", arg) : str_join3(verb, "", "");
+}
+
+/* A logged-in FTP control connection in binary mode: a pooled one that
+ * still answers NOOP, or a new one. */
+static NetConn* ftp_session(const char* host, int64_t port, const char* user, const char* pwd, int timeout_ms, char** err) {
+	char* key = session_key("ftp", host, port, user, pwd);
+	if (!key) {
+		*err = net_error("out of memory", NULL);
+		return NULL;
+	}
+	NetConn* c;
+	while ((c = pool_take(key, timeout_ms)) != NULL) {
+		char* ignored = NULL;
+		if (proto_cmd(c, "NOOP", 200, 299, &ignored) >= 0) {
+			free(key);
+			return c;
+		}
+		free(ignored);
+		conn_close(c);
+	}
+	c = conn_open(key, host, port, timeout_ms);
+	free(key);
+	if (!c) {
+		*err = net_error("connect failed", NULL);
+		return NULL;
+	}
+	if (proto_cmd(c, NULL, 220, 220, err) < 0) goto fail;
+	char* cmd = ftp_command("USER", user[0] ? user : "anonymous");
+	if (!cmd) goto oom;
+	int code = proto_cmd(c, cmd, 230, 331, err);
+	free(cmd);
+	if (code < 0) goto fail;
+	if (code == 331) {
+		cmd = str_join3("PASS ", pwd, "");
+		if (!cmd) goto oom;
+		code = proto_cmd(c, cmd, 230, 230, err);
+		free(cmd);
+		if (code < 0) goto fail;
+	}
+	if (proto_cmd(c, "TYPE I", 200, 200, err) < 0) goto fail;
+	return c;
+oom:
+	*err = net_error("out of memory", NULL);
+fail:
+	conn_close(c);
+	return NULL;
+}
+
+/* Open the data connection of a passive transfer.  The port comes from the
+ * EPSV or PASV reply; the address is always the control connection's peer,
+ * as servers behind NAT often advertise an unreachable one. */
+static SOCKET ftp_data(NetConn* c, int timeout_ms, char** err) {
+	int port = -1;
+	char* text = NULL;
+	if (send_str(c->rd.sock, "EPSV\r\n") == 0 && proto_reply(c, &text) == 229) {
+		const char* p = strstr(text, "(|||");
+		if (p) port = atoi(p + 4);
+	} else {
+		free(text);
+		text = NULL;
+		if (send_str(c->rd.sock, "PASV\r\n") == 0 && proto_reply(c, &text) == 227) {
+			const char* p = strchr(text, '(');
+			int h[6];
+			if (p && sscanf(p + 1, "%d,%d,%d,%d,%d,%d", &h[0], &h[1], &h[2], &h[3], &h[4], &h[5]) == 6) {
+				port = h[4] * 256 + h[5];
+			}
+		}
+	}
+	if (port <= 0 || port > 65535) {
+		*err = net_error("passive mode refused", text);
+		free(text);
+		return INVALID_SOCKET;
+	}
+	free(text);
+
+	struct sockaddr_storage peer;
+	net_socklen_t peer_len = (net_socklen_t)sizeof(peer);
+	if (getpeername(c->rd.sock, (struct sockaddr*)&peer, &peer_len) != 0) {
+		*err = net_error("passive mode failed", NULL);
+		return INVALID_SOCKET;
+	}
+	if (peer.ss_family == AF_INET) ((struct sockaddr_in*)&peer)->sin_port = htons((unsigned short)port);
+	else ((struct sockaddr_in6*)&peer)->sin6_port = htons((unsigned short)port);
+	SOCKET d = socket(peer.ss_family, SOCK_STREAM, 0);
+	if (d == INVALID_SOCKET) {
+		*err = net_error("data connection failed", NULL);
+		return INVALID_SOCKET;
+	}
+	set_socket_timeout_ms(d, timeout_ms);
+	if (connect(d, (struct sockaddr*)&peer, peer_len) != 0) {
+		closesocket(d);
+		*err = net_error("data connection failed", NULL);
+		return INVALID_SOCKET;
+	}
+	return d;
+}
+
+/* Run one FTP transfer: `cmd` (LIST, RETR or STOR) over a passive data
+ * connection, downloading into `down` or uploading `up` / `up_len`. */
+static int ftp_transfer(const char* host, int64_t port, const char* user, const char* pwd, int timeout_ms,
+						const char* cmd, ByteBuf* down, const unsigned char* up, size_t up_len, char** err) {
+	NetConn* c = ftp_session(host, port, user, pwd, timeout_ms, err);
+	if (!c) return -1;
+	SOCKET d = ftp_data(c, timeout_ms, err);
+	if (d == INVALID_SOCKET) {
+		conn_close(c);
+		return -1;
+	}
+	if (proto_cmd(c, cmd, 125, 150, err) < 0) {
+		closesocket(d);
+		conn_close(c);
+		return -1;
+	}
+	int rc = 0;
+	if (down) {
+		SockReader* drd = (SockReader*)malloc(sizeof(SockReader));
+		if (!drd) {
+			rc = -1;
+		} else {
+			drd->sock = d;
+			drd->pos = drd->len = 0;
+			rc = sr_read_to_end(drd, down);
+			free(drd);
+		}
+	} else {
+		rc = send_all(d, up, up_len);
+	}
+	closesocket(d);
+	if (rc != 0) {
+		*err = net_error("transfer failed", NULL);
+		conn_close(c);
+		return -1;
+	}
+	if (proto_cmd(c, NULL, 226, 250, err) < 0) {
+		conn_close(c);
+		return -1;
+	}
+	pool_put(c);
+	return 0;
+}
+
+/* An SMTP connection that has greeted the server (and logged in when `user`
+ * or `pwd` is set) and is ready for MAIL FROM. */
+static NetConn* smtp_session(const char* host, int64_t port, const char* user, const char* pwd, int timeout_ms, char** err) {
+	char* key = session_key("smtp", host, port, user, pwd);
+	if (!key) {
+		*err = net_error("out of memory", NULL);
+		return NULL;
+	}
+	NetConn* c;
+	while ((c = pool_take(key, timeout_ms)) != NULL) {
+		char* ignored = NULL;
+		if (proto_cmd(c, "RSET", 250, 250, &ignored) >= 0) {
+			free(key);
+			return c;
+		}
+		free(ignored);
+		conn_close(c);
+	}
+	c = conn_open(key, host, port, timeout_ms);
+	free(key);
+	if (!c) {
+		*err = net_error("connect failed", NULL);
+		return NULL;
+	}
+	if (proto_cmd(c, NULL, 220, 220, err) < 0) goto fail;
+	if (proto_cmd(c, "EHLO localhost", 250, 250, err) < 0) goto fail;
+	if (user[0] || pwd[0]) {
+		size_t ul = strlen(user), pl = strlen(pwd);
+		unsigned char* plain = (unsigned char*)malloc(ul + pl + 2);
+		if (!plain) {
+			*err = net_error("out of memory", NULL);
+			goto fail;
+		}
+		plain[0] = 0;
+		memcpy(plain + 1, user, ul);
+		plain[ul + 1] = 0;
+		memcpy(plain + ul + 2, pwd, pl);
+		char* b64 = base64_encode(plain, ul + pl + 2);
+		free(plain);
+		char* cmd = b64 ? str_join3("AUTH PLAIN ", b64, "") : NULL;
+		free(b64);
+		if (!cmd) {
+			*err = net_error("out of memory", NULL);
+			goto fail;
+		}
+		int code = proto_cmd(c, cmd, 235, 235, err);
+		free(cmd);
+		if (code < 0) goto fail;
+	}
+	return c;
+fail:
+	conn_close(c);
+	return NULL;
+}
+
+static int smtp_send(const char* host, int64_t port, const char* user, const char* pwd, int timeout_ms,
+					 const char* from, const char* to, const char* subject, const char* body, char** err) {
+	ByteBuf msg = {0};
+	char* rcpt_list = strdup(to);
+	if (!rcpt_list) {
+		*err = net_error("out of memory", NULL);
+		return -1;
+	}
+	/* Recipients are separated by ',' or ';'. */
+	char* rcpts[256];
+	int nrcpt = 0;
+	for (char* p = rcpt_list; *p && nrcpt < 256;) {
+		while (*p == ' ' || *p == '\t' || *p == ',' || *p == ';') p++;
+		if (!*p) break;
+		char* start = p;
+		while (*p && *p != ',' && *p != ';') p++;
+		char* end = p;
+		if (*p) *p++ = '\0';
+		while (end > start && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+		rcpts[nrcpt++] = start;
+	}
+	if (nrcpt == 0) {
+		free(rcpt_list);
+		*err = net_error("no recipients", NULL);
+		return -1;
+	}
+
+	bb_puts(&msg, "From: ");
+	bb_puts(&msg, from);
+	bb_puts(&msg, "\r\nTo: ");
+	for (int i = 0; i < nrcpt; i++) {
+		if (i) bb_puts(&msg, ", ");
+		bb_puts(&msg, rcpts[i]);
+	}
+	bb_puts(&msg, "\r\nSubject: ");
+	bb_puts(&msg, subject);
+	bb_puts(&msg, "\r\nMIME-Version: 1.0\r\nContent-Type: text/plain; charset=utf-8\r\n\r\n");
+	/* Body with CR LF line ends and leading dots doubled (RFC 5321 4.5.2). */
+	bool at_line_start = true;
+	for (const char* p = body; *p; p++) {
+		if (at_line_start && *p == '.') bb_append(&msg, ".", 1);
+		if (*p == '\n' && (p == body || p[-1] != '\r')) bb_append(&msg, "\r", 1);
+		bb_append(&msg, p, 1);
+		at_line_start = *p == '\n';
+	}
+	if (!at_line_start) bb_append(&msg, "\r\n", 2);
+	if (bb_append(&msg, ".\r\n", 3) != 0) {
+		free(msg.data);
+		free(rcpt_list);
+		*err = net_error("out of memory", NULL);
+		return -1;
+	}
+
+	int rc = -1;
+	NetConn* c = smtp_session(host, port, user, pwd, timeout_ms, err);
+	if (c) {
+		char* cmd = str_join3("MAIL FROM:<", from, ">");
+		if (!cmd) *err = net_error("out of memory", NULL);
+		if (cmd && proto_cmd(c, cmd, 250, 250, err) >= 0) {
+			rc = 0;
+			for (int i = 0; i < nrcpt && rc == 0; i++) {
+				free(cmd);
+				cmd = str_join3("RCPT TO:<", rcpts[i], ">");
+				if (!cmd) {
+					*err = net_error("out of memory", NULL);
+					rc = -1;
+				} else if (proto_cmd(c, cmd, 250, 251, err) < 0) {
+					rc = -1;
+				}
+			}
+			if (rc == 0 && proto_cmd(c, "DATA", 354, 354, err) < 0) rc = -1;
+			if (rc == 0 && send_all(c->rd.sock, msg.data, msg.len) != 0) {
+				*err = net_error("connection lost", NULL);
+				rc = -1;
+			}
+			if (rc == 0 && proto_cmd(c, NULL, 250, 250, err) < 0) rc = -1;
+		}
+		free(cmd);
+		if (rc == 0) pool_put(c);
+		else conn_close(c);
+	}
+	free(msg.data);
+	free(rcpt_list);
+	return rc;
+}
+
+#ifndef _WIN32
+/* ---- HTTP/1.1 over sockets ----
+ * Requests ask for keep-alive; a response whose end is known (by
+ * Content-Length or chunked encoding) leaves its connection in the pool.
+ * There is no TLS backend here, so https URLs are rejected. */
+
+typedef struct {
+	char host[256];
+	int64_t port;
+	const char* target;    /* path and query, or "" for "/" */
+} HttpUrl;
+
+static int http_parse_url(const char* url, HttpUrl* u, char** err) {
+	const char* p;
+	if (strncasecmp(url, "http://", 7) == 0) {
+		p = url + 7;
+	} else if (strncasecmp(url, "https://", 8) == 0) {
+		*err = net_error("https needs the Windows build (no TLS backend on this platform)", NULL);
+		return -1;
+	} else {
+		*err = net_error("unsupported URL", url);
+		return -1;
+	}
+	const char* host_end;
+	const char* host = p;
+	if (*p == '[') {
+		host = p + 1;
+		host_end = strchr(host, ']');
+		if (!host_end) {
+			*err = net_error("invalid URL", url);
+			return -1;
+		}
+		p = host_end + 1;
+	} else {
+		while (*p && *p != ':' && *p != '/' && *p != '?' && *p != '#') p++;
+		host_end = p;
+	}
+	size_t hl = (size_t)(host_end - host);
+	if (hl == 0 || hl >= sizeof(u->host)) {
+		*err = net_error("invalid URL", url);
+		return -1;
+	}
+	memcpy(u->host, host, hl);
+	u->host[hl] = '\0';
+	u->port = 80;
+	if (*p == ':') {
+		u->port = strtoll(p + 1, (char**)&p, 10);
+		if (u->port <= 0 || u->port > 65535) {
+			*err = net_error("invalid URL port", url);
+			return -1;
+		}
+	}
+	u->target = p;
+	return 0;
+}
+
+static const char* http_header_value(const char* line, const char* name) {
+	size_t n = strlen(name);
+	if (strncasecmp(line, name, n) != 0 || line[n] != ':') return NULL;
+	line += n + 1;
+	while (*line == ' ' || *line == '\t') line++;
+	return line;
+}
+
+static bool http_has_token(const char* value, const char* token) {
+	size_t n = strlen(token);
+	for (const char* p = value; *p; p++) {
+		if (strncasecmp(p, token, n) == 0) return true;
+	}
+	return false;
+}
+
+/* One request / response exchange on `c`.  Returns 0 with the response in
+ * *status / body and *reusable set, or -1; *retry is set when nothing of
+ * a response arrived, so a stale pooled connection can be replaced. */
+static int http_exchange(NetConn* c, const char* method, const HttpUrl* u, const char* host_hdr,
+						 const unsigned char* body, size_t body_len, const char* content_type,
+						 int* status, ByteBuf* out, bool* reusable, bool* retry, char** err) {
+	ByteBuf req = {0};
+	char num[32];
+	bb_puts(&req, method);
+	bb_puts(&req, " ");
+	if (u->target[0] != '/') bb_puts(&req, "/");
+	size_t tl = strcspn(u->target, "#");
+	bb_append(&req, u->target, tl);
+	bb_puts(&req, " HTTP/1.1\r\nHost: ");
+	bb_puts(&req, host_hdr);
+	bb_puts(&req, "\r\nUser-Agent: Prefix-C/networking\r\nAccept: */*\r\nConnection: keep-alive\r\n");
+	if (content_type && content_type[0]) {
+		bb_puts(&req, "Content-Type: ");
+		bb_puts(&req, content_type);
+		bb_puts(&req, "\r\n");
+	}
+	if (body || strcmp(method, "POST") == 0) {
+		snprintf(num, sizeof(num), "%zu", body_len);
+		bb_puts(&req, "Content-Length: ");
+		bb_puts(&req, num);
+		bb_puts(&req, "\r\n");
+	}
+	bb_puts(&req, "\r\n");
+	if (body_len) bb_append(&req, body, body_len);
+	int rc = req.data ? send_all(c->rd.sock, req.data, req.len) : -1;
+	free(req.data);
+	*retry = true;
+	if (rc != 0) {
+		*err = net_error("send failed", NULL);
+		return -1;
+	}
+
+	char* ln;
+	int code;
+	bool http11;
+	for (;;) {
+		ln = sr_line(&c->rd);
+		if (!ln) {
+			*err = net_error("no response", NULL);
+			return -1;
+		}
+		*retry = false;
+		if (strncmp(ln, "HTTP/1.", 7) != 0 || strlen(ln) < 12) {
+			*err = net_error("malformed response", ln);
+			free(ln);
+			return -1;
+		}
+		http11 = ln[7] != '0';
+		code = atoi(ln + 9);
+		free(ln);
+		if (code >= 200 || code < 100) break;
+		/* Skip an interim 1xx response and its headers. */
+		while ((ln = sr_line(&c->rd)) != NULL && ln[0]) free(ln);
+		if (!ln) {
+			*err = net_error("malformed response", NULL);
+			return -1;
+		}
+		free(ln);
+	}
+
+	long long content_length = -1;
+	bool chunked = false;
+	bool keep = http11;
+	for (;;) {
+		ln = sr_line(&c->rd);
+		if (!ln) {
+			*err = net_error("malformed response", NULL);
+			return -1;
+		}
+		if (!ln[0]) {
+			free(ln);
+			break;
+		}
+		const char* v;
+		if ((v = http_header_value(ln, "Content-Length")) != NULL) content_length = strtoll(v, NULL, 10);
+		else if ((v = http_header_value(ln, "Transfer-Encoding")) != NULL) chunked = http_has_token(v, "chunked");
+		else if ((v = http_header_value(ln, "Connection")) != NULL) {
+			if (http_has_token(v, "close")) keep = false;
+			else if (http_has_token(v, "keep-alive")) keep = true;
+		}
+		free(ln);
+	}
+
+	rc = 0;
+	if (strcmp(method, "HEAD") == 0 || code == 204 || code == 304) {
+		/* no body */
+	} else if (chunked) {
+		for (;;) {
+			ln = sr_line(&c->rd);
+			if (!ln) {
+				rc = -1;
+				break;
+			}
+			unsigned long long size = strtoull(ln, NULL, 16);
+			free(ln);
+			if (size == 0) {
+				while ((ln = sr_line(&c->rd)) != NULL && ln[0]) free(ln);
+				if (!ln) rc = -1;
+				free(ln);
+				break;
+			}
+			if (sr_read(&c->rd, out, (size_t)size) != 0) {
+				rc = -1;
+				break;
+			}
+			ln = sr_line(&c->rd);
+			if (!ln) {
+				rc = -1;
+				break;
+			}
+			free(ln);
+		}
+	} else if (content_length >= 0) {
+		rc = sr_read(&c->rd, out, (size_t)content_length);
+	} else {
+		keep = false;
+		rc = sr_read_to_end(&c->rd, out);
+	}
+	if (rc != 0) {
+		*err = net_error("truncated response", NULL);
+		return -1;
+	}
+	if (!out->data && bb_append(out, "", 0) != 0) {
+		*err = net_error("out of memory", NULL);
+		return -1;
+	}
+	*status = code;
+	*reusable = keep;
+	return 0;
+}
+
+static int http_request(const char* method, const char* url, const unsigned char* body, size_t body_len,
+						const char* content_type, int timeout_ms,
+						int* out_status, unsigned char** out_body, size_t* out_body_len, char** err) {
+	HttpUrl u;
+	if (http_parse_url(url, &u, err) != 0) return -1;
+	char key[400];
+	char host_hdr[300];
+	snprintf(key, sizeof(key), "http\n%s\n%lld", u.host, (long long)u.port);
+	if (strchr(u.host, ':')) snprintf(host_hdr, sizeof(host_hdr), "[%s]", u.host);
+	else snprintf(host_hdr, sizeof(host_hdr), "%s", u.host);
+	if (u.port != 80) {
+		size_t hl = strlen(host_hdr);
+		snprintf(host_hdr + hl, sizeof(host_hdr) - hl, ":%lld", (long long)u.port);
+	}
+
+	for (;;) {
+		NetConn* c = pool_take(key, timeout_ms);
+		bool pooled = c != NULL;
+		if (!c) c = conn_open(key, u.host, u.port, timeout_ms);
+		if (!c) {
+			*err = net_error("connect failed", u.host);
+			return -1;
+		}
+		ByteBuf out = {0};
+		bool reusable = false, retry = false;
+		char* xerr = NULL;
+		if (http_exchange(c, method, &u, host_hdr, body, body_len, content_type,
+						  out_status, &out, &reusable, &retry, &xerr) == 0) {
+			if (reusable) pool_put(c);
+			else conn_close(c);
+			*out_body = out.data;
+			*out_body_len = out.len;
+			return 0;
+		}
+		conn_close(c);
+		free(out.data);
+		if (pooled && retry) {
+			/* The server closed the idle connection; try a fresh one. */
+			free(xerr);
+			continue;
+		}
+		*err = xerr;
+		return -1;
+	}
+}
+#endif
+
 #ifdef _WIN32
 static wchar_t* utf8_to_wide(const char* s) {
 	if (!s) s = "";
@@ -511,6 +1473,22 @@ static wchar_t* utf8_to_wide(const char* s) {
 	return w;
 }
 
+/* One WinHTTP session for the process: WinHTTP keeps its connection pool
+ * per session, so reusing it lets repeated requests to a host share a
+ * kept-alive (and already TLS-negotiated) connection. */
+static HINTERNET g_http_session = NULL;
+
+static HINTERNET winhttp_session(void) {
+	mtx_lock(&g_pool_lock);
+	if (!g_http_session) {
+		g_http_session = WinHttpOpen(L"Prefix-C/networking", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+									 WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+	}
+	HINTERNET h = g_http_session;
+	mtx_unlock(&g_pool_lock);
+	return h;
+}
+
 static int winhttp_request(const char* method_u8, const char* url_u8, const unsigned char* body, size_t body_len,
 						   const char* content_type_u8, int timeout_ms, int verify,
 						   int* out_status, unsigned char** out_body, size_t* out_body_len) {
@@ -537,14 +1515,9 @@ static int winhttp_request(const char* method_u8, const char* url_u8, const unsi
 	host[uc.dwHostNameLength] = L'\0';
 	path[uc.dwUrlPathLength] = L'\0';
 
-	hSession = WinHttpOpen(L"Prefix-C/networking", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
-						   WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+	hSession = winhttp_session();
 	if (!hSession) goto cleanup;
 
-	if (timeout_ms > 0) {
-		WinHttpSetTimeouts(hSession, timeout_ms, timeout_ms, timeout_ms, timeout_ms);
-	}
-
 	hConnect = WinHttpConnect(hSession, host, uc.nPort, 0);
 	if (!hConnect) goto cleanup;
 
@@ -554,6 +1527,10 @@ static int winhttp_request(const char* method_u8, const char* url_u8, const unsi
 								  WINHTTP_DEFAULT_ACCEPT_TYPES, req_flags);
 	if (!hRequest) goto cleanup;
 
+	if (timeout_ms > 0) {
+		WinHttpSetTimeouts(hRequest, timeout_ms, timeout_ms, timeout_ms, timeout_ms);
+	}
+
 	if (!verify && uc.nScheme == INTERNET_SCHEME_HTTPS) {
 		DWORD sec = SECURITY_FLAG_IGNORE_CERT_CN_INVALID |
 					SECURITY_FLAG_IGNORE_CERT_DATE_INVALID |
@@ -638,7 +1615,6 @@ static int winhttp_request(const char* method_u8, const char* url_u8, const unsi
 cleanup:
 	if (hRequest) WinHttpCloseHandle(hRequest);
 	if (hConnect) WinHttpCloseHandle(hConnect);
-	if (hSession) WinHttpCloseHandle(hSession);
 	free(wmethod);
 	free(wurl);
 	return ret;
@@ -667,37 +1643,12 @@ static Value op_tcp_connect(Interpreter* interp, Value* args, int argc, Expr** a
 	if (port < 0 || port > 65535) RUNTIME_ERROR(interp, "TCP_CONNECT: port out of range", line, col);
 	if (tls != 0) RUNTIME_ERROR(interp, "TCP_CONNECT: TLS not supported in C extension build", line, col);
 
-	char port_buf[32];
-	snprintf(port_buf, sizeof(port_buf), "%lld", (long long)port);
-
-	struct addrinfo hints;
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_family = AF_UNSPEC;
-	struct addrinfo* res = NULL;
-	if (getaddrinfo(host, port_buf, &hints, &res) != 0 || !res) {
-		RUNTIME_ERROR(interp, "TCP_CONNECT failed: resolve error", line, col);
-	}
-
-	SOCKET s = INVALID_SOCKET;
-	for (struct addrinfo* it = res; it; it = it->ai_next) {
-		s = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
-		if (s == INVALID_SOCKET) continue;
-		int tmo = ms_to_timeout_ms(timeout_ms);
-		set_socket_timeout_ms(s, tmo);
-		if (connect(s, it->ai_addr, (int)it->ai_addrlen) == 0) {
-			break;
-		}
-		closesocket(s);
-		s = INVALID_SOCKET;
-	}
-	freeaddrinfo(res);
-
+	SOCKET s = tcp_open(host, port, ms_to_timeout_ms(timeout_ms));
 	if (s == INVALID_SOCKET) {
 		RUNTIME_ERROR(interp, "TCP_CONNECT failed", line, col);
 	}
 
-	int id = add_handle(&g_state.tcp, &g_state.tcp_count, &g_state.tcp_cap, s);
+	int id = add_handle(&g_state.tcp, s);
 	if (id <= 0) {
 		closesocket(s);
 		RUNTIME_ERROR(interp, "TCP_CONNECT failed: out of memory", line, col);
@@ -714,8 +1665,9 @@ static Value op_tcp_send(Interpreter* interp, Value* args, int argc, Expr** arg_
 
 	int hid = (int)as_i64(args[0]);
 	const char* payload = as_cstr(args[1]);
-	SOCKET s = find_handle(g_state.tcp, g_state.tcp_count, hid);
-	if (s == INVALID_SOCKET) RUNTIME_ERROR(interp, "TCP_SEND: invalid handle", line, col);
+	NetHandle h;
+	if (get_handle(&g_state.tcp, hid, &h) != 0) RUNTIME_ERROR(interp, "TCP_SEND: invalid handle", line, col);
+	SOCKET s = h.sock;
 
 	const char* coding = (argc >= 3) ? as_cstr(args[2]) : "UTF-8";
 	char* norm = normalize_encoding_name(coding);
@@ -726,8 +1678,11 @@ static Value op_tcp_send(Interpreter* interp, Value* args, int argc, Expr** arg_
 	}
 	free(norm);
 
-	int n = send(s, payload, (int)strlen(payload), 0);
-	if (n == SOCKET_ERROR) RUNTIME_ERROR(interp, "TCP_SEND failed", line, col);
+	int n = send(s, payload, (int)strlen(payload), NET_SEND_FLAGS);
+	if (n == SOCKET_ERROR) {
+		if (h.nonblocking && net_would_block()) return value_int(0);
+		RUNTIME_ERROR(interp, "TCP_SEND failed", line, col);
+	}
 	return value_int(n);
 }
 
@@ -741,15 +1696,20 @@ static Value op_tcp_recv_text(Interpreter* interp, Value* args, int argc, Expr**
 	int hid = (int)as_i64(args[0]);
 	int64_t max_bytes = as_i64(args[1]);
 	if (max_bytes <= 0 || max_bytes > 16 * 1024 * 1024) RUNTIME_ERROR(interp, "TCP_RECV_TEXT: max_bytes must be > 0", line, col);
-	SOCKET s = find_handle(g_state.tcp, g_state.tcp_count, hid);
-	if (s == INVALID_SOCKET) RUNTIME_ERROR(interp, "TCP_RECV_TEXT: invalid handle", line, col);
+	NetHandle h;
+	if (get_handle(&g_state.tcp, hid, &h) != 0) RUNTIME_ERROR(interp, "TCP_RECV_TEXT: invalid handle", line, col);
+	SOCKET s = h.sock;
 
 	char* buf = (char*)malloc((size_t)max_bytes + 1);
 	if (!buf) RUNTIME_ERROR(interp, "TCP_RECV_TEXT failed: out of memory", line, col);
 	int n = recv(s, buf, (int)max_bytes, 0);
 	if (n == SOCKET_ERROR) {
-		free(buf);
-		RUNTIME_ERROR(interp, "TCP_RECV_TEXT failed", line, col);
+		if (h.nonblocking && net_would_block()) {
+			n = 0;
+		} else {
+			free(buf);
+			RUNTIME_ERROR(interp, "TCP_RECV_TEXT failed", line, col);
+		}
 	}
 	buf[n < 0 ? 0 : n] = '\0';
 	Value v = value_str(buf);
@@ -766,15 +1726,20 @@ static Value op_tcp_recv_bytes(Interpreter* interp, Value* args, int argc, Expr*
 	int hid = (int)as_i64(args[0]);
 	int64_t max_bytes = as_i64(args[1]);
 	if (max_bytes <= 0 || max_bytes > 16 * 1024 * 1024) RUNTIME_ERROR(interp, "TCP_RECV_BYTES: max_bytes must be > 0", line, col);
-	SOCKET s = find_handle(g_state.tcp, g_state.tcp_count, hid);
-	if (s == INVALID_SOCKET) RUNTIME_ERROR(interp, "TCP_RECV_BYTES: invalid handle", line, col);
+	NetHandle h;
+	if (get_handle(&g_state.tcp, hid, &h) != 0) RUNTIME_ERROR(interp, "TCP_RECV_BYTES: invalid handle", line, col);
+	SOCKET s = h.sock;
 
 	unsigned char* buf = (unsigned char*)malloc((size_t)max_bytes);
 	if (!buf) RUNTIME_ERROR(interp, "TCP_RECV_BYTES failed: out of memory", line, col);
 	int n = recv(s, (char*)buf, (int)max_bytes, 0);
 	if (n == SOCKET_ERROR) {
-		free(buf);
-		RUNTIME_ERROR(interp, "TCP_RECV_BYTES failed", line, col);
+		if (h.nonblocking && net_would_block()) {
+			n = 0;
+		} else {
+			free(buf);
+			RUNTIME_ERROR(interp, "TCP_RECV_BYTES failed", line, col);
+		}
 	}
 	Value out = bytes_to_tns(buf, (size_t)((n < 0) ? 0 : n));
 	free(buf);
@@ -788,7 +1753,7 @@ static Value op_tcp_close(Interpreter* interp, Value* args, int argc, Expr** arg
 	EXPECT_INT_AT(args, 0, "TCP_CLOSE", interp, line, col);
 	int hid = (int)as_i64(args[0]);
 	SOCKET s = INVALID_SOCKET;
-	if (remove_handle(g_state.tcp, &g_state.tcp_count, hid, &s) != 0) {
+	if (remove_handle(&g_state.tcp, hid, &s) != 0) {
 		RUNTIME_ERROR(interp, "TCP_CLOSE: invalid handle", line, col);
 	}
 	closesocket(s);
@@ -831,7 +1796,7 @@ static Value op_udp_bind(Interpreter* interp, Value* args, int argc, Expr** arg_
 		RUNTIME_ERROR(interp, "UDP_BIND failed", line, col);
 	}
 
-	int id = add_handle(&g_state.udp, &g_state.udp_count, &g_state.udp_cap, s);
+	int id = add_handle(&g_state.udp, s);
 	if (id <= 0) {
 		closesocket(s);
 		RUNTIME_ERROR(interp, "UDP_BIND failed: out of memory", line, col);
@@ -854,8 +1819,9 @@ static Value op_udp_send(Interpreter* interp, Value* args, int argc, Expr** arg_
 	const char* payload = as_cstr(args[3]);
 	if (port < 0 || port > 65535) RUNTIME_ERROR(interp, "UDP_SEND: port out of range", line, col);
 
-	SOCKET s = find_handle(g_state.udp, g_state.udp_count, hid);
-	if (s == INVALID_SOCKET) RUNTIME_ERROR(interp, "UDP_SEND: invalid handle", line, col);
+	NetHandle h;
+	if (get_handle(&g_state.udp, hid, &h) != 0) RUNTIME_ERROR(interp, "UDP_SEND: invalid handle", line, col);
+	SOCKET s = h.sock;
 
 	struct sockaddr_in addr;
 	memset(&addr, 0, sizeof(addr));
@@ -866,7 +1832,10 @@ static Value op_udp_send(Interpreter* interp, Value* args, int argc, Expr** arg_
 	}
 
 	int n = sendto(s, payload, (int)strlen(payload), 0, (const struct sockaddr*)&addr, sizeof(addr));
-	if (n == SOCKET_ERROR) RUNTIME_ERROR(interp, "UDP_SEND failed", line, col);
+	if (n == SOCKET_ERROR) {
+		if (h.nonblocking && net_would_block()) return value_int(0);
+		RUNTIME_ERROR(interp, "UDP_SEND failed", line, col);
+	}
 	return value_int(n);
 }
 
@@ -883,8 +1852,9 @@ static Value op_udp_recv_text(Interpreter* interp, Value* args, int argc, Expr**
 	int64_t timeout_ms = (argc >= 3) ? as_i64(args[2]) : 0;
 	if (max_bytes <= 0 || max_bytes > 16 * 1024 * 1024) RUNTIME_ERROR(interp, "UDP_RECV_TEXT: max_bytes must be > 0", line, col);
 
-	SOCKET s = find_handle(g_state.udp, g_state.udp_count, hid);
-	if (s == INVALID_SOCKET) RUNTIME_ERROR(interp, "UDP_RECV_TEXT: invalid handle", line, col);
+	NetHandle h;
+	if (get_handle(&g_state.udp, hid, &h) != 0) RUNTIME_ERROR(interp, "UDP_RECV_TEXT: invalid handle", line, col);
+	SOCKET s = h.sock;
 	set_socket_timeout_ms(s, ms_to_timeout_ms(timeout_ms));
 
 	char* buf = (char*)malloc((size_t)max_bytes + 1);
@@ -897,8 +1867,12 @@ static Value op_udp_recv_text(Interpreter* interp, Value* args, int argc, Expr**
 #endif
 	int n = recvfrom(s, buf, (int)max_bytes, 0, (struct sockaddr*)&from, &from_len);
 	if (n == SOCKET_ERROR) {
-		free(buf);
-		RUNTIME_ERROR(interp, "UDP_RECV_TEXT failed", line, col);
+		if (h.nonblocking && net_would_block()) {
+			n = 0;
+		} else {
+			free(buf);
+			RUNTIME_ERROR(interp, "UDP_RECV_TEXT failed", line, col);
+		}
 	}
 	buf[n < 0 ? 0 : n] = '\0';
 	Value out = value_str(buf);
@@ -918,8 +1892,9 @@ static Value op_udp_recv_bytes(Interpreter* interp, Value* args, int argc, Expr*
 	int64_t timeout_ms = (argc >= 3) ? as_i64(args[2]) : 0;
 	if (max_bytes <= 0 || max_bytes > 16 * 1024 * 1024) RUNTIME_ERROR(interp, "UDP_RECV_BYTES: max_bytes must be > 0", line, col);
 
-	SOCKET s = find_handle(g_state.udp, g_state.udp_count, hid);
-	if (s == INVALID_SOCKET) RUNTIME_ERROR(interp, "UDP_RECV_BYTES: invalid handle", line, col);
+	NetHandle h;
+	if (get_handle(&g_state.udp, hid, &h) != 0) RUNTIME_ERROR(interp, "UDP_RECV_BYTES: invalid handle", line, col);
+	SOCKET s = h.sock;
 	set_socket_timeout_ms(s, ms_to_timeout_ms(timeout_ms));
 
 	unsigned char* buf = (unsigned char*)malloc((size_t)max_bytes);
@@ -932,8 +1907,12 @@ static Value op_udp_recv_bytes(Interpreter* interp, Value* args, int argc, Expr*
 #endif
 	int n = recvfrom(s, (char*)buf, (int)max_bytes, 0, (struct sockaddr*)&from, &from_len);
 	if (n == SOCKET_ERROR) {
-		free(buf);
-		RUNTIME_ERROR(interp, "UDP_RECV_BYTES failed", line, col);
+		if (h.nonblocking && net_would_block()) {
+			n = 0;
+		} else {
+			free(buf);
+			RUNTIME_ERROR(interp, "UDP_RECV_BYTES failed", line, col);
+		}
 	}
 	Value out = bytes_to_tns(buf, (size_t)((n < 0) ? 0 : n));
 	free(buf);
@@ -947,31 +1926,260 @@ static Value op_udp_close(Interpreter* interp, Value* args, int argc, Expr** arg
 	EXPECT_INT_AT(args, 0, "UDP_CLOSE", interp, line, col);
 	int hid = (int)as_i64(args[0]);
 	SOCKET s = INVALID_SOCKET;
-	if (remove_handle(g_state.udp, &g_state.udp_count, hid, &s) != 0) {
+	if (remove_handle(&g_state.udp, hid, &s) != 0) {
 		RUNTIME_ERROR(interp, "UDP_CLOSE: invalid handle", line, col);
 	}
 	closesocket(s);
 	return value_int(0);
 }
 
+static Value op_tcp_listen(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+	(void)arg_nodes; (void)env;
+	EXPECT_ARGC_MINMAX("TCP_LISTEN", 2, 3);
+	EXPECT_STR_AT(args, 0, "TCP_LISTEN", interp, line, col);
+	EXPECT_INT_AT(args, 1, "TCP_LISTEN", interp, line, col);
+	if (argc >= 3) EXPECT_INT_AT(args, 2, "TCP_LISTEN", interp, line, col);
+	ensure_socket_runtime();
+
+	const char* host = as_cstr(args[0]);
+	int64_t port = as_i64(args[1]);
+	int64_t backlog = (argc >= 3) ? as_i64(args[2]) : 64;
+	if (port < 0 || port > 65535) RUNTIME_ERROR(interp, "TCP_LISTEN: port out of range", line, col);
+	if (backlog <= 0 || backlog > 65535) RUNTIME_ERROR(interp, "TCP_LISTEN: backlog out of range", line, col);
+	if (host[0] == '\0' || strcmp(host, "*") == 0) host = NULL;
+
+	char port_buf[32];
+	snprintf(port_buf, sizeof(port_buf), "%lld", (long long)port);
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_family = host ? AF_UNSPEC : AF_INET;
+	hints.ai_flags = AI_PASSIVE;
+	struct addrinfo* res = NULL;
+	if (getaddrinfo(host, port_buf, &hints, &res) != 0 || !res) {
+		RUNTIME_ERROR(interp, "TCP_LISTEN failed: invalid host", line, col);
+	}
+
+	SOCKET s = INVALID_SOCKET;
+	for (struct addrinfo* it = res; it; it = it->ai_next) {
+		s = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+		if (s == INVALID_SOCKET) continue;
+#ifndef _WIN32
+		int one = 1;
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#endif
+		if (bind(s, it->ai_addr, (net_socklen_t)it->ai_addrlen) == 0 && listen(s, (int)backlog) == 0) break;
+		closesocket(s);
+		s = INVALID_SOCKET;
+	}
+	freeaddrinfo(res);
+	if (s == INVALID_SOCKET) RUNTIME_ERROR(interp, "TCP_LISTEN failed", line, col);
+
+	int id = add_handle(&g_state.tcp, s);
+	if (id <= 0) {
+		closesocket(s);
+		RUNTIME_ERROR(interp, "TCP_LISTEN failed: out of memory", line, col);
+	}
+	return value_int(id);
+}
+
+static Value op_tcp_accept(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+	(void)arg_nodes; (void)env;
+	EXPECT_ARGC_MINMAX("TCP_ACCEPT", 1, 1);
+	EXPECT_INT_AT(args, 0, "TCP_ACCEPT", interp, line, col);
+
+	int hid = (int)as_i64(args[0]);
+	NetHandle h;
+	if (get_handle(&g_state.tcp, hid, &h) != 0) RUNTIME_ERROR(interp, "TCP_ACCEPT: invalid handle", line, col);
+
+	SOCKET c = accept(h.sock, NULL, NULL);
+	if (c == INVALID_SOCKET) {
+		if (h.nonblocking && net_would_block()) return value_int(0);
+		RUNTIME_ERROR(interp, "TCP_ACCEPT failed", line, col);
+	}
+	/* The new connection follows its listener's mode, whatever the
+	 * platform's inheritance rule is. */
+	if (set_socket_nonblocking(c, h.nonblocking) != 0) {
+		closesocket(c);
+		RUNTIME_ERROR(interp, "TCP_ACCEPT failed", line, col);
+	}
+	int id = add_handle(&g_state.tcp, c);
+	if (id <= 0) {
+		closesocket(c);
+		RUNTIME_ERROR(interp, "TCP_ACCEPT failed: out of memory", line, col);
+	}
+	if (h.nonblocking) set_handle_nonblocking(&g_state.tcp, id, 1);
+	return value_int(id);
+}
+
+static Value op_net_port(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+	(void)arg_nodes; (void)env;
+	EXPECT_ARGC_MINMAX("NET_PORT", 1, 1);
+	EXPECT_INT_AT(args, 0, "NET_PORT", interp, line, col);
+
+	NetHandle h;
+	if (!table_of((int)as_i64(args[0]), &h)) RUNTIME_ERROR(interp, "NET_PORT: invalid handle", line, col);
+	struct sockaddr_storage addr;
+	net_socklen_t len = (net_socklen_t)sizeof(addr);
+	if (getsockname(h.sock, (struct sockaddr*)&addr, &len) != 0) RUNTIME_ERROR(interp, "NET_PORT failed", line, col);
+	if (addr.ss_family == AF_INET6) return value_int(ntohs(((struct sockaddr_in6*)&addr)->sin6_port));
+	return value_int(ntohs(((struct sockaddr_in*)&addr)->sin_port));
+}
+
+static Value op_net_nonblock(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+	(void)arg_nodes; (void)env;
+	EXPECT_ARGC_MINMAX("NET_NONBLOCK", 1, 2);
+	EXPECT_INT_AT(args, 0, "NET_NONBLOCK", interp, line, col);
+	if (argc >= 2) EXPECT_INT_AT(args, 1, "NET_NONBLOCK", interp, line, col);
+
+	int hid = (int)as_i64(args[0]);
+	int on = (argc >= 2) ? (as_i64(args[1]) != 0) : 1;
+	NetHandle h;
+	HandleTable* t = table_of(hid, &h);
+	if (!t) RUNTIME_ERROR(interp, "NET_NONBLOCK: invalid handle", line, col);
+	if (set_socket_nonblocking(h.sock, on) != 0) RUNTIME_ERROR(interp, "NET_NONBLOCK failed", line, col);
+	set_handle_nonblocking(t, hid, on);
+	return value_int(0);
+}
+
+/* Longest single wait inside NET_POLL when it runs on a THR, so a STOP on
+ * that thread is seen promptly without busy-waiting. */
+#define NET_POLL_SLICE_MS 100
+
+#ifdef _WIN32
+#define net_poll WSAPoll
+typedef ULONG net_nfds_t;
+#else
+#define net_poll poll
+typedef nfds_t net_nfds_t;
+#endif
+
+static Value op_net_poll(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+	(void)arg_nodes; (void)env;
+	EXPECT_ARGC_MINMAX("NET_POLL", 1, 3);
+	if (args[0].type != VAL_TNS && args[0].type != VAL_INT) {
+		RUNTIME_ERROR(interp, "NET_POLL expects INT or TNS of handles", line, col);
+	}
+	if (argc >= 2) EXPECT_INT_AT(args, 1, "NET_POLL", interp, line, col);
+	if (argc >= 3) EXPECT_STR_AT(args, 2, "NET_POLL", interp, line, col);
+
+	int64_t timeout_ms = (argc >= 2) ? as_i64(args[1]) : -1;
+	const char* mode = (argc >= 3) ? as_cstr(args[2]) : "r";
+	short events = 0;
+	for (const char* m = mode; *m; m++) {
+		if (*m == 'r' || *m == 'R') events = (short)(events | POLLIN);
+		else if (*m == 'w' || *m == 'W') events = (short)(events | POLLOUT);
+		else RUNTIME_ERROR(interp, "NET_POLL: mode must be \"r\", \"w\" or \"rw\"", line, col);
+	}
+	if (!events) RUNTIME_ERROR(interp, "NET_POLL: mode must be \"r\", \"w\" or \"rw\"", line, col);
+
+	size_t n = 1;
+	Tensor* t = NULL;
+	if (args[0].type == VAL_TNS) {
+		t = args[0].as.tns;
+		if (!t || t->ndim != 1) RUNTIME_ERROR(interp, "NET_POLL expects a 1-D TNS of handles", line, col);
+		n = t->length;
+		if (n == 0) return value_tns_new(TYPE_INT, 1, &n);
+	}
+	struct pollfd* fds = (struct pollfd*)calloc(n, sizeof(struct pollfd));
+	int* ids = (int*)malloc(n * sizeof(int));
+	if (!fds || !ids) {
+		free(fds);
+		free(ids);
+		RUNTIME_ERROR(interp, "NET_POLL failed: out of memory", line, col);
+	}
+	for (size_t i = 0; i < n; i++) {
+		Value e = t ? value_tns_elem(t, i) : args[0];
+		NetHandle h;
+		if (e.type != VAL_INT || !table_of((int)e.as.i, &h)) {
+			free(fds);
+			free(ids);
+			RUNTIME_ERROR(interp, "NET_POLL: invalid handle", line, col);
+		}
+		ids[i] = (int)e.as.i;
+		fds[i].fd = h.sock;
+		fds[i].events = events;
+	}
+
+	/* The wait itself blocks in the kernel.  On a THR it is cut into
+	 * slices so that STOP on the thread ends it. */
+	Value self = value_null();
+	if (interp->current_thr) {
+		self.type = VAL_THR;
+		self.as.thr = interp->current_thr;
+	}
+	int ready = 0;
+	for (;;) {
+		int wait = (timeout_ms < 0) ? -1 : (timeout_ms > 2147483647LL) ? 2147483647 : (int)timeout_ms;
+		if (self.type == VAL_THR && (wait < 0 || wait > NET_POLL_SLICE_MS)) wait = NET_POLL_SLICE_MS;
+		ready = net_poll(fds, (net_nfds_t)n, wait);
+		if (ready < 0) {
+#ifndef _WIN32
+			if (errno == EINTR) continue;
+#endif
+			free(fds);
+			free(ids);
+			RUNTIME_ERROR(interp, "NET_POLL failed", line, col);
+		}
+		if (ready > 0) break;
+		if (timeout_ms >= 0) {
+			timeout_ms -= wait;
+			if (timeout_ms <= 0) break;
+		}
+		if (self.type == VAL_THR && value_thr_get_finished(self)) break;
+	}
+
+	/* Errors and hang-ups count as ready: the next recv reports them. */
+	size_t count = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (fds[i].revents & (events | POLLERR | POLLHUP | POLLNVAL)) ids[count++] = ids[i];
+	}
+	Value out = value_tns_new(TYPE_INT, 1, &count);
+	if (out.type == VAL_TNS) {
+		for (size_t i = 0; i < count; i++) out.as.tns->ints[i] = ids[i];
+	}
+	free(fds);
+	free(ids);
+	if (out.type != VAL_TNS) RUNTIME_ERROR(interp, "NET_POLL failed: allocation", line, col);
+	return out;
+}
+
+/* HTTP goes through WinHTTP on Windows and the socket client elsewhere;
+ * both keep connections alive between calls. */
+static int http_fetch(const char* method, const char* url, const unsigned char* body, size_t body_len,
+					  const char* content_type, int timeout_ms, int verify,
+					  int* out_status, unsigned char** out_body, size_t* out_body_len, char** err) {
+#ifdef _WIN32
+	*err = NULL;
+	return winhttp_request(method, url, body, body_len, content_type, timeout_ms, verify != 0,
+						   out_status, out_body, out_body_len);
+#else
+	(void)verify;
+	return http_request(method, url, body, body_len, content_type, ms_to_timeout_ms(timeout_ms),
+						out_status, out_body, out_body_len, err);
+#endif
+}
+
 static Value op_http_get_text(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
 	(void)arg_nodes; (void)env;
 	EXPECT_ARGC_MINMAX("HTTP_GET_TEXT", 1, 3);
 	EXPECT_STR_AT(args, 0, "HTTP_GET_TEXT", interp, line, col);
 	if (argc >= 2) EXPECT_INT_AT(args, 1, "HTTP_GET_TEXT", interp, line, col);
 	if (argc >= 3) EXPECT_INT_AT(args, 2, "HTTP_GET_TEXT", interp, line, col);
+	EXPECT_LINE_FIELD_AT(args, 0, "HTTP_GET_TEXT", "URL");
 
-#ifndef _WIN32
-	RUNTIME_ERROR(interp, "HTTP_GET_TEXT not supported on this platform", line, col);
-#else
 	const char* url = as_cstr(args[0]);
 	int timeout_ms = (argc >= 2) ? (int)as_i64(args[1]) : 5000;
 	int verify = (argc >= 3) ? (int)as_i64(args[2]) : 1;
 	int status = 0;
 	unsigned char* body = NULL;
 	size_t blen = 0;
-	if (winhttp_request("GET", url, NULL, 0, NULL, timeout_ms, verify != 0, &status, &body, &blen) != 0) {
-		RUNTIME_ERROR(interp, "HTTP_GET_TEXT failed", line, col);
+	char* err = NULL;
+	if (http_fetch("GET", url, NULL, 0, NULL, timeout_ms, verify, &status, &body, &blen, &err) != 0) {
+		char msg[512];
+		snprintf(msg, sizeof(msg), "HTTP_GET_TEXT failed%s%s", err ? ": " : "", err ? err : "");
+		free(err);
+		RUNTIME_ERROR(interp, msg, line, col);
 	}
 	(void)status;
 	char* txt = (char*)malloc(blen + 1);
@@ -985,7 +2193,6 @@ static Value op_http_get_text(Interpreter* interp, Value* args, int argc, Expr**
 	Value out = value_str(txt);
 	free(txt);
 	return out;
-#endif
 }
 
 static Value op_http_get_bytes(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
@@ -994,24 +2201,25 @@ static Value op_http_get_bytes(Interpreter* interp, Value* args, int argc, Expr*
 	EXPECT_STR_AT(args, 0, "HTTP_GET_BYTES", interp, line, col);
 	if (argc >= 2) EXPECT_INT_AT(args, 1, "HTTP_GET_BYTES", interp, line, col);
 	if (argc >= 3) EXPECT_INT_AT(args, 2, "HTTP_GET_BYTES", interp, line, col);
+	EXPECT_LINE_FIELD_AT(args, 0, "HTTP_GET_BYTES", "URL");
 
-#ifndef _WIN32
-	RUNTIME_ERROR(interp, "HTTP_GET_BYTES not supported on this platform", line, col);
-#else
 	const char* url = as_cstr(args[0]);
 	int timeout_ms = (argc >= 2) ? (int)as_i64(args[1]) : 5000;
 	int verify = (argc >= 3) ? (int)as_i64(args[2]) : 1;
 	int status = 0;
 	unsigned char* body = NULL;
 	size_t blen = 0;
-	if (winhttp_request("GET", url, NULL, 0, NULL, timeout_ms, verify != 0, &status, &body, &blen) != 0) {
-		RUNTIME_ERROR(interp, "HTTP_GET_BYTES failed", line, col);
+	char* err = NULL;
+	if (http_fetch("GET", url, NULL, 0, NULL, timeout_ms, verify, &status, &body, &blen, &err) != 0) {
+		char msg[512];
+		snprintf(msg, sizeof(msg), "HTTP_GET_BYTES failed%s%s", err ? ": " : "", err ? err : "");
+		free(err);
+		RUNTIME_ERROR(interp, msg, line, col);
 	}
 	Value out = bytes_to_tns(body, blen);
 	free(body);
 	if (out.type == VAL_NULL) RUNTIME_ERROR(interp, "HTTP_GET_BYTES failed: allocation", line, col);
 	return out;
-#endif
 }
 
 static Value op_http_get_status(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
@@ -1020,22 +2228,23 @@ static Value op_http_get_status(Interpreter* interp, Value* args, int argc, Expr
 	EXPECT_STR_AT(args, 0, "HTTP_GET_STATUS", interp, line, col);
 	if (argc >= 2) EXPECT_INT_AT(args, 1, "HTTP_GET_STATUS", interp, line, col);
 	if (argc >= 3) EXPECT_INT_AT(args, 2, "HTTP_GET_STATUS", interp, line, col);
+	EXPECT_LINE_FIELD_AT(args, 0, "HTTP_GET_STATUS", "URL");
 
-#ifndef _WIN32
-	RUNTIME_ERROR(interp, "HTTP_GET_STATUS not supported on this platform", line, col);
-#else
 	const char* url = as_cstr(args[0]);
 	int timeout_ms = (argc >= 2) ? (int)as_i64(args[1]) : 5000;
 	int verify = (argc >= 3) ? (int)as_i64(args[2]) : 1;
 	int status = 0;
 	unsigned char* body = NULL;
 	size_t blen = 0;
-	if (winhttp_request("GET", url, NULL, 0, NULL, timeout_ms, verify != 0, &status, &body, &blen) != 0) {
-		RUNTIME_ERROR(interp, "HTTP_GET_STATUS failed", line, col);
+	char* err = NULL;
+	if (http_fetch("GET", url, NULL, 0, NULL, timeout_ms, verify, &status, &body, &blen, &err) != 0) {
+		char msg[512];
+		snprintf(msg, sizeof(msg), "HTTP_GET_STATUS failed%s%s", err ? ": " : "", err ? err : "");
+		free(err);
+		RUNTIME_ERROR(interp, msg, line, col);
 	}
 	free(body);
 	return value_int(status);
-#endif
 }
 
 static Value op_http_post_text(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
@@ -1046,10 +2255,9 @@ static Value op_http_post_text(Interpreter* interp, Value* args, int argc, Expr*
 	if (argc >= 3) EXPECT_STR_AT(args, 2, "HTTP_POST_TEXT", interp, line, col);
 	if (argc >= 4) EXPECT_INT_AT(args, 3, "HTTP_POST_TEXT", interp, line, col);
 	if (argc >= 5) EXPECT_INT_AT(args, 4, "HTTP_POST_TEXT", interp, line, col);
+	EXPECT_LINE_FIELD_AT(args, 0, "HTTP_POST_TEXT", "URL");
+	if (argc >= 3) EXPECT_LINE_FIELD_AT(args, 2, "HTTP_POST_TEXT", "content type");
 
-#ifndef _WIN32
-	RUNTIME_ERROR(interp, "HTTP_POST_TEXT not supported on this platform", line, col);
-#else
 	const char* url = as_cstr(args[0]);
 	const char* body_txt = as_cstr(args[1]);
 	const char* content_type = (argc >= 3) ? as_cstr(args[2]) : "text/plain; charset=utf-8";
@@ -1059,11 +2267,15 @@ static Value op_http_post_text(Interpreter* interp, Value* args, int argc, Expr*
 	int status = 0;
 	unsigned char* resp = NULL;
 	size_t rlen = 0;
-	if (winhttp_request("POST", url,
-						(const unsigned char*)body_txt, strlen(body_txt),
-						content_type, timeout_ms, verify != 0,
-						&status, &resp, &rlen) != 0) {
-		RUNTIME_ERROR(interp, "HTTP_POST_TEXT failed", line, col);
+	char* err = NULL;
+	if (http_fetch("POST", url,
+				   (const unsigned char*)body_txt, strlen(body_txt),
+				   content_type, timeout_ms, verify,
+				   &status, &resp, &rlen, &err) != 0) {
+		char msg[512];
+		snprintf(msg, sizeof(msg), "HTTP_POST_TEXT failed%s%s", err ? ": " : "", err ? err : "");
+		free(err);
+		RUNTIME_ERROR(interp, msg, line, col);
 	}
 	(void)status;
 	char* txt = (char*)malloc(rlen + 1);
@@ -1077,7 +2289,6 @@ static Value op_http_post_text(Interpreter* interp, Value* args, int argc, Expr*
 	Value out = value_str(txt);
 	free(txt);
 	return out;
-#endif
 }
 
 static Value op_ftp_list(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
@@ -1091,6 +2302,10 @@ static Value op_ftp_list(Interpreter* interp, Value* args, int argc, Expr** arg_
 	if (argc >= 6) EXPECT_INT_AT(args, 5, "FTP_LIST", interp, line, col);
 	if (argc >= 7) EXPECT_INT_AT(args, 6, "FTP_LIST", interp, line, col);
 	if (argc >= 8) EXPECT_INT_AT(args, 7, "FTP_LIST", interp, line, col);
+	EXPECT_LINE_FIELD_AT(args, 0, "FTP_LIST", "host");
+	EXPECT_LINE_FIELD_AT(args, 2, "FTP_LIST", "user");
+	EXPECT_LINE_FIELD_AT(args, 3, "FTP_LIST", "password");
+	EXPECT_LINE_FIELD_AT(args, 4, "FTP_LIST", "path");
 
 	int64_t port = as_i64(args[1]);
 	if (port < 0 || port > 65535) RUNTIME_ERROR(interp, "FTP_LIST: port out of range", line, col);
@@ -1101,6 +2316,35 @@ static Value op_ftp_list(Interpreter* interp, Value* args, int argc, Expr** arg_
 	snprintf(timeout_buf, sizeof(timeout_buf), "%lld", (long long)((argc >= 7) ? as_i64(args[6]) : 10000));
 	snprintf(verify_buf, sizeof(verify_buf), "%lld", (long long)((argc >= 8) ? as_i64(args[7]) : 1));
 
+	if (((argc >= 6) ? as_i64(args[5]) : 0) == 0) {
+		char* cmd = ftp_command("LIST", as_cstr(args[4]));
+		if (!cmd) RUNTIME_ERROR(interp, "FTP_LIST failed: out of memory", line, col);
+		ByteBuf listing = {0};
+		char* err = NULL;
+		int rc = ftp_transfer(as_cstr(args[0]), port, as_cstr(args[2]), as_cstr(args[3]),
+							  ms_to_timeout_ms((argc >= 7) ? as_i64(args[6]) : 10000),
+							  cmd, &listing, NULL, 0, &err);
+		free(cmd);
+		if (rc != 0) {
+			char msg[512];
+			snprintf(msg, sizeof(msg), "FTP_LIST failed: %s", err ? err : "connection error");
+			free(err);
+			free(listing.data);
+			RUNTIME_ERROR(interp, msg, line, col);
+		}
+		/* One entry per line, LF-separated, as the bridge returns it. */
+		size_t n = 0;
+		for (size_t i = 0; i < listing.len; i++) {
+			if (listing.data[i] == '\r' && i + 1 < listing.len && listing.data[i + 1] == '\n') continue;
+			listing.data[n++] = listing.data[i];
+		}
+		while (n > 0 && (listing.data[n - 1] == '\n' || listing.data[n - 1] == '\r')) n--;
+		if (listing.data) listing.data[n] = 0;
+		Value v = value_str(listing.data ? (const char*)listing.data : "");
+		free(listing.data);
+		return v;
+	}
+
 	const char* bargs[8] = { as_cstr(args[0]), port_buf, as_cstr(args[2]), as_cstr(args[3]), as_cstr(args[4]), tls_buf, timeout_buf, verify_buf };
 	unsigned char* out = NULL;
 	size_t out_len = 0;
@@ -1135,6 +2379,10 @@ static Value op_ftp_get_bytes(Interpreter* interp, Value* args, int argc, Expr**
 	if (argc >= 6) EXPECT_INT_AT(args, 5, "FTP_GET_BYTES", interp, line, col);
 	if (argc >= 7) EXPECT_INT_AT(args, 6, "FTP_GET_BYTES", interp, line, col);
 	if (argc >= 8) EXPECT_INT_AT(args, 7, "FTP_GET_BYTES", interp, line, col);
+	EXPECT_LINE_FIELD_AT(args, 0, "FTP_GET_BYTES", "host");
+	EXPECT_LINE_FIELD_AT(args, 2, "FTP_GET_BYTES", "user");
+	EXPECT_LINE_FIELD_AT(args, 3, "FTP_GET_BYTES", "password");
+	EXPECT_LINE_FIELD_AT(args, 4, "FTP_GET_BYTES", "path");
 
 	int64_t port = as_i64(args[1]);
 	if (port < 0 || port > 65535) RUNTIME_ERROR(interp, "FTP_GET_BYTES: port out of range", line, col);
@@ -1145,6 +2393,28 @@ static Value op_ftp_get_bytes(Interpreter* interp, Value* args, int argc, Expr**
 	snprintf(timeout_buf, sizeof(timeout_buf), "%lld", (long long)((argc >= 7) ? as_i64(args[6]) : 10000));
 	snprintf(verify_buf, sizeof(verify_buf), "%lld", (long long)((argc >= 8) ? as_i64(args[7]) : 1));
 
+	if (((argc >= 6) ? as_i64(args[5]) : 0) == 0) {
+		char* cmd = ftp_command("RETR", as_cstr(args[4]));
+		if (!cmd) RUNTIME_ERROR(interp, "FTP_GET_BYTES failed: out of memory", line, col);
+		ByteBuf data = {0};
+		char* err = NULL;
+		int rc = ftp_transfer(as_cstr(args[0]), port, as_cstr(args[2]), as_cstr(args[3]),
+							  ms_to_timeout_ms((argc >= 7) ? as_i64(args[6]) : 10000),
+							  cmd, &data, NULL, 0, &err);
+		free(cmd);
+		if (rc != 0) {
+			char msg[512];
+			snprintf(msg, sizeof(msg), "FTP_GET_BYTES failed: %s", err ? err : "connection error");
+			free(err);
+			free(data.data);
+			RUNTIME_ERROR(interp, msg, line, col);
+		}
+		Value v = bytes_to_tns(data.data, data.len);
+		free(data.data);
+		if (v.type == VAL_NULL) RUNTIME_ERROR(interp, "FTP_GET_BYTES failed: allocation", line, col);
+		return v;
+	}
+
 	const char* bargs[8] = { as_cstr(args[0]), port_buf, as_cstr(args[2]), as_cstr(args[3]), as_cstr(args[4]), tls_buf, timeout_buf, verify_buf };
 	unsigned char* out = NULL;
 	size_t out_len = 0;
@@ -1172,6 +2442,10 @@ static Value op_ftp_put_bytes(Interpreter* interp, Value* args, int argc, Expr**
 	if (argc >= 7) EXPECT_INT_AT(args, 6, "FTP_PUT_BYTES", interp, line, col);
 	if (argc >= 8) EXPECT_INT_AT(args, 7, "FTP_PUT_BYTES", interp, line, col);
 	if (argc >= 9) EXPECT_INT_AT(args, 8, "FTP_PUT_BYTES", interp, line, col);
+	EXPECT_LINE_FIELD_AT(args, 0, "FTP_PUT_BYTES", "host");
+	EXPECT_LINE_FIELD_AT(args, 2, "FTP_PUT_BYTES", "user");
+	EXPECT_LINE_FIELD_AT(args, 3, "FTP_PUT_BYTES", "password");
+	EXPECT_LINE_FIELD_AT(args, 4, "FTP_PUT_BYTES", "path");
 
 	int64_t port = as_i64(args[1]);
 	if (port < 0 || port > 65535) RUNTIME_ERROR(interp, "FTP_PUT_BYTES: port out of range", line, col);
@@ -1180,6 +2454,26 @@ static Value op_ftp_put_bytes(Interpreter* interp, Value* args, int argc, Expr**
 	if (tns_to_bytes(args[5], &payload, &payload_len) != 0) {
 		RUNTIME_ERROR(interp, "FTP_PUT_BYTES expects TNS byte array", line, col);
 	}
+	if (((argc >= 7) ? as_i64(args[6]) : 0) == 0) {
+		char* cmd = ftp_command("STOR", as_cstr(args[4]));
+		if (!cmd) {
+			free(payload);
+			RUNTIME_ERROR(interp, "FTP_PUT_BYTES failed: out of memory", line, col);
+		}
+		char* err = NULL;
+		int rc = ftp_transfer(as_cstr(args[0]), port, as_cstr(args[2]), as_cstr(args[3]),
+							  ms_to_timeout_ms((argc >= 8) ? as_i64(args[7]) : 10000),
+							  cmd, NULL, payload, payload_len, &err);
+		free(cmd);
+		free(payload);
+		if (rc != 0) {
+			char msg[512];
+			snprintf(msg, sizeof(msg), "FTP_PUT_BYTES failed: %s", err ? err : "connection error");
+			free(err);
+			RUNTIME_ERROR(interp, msg, line, col);
+		}
+		return value_int(1);
+	}
 	char* payload_hex = hex_encode(payload, payload_len);
 	free(payload);
 	if (!payload_hex) RUNTIME_ERROR(interp, "FTP_PUT_BYTES failed: out of memory", line, col);
@@ -1220,10 +2514,29 @@ static Value op_smtp_send(Interpreter* interp, Value* args, int argc, Expr** arg
 	if (argc >= 9) EXPECT_INT_AT(args, 8, "SMTP_SEND", interp, line, col);
 	if (argc >= 10) EXPECT_INT_AT(args, 9, "SMTP_SEND", interp, line, col);
 	if (argc >= 11) EXPECT_INT_AT(args, 10, "SMTP_SEND", interp, line, col);
+	EXPECT_LINE_FIELD_AT(args, 0, "SMTP_SEND", "host");
+	EXPECT_LINE_FIELD_AT(args, 2, "SMTP_SEND", "user");
+	EXPECT_LINE_FIELD_AT(args, 3, "SMTP_SEND", "password");
+	EXPECT_LINE_FIELD_AT(args, 4, "SMTP_SEND", "from");
+	EXPECT_LINE_FIELD_AT(args, 5, "SMTP_SEND", "to");
+	EXPECT_LINE_FIELD_AT(args, 6, "SMTP_SEND", "subject");
 
 	int64_t port = as_i64(args[1]);
 	if (port < 0 || port > 65535) RUNTIME_ERROR(interp, "SMTP_SEND: port out of range", line, col);
 
+	if (argc >= 9 && as_i64(args[8]) == 0) {
+		char* err = NULL;
+		if (smtp_send(as_cstr(args[0]), port, as_cstr(args[2]), as_cstr(args[3]),
+					  ms_to_timeout_ms((argc >= 10) ? as_i64(args[9]) : 10000),
+					  as_cstr(args[4]), as_cstr(args[5]), as_cstr(args[6]), as_cstr(args[7]), &err) != 0) {
+			char msg[512];
+			snprintf(msg, sizeof(msg), "SMTP_SEND failed: %s", err ? err : "connection error");
+			free(err);
+			RUNTIME_ERROR(interp, msg, line, col);
+		}
+		return value_int(1);
+	}
+
 	char port_buf[32], tls_buf[32], timeout_buf[32], verify_buf[32];
 	snprintf(port_buf, sizeof(port_buf), "%lld", (long long)port);
 	snprintf(tls_buf, sizeof(tls_buf), "%lld", (long long)((argc >= 9) ? as_i64(args[8]) : 1));
@@ -1253,11 +2566,21 @@ __declspec(dllexport)
 void prefix_extension_init(prefix_ext_context* ctx) {
 	if (!ctx) return;
 	ensure_socket_runtime();
+	g_tns_acquire = ctx->tns_acquire;
+	g_tns_release = ctx->tns_release;
+	g_tns_alloc = ctx->tns_alloc;
+	if (!g_pool_ready) {
+		mtx_init(&g_pool_lock, mtx_plain);
+		mtx_init(&g_handles_lock, mtx_plain);
+		g_pool_ready = true;
+	}
 	ctx->register_operator("TCP_CONNECT", op_tcp_connect, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("TCP_SEND", op_tcp_send, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("TCP_RECV_TEXT", op_tcp_recv_text, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("TCP_RECV_BYTES", op_tcp_recv_bytes, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("TCP_CLOSE", op_tcp_close, PREFIX_EXTENSION_ASMODULE);
+	ctx->register_operator("TCP_LISTEN", op_tcp_listen, PREFIX_EXTENSION_ASMODULE);
+	ctx->register_operator("TCP_ACCEPT", op_tcp_accept, PREFIX_EXTENSION_ASMODULE);
 
 	ctx->register_operator("UDP_BIND", op_udp_bind, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("UDP_SEND", op_udp_send, PREFIX_EXTENSION_ASMODULE);
@@ -1265,6 +2588,10 @@ void prefix_extension_init(prefix_ext_context* ctx) {
 	ctx->register_operator("UDP_RECV_BYTES", op_udp_recv_bytes, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("UDP_CLOSE", op_udp_close, PREFIX_EXTENSION_ASMODULE);
 
+	ctx->register_operator("NET_PORT", op_net_port, PREFIX_EXTENSION_ASMODULE);
+	ctx->register_operator("NET_NONBLOCK", op_net_nonblock, PREFIX_EXTENSION_ASMODULE);
+	ctx->register_operator("NET_POLL", op_net_poll, PREFIX_EXTENSION_ASMODULE);
+
 	ctx->register_operator("HTTP_GET_TEXT", op_http_get_text, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("HTTP_GET_BYTES", op_http_get_bytes, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("HTTP_GET_STATUS", op_http_get_status, PREFIX_EXTENSION_ASMODULE);
@@ -284,8 +284,8 @@ static int gui_ensure_class(void) {
 static Value make_dims_tns(int w, int h) {
 	size_t shape[1] = {2};
 	Value out = value_tns_new(TYPE_INT, 1, shape);
-	out.as.tns->data[0] = value_int((int64_t)w);
-	out.as.tns->data[1] = value_int((int64_t)h);
+	out.as.tns->ints[0] = (int64_t)w;
+	out.as.tns->ints[1] = (int64_t)h;
 	return out;
 }
 
@@ -326,7 +326,7 @@ static int extract_image_rgba(Interpreter* interp, Value v, uint8_t** out_rgba,
 			size_t pixel_i = ((size_t)y * (size_t)w + (size_t)x) * 4u;
 			size_t base = (size_t)x * t->strides[0] + (size_t)y * t->strides[1];
 			for (int ch = 0; ch < c; ch++) {
-				Value e = t->data[base + (size_t)ch * t->strides[2]];
+				Value e = value_tns_elem(t, base + (size_t)ch * t->strides[2]);
 				if (e.type != VAL_INT) {
 					free(rgba);
 					set_runtime_error(interp, "GUI_SHOW_IMAGE failed: image tensor channels must be INT", line, col);
@@ -734,10 +734,10 @@ static Value op_screenshot(Interpreter* interp, Value* args, int argc, Expr** ar
 			uint8_t a = buf[src_i + 3];
 
 			size_t base = (size_t)x * t->strides[0] + (size_t)y * t->strides[1];
-			t->data[base + 0 * t->strides[2]] = value_int((int64_t)r);
-			t->data[base + 1 * t->strides[2]] = value_int((int64_t)g);
-			t->data[base + 2 * t->strides[2]] = value_int((int64_t)b);
-			t->data[base + 3 * t->strides[2]] = value_int((int64_t)a);
+			t->ints[base + 0 * t->strides[2]] = (int64_t)r;
+			t->ints[base + 1 * t->strides[2]] = (int64_t)g;
+			t->ints[base + 2 * t->strides[2]] = (int64_t)b;
+			t->ints[base + 3 * t->strides[2]] = (int64_t)a;
 		}
 	}
 
@@ -20,12 +20,20 @@
 #define strdup _strdup
 #endif
 
+/* A pinned, contiguous view of an image argument's channel buffer
+ * (see image_from_value); release it with image_release. */
 typedef struct {
-	Tensor* t;
+	TnsBuffer buf;
+	const int64_t* px;
 	size_t w;
 	size_t h;
 } ImageView;
 
+/* Tensor buffer access and the host's thread pool, from the init context. */
+static int (*g_tns_acquire)(Value* tensor, int flags, TnsBuffer* out);
+static void (*g_tns_release)(TnsBuffer* buf);
+static void (*g_parallel_for)(size_t count, size_t chunk, prefix_parallel_fn fn, void* ctx);
+
 static void set_runtime_error(Interpreter* interp, const char* msg, int line, int col) {
 	if (!interp) return;
 	if (interp->error) free(interp->error);
@@ -103,12 +111,32 @@ static int image_from_value(Interpreter* interp, Value v, const char* opname, in
 		set_runtime_error(interp, "image dimensions must be non-zero", line, col);
 		return 0;
 	}
-	out->t = t;
+	/* Kernels below work directly on the packed int64 channel buffer,
+	 * which stays unchanged until image_release. */
+	if (g_tns_acquire(&v, PREFIX_TNS_CONTIGUOUS, &out->buf) != 0) {
+		set_runtime_error(interp, "image tensor channels must be INT", line, col);
+		return 0;
+	}
+	if (out->buf.elem_type != TYPE_INT) {
+		g_tns_release(&out->buf);
+		set_runtime_error(interp, "image tensor channels must be INT", line, col);
+		return 0;
+	}
+	out->px = out->buf.ints;
 	out->w = t->shape[0];
 	out->h = t->shape[1];
 	return 1;
 }
 
+static void image_release(ImageView* iv) {
+	g_tns_release(&iv->buf);
+}
+
+/* Channel 0 of pixel (x, y) in a contiguous [width, height, 4] buffer. */
+static size_t image_offset(const ImageView* iv, size_t x, size_t y) {
+	return (x * iv->h + y) * 4;
+}
+
 static size_t pixel_offset(const Tensor* t, size_t x, size_t y) {
 	return (x * t->strides[0]) + (y * t->strides[1]);
 }
@@ -133,28 +161,208 @@ static Value make_image(size_t w, size_t h) {
 	return value_tns_new(TYPE_INT, 3, shape);
 }
 
-static Value copy_image_checked(Interpreter* interp, Value src, const char* opname, int line, int col) {
+/* Kernels below treat an image as `w` columns of `h * 4` contiguous
+ * int64 channels: the tensor is [width, height, 4], so pixel (x, y) is
+ * element (x * h + y) * 4.  Once an image is large enough to repay the
+ * hand-off, work is split across the host interpreter's thread pool
+ * through ctx->parallel_for; the extension never runs a pool of its own. */
+#define IMAGE_PARALLEL_MIN_PIXELS 65536
+
+static void image_parallel(size_t count, size_t pixels, prefix_parallel_fn fn, void* ctx) {
+	if (count == 0) return;
+	if (!g_parallel_for || count == 1 || pixels < IMAGE_PARALLEL_MIN_PIXELS) {
+		fn(ctx, 0, count);
+		return;
+	}
+	g_parallel_for(count, 0, fn, ctx);
+}
+
+/* Per-pixel kernels: read the clamped source pixel, write the result. */
+typedef enum {
+	PIX_COPY,
+	PIX_THRESHOLD,
+	PIX_GRAYSCALE,
+	PIX_REPLACE,
+	PIX_CELLSHADE
+} PixelOp;
+
+typedef struct {
+	const int64_t* src;
+	int64_t* dst;
+	PixelOp op;
+	int channel;            /* PIX_THRESHOLD */
+	int threshold;          /* PIX_THRESHOLD */
+	int a[4];               /* threshold color / replace target */
+	int b[4];               /* replacement */
+	const int* palette;     /* PIX_CELLSHADE, 4 ints per entry */
+	size_t palette_n;
+} PixelJob;
+
+static void pixel_chunk(void* ctx, size_t begin, size_t end) {
+	const PixelJob* j = (const PixelJob*)ctx;
+	for (size_t p = begin; p < end; p++) {
+		const int64_t* s = j->src + p * 4;
+		int64_t* d = j->dst + p * 4;
+		int px[4];
+		for (size_t c = 0; c < 4; c++) px[c] = clamp_u8_i64(s[c]);
+		switch (j->op) {
+		case PIX_COPY:
+			break;
+		case PIX_THRESHOLD:
+			if (px[j->channel] <= j->threshold) {
+				for (size_t c = 0; c < 4; c++) px[c] = j->a[c];
+			}
+			break;
+		case PIX_GRAYSCALE: {
+			int l = clamp_u8_i32((299 * px[0] + 587 * px[1] + 114 * px[2]) / 1000);
+			px[0] = l;
+			px[1] = l;
+			px[2] = l;
+			break;
+		}
+		case PIX_REPLACE:
+			if (px[0] == j->a[0] && px[1] == j->a[1] && px[2] == j->a[2] && px[3] == j->a[3]) {
+				for (size_t c = 0; c < 4; c++) px[c] = j->b[c];
+			}
+			break;
+		case PIX_CELLSHADE: {
+			size_t best = 0;
+			int64_t bestd = INT64_MAX;
+			for (size_t i = 0; i < j->palette_n; i++) {
+				int dr = px[0] - j->palette[i * 4 + 0];
+				int dg = px[1] - j->palette[i * 4 + 1];
+				int db = px[2] - j->palette[i * 4 + 2];
+				int64_t dist = (int64_t)dr * dr + (int64_t)dg * dg + (int64_t)db * db;
+				if (dist < bestd) {
+					bestd = dist;
+					best = i;
+				}
+			}
+			for (size_t c = 0; c < 4; c++) px[c] = j->palette[best * 4 + c];
+			break;
+		}
+		}
+		for (size_t c = 0; c < 4; c++) d[c] = (int64_t)px[c];
+	}
+}
+
+/* Run `job` (src / dst filled in here) over a fresh copy of `src`. */
+static Value map_pixels(Interpreter* interp, Value src, PixelJob* job, const char* opname, int line, int col) {
 	ImageView iv;
 	if (!image_from_value(interp, src, opname, line, col, &iv)) return value_null();
 	Value out = make_image(iv.w, iv.h);
-	Tensor* st = iv.t;
-	Tensor* dt = out.as.tns;
-	for (size_t x = 0; x < iv.w; x++) {
-		for (size_t y = 0; y < iv.h; y++) {
-			size_t so = pixel_offset(st, x, y);
-			size_t doff = pixel_offset(dt, x, y);
-			for (size_t c = 0; c < 4; c++) {
-				Value sv = st->data[so + c];
-				if (sv.type != VAL_INT) {
-					value_free(out);
-					set_runtime_error(interp, "image tensor channels must be INT", line, col);
-					return value_null();
-				}
-				dt->data[doff + c] = value_int((int64_t)clamp_u8_i64(sv.as.i));
+	job->src = iv.px;
+	job->dst = out.as.tns->ints;
+	image_parallel(iv.w * iv.h, iv.w * iv.h, pixel_chunk, job);
+	image_release(&iv);
+	return out;
+}
+
+
+/* Box blur: a pass along x into `tmp`, then a pass along y into `dst`,
+ * each truncating its averages.  Both passes slide a running window sum,
+ * so the cost per pixel does not grow with the radius. */
+typedef struct {
+	const int64_t* src;
+	int32_t* tmp;
+	int64_t* dst;
+	int64_t* sums;          /* h * 4 running sums for the x pass */
+	size_t w;
+	size_t h;
+	int radius;
+} BlurJob;
+
+static int64_t window_count(size_t i, size_t n, int radius) {
+	int64_t lo = (int64_t)i - radius;
+	int64_t hi = (int64_t)i + radius;
+	if (lo < 0) lo = 0;
+	if (hi > (int64_t)n - 1) hi = (int64_t)n - 1;
+	return hi - lo + 1;
+}
+
+/* Pass along x for rows [begin, end).  The window moves across columns,
+ * and each step reads one contiguous run per entering / leaving column. */
+static void blur_x_chunk(void* ctx, size_t begin, size_t end) {
+	const BlurJob* j = (const BlurJob*)ctx;
+	size_t col_len = j->h * 4;
+	size_t lo = begin * 4;
+	size_t n = (end - begin) * 4;
+	int64_t* sum = j->sums + lo;
+	size_t r = (size_t)j->radius;
+	memset(sum, 0, n * sizeof(int64_t));
+	for (size_t x = 0; x <= r && x < j->w; x++) {
+		const int64_t* s = j->src + x * col_len + lo;
+		for (size_t k = 0; k < n; k++) sum[k] += (int)s[k];
+	}
+	for (size_t x = 0; x < j->w; x++) {
+		int64_t cnt = window_count(x, j->w, j->radius);
+		int32_t* t = j->tmp + x * col_len + lo;
+		for (size_t k = 0; k < n; k++) t[k] = (int32_t)(sum[k] / cnt);
+		if (x + r + 1 < j->w) {
+			const int64_t* s = j->src + (x + r + 1) * col_len + lo;
+			for (size_t k = 0; k < n; k++) sum[k] += (int)s[k];
+		}
+		if (x >= r) {
+			const int64_t* s = j->src + (x - r) * col_len + lo;
+			for (size_t k = 0; k < n; k++) sum[k] -= (int)s[k];
+		}
+	}
+}
+
+/* Pass along y for columns [begin, end); each column is contiguous. */
+static void blur_y_chunk(void* ctx, size_t begin, size_t end) {
+	const BlurJob* j = (const BlurJob*)ctx;
+	size_t col_len = j->h * 4;
+	size_t r = (size_t)j->radius;
+	for (size_t x = begin; x < end; x++) {
+		const int32_t* t = j->tmp + x * col_len;
+		int64_t* d = j->dst + x * col_len;
+		int64_t sum[4] = {0, 0, 0, 0};
+		for (size_t y = 0; y <= r && y < j->h; y++) {
+			for (size_t c = 0; c < 4; c++) sum[c] += t[y * 4 + c];
+		}
+		for (size_t y = 0; y < j->h; y++) {
+			int64_t cnt = window_count(y, j->h, j->radius);
+			for (size_t c = 0; c < 4; c++) d[y * 4 + c] = sum[c] / cnt;
+			if (y + r + 1 < j->h) {
+				for (size_t c = 0; c < 4; c++) sum[c] += t[(y + r + 1) * 4 + c];
+			}
+			if (y >= r) {
+				for (size_t c = 0; c < 4; c++) sum[c] -= t[(y - r) * 4 + c];
 			}
 		}
 	}
-	return out;
+}
+
+/* Blur `w` x `h` pixels of `src` into `dst`.  Returns 0 when out of
+ * memory. */
+static int box_blur(const int64_t* src, int64_t* dst, size_t w, size_t h, int radius) {
+	BlurJob j;
+	j.src = src;
+	j.dst = dst;
+	j.w = w;
+	j.h = h;
+	j.radius = radius;
+	j.tmp = (int32_t*)malloc(w * h * 4 * sizeof(int32_t));
+	j.sums = (int64_t*)malloc(h * 4 * sizeof(int64_t));
+	if (!j.tmp || !j.sums) {
+		free(j.tmp);
+		free(j.sums);
+		return 0;
+	}
+	image_parallel(h, w * h, blur_x_chunk, &j);
+	image_parallel(w, w * h, blur_y_chunk, &j);
+	free(j.tmp);
+	free(j.sums);
+	return 1;
+}
+
+
+static Value copy_image_checked(Interpreter* interp, Value src, const char* opname, int line, int col) {
+	PixelJob job;
+	memset(&job, 0, sizeof(job));
+	job.op = PIX_COPY;
+	return map_pixels(interp, src, &job, opname, line, col);
 }
 
 static int parse_color_rgba(Interpreter* interp, Value v, int out_rgba[4], const char* opname, int line, int col) {
@@ -169,7 +377,7 @@ static int parse_color_rgba(Interpreter* interp, Value v, int out_rgba[4], const
 		return 0;
 	}
 	for (size_t i = 0; i < 4; i++) {
-		Value e = t->data[i];
+		Value e = value_tns_elem(t, i);
 		if (e.type != VAL_INT) {
 			set_runtime_error(interp, "color channels must be INT", line, col);
 			return 0;
@@ -200,8 +408,8 @@ static int parse_points_xy(Interpreter* interp, Value v, int** out_pts, size_t*
 	}
 	for (size_t i = 0; i < n; i++) {
 		size_t off = i * t->strides[0];
-		Value vx = t->data[off + 0];
-		Value vy = t->data[off + 1];
+		Value vx = value_tns_elem(t, off + 0);
+		Value vy = value_tns_elem(t, off + 1);
 		if (vx.type != VAL_INT || vy.type != VAL_INT) {
 			free(pts);
 			set_runtime_error(interp, "point coordinates must be INT", line, col);
@@ -221,16 +429,16 @@ static void put_pixel_rgba(Tensor* t, int x, int y, const int rgba[4], int mix_a
 	if (x < 0 || y < 0) return;
 	if ((size_t)x >= t->shape[0] || (size_t)y >= t->shape[1]) return;
 	size_t off = pixel_offset(t, (size_t)x, (size_t)y);
-	int dr = (int)t->data[off + 0].as.i;
-	int dg = (int)t->data[off + 1].as.i;
-	int db = (int)t->data[off + 2].as.i;
-	int da = (int)t->data[off + 3].as.i;
+	int dr = (int)t->ints[off + 0];
+	int dg = (int)t->ints[off + 1];
+	int db = (int)t->ints[off + 2];
+	int da = (int)t->ints[off + 3];
 	int sr = rgba[0], sg = rgba[1], sb = rgba[2], sa = rgba[3];
 	if (!mix_alpha) {
-		t->data[off + 0] = value_int(sr);
-		t->data[off + 1] = value_int(sg);
-		t->data[off + 2] = value_int(sb);
-		t->data[off + 3] = value_int(sa);
+		t->ints[off + 0] = (int64_t)sr;
+		t->ints[off + 1] = (int64_t)sg;
+		t->ints[off + 2] = (int64_t)sb;
+		t->ints[off + 3] = (int64_t)sa;
 		return;
 	}
 	int inv = 255 - sa;
@@ -238,10 +446,10 @@ static void put_pixel_rgba(Tensor* t, int x, int y, const int rgba[4], int mix_a
 	int org = clamp_u8_i32((sa * sg + inv * dg) / 255);
 	int orb = clamp_u8_i32((sa * sb + inv * db) / 255);
 	int ora = clamp_u8_i32(sa + (inv * da) / 255);
-	t->data[off + 0] = value_int(orr);
-	t->data[off + 1] = value_int(org);
-	t->data[off + 2] = value_int(orb);
-	t->data[off + 3] = value_int(ora);
+	t->ints[off + 0] = (int64_t)orr;
+	t->ints[off + 1] = (int64_t)org;
+	t->ints[off + 2] = (int64_t)orb;
+	t->ints[off + 3] = (int64_t)ora;
 }
 
 static void draw_line(Tensor* t, int x0, int y0, int x1, int y1, const int rgba[4], int thickness) {
@@ -583,10 +791,10 @@ static Value load_with_gdiplus(Interpreter* interp, const char* path, int line,
 			const uint8_t* px = row + (size_t)x * 4U;
 			uint8_t b = px[0], g = px[1], r = px[2], a = px[3];
 			size_t off = pixel_offset(t, (size_t)x, (size_t)y);
-			t->data[off + 0] = value_int((int64_t)r);
-			t->data[off + 1] = value_int((int64_t)g);
-			t->data[off + 2] = value_int((int64_t)b);
-			t->data[off + 3] = value_int((int64_t)a);
+			t->ints[off + 0] = (int64_t)r;
+			t->ints[off + 1] = (int64_t)g;
+			t->ints[off + 2] = (int64_t)b;
+			t->ints[off + 3] = (int64_t)a;
 		}
 	}
 
@@ -598,28 +806,29 @@ static Value load_with_gdiplus(Interpreter* interp, const char* path, int line,
 static Value save_with_gdiplus(Interpreter* interp, Value imgv, const char* path, const WCHAR* mime, int quality, int line, int col) {
 	ImageView iv;
 	if (!image_from_value(interp, imgv, "SAVE_*", line, col, &iv)) return value_int(0);
-	if (!ensure_gdiplus(interp, line, col)) return value_int(0);
+	if (!ensure_gdiplus(interp, line, col)) { image_release(&iv); return value_int(0); }
 
 	int w = (int)iv.w;
 	int h = (int)iv.h;
 	int stride = w * 4;
 	uint8_t* bgra = (uint8_t*)malloc((size_t)stride * (size_t)h);
-	if (!bgra) { set_runtime_error(interp, "image: out of memory", line, col); return value_int(0); }
+	if (!bgra) { image_release(&iv); set_runtime_error(interp, "image: out of memory", line, col); return value_int(0); }
 
 	for (int y = 0; y < h; y++) {
 		uint8_t* row = bgra + (size_t)y * (size_t)stride;
 		for (int x = 0; x < w; x++) {
-			size_t off = pixel_offset(iv.t, (size_t)x, (size_t)y);
-			int r = clamp_u8_i64(iv.t->data[off + 0].as.i);
-			int g = clamp_u8_i64(iv.t->data[off + 1].as.i);
-			int b = clamp_u8_i64(iv.t->data[off + 2].as.i);
-			int a = clamp_u8_i64(iv.t->data[off + 3].as.i);
+			size_t off = image_offset(&iv, (size_t)x, (size_t)y);
+			int r = clamp_u8_i64(iv.px[off + 0]);
+			int g = clamp_u8_i64(iv.px[off + 1]);
+			int b = clamp_u8_i64(iv.px[off + 2]);
+			int a = clamp_u8_i64(iv.px[off + 3]);
 			row[(size_t)x * 4U + 0U] = (uint8_t)b;
 			row[(size_t)x * 4U + 1U] = (uint8_t)g;
 			row[(size_t)x * 4U + 2U] = (uint8_t)r;
 			row[(size_t)x * 4U + 3U] = (uint8_t)a;
 		}
 	}
+	image_release(&iv);
 
 	GpBitmap_C* bmp = NULL;
 	if (pGdipCreateBitmapFromScan0(w, h, stride, PixelFormat32bppARGB_C, bgra, &bmp) != 0 || !bmp) {
@@ -801,8 +1010,8 @@ static Value op_ellipse(Interpreter* interp, Value* args, int argc, Expr** arg_n
 		value_free(out);
 		return fail(interp, "ELLIPSE center must be TNS[2]", line, col);
 	}
-	Value cxv = args[1].as.tns->data[0];
-	Value cyv = args[1].as.tns->data[1];
+	Value cxv = value_tns_elem(args[1].as.tns, 0);
+	Value cyv = value_tns_elem(args[1].as.tns, 1);
 	if (cxv.type != VAL_INT || cyv.type != VAL_INT) {
 		value_free(out);
 		return fail(interp, "ELLIPSE center coordinates must be INT", line, col);
@@ -835,31 +1044,19 @@ static Value op_ellipse(Interpreter* interp, Value* args, int argc, Expr** arg_n
 }
 
 static Value threshold_channel(Interpreter* interp, Value imgv, Value thv, Value colorv, int ch, const char* opname, int line, int col) {
-	Value out = copy_image_checked(interp, imgv, opname, line, col);
+	ImageView iv;
+	if (!image_from_value(interp, imgv, opname, line, col, &iv)) return value_null();
+	image_release(&iv);
+	PixelJob job;
+	memset(&job, 0, sizeof(job));
+	job.op = PIX_THRESHOLD;
+	job.channel = ch;
+	job.threshold = (int)expect_int(interp, thv, opname, line, col);
 	if (interp->error) return value_null();
-	int th = (int)expect_int(interp, thv, opname, line, col);
-	if (interp->error) {
-		value_free(out);
-		return value_null();
-	}
-	int color[4] = {0, 0, 0, 0};
 	if (colorv.type != VAL_NULL) {
-		if (!parse_color_rgba(interp, colorv, color, opname, line, col)) {
-			value_free(out);
-			return value_null();
-		}
+		if (!parse_color_rgba(interp, colorv, job.a, opname, line, col)) return value_null();
 	}
-	Tensor* t = out.as.tns;
-	for (size_t x = 0; x < t->shape[0]; x++) {
-		for (size_t y = 0; y < t->shape[1]; y++) {
-			size_t off = pixel_offset(t, x, y);
-			int v = (int)t->data[off + (size_t)ch].as.i;
-			if (v <= th) {
-				for (size_t c = 0; c < 4; c++) t->data[off + c] = value_int((int64_t)color[c]);
-			}
-		}
-	}
-	return out;
+	return map_pixels(interp, imgv, &job, opname, line, col);
 }
 
 static Value op_threshhold_a(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
@@ -890,57 +1087,115 @@ static Value op_threshhold_b(Interpreter* interp, Value* args, int argc, Expr**
 	return threshold_channel(interp, args[0], args[1], (argc >= 3) ? args[2] : value_null(), 2, "THRESHHOLD_B", line, col);
 }
 
+typedef struct {
+	const int64_t* src;
+	int64_t* dst;
+	size_t sw;
+	size_t sh;
+	size_t dh;
+	double sx;
+	int antialiasing;
+	/* Per destination row, computed once instead of per pixel. */
+	const int* ny;          /* nearest source row */
+	const int* y0;          /* bilinear rows and weight */
+	const int* y1;
+	const double* wy;
+} ResizeJob;
+
+static void resize_chunk(void* ctx, size_t begin, size_t end) {
+	const ResizeJob* j = (const ResizeJob*)ctx;
+	size_t scol = j->sh * 4;
+	for (size_t x = begin; x < end; x++) {
+		double srcx = ((double)x + 0.5) * j->sx - 0.5;
+		int64_t* d = j->dst + x * j->dh * 4;
+		if (!j->antialiasing) {
+			int nx = (int)floor(srcx + 0.5);
+			if (nx < 0) nx = 0;
+			if ((size_t)nx >= j->sw) nx = (int)j->sw - 1;
+			const int64_t* s = j->src + (size_t)nx * scol;
+			for (size_t y = 0; y < j->dh; y++) {
+				const int64_t* sp = s + (size_t)j->ny[y] * 4;
+				for (size_t c = 0; c < 4; c++) d[y * 4 + c] = sp[c];
+			}
+			continue;
+		}
+		int x0 = (int)floor(srcx);
+		int x1 = x0 + 1;
+		double wx = srcx - (double)x0;
+		if (x0 < 0) x0 = 0;
+		if ((size_t)x1 >= j->sw) x1 = (int)j->sw - 1;
+		const int64_t* s0 = j->src + (size_t)x0 * scol;
+		const int64_t* s1 = j->src + (size_t)x1 * scol;
+		for (size_t y = 0; y < j->dh; y++) {
+			size_t o0 = (size_t)j->y0[y] * 4;
+			size_t o1 = (size_t)j->y1[y] * 4;
+			double wy = j->wy[y];
+			for (size_t c = 0; c < 4; c++) {
+				double v00 = (double)s0[o0 + c];
+				double v10 = (double)s1[o0 + c];
+				double v01 = (double)s0[o1 + c];
+				double v11 = (double)s1[o1 + c];
+				double v0 = v00 * (1.0 - wx) + v10 * wx;
+				double v1 = v01 * (1.0 - wx) + v11 * wx;
+				int outv = (int)floor(v0 * (1.0 - wy) + v1 * wy + 0.5);
+				d[y * 4 + c] = (int64_t)clamp_u8_i32(outv);
+			}
+		}
+	}
+}
+
 static Value resize_impl(Interpreter* interp, Value imgv, int new_w, int new_h, int antialiasing, const char* opname, int line, int col) {
 	ImageView iv;
 	if (!image_from_value(interp, imgv, opname, line, col, &iv)) return value_null();
-	if (new_w <= 0 || new_h <= 0) return fail(interp, "new dimensions must be > 0", line, col);
-
-	Value out = make_image((size_t)new_w, (size_t)new_h);
-	Tensor* st = iv.t;
-	Tensor* dt = out.as.tns;
+	if (new_w <= 0 || new_h <= 0) {
+		image_release(&iv);
+		return fail(interp, "new dimensions must be > 0", line, col);
+	}
 
-	double sx = (double)iv.w / (double)new_w;
+	int* rows = (int*)malloc(sizeof(int) * (size_t)new_h * 3);
+	double* wys = (double*)malloc(sizeof(double) * (size_t)new_h);
+	if (!rows || !wys) {
+		free(rows);
+		free(wys);
+		image_release(&iv);
+		return fail(interp, "out of memory", line, col);
+	}
+	int* ny = rows;
+	int* y0s = rows + new_h;
+	int* y1s = rows + 2 * (size_t)new_h;
 	double sy = (double)iv.h / (double)new_h;
-
-	for (int x = 0; x < new_w; x++) {
-		for (int y = 0; y < new_h; y++) {
-			double srcx = ((double)x + 0.5) * sx - 0.5;
-			double srcy = ((double)y + 0.5) * sy - 0.5;
-			size_t doff = pixel_offset(dt, (size_t)x, (size_t)y);
-
-			if (!antialiasing) {
-				int nx = (int)floor(srcx + 0.5);
-				int ny = (int)floor(srcy + 0.5);
-				if (nx < 0) nx = 0;
-				if (ny < 0) ny = 0;
-				if ((size_t)nx >= iv.w) nx = (int)iv.w - 1;
-				if ((size_t)ny >= iv.h) ny = (int)iv.h - 1;
-				size_t soff = pixel_offset(st, (size_t)nx, (size_t)ny);
-				for (size_t c = 0; c < 4; c++) dt->data[doff + c] = value_int(st->data[soff + c].as.i);
-			} else {
-				int x0 = (int)floor(srcx);
-				int y0 = (int)floor(srcy);
-				int x1 = x0 + 1;
-				int y1 = y0 + 1;
-				double wx = srcx - (double)x0;
-				double wy = srcy - (double)y0;
-				if (x0 < 0) x0 = 0;
-				if (y0 < 0) y0 = 0;
-				if ((size_t)x1 >= iv.w) x1 = (int)iv.w - 1;
-				if ((size_t)y1 >= iv.h) y1 = (int)iv.h - 1;
-				for (size_t c = 0; c < 4; c++) {
-					double v00 = (double)st->data[pixel_offset(st, (size_t)x0, (size_t)y0) + c].as.i;
-					double v10 = (double)st->data[pixel_offset(st, (size_t)x1, (size_t)y0) + c].as.i;
-					double v01 = (double)st->data[pixel_offset(st, (size_t)x0, (size_t)y1) + c].as.i;
-					double v11 = (double)st->data[pixel_offset(st, (size_t)x1, (size_t)y1) + c].as.i;
-					double v0 = v00 * (1.0 - wx) + v10 * wx;
-					double v1 = v01 * (1.0 - wx) + v11 * wx;
-					int outv = (int)floor(v0 * (1.0 - wy) + v1 * wy + 0.5);
-					dt->data[doff + c] = value_int((int64_t)clamp_u8_i32(outv));
-				}
-			}
-		}
+	for (int y = 0; y < new_h; y++) {
+		double srcy = ((double)y + 0.5) * sy - 0.5;
+		int n = (int)floor(srcy + 0.5);
+		if (n < 0) n = 0;
+		if ((size_t)n >= iv.h) n = (int)iv.h - 1;
+		ny[y] = n;
+		int y0 = (int)floor(srcy);
+		int y1 = y0 + 1;
+		wys[y] = srcy - (double)y0;
+		if (y0 < 0) y0 = 0;
+		if ((size_t)y1 >= iv.h) y1 = (int)iv.h - 1;
+		y0s[y] = y0;
+		y1s[y] = y1;
 	}
+
+	Value out = make_image((size_t)new_w, (size_t)new_h);
+	ResizeJob j;
+	j.src = iv.px;
+	j.dst = out.as.tns->ints;
+	j.sw = iv.w;
+	j.sh = iv.h;
+	j.dh = (size_t)new_h;
+	j.sx = (double)iv.w / (double)new_w;
+	j.antialiasing = antialiasing;
+	j.ny = ny;
+	j.y0 = y0s;
+	j.y1 = y1s;
+	j.wy = wys;
+	image_parallel((size_t)new_w, (size_t)new_w * (size_t)new_h, resize_chunk, &j);
+	free(rows);
+	free(wys);
+	image_release(&iv);
 	return out;
 }
 
@@ -950,6 +1205,7 @@ static Value op_scale(Interpreter* interp, Value* args, int argc, Expr** arg_nod
 	if (!expect_argc_range(interp, argc, 3, 4, "SCALE", line, col)) return value_null();
 	ImageView iv;
 	if (!image_from_value(interp, args[0], "SCALE", line, col, &iv)) return value_null();
+	image_release(&iv);
 	double sx = expect_num(interp, args[1], "SCALE", line, col);
 	double sy = expect_num(interp, args[2], "SCALE", line, col);
 	if (interp->error) return value_null();
@@ -977,44 +1233,60 @@ static Value op_resize(Interpreter* interp, Value* args, int argc, Expr** arg_no
 	return resize_impl(interp, args[0], nw, nh, aa != 0, "RESIZE", line, col);
 }
 
+typedef struct {
+	const int64_t* src;
+	int64_t* dst;
+	size_t w;
+	size_t h;
+	double cs;
+	double sn;
+	double cx;
+	double cy;
+} RotateJob;
+
+static void rotate_chunk(void* ctx, size_t begin, size_t end) {
+	const RotateJob* j = (const RotateJob*)ctx;
+	for (size_t x = begin; x < end; x++) {
+		double dx = (double)x - j->cx;
+		int64_t* d = j->dst + x * j->h * 4;
+		for (size_t y = 0; y < j->h; y++) {
+			double dy = (double)y - j->cy;
+			double sx = j->cx + dx * j->cs - dy * j->sn;
+			double sy = j->cy + dx * j->sn + dy * j->cs;
+			int ix = (int)floor(sx + 0.5);
+			int iy = (int)floor(sy + 0.5);
+			if (ix >= 0 && iy >= 0 && (size_t)ix < j->w && (size_t)iy < j->h) {
+				const int64_t* s = j->src + ((size_t)ix * j->h + (size_t)iy) * 4;
+				for (size_t c = 0; c < 4; c++) d[y * 4 + c] = s[c];
+			} else {
+				for (size_t c = 0; c < 4; c++) d[y * 4 + c] = 0;
+			}
+		}
+	}
+}
+
 static Value op_rotate(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
 	(void)arg_nodes;
 	(void)env;
 	if (!expect_argc_range(interp, argc, 2, 2, "ROTATE", line, col)) return value_null();
 	ImageView iv;
-	if (!image_from_value(interp, args[0], "ROTATE", line, col, &iv)) return value_null();
 	double deg = expect_num(interp, args[1], "ROTATE", line, col);
 	if (interp->error) return value_null();
+	if (!image_from_value(interp, args[0], "ROTATE", line, col, &iv)) return value_null();
 
 	Value out = make_image(iv.w, iv.h);
-	Tensor* st = iv.t;
-	Tensor* dt = out.as.tns;
 	double rad = -deg * (3.14159265358979323846 / 180.0);
-	double cs = cos(rad);
-	double sn = sin(rad);
-	double cx = ((double)iv.w - 1.0) * 0.5;
-	double cy = ((double)iv.h - 1.0) * 0.5;
-
-	for (size_t x = 0; x < iv.w; x++) {
-		for (size_t y = 0; y < iv.h; y++) {
-			double dx = (double)x - cx;
-			double dy = (double)y - cy;
-			double sx = cx + dx * cs - dy * sn;
-			double sy = cy + dx * sn + dy * cs;
-			size_t doff = pixel_offset(dt, x, y);
-			int ix = (int)floor(sx + 0.5);
-			int iy = (int)floor(sy + 0.5);
-			if (ix >= 0 && iy >= 0 && (size_t)ix < iv.w && (size_t)iy < iv.h) {
-				size_t soff = pixel_offset(st, (size_t)ix, (size_t)iy);
-				for (size_t c = 0; c < 4; c++) dt->data[doff + c] = value_int(st->data[soff + c].as.i);
-			} else {
-				dt->data[doff + 0] = value_int(0);
-				dt->data[doff + 1] = value_int(0);
-				dt->data[doff + 2] = value_int(0);
-				dt->data[doff + 3] = value_int(0);
-			}
-		}
-	}
+	RotateJob j;
+	j.src = iv.px;
+	j.dst = out.as.tns->ints;
+	j.w = iv.w;
+	j.h = iv.h;
+	j.cs = cos(rad);
+	j.sn = sin(rad);
+	j.cx = ((double)iv.w - 1.0) * 0.5;
+	j.cy = ((double)iv.h - 1.0) * 0.5;
+	image_parallel(iv.w, iv.w * iv.h, rotate_chunk, &j);
+	image_release(&iv);
 	return out;
 }
 
@@ -1024,8 +1296,6 @@ static Value op_blit(Interpreter* interp, Value* args, int argc, Expr** arg_node
 	if (!expect_argc_range(interp, argc, 4, 5, "BLIT", line, col)) return value_null();
 	ImageView src;
 	ImageView dst;
-	if (!image_from_value(interp, args[0], "BLIT", line, col, &src)) return value_null();
-	if (!image_from_value(interp, args[1], "BLIT", line, col, &dst)) return value_null();
 	int ox = (int)expect_int(interp, args[2], "BLIT", line, col);
 	int oy = (int)expect_int(interp, args[3], "BLIT", line, col);
 	/* Convert origin from user (1-based) to internal (0-based) */
@@ -1035,9 +1305,18 @@ static Value op_blit(Interpreter* interp, Value* args, int argc, Expr** arg_node
 	int mix = 1;
 	if (argc >= 5) mix = (int)expect_int(interp, args[4], "BLIT", line, col);
 	if (interp->error) return value_null();
+	if (!image_from_value(interp, args[0], "BLIT", line, col, &src)) return value_null();
+	if (!image_from_value(interp, args[1], "BLIT", line, col, &dst)) {
+		image_release(&src);
+		return value_null();
+	}
+	image_release(&dst);
 
 	Value out = copy_image_checked(interp, args[1], "BLIT", line, col);
-	if (interp->error) return value_null();
+	if (interp->error) {
+		image_release(&src);
+		return value_null();
+	}
 	Tensor* dt = out.as.tns;
 
 	for (size_t sx = 0; sx < src.w; sx++) {
@@ -1045,16 +1324,17 @@ static Value op_blit(Interpreter* interp, Value* args, int argc, Expr** arg_node
 			int dx = (int)sx + ox;
 			int dy = (int)sy + oy;
 			if (dx < 0 || dy < 0 || (size_t)dx >= dst.w || (size_t)dy >= dst.h) continue;
-			size_t soff = pixel_offset(src.t, sx, sy);
+			size_t soff = image_offset(&src, sx, sy);
 			int rgba[4] = {
-				(int)src.t->data[soff + 0].as.i,
-				(int)src.t->data[soff + 1].as.i,
-				(int)src.t->data[soff + 2].as.i,
-				(int)src.t->data[soff + 3].as.i
+				(int)src.px[soff + 0],
+				(int)src.px[soff + 1],
+				(int)src.px[soff + 2],
+				(int)src.px[soff + 3]
 			};
 			put_pixel_rgba(dt, dx, dy, rgba, mix != 0);
 		}
 	}
+	image_release(&src);
 	return out;
 }
 
@@ -1062,51 +1342,22 @@ static Value op_grayscale(Interpreter* interp, Value* args, int argc, Expr** arg
 	(void)arg_nodes;
 	(void)env;
 	if (!expect_argc_range(interp, argc, 1, 1, "GRAYSCALE", line, col)) return value_null();
-	Value out = copy_image_checked(interp, args[0], "GRAYSCALE", line, col);
-	if (interp->error) return value_null();
-	Tensor* t = out.as.tns;
-	for (size_t x = 0; x < t->shape[0]; x++) {
-		for (size_t y = 0; y < t->shape[1]; y++) {
-			size_t off = pixel_offset(t, x, y);
-			int r = (int)t->data[off + 0].as.i;
-			int g = (int)t->data[off + 1].as.i;
-			int b = (int)t->data[off + 2].as.i;
-			int l = clamp_u8_i32((299 * r + 587 * g + 114 * b) / 1000);
-			t->data[off + 0] = value_int(l);
-			t->data[off + 1] = value_int(l);
-			t->data[off + 2] = value_int(l);
-		}
-	}
-	return out;
+	PixelJob job;
+	memset(&job, 0, sizeof(job));
+	job.op = PIX_GRAYSCALE;
+	return map_pixels(interp, args[0], &job, "GRAYSCALE", line, col);
 }
 
 static Value op_replace_color(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
 	(void)arg_nodes;
 	(void)env;
 	if (!expect_argc_range(interp, argc, 3, 3, "REPLACE_COLOR", line, col)) return value_null();
-	int target[4];
-	int repl[4];
-	if (!parse_color_rgba(interp, args[1], target, "REPLACE_COLOR", line, col)) return value_null();
-	if (!parse_color_rgba(interp, args[2], repl, "REPLACE_COLOR", line, col)) return value_null();
-	Value out = copy_image_checked(interp, args[0], "REPLACE_COLOR", line, col);
-	if (interp->error) return value_null();
-	Tensor* t = out.as.tns;
-	for (size_t x = 0; x < t->shape[0]; x++) {
-		for (size_t y = 0; y < t->shape[1]; y++) {
-			size_t off = pixel_offset(t, x, y);
-			int same = 1;
-			for (size_t c = 0; c < 4; c++) {
-				if ((int)t->data[off + c].as.i != target[c]) {
-					same = 0;
-					break;
-				}
-			}
-			if (same) {
-				for (size_t c = 0; c < 4; c++) t->data[off + c] = value_int((int64_t)repl[c]);
-			}
-		}
-	}
-	return out;
+	PixelJob job;
+	memset(&job, 0, sizeof(job));
+	job.op = PIX_REPLACE;
+	if (!parse_color_rgba(interp, args[1], job.a, "REPLACE_COLOR", line, col)) return value_null();
+	if (!parse_color_rgba(interp, args[2], job.b, "REPLACE_COLOR", line, col)) return value_null();
+	return map_pixels(interp, args[0], &job, "REPLACE_COLOR", line, col);
 }
 
 static Value op_blur(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
@@ -1120,92 +1371,65 @@ static Value op_blur(Interpreter* interp, Value* args, int argc, Expr** arg_node
 
 	ImageView iv;
 	if (!image_from_value(interp, args[0], "BLUR", line, col, &iv)) return value_null();
-	Value temp = make_image(iv.w, iv.h);
 	Value out = make_image(iv.w, iv.h);
-	Tensor* st = iv.t;
-	Tensor* tt = temp.as.tns;
-	Tensor* dt = out.as.tns;
-
-	for (size_t x = 0; x < iv.w; x++) {
-		for (size_t y = 0; y < iv.h; y++) {
-			size_t off = pixel_offset(tt, x, y);
-			for (size_t c = 0; c < 4; c++) {
-				int sum = 0;
-				int cnt = 0;
-				for (int k = -radius; k <= radius; k++) {
-					int sx = (int)x + k;
-					if (sx < 0 || (size_t)sx >= iv.w) continue;
-					sum += (int)st->data[pixel_offset(st, (size_t)sx, y) + c].as.i;
-					cnt++;
-				}
-				tt->data[off + c] = value_int((cnt > 0) ? (sum / cnt) : 0);
-			}
-		}
+	int ok = box_blur(iv.px, out.as.tns->ints, iv.w, iv.h, radius);
+	image_release(&iv);
+	if (!ok) {
+		value_free(out);
+		return fail(interp, "out of memory", line, col);
 	}
+	return out;
+}
 
-	for (size_t x = 0; x < iv.w; x++) {
-		for (size_t y = 0; y < iv.h; y++) {
-			size_t off = pixel_offset(dt, x, y);
-			for (size_t c = 0; c < 4; c++) {
-				int sum = 0;
-				int cnt = 0;
-				for (int k = -radius; k <= radius; k++) {
-					int sy = (int)y + k;
-					if (sy < 0 || (size_t)sy >= iv.h) continue;
-					sum += (int)tt->data[pixel_offset(tt, x, (size_t)sy) + c].as.i;
-					cnt++;
-				}
-				dt->data[off + c] = value_int((cnt > 0) ? (sum / cnt) : 0);
-			}
-		}
+typedef struct {
+	const int64_t* b1;
+	const int64_t* b2;
+	int64_t* dst;
+} EdgeJob;
+
+static void edge_chunk(void* ctx, size_t begin, size_t end) {
+	const EdgeJob* j = (const EdgeJob*)ctx;
+	for (size_t p = begin; p < end; p++) {
+		const int64_t* p1 = j->b1 + p * 4;
+		const int64_t* p2 = j->b2 + p * 4;
+		int g1 = ((int)p1[0] + (int)p1[1] + (int)p1[2]) / 3;
+		int g2 = ((int)p2[0] + (int)p2[1] + (int)p2[2]) / 3;
+		int e = abs(g1 - g2);
+		if (e > 255) e = 255;
+		int64_t* d = j->dst + p * 4;
+		d[0] = (int64_t)e;
+		d[1] = (int64_t)e;
+		d[2] = (int64_t)e;
+		d[3] = p1[3];
 	}
-
-	value_free(temp);
-	return out;
 }
 
 static Value op_edge(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
 	(void)arg_nodes;
 	(void)env;
 	if (!expect_argc_range(interp, argc, 1, 1, "EDGE", line, col)) return value_null();
-	Value blur1_args[2] = {args[0], value_int(1)};
-	Value blur2_args[2] = {args[0], value_int(2)};
-	Value b1 = op_blur(interp, blur1_args, 2, NULL, NULL, line, col);
-	if (interp->error) return value_null();
-	Value b2 = op_blur(interp, blur2_args, 2, NULL, NULL, line, col);
-	if (interp->error) {
-		value_free(b1);
-		return value_null();
-	}
-
-	ImageView i1;
-	ImageView i2;
-	if (!image_from_value(interp, b1, "EDGE", line, col, &i1) || !image_from_value(interp, b2, "EDGE", line, col, &i2)) {
-		value_free(b1);
-		value_free(b2);
-		return value_null();
-	}
-	Value out = make_image(i1.w, i1.h);
-	Tensor* dt = out.as.tns;
-
-	for (size_t x = 0; x < i1.w; x++) {
-		for (size_t y = 0; y < i1.h; y++) {
-			size_t o1 = pixel_offset(i1.t, x, y);
-			size_t o2 = pixel_offset(i2.t, x, y);
-			size_t od = pixel_offset(dt, x, y);
-			int g1 = ((int)i1.t->data[o1 + 0].as.i + (int)i1.t->data[o1 + 1].as.i + (int)i1.t->data[o1 + 2].as.i) / 3;
-			int g2 = ((int)i2.t->data[o2 + 0].as.i + (int)i2.t->data[o2 + 1].as.i + (int)i2.t->data[o2 + 2].as.i) / 3;
-			int e = abs(g1 - g2);
-			if (e > 255) e = 255;
-			dt->data[od + 0] = value_int(e);
-			dt->data[od + 1] = value_int(e);
-			dt->data[od + 2] = value_int(e);
-			dt->data[od + 3] = value_int((int64_t)i1.t->data[o1 + 3].as.i);
-		}
+	ImageView iv;
+	if (!image_from_value(interp, args[0], "EDGE", line, col, &iv)) return value_null();
+
+	/* Both blurs go to scratch buffers; only the result becomes a tensor. */
+	size_t n = iv.w * iv.h * 4;
+	int64_t* b1 = (int64_t*)malloc(n * sizeof(int64_t));
+	int64_t* b2 = (int64_t*)malloc(n * sizeof(int64_t));
+	int ok = b1 && b2 && box_blur(iv.px, b1, iv.w, iv.h, 1) && box_blur(iv.px, b2, iv.w, iv.h, 2);
+	image_release(&iv);
+	if (!ok) {
+		free(b1);
+		free(b2);
+		return fail(interp, "out of memory", line, col);
 	}
-
-	value_free(b1);
-	value_free(b2);
+	Value out = make_image(iv.w, iv.h);
+	EdgeJob j;
+	j.b1 = b1;
+	j.b2 = b2;
+	j.dst = out.as.tns->ints;
+	image_parallel(iv.w * iv.h, iv.w * iv.h, edge_chunk, &j);
+	free(b1);
+	free(b2);
 	return out;
 }
 
@@ -1224,7 +1448,7 @@ static int parse_palette(Interpreter* interp, Value v, int** out_colors, size_t*
 			set_runtime_error(interp, "out of memory", line, col);
 			return 0;
 		}
-		for (size_t c = 0; c < 4; c++) cols[c] = (c < t->shape[0] && t->data[c].type == VAL_INT) ? clamp_u8_i64(t->data[c].as.i) : 255;
+		for (size_t c = 0; c < 4; c++) cols[c] = (c < t->shape[0] && value_tns_elem(t, c).type == VAL_INT) ? clamp_u8_i64(value_tns_elem(t, c).as.i) : 255;
 		if (t->shape[0] == 3) cols[3] = 255;
 		*out_colors = cols;
 		*out_n = 1;
@@ -1240,7 +1464,7 @@ static int parse_palette(Interpreter* interp, Value v, int** out_colors, size_t*
 		for (size_t i = 0; i < n; i++) {
 			size_t off = i * t->strides[0];
 			for (size_t c = 0; c < t->shape[1]; c++) {
-				Value e = t->data[off + c];
+				Value e = value_tns_elem(t, off + c);
 				if (e.type != VAL_INT) {
 					free(cols);
 					set_runtime_error(interp, "palette channels must be INT", line, col);
@@ -1266,39 +1490,12 @@ static Value op_cellshade(Interpreter* interp, Value* args, int argc, Expr** arg
 	size_t pal_n = 0;
 	if (!parse_palette(interp, args[1], &palette, &pal_n, line, col)) return value_null();
 
-	Value out = copy_image_checked(interp, args[0], "CELLSHADE", line, col);
-	if (interp->error) {
-		free(palette);
-		return value_null();
-	}
-	Tensor* t = out.as.tns;
-	for (size_t x = 0; x < t->shape[0]; x++) {
-		for (size_t y = 0; y < t->shape[1]; y++) {
-			size_t off = pixel_offset(t, x, y);
-			int r = (int)t->data[off + 0].as.i;
-			int g = (int)t->data[off + 1].as.i;
-			int b = (int)t->data[off + 2].as.i;
-			size_t best = 0;
-			int64_t bestd = INT64_MAX;
-			for (size_t i = 0; i < pal_n; i++) {
-				int pr = palette[i * 4 + 0];
-				int pg = palette[i * 4 + 1];
-				int pb = palette[i * 4 + 2];
-				int dr = r - pr;
-				int dg = g - pg;
-				int db = b - pb;
-				int64_t d = (int64_t)dr * dr + (int64_t)dg * dg + (int64_t)db * db;
-				if (d < bestd) {
-					bestd = d;
-					best = i;
-				}
-			}
-			t->data[off + 0] = value_int((int64_t)palette[best * 4 + 0]);
-			t->data[off + 1] = value_int((int64_t)palette[best * 4 + 1]);
-			t->data[off + 2] = value_int((int64_t)palette[best * 4 + 2]);
-			t->data[off + 3] = value_int((int64_t)palette[best * 4 + 3]);
-		}
-	}
+	PixelJob job;
+	memset(&job, 0, sizeof(job));
+	job.op = PIX_CELLSHADE;
+	job.palette = palette;
+	job.palette_n = pal_n;
+	Value out = map_pixels(interp, args[0], &job, "CELLSHADE", line, col);
 	free(palette);
 	return out;
 }
@@ -1308,6 +1505,9 @@ __declspec(dllexport)
 #endif
 void prefix_extension_init(prefix_ext_context* ctx) {
 	if (!ctx) return;
+	g_tns_acquire = ctx->tns_acquire;
+	g_tns_release = ctx->tns_release;
+	g_parallel_for = ctx->parallel_for;
 	ctx->register_operator("LOAD_PNG", (prefix_operator_fn)op_load_png, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("LOAD_JPEG", (prefix_operator_fn)op_load_jpeg, PREFIX_EXTENSION_ASMODULE);
 	ctx->register_operator("LOAD_BMP", (prefix_operator_fn)op_load_bmp, PREFIX_EXTENSION_ASMODULE);
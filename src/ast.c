@@ -1,22 +1,164 @@
 #include "ast.h"
+#include "value.h"
+#include "vm.h"
+#include "builtins.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-#ifdef _MSC_VER
-#define strdup _strdup
-#endif
+// ============ AST arenas ============
+//
+// Chunks are bump-allocated and only ever freed all together.  A request
+// larger than a quarter of the default chunk gets a chunk of its own, so
+// one huge string literal does not waste the tail of the current chunk.
 
-static void* ast_alloc(size_t size) {
-    void* ptr = malloc(size);
-    if (!ptr) {
-        fprintf(stderr, "Out of memory\n");
-        exit(1);
+#define AST_CHUNK_SIZE (64 * 1024)
+#define AST_ALIGN 8  // int64_t, double and pointers
+
+typedef struct AstChunk {
+    struct AstChunk* next;
+    size_t size;   // usable bytes after the header
+    size_t used;
+} AstChunk;
+
+// Header size rounded up so chunk data starts suitably aligned.
+#define AST_CHUNK_HEADER ((sizeof(AstChunk) + 15) & ~(size_t)15)
+
+// STMT_BLOCK nodes whose VM code and GOTOPOINT tables (both heap memory
+// built after parsing) are freed with the arena.
+typedef struct AstBlockLink {
+    struct AstBlockLink* next;
+    Stmt* block;
+} AstBlockLink;
+
+struct AstArena {
+    AstChunk* chunks;      // current chunk first
+    AstBlockLink* blocks;
+    atomic_count_t refcount;
+};
+
+static _Thread_local AstArena* t_arena;
+
+static void ast_oom(void) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+}
+
+static AstChunk* ast_chunk_new(size_t size) {
+    AstChunk* chunk = malloc(AST_CHUNK_HEADER + size);
+    if (!chunk) ast_oom();
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+AstArena* ast_arena_new(void) {
+    AstArena* arena = malloc(sizeof(AstArena));
+    if (!arena) ast_oom();
+    arena->chunks = ast_chunk_new(AST_CHUNK_SIZE);
+    arena->blocks = NULL;
+    atomic_count_store(&arena->refcount, 1);
+    return arena;
+}
+
+void ast_arena_retain(AstArena* arena) {
+    if (arena) atomic_count_inc(&arena->refcount);
+}
+
+void ast_arena_release(AstArena* arena) {
+    if (!arena || atomic_count_dec(&arena->refcount) > 0) return;
+    for (AstBlockLink* link = arena->blocks; link; link = link->next) {
+        vm_code_free(link->block->code);
+        label_table_free(link->block->as.block.labels);
+    }
+    AstChunk* chunk = arena->chunks;
+    while (chunk) {
+        AstChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+AstArena* ast_arena_enter(AstArena* arena) {
+    AstArena* previous = t_arena;
+    t_arena = arena;
+    return previous;
+}
+
+void ast_arena_leave(AstArena* previous) {
+    t_arena = previous;
+}
+
+AstArena* ast_arena_current(void) {
+    return t_arena;
+}
+
+static void* arena_take(AstArena* arena, size_t size, size_t align) {
+    AstChunk* chunk = arena->chunks;
+    size_t at = (chunk->used + align - 1) & ~(align - 1);
+    if (at + size > chunk->size) {
+        if (size > AST_CHUNK_SIZE / 4) {
+            // Oversized: its own chunk, kept behind the current one.
+            AstChunk* big = ast_chunk_new(size);
+            big->used = size;
+            big->next = chunk->next;
+            chunk->next = big;
+            return (unsigned char*)big + AST_CHUNK_HEADER;
+        }
+        chunk = ast_chunk_new(AST_CHUNK_SIZE);
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        at = 0;
+    }
+    chunk->used = at + size;
+    return (unsigned char*)chunk + AST_CHUNK_HEADER + at;
+}
+
+void* ast_alloc(size_t size) {
+    void* ptr;
+    if (t_arena) {
+        ptr = arena_take(t_arena, size, AST_ALIGN);
+    } else {
+        ptr = malloc(size);
+        if (!ptr) ast_oom();
     }
     memset(ptr, 0, size);
     return ptr;
 }
 
+char* ast_strndup(const char* s, size_t len) {
+    char* out;
+    if (t_arena) {
+        out = arena_take(t_arena, len + 1, 1);
+    } else {
+        out = malloc(len + 1);
+        if (!out) ast_oom();
+    }
+    memcpy(out, s, len);
+    out[len] = '\0';
+    return out;
+}
+
+char* ast_strdup(const char* s) {
+    return s ? ast_strndup(s, strlen(s)) : NULL;
+}
+
+// List arrays grow by copying into a fresh arena array; the old one is
+// reclaimed with the arena.
+static void* ast_grow(void* items, size_t count, size_t new_cap, size_t elem) {
+    void* grown = ast_alloc(new_cap * elem);
+    if (count) memcpy(grown, items, count * elem);
+    return grown;
+}
+
+static Stmt* stmt_alloc(void) {
+    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    stmt->arena = t_arena;
+    return stmt;
+}
+
 Expr* expr_int(int64_t value, int line, int column) {
     Expr* expr = ast_alloc(sizeof(Expr));
     expr->type = EXPR_INT;
@@ -35,12 +177,13 @@ Expr* expr_flt(double value, int line, int column) {
     return expr;
 }
 
-Expr* expr_str(char* value, int line, int column) {
+Expr* expr_str(const char* value, int line, int column) {
     Expr* expr = ast_alloc(sizeof(Expr));
     expr->type = EXPR_STR;
     expr->line = line;
     expr->column = column;
-    expr->as.str_value = value;
+    // Literals are interned so evaluating one never copies it.
+    expr->as.str_value = (char*)value_str_intern(value);
     return expr;
 }
 
@@ -50,6 +193,7 @@ Expr* expr_ident(char* name, int line, int column) {
     expr->line = line;
     expr->column = column;
     expr->as.ident = name;
+    expr->ref.coord = 0;
     return expr;
 }
 
@@ -68,6 +212,12 @@ Expr* expr_call(Expr* callee, int line, int column) {
     expr->as.call.kw_args.capacity = 0;
     expr->as.call.kw_count = 0;
     expr->as.call.kw_capacity = 0;
+    expr->as.call.cached_builtin = NULL;
+    expr->as.call.cached_epoch = 0;
+    // Fixed by the callee's name, so it is never rewritten while the node runs.
+    expr->as.call.quote_mask = (callee && callee->type == EXPR_IDENT)
+        ? builtin_arg_quote_mask(callee->as.ident) : 0;
+    expr->as.call.typed_op = CALL_TYPED_NONE;
     return expr;
 }
 
@@ -149,11 +299,7 @@ Expr* expr_async(Stmt* block, int line, int column) {
 void expr_list_add(ExprList* list, Expr* expr) {
     if (list->count + 1 > list->capacity) {
         size_t new_cap = list->capacity == 0 ? 4 : list->capacity * 2;
-        list->items = realloc(list->items, new_cap * sizeof(Expr*));
-        if (!list->items) {
-            fprintf(stderr, "Out of memory\n");
-            exit(1);
-        }
+        list->items = ast_grow(list->items, list->count, new_cap, sizeof(Expr*));
         list->capacity = new_cap;
     }
     list->items[list->count++] = expr;
@@ -163,8 +309,7 @@ void expr_list_add(ExprList* list, Expr* expr) {
         if (!call || call->type != EXPR_CALL) return;
         if (call->as.call.kw_count + 1 > call->as.call.kw_capacity) {
             size_t new_cap = call->as.call.kw_capacity == 0 ? 4 : call->as.call.kw_capacity * 2;
-            call->as.call.kw_names = realloc(call->as.call.kw_names, new_cap * sizeof(char*));
-            if (!call->as.call.kw_names) { fprintf(stderr, "Out of memory\n"); exit(1); }
+            call->as.call.kw_names = ast_grow(call->as.call.kw_names, call->as.call.kw_count, new_cap, sizeof(char*));
             call->as.call.kw_capacity = new_cap;
         }
         call->as.call.kw_names[call->as.call.kw_count++] = name;
@@ -172,15 +317,21 @@ void expr_list_add(ExprList* list, Expr* expr) {
     }
 
 Stmt* stmt_block(int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_BLOCK;
     stmt->line = line;
     stmt->column = column;
+    if (t_arena) {
+        AstBlockLink* link = ast_alloc(sizeof(AstBlockLink));
+        link->block = stmt;
+        link->next = t_arena->blocks;
+        t_arena->blocks = link;
+    }
     return stmt;
 }
 
 Stmt* stmt_async(Stmt* body, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_ASYNC;
     stmt->line = line;
     stmt->column = column;
@@ -189,7 +340,7 @@ Stmt* stmt_async(Stmt* body, int line, int column) {
 }
 
 Stmt* stmt_expr(Expr* expr, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_EXPR;
     stmt->line = line;
     stmt->column = column;
@@ -198,7 +349,7 @@ Stmt* stmt_expr(Expr* expr, int line, int column) {
 }
 
 Stmt* stmt_assign(bool has_type, DeclType decl_type, char* name, Expr* target, Expr* value, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_ASSIGN;
     stmt->line = line;
     stmt->column = column;
@@ -207,11 +358,12 @@ Stmt* stmt_assign(bool has_type, DeclType decl_type, char* name, Expr* target, E
     stmt->as.assign.name = name;
     stmt->as.assign.target = target;
     stmt->as.assign.value = value;
+    stmt->as.assign.ref.coord = 0;
     return stmt;
 }
 
 Stmt* stmt_decl(DeclType decl_type, char* name, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_DECL;
     stmt->line = line;
     stmt->column = column;
@@ -221,7 +373,7 @@ Stmt* stmt_decl(DeclType decl_type, char* name, int line, int column) {
 }
 
 Stmt* stmt_if(Expr* cond, Stmt* then_branch, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_IF;
     stmt->line = line;
     stmt->column = column;
@@ -231,7 +383,7 @@ Stmt* stmt_if(Expr* cond, Stmt* then_branch, int line, int column) {
 }
 
 Stmt* stmt_while(Expr* cond, Stmt* body, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_WHILE;
     stmt->line = line;
     stmt->column = column;
@@ -241,18 +393,19 @@ Stmt* stmt_while(Expr* cond, Stmt* body, int line, int column) {
 }
 
 Stmt* stmt_for(char* counter, Expr* target, Stmt* body, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_FOR;
     stmt->line = line;
     stmt->column = column;
     stmt->as.for_stmt.counter = counter;
     stmt->as.for_stmt.target = target;
     stmt->as.for_stmt.body = body;
+    stmt->as.for_stmt.ref.coord = 0;
     return stmt;
 }
 
 Stmt* stmt_parfor(char* counter, Expr* target, Stmt* body, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_PARFOR;
     stmt->line = line;
     stmt->column = column;
@@ -263,7 +416,7 @@ Stmt* stmt_parfor(char* counter, Expr* target, Stmt* body, int line, int column)
 }
 
 Stmt* stmt_func(char* name, DeclType ret, Stmt* body, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_FUNC;
     stmt->line = line;
     stmt->column = column;
@@ -274,7 +427,7 @@ Stmt* stmt_func(char* name, DeclType ret, Stmt* body, int line, int column) {
 }
 
 Stmt* stmt_return(Expr* value, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_RETURN;
     stmt->line = line;
     stmt->column = column;
@@ -283,7 +436,7 @@ Stmt* stmt_return(Expr* value, int line, int column) {
 }
 
 Stmt* stmt_pop(char* name, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_POP;
     stmt->line = line;
     stmt->column = column;
@@ -292,7 +445,7 @@ Stmt* stmt_pop(char* name, int line, int column) {
 }
 
 Stmt* stmt_break(Expr* value, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_BREAK;
     stmt->line = line;
     stmt->column = column;
@@ -301,7 +454,7 @@ Stmt* stmt_break(Expr* value, int line, int column) {
 }
 
 Stmt* stmt_continue(int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_CONTINUE;
     stmt->line = line;
     stmt->column = column;
@@ -309,7 +462,7 @@ Stmt* stmt_continue(int line, int column) {
 }
 
 Stmt* stmt_thr(char* name, Stmt* body, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_THR;
     stmt->line = line;
     stmt->column = column;
@@ -319,7 +472,7 @@ Stmt* stmt_thr(char* name, Stmt* body, int line, int column) {
 }
 
 Stmt* stmt_try(Stmt* try_block, char* catch_name, Stmt* catch_block, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_TRY;
     stmt->line = line;
     stmt->column = column;
@@ -330,7 +483,7 @@ Stmt* stmt_try(Stmt* try_block, char* catch_name, Stmt* catch_block, int line, i
 }
 
 Stmt* stmt_goto(Expr* target, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_GOTO;
     stmt->line = line;
     stmt->column = column;
@@ -339,7 +492,7 @@ Stmt* stmt_goto(Expr* target, int line, int column) {
 }
 
 Stmt* stmt_gotopoint(Expr* target, int line, int column) {
-    Stmt* stmt = ast_alloc(sizeof(Stmt));
+    Stmt* stmt = stmt_alloc();
     stmt->type = STMT_GOTOPOINT;
     stmt->line = line;
     stmt->column = column;
@@ -350,11 +503,7 @@ Stmt* stmt_gotopoint(Expr* target, int line, int column) {
 void stmt_list_add(StmtList* list, Stmt* stmt) {
     if (list->count + 1 > list->capacity) {
         size_t new_cap = list->capacity == 0 ? 4 : list->capacity * 2;
-        list->items = realloc(list->items, new_cap * sizeof(Stmt*));
-        if (!list->items) {
-            fprintf(stderr, "Out of memory\n");
-            exit(1);
-        }
+        list->items = ast_grow(list->items, list->count, new_cap, sizeof(Stmt*));
         list->capacity = new_cap;
     }
     list->items[list->count++] = stmt;
@@ -363,164 +512,12 @@ void stmt_list_add(StmtList* list, Stmt* stmt) {
 void param_list_add(ParamList* list, Param param) {
     if (list->count + 1 > list->capacity) {
         size_t new_cap = list->capacity == 0 ? 4 : list->capacity * 2;
-        list->items = realloc(list->items, new_cap * sizeof(Param));
-        if (!list->items) {
-            fprintf(stderr, "Out of memory\n");
-            exit(1);
-        }
+        list->items = ast_grow(list->items, list->count, new_cap, sizeof(Param));
         list->capacity = new_cap;
     }
     list->items[list->count++] = param;
 }
 
-static void free_expr_list(ExprList* list) {
-    for (size_t i = 0; i < list->count; i++) {
-        free_expr(list->items[i]);
-    }
-    free(list->items);
-}
-
-static void free_stmt_list(StmtList* list) {
-    for (size_t i = 0; i < list->count; i++) {
-        free_stmt(list->items[i]);
-    }
-    free(list->items);
-}
-
-void free_expr(Expr* expr) {
-    if (!expr) return;
-    switch (expr->type) {
-        case EXPR_ASYNC:
-            free_stmt(expr->as.async.block);
-            break;
-        case EXPR_STR:
-            free(expr->as.str_value);
-            break;
-        case EXPR_PTR:
-            free(expr->as.ptr_name);
-            break;
-        case EXPR_TNS:
-            free_expr_list(&expr->as.tns_items);
-            break;
-            case EXPR_MAP:
-                free_expr_list(&expr->as.map_items.keys);
-                free_expr_list(&expr->as.map_items.values);
-                break;
-        case EXPR_INDEX:
-            free_expr(expr->as.index.target);
-            free_expr_list(&expr->as.index.indices);
-            break;
-        case EXPR_RANGE:
-            free_expr(expr->as.range.start);
-            free_expr(expr->as.range.end);
-            break;
-        case EXPR_LAMBDA:
-            for (size_t i = 0; i < expr->as.lambda.params.count; i++) {
-                free(expr->as.lambda.params.items[i].name);
-                free_expr(expr->as.lambda.params.items[i].default_value);
-            }
-            free(expr->as.lambda.params.items);
-            free_stmt(expr->as.lambda.body);
-            break;
-        case EXPR_IDENT:
-            free(expr->as.ident);
-            break;
-        case EXPR_CALL:
-            free_expr(expr->as.call.callee);
-            free_expr_list(&expr->as.call.args);
-                if (expr->as.call.kw_names) {
-                    for (size_t i = 0; i < expr->as.call.kw_count; i++) free(expr->as.call.kw_names[i]);
-                    free(expr->as.call.kw_names);
-                }
-                free_expr_list(&expr->as.call.kw_args);
-            break;
-        default:
-            break;
-    }
-    free(expr);
-}
-
-void free_stmt(Stmt* stmt) {
-    if (!stmt) return;
-    switch (stmt->type) {
-        case STMT_BLOCK:
-            free_stmt_list(&stmt->as.block);
-            break;
-        case STMT_ASYNC:
-            free_stmt(stmt->as.async_stmt.body);
-            break;
-        case STMT_EXPR:
-            free_expr(stmt->as.expr_stmt.expr);
-            break;
-        case STMT_ASSIGN:
-            if (stmt->as.assign.name) free(stmt->as.assign.name);
-            if (stmt->as.assign.target) free_expr(stmt->as.assign.target);
-            free_expr(stmt->as.assign.value);
-            break;
-        case STMT_DECL:
-            free(stmt->as.decl.name);
-            break;
-        case STMT_IF:
-            free_expr(stmt->as.if_stmt.condition);
-            free_stmt(stmt->as.if_stmt.then_branch);
-            free_expr_list(&stmt->as.if_stmt.elif_conditions);
-            free_stmt_list(&stmt->as.if_stmt.elif_blocks);
-            free_stmt(stmt->as.if_stmt.else_branch);
-            break;
-        case STMT_WHILE:
-            free_expr(stmt->as.while_stmt.condition);
-            free_stmt(stmt->as.while_stmt.body);
-            break;
-        case STMT_FOR:
-            free(stmt->as.for_stmt.counter);
-            free_expr(stmt->as.for_stmt.target);
-            free_stmt(stmt->as.for_stmt.body);
-            break;
-        case STMT_PARFOR:
-            free(stmt->as.parfor_stmt.counter);
-            free_expr(stmt->as.parfor_stmt.target);
-            free_stmt(stmt->as.parfor_stmt.body);
-            break;
-        case STMT_FUNC:
-            free(stmt->as.func_stmt.name);
-            for (size_t i = 0; i < stmt->as.func_stmt.params.count; i++) {
-                free(stmt->as.func_stmt.params.items[i].name);
-                free_expr(stmt->as.func_stmt.params.items[i].default_value);
-            }
-            free(stmt->as.func_stmt.params.items);
-            free_stmt(stmt->as.func_stmt.body);
-            break;
-        case STMT_RETURN:
-            free_expr(stmt->as.return_stmt.value);
-            break;
-        case STMT_POP:
-            free(stmt->as.pop_stmt.name);
-            break;
-        case STMT_BREAK:
-            free_expr(stmt->as.break_stmt.value);
-            break;
-        case STMT_THR:
-            free(stmt->as.thr_stmt.name);
-            free_stmt(stmt->as.thr_stmt.body);
-            break;
-        case STMT_TRY:
-            free_stmt(stmt->as.try_stmt.try_block);
-            free(stmt->as.try_stmt.catch_name);
-            free_stmt(stmt->as.try_stmt.catch_block);
-            break;
-        case STMT_GOTO:
-            free_expr(stmt->as.goto_stmt.target);
-            break;
-        case STMT_GOTOPOINT:
-            free_expr(stmt->as.gotopoint_stmt.target);
-            break;
-        default:
-            break;
-    }
-        if (stmt->src_text) free(stmt->src_text);
-        free(stmt);
-}
-
 Expr* expr_ptr(char* name, int line, int column) {
     Expr* expr = ast_alloc(sizeof(Expr));
     expr->type = EXPR_PTR;
@@ -531,11 +528,5 @@ Expr* expr_ptr(char* name, int line, int column) {
 }
 
 void stmt_set_src(Stmt* stmt, const char* src) {
-    if (!stmt) return;
-    if (stmt->src_text) free(stmt->src_text);
-    if (!src) {
-        stmt->src_text = NULL;
-        return;
-    }
-    stmt->src_text = strdup(src);
+    if (stmt) stmt->src_text = src;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define AST_H
 
 #include "common.h"
+#include "win32_shim.h"
 
 typedef enum {
     TYPE_INT,
@@ -17,6 +18,122 @@ typedef enum {
 typedef struct Expr Expr;
 typedef struct Stmt Stmt;
 
+// ============ AST arenas ============
+//
+// Every node, list array, name and token literal of one parsed program (a
+// script, an IMPORTed module, a RUN string, a REPL entry or one UNSER call)
+// is bump-allocated from one AstArena and freed with it in one shot; nodes
+// are never freed one by one.  The AST constructors below allocate from
+// the arena entered on the calling thread (outside any arena they fall
+// back to the heap, and those nodes live for the rest of the process).
+//
+// An arena is refcounted.  Whoever parses holds the first reference
+// (program->arena); a FUNC or LAMBDA value, a THR whose body came from the
+// arena and a -profile line entry each hold another, so releasing the
+// program after it ran keeps the parts still reachable alive.
+typedef struct AstArena AstArena;
+
+AstArena* ast_arena_new(void);
+void ast_arena_retain(AstArena* arena);   // NULL is ignored
+void ast_arena_release(AstArena* arena);  // NULL is ignored
+// Make `arena` the one this thread allocates AST nodes from and return the
+// previously entered one, to be passed back to ast_arena_leave().
+AstArena* ast_arena_enter(AstArena* arena);
+void ast_arena_leave(AstArena* previous);
+AstArena* ast_arena_current(void);
+// Zeroed, 8-byte aligned memory / a string copy from the current arena.
+void* ast_alloc(size_t size);
+char* ast_strndup(const char* s, size_t len);
+char* ast_strdup(const char* s);
+
+// ============ Run-time caches in AST nodes ============
+//
+// A node is shared by every thread that runs it (PARFOR workers, THR
+// bodies), so the caches it carries are written while other threads read
+// them.  Each cache is read and written through these accessors only: a
+// word is never torn, and a value stored with release is visible to a
+// thread that loads the word guarding it with acquire.
+#if defined(_MSC_VER)
+#include <intrin.h>
+#if defined(_M_ARM) || defined(_M_ARM64)
+#define AST_CACHE_BARRIER() __dmb(0xB)  // ISH
+#else
+#define AST_CACHE_BARRIER() _ReadWriteBarrier()
+#endif
+static inline uint64_t ast_cache_load64(const uint64_t* p) {
+    return (uint64_t)__iso_volatile_load64((const volatile __int64*)p);
+}
+static inline void ast_cache_store64(uint64_t* p, uint64_t v) {
+    __iso_volatile_store64((volatile __int64*)p, (__int64)v);
+}
+static inline unsigned ast_cache_load_acquire(const unsigned* p) {
+    unsigned v = (unsigned)__iso_volatile_load32((const volatile __int32*)p);
+    AST_CACHE_BARRIER();
+    return v;
+}
+static inline void ast_cache_store_release(unsigned* p, unsigned v) {
+    AST_CACHE_BARRIER();
+    __iso_volatile_store32((volatile __int32*)p, (__int32)v);
+}
+#if defined(_WIN64)
+static inline void* ast_cache_load_ptr(void* const* p) {
+    return (void*)__iso_volatile_load64((const volatile __int64*)p);
+}
+static inline void ast_cache_store_ptr(void** p, void* v) {
+    __iso_volatile_store64((volatile __int64*)p, (__int64)v);
+}
+#else
+static inline void* ast_cache_load_ptr(void* const* p) {
+    return (void*)__iso_volatile_load32((const volatile __int32*)p);
+}
+static inline void ast_cache_store_ptr(void** p, void* v) {
+    __iso_volatile_store32((volatile __int32*)p, (__int32)v);
+}
+#endif
+#else
+static inline uint64_t ast_cache_load64(const uint64_t* p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+static inline void ast_cache_store64(uint64_t* p, uint64_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+static inline unsigned ast_cache_load_acquire(const unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline void ast_cache_store_release(unsigned* p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+static inline void* ast_cache_load_ptr(void* const* p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+static inline void ast_cache_store_ptr(void** p, void* v) {
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+#endif
+
+// Cached (depth, slot) coordinate of a variable binding.  Seeded by the
+// resolver pass (resolver.c) and refreshed by env lookups; always
+// validated against the live Env chain before use, so a stale ref only
+// costs a fall back to the by-name path.  Lookups refresh it from several
+// threads at once, so both halves live in one word (slot_ref_get/set).
+typedef struct SlotRef {
+    uint64_t coord;   // (depth + 1) << 32 | slot, 0 if unresolved
+    uint64_t bit;     // env_name_bit() of the name (set by the resolver), or 0
+    const char* name; // interned name (set by the resolver), or NULL
+} SlotRef;
+
+static inline bool slot_ref_get(const SlotRef* ref, int* depth, int* slot) {
+    uint64_t coord = ast_cache_load64(&ref->coord);
+    if (coord == 0) return false;
+    *depth = (int)(coord >> 32) - 1;
+    *slot = (int)(uint32_t)coord;
+    return true;
+}
+
+static inline void slot_ref_set(SlotRef* ref, int depth, int slot) {
+    ast_cache_store64(&ref->coord, ((uint64_t)(uint32_t)(depth + 1) << 32) | (uint32_t)slot);
+}
+
 typedef struct Param {
     DeclType type;
     char* name;
@@ -51,14 +168,25 @@ typedef struct {
     size_t capacity;
 } ExprList;
 
+// Typed fast path of a two-argument builtin call, picked by the optimizer
+// pass (optimizer.h) when both arguments are statically INT or both FLT.
+typedef enum {
+    CALL_TYPED_NONE,
+    CALL_TYPED_IADD, CALL_TYPED_ISUB, CALL_TYPED_IMUL,
+    CALL_TYPED_IEQ, CALL_TYPED_INEQ, CALL_TYPED_ILT, CALL_TYPED_IGT, CALL_TYPED_ILTE, CALL_TYPED_IGTE,
+    CALL_TYPED_FADD, CALL_TYPED_FSUB, CALL_TYPED_FMUL,
+    CALL_TYPED_FEQ, CALL_TYPED_FNEQ, CALL_TYPED_FLT, CALL_TYPED_FGT, CALL_TYPED_FLTE, CALL_TYPED_FGTE
+} CallTyped;
+
 struct Expr {
     ExprType type;
     int line;
     int column;
+    SlotRef ref; // EXPR_IDENT only
     union {
         int64_t int_value;
         double flt_value;
-        char* str_value;
+        char* str_value;   // interned (value_str_intern)
         char* ident;
         char* ptr_name;
             struct { Stmt* block; } async;
@@ -69,6 +197,13 @@ struct Expr {
             ExprList kw_args;
             size_t kw_count;
             size_t kw_capacity;
+            // Call-site cache for identifier callees, filled and validated
+            // by builtin_lookup_call() (builtins.h) through the ast_cache_*
+            // accessors: cached_builtin is stored first, cached_epoch last.
+            void* cached_builtin;       // BuiltinFunction*
+            unsigned cached_epoch;      // builtins_epoch() at fill time, 0 = empty
+            unsigned quote_mask;        // bit i: positional arg i is passed unevaluated (set by expr_call)
+            unsigned char typed_op;     // CallTyped, set by optimize_program()
         } call;
         struct {
             Expr* target;
@@ -86,6 +221,7 @@ struct Expr {
             ParamList params;
             DeclType return_type;
             Stmt* body;
+            size_t frame_size; // call Env bindings, set by the resolver
         } lambda;
         ExprList tns_items;
     } as;
@@ -116,17 +252,29 @@ typedef struct {
     Stmt** items;
     size_t count;
     size_t capacity;
+    // GOTOPOINT table, built on the list's first execution (see
+    // interpreter.c); stays NULL for a list without GOTOPOINT.
+    struct LabelTable* labels;
+    atomic_count_t labels_ready;
 } StmtList;
 
 struct Stmt {
     StmtType type;
     int line;
     int column;
-    char* src_text;
+    // Trimmed source line, a slice of the arena's copy of the program text
+    // (see stmt_set_src); NULL when unknown.
+    const char* src_text;
+    // Arena the statement was allocated from (NULL for heap nodes).
+    AstArena* arena;
+    // Bytecode for a STMT_BLOCK compiled by the VM (vm.c), else NULL.
+    // Built right after parsing, before the program runs, and read-only
+    // afterwards.
+    struct VmCode* code;
     union {
         StmtList block;
         struct { Expr* expr; } expr_stmt;
-        struct { bool has_type; DeclType decl_type; char* name; Expr* target; Expr* value; } assign;
+        struct { bool has_type; DeclType decl_type; char* name; Expr* target; Expr* value; SlotRef ref; } assign;
         struct { DeclType decl_type; char* name; } decl;
         struct {
             Expr* condition;
@@ -136,9 +284,9 @@ struct Stmt {
             Stmt* else_branch; // optional
         } if_stmt;
         struct { Expr* condition; Stmt* body; } while_stmt;
-        struct { char* counter; Expr* target; Stmt* body; } for_stmt;
+        struct { char* counter; Expr* target; Stmt* body; SlotRef ref; } for_stmt;
         struct { char* counter; Expr* target; Stmt* body; } parfor_stmt;
-        struct { char* name; ParamList params; DeclType return_type; Stmt* body; } func_stmt;
+        struct { char* name; ParamList params; DeclType return_type; Stmt* body; size_t frame_size; } func_stmt;
         struct { Expr* value; } return_stmt;
         struct { Expr* value; } break_stmt;
         struct { Stmt* body; } async_stmt;
@@ -152,7 +300,7 @@ struct Stmt {
 
 Expr* expr_int(int64_t value, int line, int column);
 Expr* expr_flt(double value, int line, int column);
-Expr* expr_str(char* value, int line, int column);
+Expr* expr_str(const char* value, int line, int column);
 Expr* expr_ptr(char* name, int line, int column);
 Expr* expr_ident(char* name, int line, int column);
 Expr* expr_call(Expr* callee, int line, int column);
@@ -188,10 +336,9 @@ Stmt* stmt_gotopoint(Expr* target, int line, int column);
 void stmt_list_add(StmtList* list, Stmt* stmt);
 void param_list_add(ParamList* list, Param param);
 
-// Attach original source text (single line) to a statement node.
+// Attach original source text (single line) to a statement node.  The
+// text is not copied, so it must live as long as the statement: a string
+// from the statement's arena (lexer_get_line, ast_strdup) or a literal.
 void stmt_set_src(Stmt* stmt, const char* src);
 
-void free_expr(Expr* expr);
-void free_stmt(Stmt* stmt);
-
 #endif // AST_H
\ No newline at end of file
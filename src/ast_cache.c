@@ -0,0 +1,546 @@
+#include "ast_cache.h"
+#include "parser.h"
+#include "optimizer.h"
+#include "resolver.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// File layout (native byte order; the magic doubles as an endianness check):
+//   magic[8] format:u32 build:str source_len:u64 source_hash:u64 program
+//   program_hash:u64
+// where a str is u32 length (0xFFFFFFFF for NULL) plus bytes, and a node
+// is a u8 type tag (0xFF for NULL), line:i32, column:i32 and its fields in
+// the order written by write_expr / write_stmt.
+#define AST_CACHE_MAGIC "PREFXAST"
+#define AST_CACHE_FORMAT 1u
+#define AST_CACHE_NULL_TAG 0xFFu
+#define AST_CACHE_NULL_STR 0xFFFFFFFFu
+
+// Entries written by a different interpreter build are stale.
+static const char g_build_id[] = __DATE__ " " __TIME__;
+
+static uint64_t fnv1a(const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// `foo.pre` -> `foo.prec`; any other name gets ".prec" appended.
+static char* cache_path_for(const char* path) {
+    if (!path || !path[0]) return NULL;
+    size_t n = strlen(path);
+    bool pre = n >= 4 && strcmp(path + n - 4, ".pre") == 0;
+    char* out = malloc(n + (pre ? 2 : 6));
+    if (!out) return NULL;
+    memcpy(out, path, n);
+    if (pre) memcpy(out + n, "c", 2);
+    else memcpy(out + n, ".prec", 6);
+    return out;
+}
+
+// ============ Writer ============
+
+typedef struct {
+    unsigned char* data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} CacheWriter;
+
+static void put(CacheWriter* w, const void* p, size_t n) {
+    if (w->failed) return;
+    if (w->len + n > w->cap) {
+        size_t new_cap = w->cap == 0 ? 4096 : w->cap;
+        while (new_cap < w->len + n) new_cap *= 2;
+        unsigned char* grown = realloc(w->data, new_cap);
+        if (!grown) { w->failed = true; return; }
+        w->data = grown;
+        w->cap = new_cap;
+    }
+    memcpy(w->data + w->len, p, n);
+    w->len += n;
+}
+
+static void put_u8(CacheWriter* w, unsigned v) { unsigned char b = (unsigned char)v; put(w, &b, 1); }
+static void put_u32(CacheWriter* w, uint32_t v) { put(w, &v, sizeof(v)); }
+static void put_i32(CacheWriter* w, int v) { int32_t x = (int32_t)v; put(w, &x, sizeof(x)); }
+static void put_u64(CacheWriter* w, uint64_t v) { put(w, &v, sizeof(v)); }
+
+static void put_str(CacheWriter* w, const char* s) {
+    if (!s) { put_u32(w, AST_CACHE_NULL_STR); return; }
+    size_t n = strlen(s);
+    if (n >= AST_CACHE_NULL_STR) { w->failed = true; return; }
+    put_u32(w, (uint32_t)n);
+    put(w, s, n);
+}
+
+static void write_expr(CacheWriter* w, const Expr* expr);
+static void write_stmt(CacheWriter* w, const Stmt* stmt);
+
+static void write_expr_list(CacheWriter* w, const ExprList* list) {
+    put_u32(w, (uint32_t)list->count);
+    for (size_t i = 0; i < list->count; i++) write_expr(w, list->items[i]);
+}
+
+static void write_stmt_list(CacheWriter* w, const StmtList* list) {
+    put_u32(w, (uint32_t)list->count);
+    for (size_t i = 0; i < list->count; i++) write_stmt(w, list->items[i]);
+}
+
+static void write_params(CacheWriter* w, const ParamList* params) {
+    put_u32(w, (uint32_t)params->count);
+    for (size_t i = 0; i < params->count; i++) {
+        put_u8(w, (unsigned)params->items[i].type);
+        put_str(w, params->items[i].name);
+        write_expr(w, params->items[i].default_value);
+    }
+}
+
+static void write_expr(CacheWriter* w, const Expr* expr) {
+    if (!expr) { put_u8(w, AST_CACHE_NULL_TAG); return; }
+    put_u8(w, (unsigned)expr->type);
+    put_i32(w, expr->line);
+    put_i32(w, expr->column);
+    switch (expr->type) {
+        case EXPR_INT: put_u64(w, (uint64_t)expr->as.int_value); break;
+        case EXPR_FLT: put(w, &expr->as.flt_value, sizeof(double)); break;
+        case EXPR_STR: put_str(w, expr->as.str_value); break;
+        case EXPR_PTR: put_str(w, expr->as.ptr_name); break;
+        case EXPR_IDENT: put_str(w, expr->as.ident); break;
+        case EXPR_CALL:
+            write_expr(w, expr->as.call.callee);
+            write_expr_list(w, &expr->as.call.args);
+            put_u32(w, (uint32_t)expr->as.call.kw_count);
+            for (size_t i = 0; i < expr->as.call.kw_count; i++) {
+                put_str(w, expr->as.call.kw_names[i]);
+                write_expr(w, expr->as.call.kw_args.items[i]);
+            }
+            break;
+        case EXPR_ASYNC: write_stmt(w, expr->as.async.block); break;
+        case EXPR_TNS: write_expr_list(w, &expr->as.tns_items); break;
+        case EXPR_MAP:
+            write_expr_list(w, &expr->as.map_items.keys);
+            write_expr_list(w, &expr->as.map_items.values);
+            break;
+        case EXPR_INDEX:
+            write_expr(w, expr->as.index.target);
+            write_expr_list(w, &expr->as.index.indices);
+            break;
+        case EXPR_RANGE:
+            write_expr(w, expr->as.range.start);
+            write_expr(w, expr->as.range.end);
+            break;
+        case EXPR_WILDCARD: break;
+        case EXPR_LAMBDA:
+            write_params(w, &expr->as.lambda.params);
+            put_u8(w, (unsigned)expr->as.lambda.return_type);
+            write_stmt(w, expr->as.lambda.body);
+            break;
+        default:
+            w->failed = true;
+            break;
+    }
+}
+
+static void write_stmt(CacheWriter* w, const Stmt* stmt) {
+    if (!stmt) { put_u8(w, AST_CACHE_NULL_TAG); return; }
+    put_u8(w, (unsigned)stmt->type);
+    put_i32(w, stmt->line);
+    put_i32(w, stmt->column);
+    put_str(w, stmt->src_text);
+    switch (stmt->type) {
+        case STMT_BLOCK: write_stmt_list(w, &stmt->as.block); break;
+        case STMT_ASYNC: write_stmt(w, stmt->as.async_stmt.body); break;
+        case STMT_EXPR: write_expr(w, stmt->as.expr_stmt.expr); break;
+        case STMT_ASSIGN:
+            put_u8(w, stmt->as.assign.has_type ? 1u : 0u);
+            put_u8(w, (unsigned)stmt->as.assign.decl_type);
+            put_str(w, stmt->as.assign.name);
+            write_expr(w, stmt->as.assign.target);
+            write_expr(w, stmt->as.assign.value);
+            break;
+        case STMT_DECL:
+            put_u8(w, (unsigned)stmt->as.decl.decl_type);
+            put_str(w, stmt->as.decl.name);
+            break;
+        case STMT_IF:
+            write_expr(w, stmt->as.if_stmt.condition);
+            write_stmt(w, stmt->as.if_stmt.then_branch);
+            write_expr_list(w, &stmt->as.if_stmt.elif_conditions);
+            write_stmt_list(w, &stmt->as.if_stmt.elif_blocks);
+            write_stmt(w, stmt->as.if_stmt.else_branch);
+            break;
+        case STMT_WHILE:
+            write_expr(w, stmt->as.while_stmt.condition);
+            write_stmt(w, stmt->as.while_stmt.body);
+            break;
+        case STMT_FOR:
+            put_str(w, stmt->as.for_stmt.counter);
+            write_expr(w, stmt->as.for_stmt.target);
+            write_stmt(w, stmt->as.for_stmt.body);
+            break;
+        case STMT_PARFOR:
+            put_str(w, stmt->as.parfor_stmt.counter);
+            write_expr(w, stmt->as.parfor_stmt.target);
+            write_stmt(w, stmt->as.parfor_stmt.body);
+            break;
+        case STMT_FUNC:
+            put_str(w, stmt->as.func_stmt.name);
+            write_params(w, &stmt->as.func_stmt.params);
+            put_u8(w, (unsigned)stmt->as.func_stmt.return_type);
+            write_stmt(w, stmt->as.func_stmt.body);
+            break;
+        case STMT_RETURN: write_expr(w, stmt->as.return_stmt.value); break;
+        case STMT_BREAK: write_expr(w, stmt->as.break_stmt.value); break;
+        case STMT_CONTINUE: break;
+        case STMT_THR:
+            put_str(w, stmt->as.thr_stmt.name);
+            write_stmt(w, stmt->as.thr_stmt.body);
+            break;
+        case STMT_POP: put_str(w, stmt->as.pop_stmt.name); break;
+        case STMT_TRY:
+            write_stmt(w, stmt->as.try_stmt.try_block);
+            put_str(w, stmt->as.try_stmt.catch_name);
+            write_stmt(w, stmt->as.try_stmt.catch_block);
+            break;
+        case STMT_GOTO: write_expr(w, stmt->as.goto_stmt.target); break;
+        case STMT_GOTOPOINT: write_expr(w, stmt->as.gotopoint_stmt.target); break;
+        default:
+            w->failed = true;
+            break;
+    }
+}
+
+static void write_header(CacheWriter* w, size_t source_len, uint64_t hash) {
+    put(w, AST_CACHE_MAGIC, 8);
+    put_u32(w, AST_CACHE_FORMAT);
+    put_str(w, g_build_id);
+    put_u64(w, (uint64_t)source_len);
+    put_u64(w, hash);
+}
+
+// Write through a temporary file and rename it into place, so a reader
+// never sees a half-written entry.
+static void cache_store(const char* cache_path, const Stmt* program, size_t source_len, uint64_t hash) {
+    CacheWriter w = {0};
+    write_header(&w, source_len, hash);
+    size_t body = w.len;
+    write_stmt(&w, program);
+    if (!w.failed) put_u64(&w, fnv1a(w.data + body, w.len - body));
+    if (w.failed) { free(w.data); return; }
+
+    size_t n = strlen(cache_path);
+    char* tmp = malloc(n + 5);
+    if (!tmp) { free(w.data); return; }
+    memcpy(tmp, cache_path, n);
+    memcpy(tmp + n, ".tmp", 5);
+
+    FILE* f = fopen(tmp, "wb");
+    if (f) {
+        bool ok = fwrite(w.data, 1, w.len, f) == w.len;
+        ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+        if (ok) remove(cache_path);
+#endif
+        if (!ok || rename(tmp, cache_path) != 0) remove(tmp);
+    }
+    free(tmp);
+    free(w.data);
+}
+
+// ============ Reader ============
+
+// Every read is bounds-checked; a truncated or corrupt entry sets `failed`
+// and the partially built tree is freed by the caller.
+typedef struct {
+    const unsigned char* data;
+    size_t len;
+    size_t pos;
+    bool failed;
+} CacheReader;
+
+static bool take(CacheReader* r, void* out, size_t n) {
+    if (r->failed || r->len - r->pos < n) {
+        r->failed = true;
+        memset(out, 0, n);
+        return false;
+    }
+    memcpy(out, r->data + r->pos, n);
+    r->pos += n;
+    return true;
+}
+
+static unsigned get_u8(CacheReader* r) { unsigned char b; take(r, &b, 1); return b; }
+static uint32_t get_u32(CacheReader* r) { uint32_t v; take(r, &v, sizeof(v)); return v; }
+static int get_i32(CacheReader* r) { int32_t v; take(r, &v, sizeof(v)); return (int)v; }
+static uint64_t get_u64(CacheReader* r) { uint64_t v; take(r, &v, sizeof(v)); return v; }
+
+// Counts are bounded by the bytes left, so a corrupt count cannot make a
+// reader loop or allocate far past the end of the entry.
+static size_t get_count(CacheReader* r) {
+    uint32_t n = get_u32(r);
+    if (n > r->len - r->pos) { r->failed = true; return 0; }
+    return n;
+}
+
+static char* get_str(CacheReader* r) {
+    uint32_t n = get_u32(r);
+    if (r->failed || n == AST_CACHE_NULL_STR) return NULL;
+    if (n > r->len - r->pos) { r->failed = true; return NULL; }
+    char* s = ast_strndup((const char*)r->data + r->pos, n);
+    r->pos += n;
+    return s;
+}
+
+static DeclType get_decl_type(CacheReader* r) {
+    unsigned t = get_u8(r);
+    if (t > (unsigned)TYPE_UNKNOWN) { r->failed = true; return TYPE_UNKNOWN; }
+    return (DeclType)t;
+}
+
+static Expr* read_expr(CacheReader* r);
+static Stmt* read_stmt(CacheReader* r);
+
+static void read_expr_list(CacheReader* r, ExprList* list) {
+    size_t n = get_count(r);
+    for (size_t i = 0; i < n && !r->failed; i++) expr_list_add(list, read_expr(r));
+}
+
+static void read_stmt_list(CacheReader* r, StmtList* list) {
+    size_t n = get_count(r);
+    for (size_t i = 0; i < n && !r->failed; i++) stmt_list_add(list, read_stmt(r));
+}
+
+static void read_params(CacheReader* r, ParamList* params) {
+    size_t n = get_count(r);
+    for (size_t i = 0; i < n && !r->failed; i++) {
+        Param p;
+        p.type = get_decl_type(r);
+        p.name = get_str(r);
+        p.default_value = read_expr(r);
+        param_list_add(params, p);
+    }
+}
+
+static Expr* read_expr(CacheReader* r) {
+    unsigned tag = get_u8(r);
+    if (r->failed || tag == AST_CACHE_NULL_TAG) return NULL;
+    int line = get_i32(r);
+    int column = get_i32(r);
+    Expr* expr = NULL;
+    switch ((ExprType)tag) {
+        case EXPR_INT: expr = expr_int((int64_t)get_u64(r), line, column); break;
+        case EXPR_FLT: {
+            double v;
+            take(r, &v, sizeof(v));
+            expr = expr_flt(v, line, column);
+            break;
+        }
+        case EXPR_STR: {
+            char* s = get_str(r);
+            if (!s) { r->failed = true; return NULL; }
+            expr = expr_str(s, line, column);
+            break;
+        }
+        case EXPR_PTR: expr = expr_ptr(get_str(r), line, column); break;
+        case EXPR_IDENT: expr = expr_ident(get_str(r), line, column); break;
+        case EXPR_CALL: {
+            expr = expr_call(read_expr(r), line, column);
+            read_expr_list(r, &expr->as.call.args);
+            size_t kw = get_count(r);
+            for (size_t i = 0; i < kw && !r->failed; i++) {
+                char* name = get_str(r);
+                call_kw_add(expr, name, read_expr(r));
+            }
+            break;
+        }
+        case EXPR_ASYNC: expr = expr_async(read_stmt(r), line, column); break;
+        case EXPR_TNS:
+            expr = expr_tns(line, column);
+            read_expr_list(r, &expr->as.tns_items);
+            break;
+        case EXPR_MAP:
+            expr = expr_map(line, column);
+            read_expr_list(r, &expr->as.map_items.keys);
+            read_expr_list(r, &expr->as.map_items.values);
+            break;
+        case EXPR_INDEX:
+            expr = expr_index(read_expr(r), line, column);
+            read_expr_list(r, &expr->as.index.indices);
+            break;
+        case EXPR_RANGE: {
+            Expr* start = read_expr(r);
+            expr = expr_range(start, read_expr(r), line, column);
+            break;
+        }
+        case EXPR_WILDCARD: expr = expr_wildcard(line, column); break;
+        case EXPR_LAMBDA: {
+            ParamList params = {0};
+            read_params(r, &params);
+            DeclType ret = get_decl_type(r);
+            expr = expr_lambda(params, ret, NULL, line, column);
+            expr->as.lambda.body = read_stmt(r);
+            break;
+        }
+        default:
+            r->failed = true;
+            return NULL;
+    }
+    return expr;
+}
+
+static Stmt* read_stmt(CacheReader* r) {
+    unsigned tag = get_u8(r);
+    if (r->failed || tag == AST_CACHE_NULL_TAG) return NULL;
+    int line = get_i32(r);
+    int column = get_i32(r);
+    char* src_text = get_str(r);
+    Stmt* stmt = NULL;
+    switch ((StmtType)tag) {
+        case STMT_BLOCK:
+            stmt = stmt_block(line, column);
+            read_stmt_list(r, &stmt->as.block);
+            break;
+        case STMT_ASYNC: stmt = stmt_async(read_stmt(r), line, column); break;
+        case STMT_EXPR: stmt = stmt_expr(read_expr(r), line, column); break;
+        case STMT_ASSIGN: {
+            bool has_type = get_u8(r) != 0;
+            DeclType type = get_decl_type(r);
+            stmt = stmt_assign(has_type, type, get_str(r), NULL, NULL, line, column);
+            stmt->as.assign.target = read_expr(r);
+            stmt->as.assign.value = read_expr(r);
+            break;
+        }
+        case STMT_DECL: {
+            DeclType type = get_decl_type(r);
+            stmt = stmt_decl(type, get_str(r), line, column);
+            break;
+        }
+        case STMT_IF:
+            stmt = stmt_if(read_expr(r), NULL, line, column);
+            stmt->as.if_stmt.then_branch = read_stmt(r);
+            read_expr_list(r, &stmt->as.if_stmt.elif_conditions);
+            read_stmt_list(r, &stmt->as.if_stmt.elif_blocks);
+            stmt->as.if_stmt.else_branch = read_stmt(r);
+            break;
+        case STMT_WHILE:
+            stmt = stmt_while(read_expr(r), NULL, line, column);
+            stmt->as.while_stmt.body = read_stmt(r);
+            break;
+        case STMT_FOR:
+            stmt = stmt_for(get_str(r), NULL, NULL, line, column);
+            stmt->as.for_stmt.target = read_expr(r);
+            stmt->as.for_stmt.body = read_stmt(r);
+            break;
+        case STMT_PARFOR:
+            stmt = stmt_parfor(get_str(r), NULL, NULL, line, column);
+            stmt->as.parfor_stmt.target = read_expr(r);
+            stmt->as.parfor_stmt.body = read_stmt(r);
+            break;
+        case STMT_FUNC:
+            stmt = stmt_func(get_str(r), TYPE_UNKNOWN, NULL, line, column);
+            read_params(r, &stmt->as.func_stmt.params);
+            stmt->as.func_stmt.return_type = get_decl_type(r);
+            stmt->as.func_stmt.body = read_stmt(r);
+            break;
+        case STMT_RETURN: stmt = stmt_return(read_expr(r), line, column); break;
+        case STMT_BREAK: stmt = stmt_break(read_expr(r), line, column); break;
+        case STMT_CONTINUE: stmt = stmt_continue(line, column); break;
+        case STMT_THR:
+            stmt = stmt_thr(get_str(r), NULL, line, column);
+            stmt->as.thr_stmt.body = read_stmt(r);
+            break;
+        case STMT_POP: stmt = stmt_pop(get_str(r), line, column); break;
+        case STMT_TRY:
+            stmt = stmt_try(read_stmt(r), NULL, NULL, line, column);
+            stmt->as.try_stmt.catch_name = get_str(r);
+            stmt->as.try_stmt.catch_block = read_stmt(r);
+            break;
+        case STMT_GOTO: stmt = stmt_goto(read_expr(r), line, column); break;
+        case STMT_GOTOPOINT: stmt = stmt_gotopoint(read_expr(r), line, column); break;
+        default:
+            r->failed = true;
+            return NULL;
+    }
+    stmt->src_text = src_text;
+    return stmt;
+}
+
+static Stmt* cache_load(const char* cache_path, size_t source_len, uint64_t hash) {
+    FILE* f = fopen(cache_path, "rb");
+    if (!f) return NULL;
+    unsigned char* data = NULL;
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+    if (size > 0 && fseek(f, 0, SEEK_SET) == 0) {
+        data = malloc((size_t)size);
+        if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    if (!data) return NULL;
+
+    CacheReader r = { data, (size_t)size, 0, false };
+    char magic[8];
+    take(&r, magic, sizeof(magic));
+    uint32_t format = get_u32(&r);
+    char* build = get_str(&r);
+    uint64_t len = get_u64(&r);
+    uint64_t h = get_u64(&r);
+    bool current = !r.failed && memcmp(magic, AST_CACHE_MAGIC, 8) == 0 &&
+                   format == AST_CACHE_FORMAT && build && strcmp(build, g_build_id) == 0 &&
+                   len == (uint64_t)source_len && h == hash;
+
+    // The program must hash to its trailer, so a damaged entry is never
+    // mistaken for a different but well-formed program.
+    if (current && r.len - r.pos >= sizeof(uint64_t)) {
+        uint64_t stored;
+        r.len -= sizeof(uint64_t);
+        memcpy(&stored, r.data + r.len, sizeof(stored));
+        current = stored == fnv1a(r.data + r.pos, r.len - r.pos);
+    } else {
+        current = false;
+    }
+
+    Stmt* program = NULL;
+    if (current) {
+        program = read_stmt(&r);
+        if (r.failed || r.pos != r.len || !program || program->type != STMT_BLOCK) program = NULL;
+    }
+    free(data);
+    return program;
+}
+
+Stmt* ast_cache_parse(const char* path, const char* src, size_t len, int* err_line, int* err_col) {
+    uint64_t hash = fnv1a(src, len);
+    char* cache_path = cache_path_for(path);
+
+    AstArena* arena = ast_arena_new();
+    AstArena* previous = ast_arena_enter(arena);
+    Stmt* program = cache_path ? cache_load(cache_path, len, hash) : NULL;
+    if (program) {
+        resolve_program(program);
+        optimize_program(program);
+        if (vm_enabled()) vm_compile_program(program);
+    }
+    ast_arena_leave(previous);
+    if (program) {
+        free(cache_path);
+        return program;
+    }
+    // Whatever a stale or damaged entry left behind goes with its arena.
+    ast_arena_release(arena);
+
+    program = parser_parse_source(src, path, err_line, err_col);
+    if (program && cache_path) cache_store(cache_path, program, len, hash);
+    free(cache_path);
+    return program;
+}
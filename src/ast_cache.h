@@ -0,0 +1,19 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include "ast.h"
+
+// On-disk cache of parsed modules.  The AST of `foo.pre` is serialized to
+// `foo.prec` next to it, keyed by the source length and hash and by the
+// interpreter build; an entry that does not match is ignored and
+// rewritten.  The cache is best effort: unreadable or unwritable cache
+// files only cost a normal parse.
+
+// Parse `src` (`len` bytes read from `path`), loading the AST from the
+// cache when it is current and refreshing the cache otherwise.  The result
+// is resolved (and compiled for -vm) exactly like parser_parse() and owns
+// a fresh AST arena, as from parser_parse_source().  Returns NULL on a
+// parse error, with its position in *err_line / *err_col.
+Stmt* ast_cache_parse(const char* path, const char* src, size_t len, int* err_line, int* err_col);
+
+#endif // AST_CACHE_H
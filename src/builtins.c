@@ -2,7 +2,10 @@
 #include "interpreter.h"
 #include "lexer.h"
 #include "parser.h"
+#include "ast_cache.h"
 #include "extensions.h"
+#include "thread_pool.h"
+#include "simd.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -1468,7 +1471,7 @@ static void ser_value(JsonBuf* jb, SerCtx* ctx, Interpreter* interp, Value v) {
             jb_append_char(jb, '[');
             for (size_t i = 0; i < t->length; i++) {
                 if (i > 0) jb_append_char(jb, ',');
-                ser_value(jb, ctx, interp, t->data[i]);
+                ser_value(jb, ctx, interp, value_tns_elem(t, i));
             }
             jb_append_char(jb, ']');
             jb_append_char(jb, '}');
@@ -1476,6 +1479,7 @@ static void ser_value(JsonBuf* jb, SerCtx* ctx, Interpreter* interp, Value v) {
         }
         case VAL_MAP: {
             Map* m = v.as.map;
+            value_map_compact(m);
             jb_append_char(jb, '{');
             bool first = true;
             json_obj_field(jb, &first, "t");
@@ -1645,13 +1649,21 @@ typedef struct {
     EnvRegistry envs;
     FuncRegistry funcs;
     ThrRegistry thrs;
+    // Function and THR bodies rebuilt by one UNSER call share an AST arena,
+    // entered for the duration of the call.
+    AstArena* arena;
+    AstArena* previous_arena;
 } UnserCtx;
 
 static void unser_ctx_init(UnserCtx* ctx) {
     memset(ctx, 0, sizeof(*ctx));
+    ctx->arena = ast_arena_new();
+    ctx->previous_arena = ast_arena_enter(ctx->arena);
 }
 
 static void unser_ctx_free(UnserCtx* ctx) {
+    ast_arena_leave(ctx->previous_arena);
+    ast_arena_release(ctx->arena);
     for (size_t i = 0; i < ctx->envs.count; i++) free(ctx->envs.ids[i]);
     for (size_t i = 0; i < ctx->funcs.count; i++) free(ctx->funcs.ids[i]);
     for (size_t i = 0; i < ctx->thrs.count; i++) free(ctx->thrs.ids[i]);
@@ -1745,7 +1757,7 @@ static Expr* deser_default_expr(JsonValue* raw, UnserCtx* ctx, Interpreter* inte
     if (*err) return NULL;
     if (v.type == VAL_INT) return expr_int(v.as.i, 1, 1);
     if (v.type == VAL_FLT) return expr_flt(v.as.f, 1, 1);
-    if (v.type == VAL_STR) return expr_str(strdup(v.as.s ? v.as.s : ""), 1, 1);
+    if (v.type == VAL_STR) return expr_str(v.as.s ? v.as.s : "", 1, 1);
     return NULL;
 }
 
@@ -1774,7 +1786,7 @@ static Expr* deser_expr(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, cons
         }
         if (strcmp(lt, "STR") == 0) {
             const char* s = (val && val->type == JSON_STR) ? val->as.str : "";
-            return expr_str(strdup(s), line, col);
+            return expr_str(s, line, col);
         }
         return expr_int(0, line, col);
     }
@@ -1811,12 +1823,12 @@ static Expr* deser_expr(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, cons
     if (strcmp(name, "Identifier") == 0) {
         JsonValue* nm = json_obj_get(obj, "name");
         const char* s = (nm && nm->type == JSON_STR) ? nm->as.str : "";
-        return expr_ident(strdup(s), line, col);
+        return expr_ident(ast_strdup(s), line, col);
     }
     if (strcmp(name, "PointerExpression") == 0) {
         JsonValue* nm = json_obj_get(obj, "target");
         const char* s = (nm && nm->type == JSON_STR) ? nm->as.str : "";
-        return expr_ptr(strdup(s), line, col);
+        return expr_ptr(ast_strdup(s), line, col);
     }
     if (strcmp(name, "CallExpression") == 0) {
         Expr* callee = deser_expr(json_obj_get(obj, "callee"), ctx, interp, err);
@@ -1831,7 +1843,7 @@ static Expr* deser_expr(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, cons
                 Expr* arg = deser_expr(ex, ctx, interp, err);
                 if (*err) return call;
                 if (nm && nm->type == JSON_STR && nm->as.str && nm->as.str[0]) {
-                    call_kw_add(call, strdup(nm->as.str), arg);
+                    call_kw_add(call, ast_strdup(nm->as.str), arg);
                 } else {
                     expr_list_add(&call->as.call.args, arg);
                 }
@@ -1899,14 +1911,14 @@ static Stmt* deser_stmt(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, cons
             has_type = true;
         }
         Expr* ex = deser_expr(expr, ctx, interp, err);
-        return stmt_assign(has_type, dtype, strdup(tname), NULL, ex, line, col);
+        return stmt_assign(has_type, dtype, ast_strdup(tname), NULL, ex, line, col);
     }
     if (strcmp(name, "Declaration") == 0) {
         JsonValue* nm = json_obj_get(obj, "name");
         JsonValue* dt = json_obj_get(obj, "declared_type");
         const char* nms = (nm && nm->type == JSON_STR) ? nm->as.str : "";
         DeclType dtype = decl_type_from_name((dt && dt->type == JSON_STR) ? dt->as.str : NULL);
-        return stmt_decl(dtype, strdup(nms), line, col);
+        return stmt_decl(dtype, ast_strdup(nms), line, col);
     }
     if (strcmp(name, "ExpressionStatement") == 0) {
         Expr* ex = deser_expr(json_obj_get(obj, "expression"), ctx, interp, err);
@@ -1945,14 +1957,14 @@ static Stmt* deser_stmt(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, cons
         Expr* target = deser_expr(json_obj_get(obj, "target_expr"), ctx, interp, err);
         Stmt* block = deser_stmt(json_obj_get(obj, "block"), ctx, interp, err);
         const char* cnt = (counter && counter->type == JSON_STR) ? counter->as.str : "";
-        return stmt_for(strdup(cnt), target, block, line, col);
+        return stmt_for(ast_strdup(cnt), target, block, line, col);
     }
     if (strcmp(name, "ParForStatement") == 0) {
         JsonValue* counter = json_obj_get(obj, "counter");
         Expr* target = deser_expr(json_obj_get(obj, "target_expr"), ctx, interp, err);
         Stmt* block = deser_stmt(json_obj_get(obj, "block"), ctx, interp, err);
         const char* cnt = (counter && counter->type == JSON_STR) ? counter->as.str : "";
-        return stmt_parfor(strdup(cnt), target, block, line, col);
+        return stmt_parfor(ast_strdup(cnt), target, block, line, col);
     }
     if (strcmp(name, "FuncDef") == 0) {
         JsonValue* nm = json_obj_get(obj, "name");
@@ -1961,7 +1973,7 @@ static Stmt* deser_stmt(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, cons
         Stmt* body = deser_stmt(json_obj_get(obj, "body"), ctx, interp, err);
         const char* fn = (nm && nm->type == JSON_STR) ? nm->as.str : "";
         DeclType rt = decl_type_from_name((ret && ret->type == JSON_STR) ? ret->as.str : NULL);
-        Stmt* st = stmt_func(strdup(fn), rt, body, line, col);
+        Stmt* st = stmt_func(ast_strdup(fn), rt, body, line, col);
         if (params && params->type == JSON_ARR) {
             for (size_t i = 0; i < params->as.arr.count; i++) {
                 JsonValue* p = params->as.arr.items[i];
@@ -1970,7 +1982,7 @@ static Stmt* deser_stmt(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, cons
                 JsonValue* ptype = json_obj_get(p, "type");
                 JsonValue* pdef = json_obj_get(p, "default");
                 Param pr;
-                pr.name = strdup((pname && pname->type == JSON_STR) ? pname->as.str : "");
+                pr.name = ast_strdup((pname && pname->type == JSON_STR) ? pname->as.str : "");
                 pr.type = decl_type_from_name((ptype && ptype->type == JSON_STR) ? ptype->as.str : NULL);
                 pr.default_value = deser_default_expr(pdef, ctx, interp, err);
                 param_list_add(&st->as.func_stmt.params, pr);
@@ -1987,9 +1999,9 @@ static Stmt* deser_stmt(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, cons
         if (ex && ex->type == JSON_OBJ) {
             JsonValue* nm = json_obj_get(ex, "name");
             const char* name_s = (nm && nm->type == JSON_STR) ? nm->as.str : "";
-            return stmt_pop(strdup(name_s), line, col);
+            return stmt_pop(ast_strdup(name_s), line, col);
         }
-        return stmt_pop(strdup(""), line, col);
+        return stmt_pop(ast_strdup(""), line, col);
     }
     if (strcmp(name, "BreakStatement") == 0) {
         Expr* ex = deser_expr(json_obj_get(obj, "expression"), ctx, interp, err);
@@ -2014,14 +2026,14 @@ static Stmt* deser_stmt(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, cons
         JsonValue* sym = json_obj_get(obj, "symbol");
         const char* s = (sym && sym->type == JSON_STR) ? sym->as.str : "";
         Stmt* block = deser_stmt(json_obj_get(obj, "block"), ctx, interp, err);
-        return stmt_thr(strdup(s), block, line, col);
+        return stmt_thr(ast_strdup(s), block, line, col);
     }
     if (strcmp(name, "TryStatement") == 0) {
         Stmt* try_block = deser_stmt(json_obj_get(obj, "try_block"), ctx, interp, err);
         JsonValue* cs = json_obj_get(obj, "catch_symbol");
         const char* s = (cs && cs->type == JSON_STR) ? cs->as.str : NULL;
         Stmt* catch_block = deser_stmt(json_obj_get(obj, "catch_block"), ctx, interp, err);
-        return stmt_try(try_block, s ? strdup(s) : NULL, catch_block, line, col);
+        return stmt_try(try_block, s ? ast_strdup(s) : NULL, catch_block, line, col);
     }
     if (strcmp(name, "TensorSetStatement") == 0) {
         Expr* target = deser_expr(json_obj_get(obj, "target"), ctx, interp, err);
@@ -2117,6 +2129,18 @@ static Env* deser_env(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, const
     return env;
 }
 
+// Element type of a deserialized tensor item, for value_tns_from_values().
+static DeclType ser_elem_decl_type(Value v) {
+    switch (v.type) {
+        case VAL_INT: return TYPE_INT;
+        case VAL_FLT: return TYPE_FLT;
+        case VAL_STR: return TYPE_STR;
+        case VAL_TNS: return TYPE_TNS;
+        case VAL_FUNC: return TYPE_FUNC;
+        default: return TYPE_UNKNOWN;
+    }
+}
+
 static Value deser_val(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, const char** err) {
     if (!obj || obj->type != JSON_OBJ) { *err = "UNSER: invalid serialized form"; return value_null(); }
     JsonValue* t = json_obj_get(obj, "t");
@@ -2170,12 +2194,7 @@ static Value deser_val(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, const
         for (size_t i = 0; i < total; i++) {
             items[i] = deser_val(flat->as.arr.items[i], ctx, interp, err);
             if (*err) { free(shp); free(items); return value_null(); }
-            DeclType dt = TYPE_UNKNOWN;
-            if (items[i].type == VAL_INT) dt = TYPE_INT;
-            else if (items[i].type == VAL_FLT) dt = TYPE_FLT;
-            else if (items[i].type == VAL_STR) dt = TYPE_STR;
-            else if (items[i].type == VAL_TNS) dt = TYPE_TNS;
-            else if (items[i].type == VAL_FUNC) dt = TYPE_FUNC;
+            DeclType dt = ser_elem_decl_type(items[i]);
             if (i == 0) elem_type = dt;
             else if (elem_type != dt) elem_type = TYPE_UNKNOWN;
         }
@@ -2228,6 +2247,8 @@ static Value deser_val(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, const
             fn->name = strdup(name);
             fn->return_type = ret == TYPE_UNKNOWN ? TYPE_INT : ret;
             fn->body = stmt_block(1, 1);
+            fn->arena = ctx->arena;
+            ast_arena_retain(fn->arena);
             fn->closure = env_create(NULL);
             if (id) unser_func_set(ctx, id, fn);
 
@@ -2277,11 +2298,13 @@ static Value deser_val(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, const
         fn->name = strdup(nm_s);
         fn->return_type = TYPE_INT;
         fn->closure = env_create(NULL);
+        fn->arena = ctx->arena;
+        ast_arena_retain(fn->arena);
 
         Stmt* block = stmt_block(1, 1);
-        Expr* callee = expr_ident(strdup("THROW"), 1, 1);
+        Expr* callee = expr_ident(ast_strdup("THROW"), 1, 1);
         Expr* call = expr_call(callee, 1, 1);
-        Expr* arg = expr_str(strdup("UNSER: function not available"), 1, 1);
+        Expr* arg = expr_str("UNSER: function not available", 1, 1);
         expr_list_add(&call->as.call.args, arg);
         Stmt* exprs = stmt_expr(call, 1, 1);
         stmt_list_add(&block->as.block, exprs);
@@ -2303,11 +2326,10 @@ static Value deser_val(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, const
         value_thr_set_finished(thr, 1);
         value_thr_set_paused(thr, json_obj_get(obj, "paused") && json_obj_get(obj, "paused")->type == JSON_BOOL ? json_obj_get(obj, "paused")->as.boolean : 0);
         value_thr_set_started(thr, 0);
-        thr.as.thr->body = NULL;
         thr.as.thr->env = NULL;
         JsonValue* blk = json_obj_get(obj, "block");
         JsonValue* envv = json_obj_get(obj, "env");
-        if (blk && blk->type == JSON_OBJ) thr.as.thr->body = deser_stmt(blk, ctx, interp, err);
+        if (blk && blk->type == JSON_OBJ) value_thr_set_body(thr, deser_stmt(blk, ctx, interp, err));
         if (envv && envv->type == JSON_OBJ) thr.as.thr->env = deser_env(envv, ctx, interp, err);
         if (id) unser_thr_set(ctx, id, thr.as.thr);
         return thr;
@@ -2317,10 +2339,454 @@ static Value deser_val(JsonValue* obj, UnserCtx* ctx, Interpreter* interp, const
     return value_null();
 }
 
+// ---- BINARY SERIALIZATION ----
+// SER(obj, "binary") produces a STR holding raw bytes; every integer below
+// is little-endian.
+//
+//   header  "PREFXSER", u32 version (1), u32 0, u64 length of the body
+//   value   u8 tag, then
+//     'I'   zigzag LEB128 varint
+//     'F'   8-byte IEEE double
+//     'S'   varint ref: 0 is a new string (varint length, bytes), which is
+//           appended to the string table; k > 0 repeats table entry k - 1
+//     'T'   u8 storage (0 boxed, 1 INT, 2 FLT), varint ndim, varint
+//           shape[ndim]; packed storage is zero-padded to an 8-byte offset
+//           and followed by the elements as a raw int64 / double array,
+//           boxed storage by one value per element
+//     'M'   varint count, then count key / value pairs
+//     'J'   varint length and the JSON form of a FUNC, THR or other value
+//
+// Packed payloads are aligned to 8 bytes from the start of the header, so
+// a checkpoint read or mapped at an aligned address can be used in place.
+// FUNC and THR fragments share one SerCtx / UnserCtx, so their ids agree
+// across the whole value.
+
+#define BIN_SER_MAGIC "PREFXSER"
+#define BIN_SER_MAGIC_LEN 8
+#define BIN_SER_VERSION 1u
+#define BIN_SER_HEADER_LEN 24
+
+static bool bin_ser_host_le(void) {
+    const uint16_t one = 1;
+    unsigned char b;
+    memcpy(&b, &one, 1);
+    return b == 1;
+}
+
+typedef struct {
+    const char* s;
+    size_t index;
+} BinSerString;
+
+typedef struct {
+    JsonBuf out;
+    SerCtx ctx;
+    Interpreter* interp;
+    BinSerString* strs;     // open-addressed by value_str_hash; s == NULL is empty
+    size_t str_cap;         // power of two, or 0
+    size_t str_count;
+} BinSer;
+
+static void bs_put(BinSer* bs, const void* p, size_t n) {
+    jb_reserve(&bs->out, n);
+    memcpy(bs->out.data + bs->out.len, p, n);
+    bs->out.len += n;
+    bs->out.data[bs->out.len] = '\0';
+}
+
+static void bs_put_u8(BinSer* bs, unsigned char b) {
+    bs_put(bs, &b, 1);
+}
+
+static void bs_put_le(BinSer* bs, uint64_t v, int bytes) {
+    unsigned char b[8];
+    for (int i = 0; i < bytes; i++) b[i] = (unsigned char)(v >> (8 * i));
+    bs_put(bs, b, (size_t)bytes);
+}
+
+static void bs_put_varint(BinSer* bs, uint64_t v) {
+    unsigned char b[10];
+    int n = 0;
+    do {
+        unsigned char c = (unsigned char)(v & 0x7f);
+        v >>= 7;
+        b[n++] = (unsigned char)(c | (v ? 0x80 : 0));
+    } while (v);
+    bs_put(bs, b, (size_t)n);
+}
+
+static void bs_pad8(BinSer* bs) {
+    static const unsigned char zeros[8] = {0};
+    size_t rem = bs->out.len % 8;
+    if (rem) bs_put(bs, zeros, 8 - rem);
+}
+
+// Slot for `s` in the string table: its entry, or the empty slot to fill.
+static BinSerString* bs_string_slot(BinSer* bs, const char* s) {
+    size_t mask = bs->str_cap - 1;
+    size_t i = (size_t)value_str_hash(s) & mask;
+    while (bs->strs[i].s && !value_str_eq(bs->strs[i].s, s)) i = (i + 1) & mask;
+    return &bs->strs[i];
+}
+
+static void bs_string(BinSer* bs, const char* s) {
+    if ((bs->str_count + 1) * 2 > bs->str_cap) {
+        BinSerString* old = bs->strs;
+        size_t old_cap = bs->str_cap;
+        bs->str_cap = old_cap ? old_cap * 2 : 64;
+        bs->strs = calloc(bs->str_cap, sizeof(BinSerString));
+        if (!bs->strs) { fprintf(stderr, "Out of memory\n"); exit(1); }
+        for (size_t i = 0; i < old_cap; i++) {
+            if (old[i].s) *bs_string_slot(bs, old[i].s) = old[i];
+        }
+        free(old);
+    }
+    BinSerString* slot = bs_string_slot(bs, s);
+    if (slot->s) {
+        bs_put_varint(bs, (uint64_t)slot->index + 1);
+        return;
+    }
+    slot->s = s;
+    slot->index = bs->str_count++;
+    size_t len = value_str_len(s);
+    bs_put_varint(bs, 0);
+    bs_put_varint(bs, (uint64_t)len);
+    bs_put(bs, s, len);
+}
+
+static void bs_value(BinSer* bs, Value v) {
+    switch (v.type) {
+        case VAL_INT:
+            bs_put_u8(bs, 'I');
+            bs_put_varint(bs, ((uint64_t)v.as.i << 1) ^ (uint64_t)(v.as.i >> 63));
+            return;
+        case VAL_FLT: {
+            uint64_t bits;
+            memcpy(&bits, &v.as.f, sizeof(bits));
+            bs_put_u8(bs, 'F');
+            bs_put_le(bs, bits, 8);
+            return;
+        }
+        case VAL_STR:
+            bs_put_u8(bs, 'S');
+            bs_string(bs, v.as.s);
+            return;
+        case VAL_TNS: {
+            Tensor* t = v.as.tns;
+            unsigned char kind = t->storage == TNS_STORAGE_INT ? 1 : t->storage == TNS_STORAGE_FLT ? 2 : 0;
+            bs_put_u8(bs, 'T');
+            bs_put_u8(bs, kind);
+            bs_put_varint(bs, (uint64_t)t->ndim);
+            for (size_t i = 0; i < t->ndim; i++) bs_put_varint(bs, (uint64_t)t->shape[i]);
+            if (kind == 0) {
+                for (size_t i = 0; i < t->length; i++) bs_value(bs, value_tns_elem(t, i));
+                return;
+            }
+            bs_pad8(bs);
+            const void* raw = kind == 1 ? (const void*)t->ints : (const void*)t->flts;
+            if (!t->steps && bin_ser_host_le()) {
+                bs_put(bs, raw, t->length * 8);
+                return;
+            }
+            for (size_t i = 0; i < t->length; i++) {
+                Value e = value_tns_elem(t, i);
+                uint64_t bits;
+                if (kind == 1) bits = (uint64_t)e.as.i;
+                else memcpy(&bits, &e.as.f, sizeof(bits));
+                bs_put_le(bs, bits, 8);
+            }
+            return;
+        }
+        case VAL_MAP: {
+            Map* m = v.as.map;
+            value_map_compact(m);
+            bs_put_u8(bs, 'M');
+            bs_put_varint(bs, (uint64_t)m->count);
+            for (size_t i = 0; i < m->count; i++) {
+                bs_value(bs, m->items[i].key);
+                bs_value(bs, m->items[i].value);
+            }
+            return;
+        }
+        default: {
+            JsonBuf jb;
+            jb_init(&jb);
+            ser_value(&jb, &bs->ctx, bs->interp, v);
+            bs_put_u8(bs, 'J');
+            bs_put_varint(bs, (uint64_t)jb.len);
+            bs_put(bs, jb.data ? jb.data : "", jb.len);
+            jb_free(&jb);
+            return;
+        }
+    }
+}
+
+static Value bin_ser(Interpreter* interp, Value v) {
+    BinSer bs;
+    memset(&bs, 0, sizeof(bs));
+    jb_init(&bs.out);
+    ser_ctx_init(&bs.ctx);
+    bs.interp = interp;
+    bs_put(&bs, BIN_SER_MAGIC, BIN_SER_MAGIC_LEN);
+    bs_put_le(&bs, BIN_SER_VERSION, 4);
+    bs_put_le(&bs, 0, 4);
+    bs_put_le(&bs, 0, 8);   // body length, patched below
+    bs_value(&bs, v);
+    uint64_t body = (uint64_t)(bs.out.len - BIN_SER_HEADER_LEN);
+    for (int i = 0; i < 8; i++) bs.out.data[16 + i] = (char)(unsigned char)(body >> (8 * i));
+    Value out = value_str_n(bs.out.data, bs.out.len);
+    jb_free(&bs.out);
+    ser_ctx_free(&bs.ctx);
+    free(bs.strs);
+    return out;
+}
+
+typedef struct {
+    const unsigned char* p;
+    size_t len;
+    size_t pos;
+    UnserCtx ctx;
+    Interpreter* interp;
+    Value* strs;            // string table, in order of first appearance
+    size_t str_count;
+    size_t str_cap;
+    const char* err;
+} BinUnser;
+
+static bool bu_fail(BinUnser* bu) {
+    if (!bu->err) bu->err = "UNSER: invalid binary serialization";
+    return false;
+}
+
+static bool bu_u8(BinUnser* bu, unsigned char* out) {
+    if (bu->pos >= bu->len) return bu_fail(bu);
+    *out = bu->p[bu->pos++];
+    return true;
+}
+
+static bool bu_le(BinUnser* bu, int bytes, uint64_t* out) {
+    if (bu->len - bu->pos < (size_t)bytes) return bu_fail(bu);
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v |= (uint64_t)bu->p[bu->pos + (size_t)i] << (8 * i);
+    bu->pos += (size_t)bytes;
+    *out = v;
+    return true;
+}
+
+static bool bu_varint(BinUnser* bu, uint64_t* out) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char c;
+        if (!bu_u8(bu, &c)) return false;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) { *out = v; return true; }
+    }
+    return bu_fail(bu);
+}
+
+// A count of items that each take at least `min_bytes` more input.
+static bool bu_count(BinUnser* bu, size_t min_bytes, size_t* out) {
+    uint64_t v;
+    if (!bu_varint(bu, &v)) return false;
+    if (v > (uint64_t)(bu->len - bu->pos) / (min_bytes ? min_bytes : 1)) return bu_fail(bu);
+    *out = (size_t)v;
+    return true;
+}
+
+static Value bu_value(BinUnser* bu) {
+    unsigned char tag;
+    if (!bu_u8(bu, &tag)) return value_null();
+    switch (tag) {
+        case 'I': {
+            uint64_t u;
+            if (!bu_varint(bu, &u)) return value_null();
+            return value_int((int64_t)(u >> 1) ^ -(int64_t)(u & 1));
+        }
+        case 'F': {
+            uint64_t bits;
+            if (!bu_le(bu, 8, &bits)) return value_null();
+            double f;
+            memcpy(&f, &bits, sizeof(f));
+            return value_flt(f);
+        }
+        case 'S': {
+            uint64_t ref;
+            if (!bu_varint(bu, &ref)) return value_null();
+            if (ref > 0) {
+                if (ref > bu->str_count) { bu_fail(bu); return value_null(); }
+                return value_copy(bu->strs[ref - 1]);
+            }
+            size_t len;
+            if (!bu_count(bu, 1, &len)) return value_null();
+            Value s = value_str_n((const char*)bu->p + bu->pos, len);
+            bu->pos += len;
+            if (bu->str_count == bu->str_cap) {
+                size_t cap = bu->str_cap ? bu->str_cap * 2 : 64;
+                Value* grown = realloc(bu->strs, cap * sizeof(Value));
+                if (!grown) { fprintf(stderr, "Out of memory\n"); exit(1); }
+                bu->strs = grown;
+                bu->str_cap = cap;
+            }
+            bu->strs[bu->str_count++] = value_copy(s);
+            return s;
+        }
+        case 'T': {
+            unsigned char kind;
+            size_t ndim;
+            if (!bu_u8(bu, &kind) || kind > 2 || !bu_count(bu, 1, &ndim)) return value_null();
+            size_t* shape = malloc(sizeof(size_t) * (ndim > 0 ? ndim : 1));
+            if (!shape) { bu->err = "Out of memory"; return value_null(); }
+            size_t total = 1;
+            for (size_t i = 0; i < ndim; i++) {
+                uint64_t d;
+                if (!bu_varint(bu, &d) || (d && total > (uint64_t)SIZE_MAX / d)) {
+                    free(shape);
+                    bu_fail(bu);
+                    return value_null();
+                }
+                shape[i] = (size_t)d;
+                total *= (size_t)d;
+            }
+            if (kind == 0) {
+                if (total > bu->len - bu->pos) { free(shape); bu_fail(bu); return value_null(); }
+                Value* items = malloc(sizeof(Value) * (total > 0 ? total : 1));
+                if (!items) { free(shape); bu->err = "Out of memory"; return value_null(); }
+                DeclType elem_type = TYPE_UNKNOWN;
+                for (size_t i = 0; i < total; i++) {
+                    items[i] = bu_value(bu);
+                    if (bu->err) {
+                        for (size_t j = 0; j < i; j++) value_free(items[j]);
+                        free(items);
+                        free(shape);
+                        return value_null();
+                    }
+                    DeclType dt = ser_elem_decl_type(items[i]);
+                    if (i == 0) elem_type = dt;
+                    else if (elem_type != dt) elem_type = TYPE_UNKNOWN;
+                }
+                Value out = value_tns_from_values(elem_type, ndim, shape, items, total);
+                for (size_t i = 0; i < total; i++) value_free(items[i]);
+                free(items);
+                free(shape);
+                return out;
+            }
+            size_t pad = (8 - bu->pos % 8) % 8;
+            if (bu->len - bu->pos < pad || (bu->len - bu->pos - pad) / 8 < total) {
+                free(shape);
+                bu_fail(bu);
+                return value_null();
+            }
+            bu->pos += pad;
+            Value out = value_tns_new(kind == 1 ? TYPE_INT : TYPE_FLT, ndim, shape);
+            free(shape);
+            void* dst = kind == 1 ? (void*)out.as.tns->ints : (void*)out.as.tns->flts;
+            if (bin_ser_host_le()) {
+                if (total) memcpy(dst, bu->p + bu->pos, total * 8);
+                bu->pos += total * 8;
+            } else {
+                for (size_t i = 0; i < total; i++) {
+                    uint64_t bits;
+                    bu_le(bu, 8, &bits);
+                    memcpy((unsigned char*)dst + i * 8, &bits, 8);
+                }
+            }
+            return out;
+        }
+        case 'M': {
+            size_t count;
+            if (!bu_count(bu, 2, &count)) return value_null();
+            Value mv = value_map_new();
+            for (size_t i = 0; i < count; i++) {
+                Value k = bu_value(bu);
+                if (bu->err) { value_free(mv); return value_null(); }
+                if (!(k.type == VAL_INT || k.type == VAL_FLT || k.type == VAL_STR)) {
+                    value_free(k);
+                    value_free(mv);
+                    bu->err = "UNSER: invalid MAP key type";
+                    return value_null();
+                }
+                Value v = bu_value(bu);
+                if (bu->err) { value_free(k); value_free(mv); return value_null(); }
+                value_map_set(&mv, k, v);
+                value_free(k);
+                value_free(v);
+            }
+            return mv;
+        }
+        case 'J': {
+            size_t len;
+            if (!bu_count(bu, 1, &len)) return value_null();
+            char* text = malloc(len + 1);
+            if (!text) { bu->err = "Out of memory"; return value_null(); }
+            memcpy(text, bu->p + bu->pos, len);
+            text[len] = '\0';
+            bu->pos += len;
+            const char* jerr = NULL;
+            JsonValue* root = json_parse(text, &jerr);
+            free(text);
+            if (!root) { bu->err = "UNSER: invalid JSON"; return value_null(); }
+            Value out = deser_val(root, &bu->ctx, bu->interp, &bu->err);
+            json_free(root);
+            return out;
+        }
+        default:
+            bu_fail(bu);
+            return value_null();
+    }
+}
+
+static bool bin_ser_detect(const char* s) {
+    return value_str_len(s) >= BIN_SER_MAGIC_LEN && memcmp(s, BIN_SER_MAGIC, BIN_SER_MAGIC_LEN) == 0;
+}
+
+// Decode a binary SER string; on failure returns a null Value with *err set.
+static Value bin_unser(Interpreter* interp, const char* s, const char** err) {
+    BinUnser bu;
+    memset(&bu, 0, sizeof(bu));
+    bu.p = (const unsigned char*)s;
+    bu.len = value_str_len(s);
+    bu.pos = BIN_SER_MAGIC_LEN;
+    bu.interp = interp;
+    unser_ctx_init(&bu.ctx);
+    uint64_t version = 0, reserved = 0, body = 0;
+    Value out = value_null();
+    if (bu_le(&bu, 4, &version) && bu_le(&bu, 4, &reserved) && bu_le(&bu, 8, &body)) {
+        if (version != BIN_SER_VERSION) {
+            bu.err = "UNSER: unsupported binary serialization version";
+        } else if (body != bu.len - bu.pos) {
+            bu_fail(&bu);
+        } else {
+            out = bu_value(&bu);
+            if (!bu.err && bu.pos != bu.len) bu_fail(&bu);
+        }
+    }
+    for (size_t i = 0; i < bu.str_count; i++) value_free(bu.strs[i]);
+    free(bu.strs);
+    unser_ctx_free(&bu.ctx);
+    if (bu.err) {
+        value_free(out);
+        *err = bu.err;
+        return value_null();
+    }
+    return out;
+}
+
 static Value builtin_ser(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
-    if (argc != 1) {
-        RUNTIME_ERROR(interp, "SER expects 1 argument", line, col);
+    if (argc < 1 || argc > 2) {
+        RUNTIME_ERROR(interp, "SER expects 1 or 2 arguments", line, col);
+    }
+    if (argc >= 2) {
+        EXPECT_STR(args[1], "SER", interp, line, col);
+        char fmt[16];
+        size_t flen = strlen(args[1].as.s);
+        if (flen >= sizeof(fmt)) flen = sizeof(fmt) - 1;
+        for (size_t i = 0; i < flen; i++) fmt[i] = (char)tolower((unsigned char)args[1].as.s[i]);
+        fmt[flen] = '\0';
+        if (strcmp(fmt, "binary") == 0) return bin_ser(interp, args[0]);
+        if (strcmp(fmt, "json") != 0) {
+            RUNTIME_ERROR(interp, "SER format must be \"json\" or \"binary\"", line, col);
+        }
     }
     SerCtx ctx;
     ser_ctx_init(&ctx);
@@ -2340,6 +2806,14 @@ static Value builtin_unser(Interpreter* interp, Value* args, int argc, Expr** ar
     }
     EXPECT_STR(args[0], "UNSER", interp, line, col);
     const char* text = args[0].as.s ? args[0].as.s : "";
+    if (bin_ser_detect(text)) {
+        const char* berr = NULL;
+        Value out = bin_unser(interp, text, &berr);
+        if (berr) {
+            RUNTIME_ERROR(interp, berr, line, col);
+        }
+        return out;
+    }
     const char* jerr = NULL;
     JsonValue* root = json_parse(text, &jerr);
     if (!root) {
@@ -2646,6 +3120,36 @@ static Value builtin_fpow(Interpreter* interp, Value* args, int argc, Expr** arg
 
 // ============ Tensor elementwise operators ============
 
+// Run the SIMD kernel for `op` into `out`, which must be a fresh tensor
+// with the operands' storage.  Either operand may be a scalar (NULL tensor).
+// Returns false if the operands are not both packed with that storage and
+// flat (strided views take the element-wise path).
+static bool packed_elemwise(Value* out, Tensor* ta, Value a, Tensor* tb, Value b, int op, int* err) {
+    Tensor* ot = out->as.tns;
+    *err = 0;
+    if ((ta && ta->steps) || (tb && tb->steps)) return false;
+    if (ot->storage == TNS_STORAGE_INT) {
+        if ((ta && ta->storage != TNS_STORAGE_INT) || (tb && tb->storage != TNS_STORAGE_INT)) return false;
+        *err = simd_i64_binop((SimdOp)op, ta ? ta->ints : &a.as.i, ta ? 1 : 0, tb ? tb->ints : &b.as.i, tb ? 1 : 0, ot->ints, ot->length);
+        return true;
+    }
+    if (ot->storage == TNS_STORAGE_FLT) {
+        if ((ta && ta->storage != TNS_STORAGE_FLT) || (tb && tb->storage != TNS_STORAGE_FLT)) return false;
+        *err = simd_f64_binop((SimdOp)op, ta ? ta->flts : &a.as.f, ta ? 1 : 0, tb ? tb->flts : &b.as.f, tb ? 1 : 0, ot->flts, ot->length);
+        return true;
+    }
+    return false;
+}
+
+#define PACKED_ELEMWISE_OR_FALLTHROUGH(out, ta, a, tb, b, op, interp, line, col) do { \
+        int perr_; \
+        if (packed_elemwise(&(out), (ta), (a), (tb), (b), (op), &perr_)) { \
+            if (perr_ == 0) return (out); \
+            value_free(out); \
+            RUNTIME_ERROR((interp), perr_ == 1 ? "Division by zero" : "Negative exponent not supported", (line), (col)); \
+        } \
+    } while (0)
+
 // op: 0=add,1=sub,2=mul,3=div,4=pow
 static Value tensor_elemwise_op(Interpreter* interp, Value a, Value b, int op, int line, int col) {
     // Both tensors
@@ -2665,10 +3169,11 @@ static Value tensor_elemwise_op(Interpreter* interp, Value a, Value b, int op, i
         }
 
         Value out = value_tns_new(ta->elem_type, ta->ndim, ta->shape);
+        PACKED_ELEMWISE_OR_FALLTHROUGH(out, ta, a, tb, b, op, interp, line, col);
         Tensor* ot = out.as.tns;
         for (size_t i = 0; i < ta->length; i++) {
-            Value va = ta->data[i];
-            Value vb = tb->data[i];
+            Value va = value_tns_elem(ta, i);
+            Value vb = value_tns_elem(tb, i);
             // Only support numeric element types
             if (va.type != vb.type) {
                 value_free(out);
@@ -2677,12 +3182,12 @@ static Value tensor_elemwise_op(Interpreter* interp, Value a, Value b, int op, i
             if (va.type == VAL_INT) {
                 int64_t ra = va.as.i;
                 int64_t rb = vb.as.i;
-                if (op == 0) ot->data[i] = value_int(ra + rb);
-                else if (op == 1) ot->data[i] = value_int(ra - rb);
-                else if (op == 2) ot->data[i] = value_int(ra * rb);
+                if (op == 0) value_tns_set_elem(ot, i, value_int(ra + rb));
+                else if (op == 1) value_tns_set_elem(ot, i, value_int(ra - rb));
+                else if (op == 2) value_tns_set_elem(ot, i, value_int(ra * rb));
                 else if (op == 3) {
                     if (rb == 0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); }
-                    ot->data[i] = value_int(ra / rb);
+                    value_tns_set_elem(ot, i, value_int(ra / rb));
                 } else if (op == 4) {
                     if (rb < 0) { value_free(out); RUNTIME_ERROR(interp, "Negative exponent not supported", line, col); }
                     int64_t result = 1;
@@ -2693,23 +3198,23 @@ static Value tensor_elemwise_op(Interpreter* interp, Value a, Value b, int op, i
                         base *= base;
                         exp >>= 1;
                     }
-                    ot->data[i] = value_int(result);
+                    value_tns_set_elem(ot, i, value_int(result));
                 }
             } else if (va.type == VAL_FLT) {
                 double ra = va.as.f;
                 double rb = vb.as.f;
-                if (op == 0) ot->data[i] = value_flt(ra + rb);
-                else if (op == 1) ot->data[i] = value_flt(ra - rb);
-                else if (op == 2) ot->data[i] = value_flt(ra * rb);
+                if (op == 0) value_tns_set_elem(ot, i, value_flt(ra + rb));
+                else if (op == 1) value_tns_set_elem(ot, i, value_flt(ra - rb));
+                else if (op == 2) value_tns_set_elem(ot, i, value_flt(ra * rb));
                 else if (op == 3) {
                     if (rb == 0.0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); }
-                    ot->data[i] = value_flt(ra / rb);
+                    value_tns_set_elem(ot, i, value_flt(ra / rb));
                 } else if (op == 4) {
-                    ot->data[i] = value_flt(pow(ra, rb));
+                    value_tns_set_elem(ot, i, value_flt(pow(ra, rb)));
                 }
             } else if (va.type == VAL_TNS) {
                 // nested tensors: recurse
-                ot->data[i] = tensor_elemwise_op(interp, va, vb, op, line, col);
+                value_tns_set_elem(ot, i, tensor_elemwise_op(interp, va, vb, op, line, col));
             } else {
                 value_free(out);
                 RUNTIME_ERROR(interp, "T* operators only support numeric or nested tensor elements", line, col);
@@ -2726,27 +3231,28 @@ static Value tensor_elemwise_op(Interpreter* interp, Value a, Value b, int op, i
             RUNTIME_ERROR(interp, "Tensor element type and scalar type mismatch", line, col);
         }
         Value out = value_tns_new(ta->elem_type, ta->ndim, ta->shape);
+        PACKED_ELEMWISE_OR_FALLTHROUGH(out, ta, a, NULL, b, op, interp, line, col);
         Tensor* ot = out.as.tns;
         for (size_t i = 0; i < ta->length; i++) {
-            Value va = ta->data[i];
+            Value va = value_tns_elem(ta, i);
             if (va.type == VAL_INT) {
                 int64_t ra = va.as.i;
                 int64_t rb = b.as.i;
-                if (op == 0) ot->data[i] = value_int(ra + rb);
-                else if (op == 1) ot->data[i] = value_int(ra - rb);
-                else if (op == 2) ot->data[i] = value_int(ra * rb);
-                else if (op == 3) { if (rb == 0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); } ot->data[i] = value_int(ra / rb); }
-                else if (op == 4) { if (rb < 0) { value_free(out); RUNTIME_ERROR(interp, "Negative exponent not supported", line, col); } int64_t result = 1; int64_t base = ra; int64_t exp = rb; while (exp > 0) { if (exp & 1) result *= base; base *= base; exp >>= 1; } ot->data[i] = value_int(result); }
+                if (op == 0) value_tns_set_elem(ot, i, value_int(ra + rb));
+                else if (op == 1) value_tns_set_elem(ot, i, value_int(ra - rb));
+                else if (op == 2) value_tns_set_elem(ot, i, value_int(ra * rb));
+                else if (op == 3) { if (rb == 0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); } value_tns_set_elem(ot, i, value_int(ra / rb)); }
+                else if (op == 4) { if (rb < 0) { value_free(out); RUNTIME_ERROR(interp, "Negative exponent not supported", line, col); } int64_t result = 1; int64_t base = ra; int64_t exp = rb; while (exp > 0) { if (exp & 1) result *= base; base *= base; exp >>= 1; } value_tns_set_elem(ot, i, value_int(result)); }
             } else if (va.type == VAL_FLT) {
                 double ra = va.as.f;
                 double rb = b.as.f;
-                if (op == 0) ot->data[i] = value_flt(ra + rb);
-                else if (op == 1) ot->data[i] = value_flt(ra - rb);
-                else if (op == 2) ot->data[i] = value_flt(ra * rb);
-                else if (op == 3) { if (rb == 0.0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); } ot->data[i] = value_flt(ra / rb); }
-                else if (op == 4) ot->data[i] = value_flt(pow(ra, rb));
+                if (op == 0) value_tns_set_elem(ot, i, value_flt(ra + rb));
+                else if (op == 1) value_tns_set_elem(ot, i, value_flt(ra - rb));
+                else if (op == 2) value_tns_set_elem(ot, i, value_flt(ra * rb));
+                else if (op == 3) { if (rb == 0.0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); } value_tns_set_elem(ot, i, value_flt(ra / rb)); }
+                else if (op == 4) value_tns_set_elem(ot, i, value_flt(pow(ra, rb)));
             } else if (va.type == VAL_TNS) {
-                ot->data[i] = tensor_elemwise_op(interp, va, b, op, line, col);
+                value_tns_set_elem(ot, i, tensor_elemwise_op(interp, va, b, op, line, col));
             } else {
                 value_free(out);
                 RUNTIME_ERROR(interp, "Unsupported tensor element type for T*", line, col);
@@ -2763,27 +3269,28 @@ static Value tensor_elemwise_op(Interpreter* interp, Value a, Value b, int op, i
             RUNTIME_ERROR(interp, "Tensor element type and scalar type mismatch", line, col);
         }
         Value out = value_tns_new(tb->elem_type, tb->ndim, tb->shape);
+        PACKED_ELEMWISE_OR_FALLTHROUGH(out, NULL, a, tb, b, op, interp, line, col);
         Tensor* ot = out.as.tns;
         for (size_t i = 0; i < tb->length; i++) {
-            Value vb = tb->data[i];
+            Value vb = value_tns_elem(tb, i);
             if (vb.type == VAL_INT) {
                 int64_t ra = a.as.i;
                 int64_t rb = vb.as.i;
-                if (op == 0) ot->data[i] = value_int(ra + rb);
-                else if (op == 1) ot->data[i] = value_int(ra - rb);
-                else if (op == 2) ot->data[i] = value_int(ra * rb);
-                else if (op == 3) { if (rb == 0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); } ot->data[i] = value_int(ra / rb); }
-                else if (op == 4) { if (rb < 0) { value_free(out); RUNTIME_ERROR(interp, "Negative exponent not supported", line, col); } int64_t result = 1; int64_t base = ra; int64_t exp = rb; while (exp > 0) { if (exp & 1) result *= base; base *= base; exp >>= 1; } ot->data[i] = value_int(result); }
+                if (op == 0) value_tns_set_elem(ot, i, value_int(ra + rb));
+                else if (op == 1) value_tns_set_elem(ot, i, value_int(ra - rb));
+                else if (op == 2) value_tns_set_elem(ot, i, value_int(ra * rb));
+                else if (op == 3) { if (rb == 0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); } value_tns_set_elem(ot, i, value_int(ra / rb)); }
+                else if (op == 4) { if (rb < 0) { value_free(out); RUNTIME_ERROR(interp, "Negative exponent not supported", line, col); } int64_t result = 1; int64_t base = ra; int64_t exp = rb; while (exp > 0) { if (exp & 1) result *= base; base *= base; exp >>= 1; } value_tns_set_elem(ot, i, value_int(result)); }
             } else if (vb.type == VAL_FLT) {
                 double ra = a.as.f;
                 double rb = vb.as.f;
-                if (op == 0) ot->data[i] = value_flt(ra + rb);
-                else if (op == 1) ot->data[i] = value_flt(ra - rb);
-                else if (op == 2) ot->data[i] = value_flt(ra * rb);
-                else if (op == 3) { if (rb == 0.0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); } ot->data[i] = value_flt(ra / rb); }
-                else if (op == 4) ot->data[i] = value_flt(pow(ra, rb));
+                if (op == 0) value_tns_set_elem(ot, i, value_flt(ra + rb));
+                else if (op == 1) value_tns_set_elem(ot, i, value_flt(ra - rb));
+                else if (op == 2) value_tns_set_elem(ot, i, value_flt(ra * rb));
+                else if (op == 3) { if (rb == 0.0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); } value_tns_set_elem(ot, i, value_flt(ra / rb)); }
+                else if (op == 4) value_tns_set_elem(ot, i, value_flt(pow(ra, rb)));
             } else if (vb.type == VAL_TNS) {
-                ot->data[i] = tensor_elemwise_op(interp, a, vb, op, line, col);
+                value_tns_set_elem(ot, i, tensor_elemwise_op(interp, a, vb, op, line, col));
             } else {
                 value_free(out);
                 RUNTIME_ERROR(interp, "Unsupported tensor element type for scalar-left T*", line, col);
@@ -2839,6 +3346,247 @@ static Value builtin_shape(Interpreter* interp, Value* args, int argc, Expr** ar
     return out;
 }
 
+// Tensor kernels split into `count` independent items (CONV rows,
+// reduction blocks).  Jobs with less work than this, in element
+// operations, run on the calling thread: the pool hand-off would cost
+// more than it saves.
+#define TNS_PARALLEL_MIN_WORK 65536
+
+static void tns_parallel(size_t count, size_t work, ThreadPoolFn fn, void* ctx) {
+    if (count == 0) return;
+    if (count == 1 || work < TNS_PARALLEL_MIN_WORK || thread_pool_size() < 2) {
+        fn(ctx, 0, count);
+        return;
+    }
+    thread_pool_run(count, 0, fn, ctx);
+}
+
+// CONV kernels.  Both tensors are read as packed row-major buffers.  The
+// output is produced one row (run along the last dimension) at a time, in
+// tiles of CONV_TILE elements that stay in cache while every kernel tap
+// streams a clamped input row across them.  Each output element still
+// starts at 0 and accumulates the taps in row-major kernel order, so FLT
+// results match a straightforward per-element loop.
+#define CONV_MAX_DIMS 64
+#define CONV_TILE 1024
+
+typedef struct {
+    size_t ndim;
+    const size_t* shape;        // input and output shape
+    const size_t* strides;      // row-major strides of `shape`
+    const size_t* kshape;
+    size_t klength;
+    bool as_int;
+    const int64_t* xi;
+    const double* xf;
+    const int64_t* ki;
+    const double* kf;
+    int64_t* oi;
+    double* of;
+} ConvJob;
+
+static void conv_rows(void* arg, size_t begin, size_t end) {
+    ConvJob* job = (ConvJob*)arg;
+    size_t nd = job->ndim;
+    size_t len = job->shape[nd - 1];
+    size_t klen = job->kshape[nd - 1];
+    size_t kouter = job->klength / klen;
+    int64_t kc = (int64_t)(klen / 2);
+    size_t idx[CONV_MAX_DIMS];
+
+    for (size_t row = begin; row < end; row++) {
+        size_t rem = row;
+        for (size_t d = nd - 1; d-- > 0;) {
+            idx[d] = rem % job->shape[d];
+            rem /= job->shape[d];
+        }
+        size_t obase = row * len;
+        for (size_t t0 = 0; t0 < len; t0 += CONV_TILE) {
+            size_t t1 = len - t0 < CONV_TILE ? len : t0 + CONV_TILE;
+            if (job->as_int) memset(job->oi + obase + t0, 0, sizeof(int64_t) * (t1 - t0));
+            else memset(job->of + obase + t0, 0, sizeof(double) * (t1 - t0));
+
+            for (size_t ko = 0; ko < kouter; ko++) {
+                // Input row for this kernel row, clamped per dimension
+                // (replicate padding).
+                size_t krem = ko;
+                size_t ibase = 0;
+                for (size_t d = nd - 1; d-- > 0;) {
+                    size_t kd = krem % job->kshape[d];
+                    krem /= job->kshape[d];
+                    int64_t rel = (int64_t)idx[d] + (int64_t)kd - (int64_t)(job->kshape[d] / 2);
+                    if (rel < 0) rel = 0;
+                    if ((size_t)rel >= job->shape[d]) rel = (int64_t)job->shape[d] - 1;
+                    ibase += (size_t)rel * job->strides[d];
+                }
+
+                for (size_t kt = 0; kt < klen; kt++) {
+                    int64_t shift = (int64_t)kt - kc;
+                    // [lo, hi) reads in-range inputs; outside it the index clamps.
+                    int64_t lo64 = -shift > (int64_t)t0 ? -shift : (int64_t)t0;
+                    int64_t hi64 = (int64_t)len - shift < (int64_t)t1 ? (int64_t)len - shift : (int64_t)t1;
+                    size_t lo = (size_t)lo64;
+                    size_t hi = hi64 > lo64 ? (size_t)hi64 : lo;
+                    if (lo > t1) lo = t1;
+                    if (job->as_int) {
+                        uint64_t w = (uint64_t)job->ki[ko * klen + kt];
+                        const int64_t* in = job->xi + ibase;
+                        int64_t* out = job->oi + obase;
+                        for (size_t i = t0; i < lo; i++) out[i] = (int64_t)((uint64_t)out[i] + w * (uint64_t)in[0]);
+                        for (size_t i = lo; i < hi; i++) out[i] = (int64_t)((uint64_t)out[i] + w * (uint64_t)in[(int64_t)i + shift]);
+                        for (size_t i = hi > lo ? hi : lo; i < t1; i++) out[i] = (int64_t)((uint64_t)out[i] + w * (uint64_t)in[len - 1]);
+                    } else {
+                        double w = job->kf[ko * klen + kt];
+                        const double* in = job->xf + ibase;
+                        double* out = job->of + obase;
+                        for (size_t i = t0; i < lo; i++) out[i] += in[0] * w;
+                        for (size_t i = lo; i < hi; i++) out[i] += in[(int64_t)i + shift] * w;
+                        for (size_t i = hi > lo ? hi : lo; i < t1; i++) out[i] += in[len - 1] * w;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void conv_run(ConvJob* job, size_t length) {
+    size_t rows = length / job->shape[job->ndim - 1];
+    tns_parallel(rows, length * job->klength, conv_rows, job);
+}
+
+// Split a rank-1 (outer product) kernel into one vector per dimension,
+// stored back to back in `f` (sum of kshape entries).  The vectors are
+// the kernel's lines through its first non-zero element, all but the
+// first divided by that element; the split is used only when multiplying
+// them back reproduces every kernel element exactly (modulo 2^64 for
+// INT, where that is all the wrapping result depends on).
+static bool conv_separate(const ConvJob* job, int64_t* fi, double* ff) {
+    size_t nd = job->ndim;
+    size_t piv = 0;
+    while (piv < job->klength && (job->as_int ? job->ki[piv] == 0 : job->kf[piv] == 0.0)) piv++;
+    if (piv == job->klength) return false;
+
+    size_t pidx[CONV_MAX_DIMS];
+    size_t kstrides[CONV_MAX_DIMS];
+    size_t rem = piv, st = 1;
+    for (size_t d = nd; d-- > 0;) {
+        pidx[d] = rem % job->kshape[d];
+        rem /= job->kshape[d];
+        kstrides[d] = st;
+        st *= job->kshape[d];
+    }
+    int64_t pi = job->as_int ? job->ki[piv] : 0;
+    double pf = job->as_int ? 0.0 : job->kf[piv];
+    size_t off = 0;
+    for (size_t d = 0; d < nd; d++) {
+        for (size_t i = 0; i < job->kshape[d]; i++) {
+            size_t at = piv + i * kstrides[d] - pidx[d] * kstrides[d];
+            if (job->as_int) {
+                int64_t v = job->ki[at];
+                if (d > 0) {
+                    if (pi == -1 && v == INT64_MIN) return false;
+                    if (v % pi != 0) return false;
+                    v /= pi;
+                }
+                fi[off + i] = v;
+            } else {
+                ff[off + i] = d > 0 ? job->kf[at] / pf : job->kf[at];
+            }
+        }
+        off += job->kshape[d];
+    }
+
+    for (size_t k = 0; k < job->klength; k++) {
+        size_t krem = k;
+        uint64_t ip = 1;
+        double fp = 1.0;
+        size_t foff = off;
+        for (size_t d = nd; d-- > 0;) {
+            size_t kd = krem % job->kshape[d];
+            krem /= job->kshape[d];
+            foff -= job->kshape[d];
+            if (job->as_int) ip *= (uint64_t)fi[foff + kd];
+            else fp *= ff[foff + kd];
+        }
+        if (job->as_int ? (int64_t)ip != job->ki[k] : fp != job->kf[k]) return false;
+    }
+    return true;
+}
+
+// CONV with a separable kernel: one 1-D pass per dimension whose factor is
+// not just [1], alternating between `out` and a scratch buffer so the last
+// pass lands in `out`.  False on out of memory (nothing written).
+static bool conv_separable(ConvJob* job, size_t length, const int64_t* fi, const double* ff) {
+    size_t nd = job->ndim;
+    size_t passes = 0, off = 0;
+    size_t foffs[CONV_MAX_DIMS];
+    for (size_t d = 0; d < nd; d++) {
+        foffs[d] = off;
+        bool identity = job->kshape[d] == 1 && (job->as_int ? fi[off] == 1 : ff[off] == 1.0);
+        if (!identity) passes++;
+        off += job->kshape[d];
+    }
+    size_t esz = job->as_int ? sizeof(int64_t) : sizeof(double);
+    void* scratch = passes > 1 ? malloc(esz * length) : NULL;
+    if (passes > 1 && !scratch) return false;
+    if (passes == 0) {
+        // Every factor is [1]: the kernel is the identity.
+        if (job->as_int) memcpy(job->oi, job->xi, esz * length);
+        else memcpy(job->of, job->xf, esz * length);
+        return true;
+    }
+
+    ConvJob pass = *job;
+    size_t ones[CONV_MAX_DIMS];
+    for (size_t d = 0; d < nd; d++) ones[d] = 1;
+    pass.kshape = ones;
+    const void* src = job->as_int ? (const void*)job->xi : (const void*)job->xf;
+    size_t left = passes;
+    for (size_t d = 0; d < nd; d++) {
+        if (job->kshape[d] == 1 && (job->as_int ? fi[foffs[d]] == 1 : ff[foffs[d]] == 1.0)) continue;
+        void* dst = (left % 2 == 1) ? (job->as_int ? (void*)job->oi : (void*)job->of) : scratch;
+        ones[d] = job->kshape[d];
+        pass.klength = job->kshape[d];
+        pass.xi = (const int64_t*)src;
+        pass.xf = (const double*)src;
+        pass.ki = fi + foffs[d];
+        pass.kf = ff + foffs[d];
+        pass.oi = (int64_t*)dst;
+        pass.of = (double*)dst;
+        conv_run(&pass, length);
+        ones[d] = 1;
+        src = dst;
+        left--;
+    }
+    free(scratch);
+    return true;
+}
+
+// Packed view of a CONV operand in the accumulation type: the tensor's own
+// buffer when it already has that type, else a converted copy in *owned.
+static bool conv_operand(Value* slot, bool as_int, TnsBuffer* buf, void** owned, const void** data) {
+    *owned = NULL;
+    Tensor* t = slot->as.tns;
+    DeclType want = as_int ? TYPE_INT : TYPE_FLT;
+    if (t->elem_type == want && value_tns_acquire(slot, TNS_ACQUIRE_CONTIGUOUS, buf)) {
+        *data = as_int ? (const void*)buf->ints : (const void*)buf->flts;
+        return true;
+    }
+    memset(buf, 0, sizeof(*buf));
+    if (as_int) return false;
+    double* f = malloc(sizeof(double) * (t->length ? t->length : 1));
+    if (!f) return false;
+    for (size_t i = 0; i < t->length; i++) {
+        Value v = value_tns_elem(t, i);
+        if (v.type == VAL_FLT) f[i] = v.as.f;
+        else if (v.type == VAL_INT) f[i] = (double)v.as.i;
+        else { free(f); return false; }
+    }
+    *owned = f;
+    *data = f;
+    return true;
+}
+
 // CONV: N-D discrete convolution (two-argument backward-compatible form)
 // Usage: CONV(TNS: x, TNS: kernel) -> TNS (same shape as x)
 static Value builtin_conv(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
@@ -2865,79 +3613,67 @@ static Value builtin_conv(Interpreter* interp, Value* args, int argc, Expr** arg
     if (!((x->elem_type == TYPE_INT || x->elem_type == TYPE_FLT) && (k->elem_type == TYPE_INT || k->elem_type == TYPE_FLT))) {
         RUNTIME_ERROR(interp, "CONV only supports INT or FLT element types", line, col);
     }
+    if (x->ndim > CONV_MAX_DIMS) {
+        RUNTIME_ERROR(interp, "CONV: too many dimensions", line, col);
+    }
 
     // Output typing: INT only if both are INT, otherwise FLT
     DeclType out_decl = (x->elem_type == TYPE_INT && k->elem_type == TYPE_INT) ? TYPE_INT : TYPE_FLT;
+    bool as_int = out_decl == TYPE_INT;
 
     Value out = value_tns_new(out_decl, x->ndim, x->shape);
     Tensor* ot = out.as.tns;
-
-    // Precompute kernel centers
-    size_t* centers = malloc(sizeof(size_t) * k->ndim);
-    for (size_t d = 0; d < k->ndim; d++) centers[d] = k->shape[d] / 2;
-
-    // For each output position, compute convolution
-    for (size_t pos = 0; pos < x->length; pos++) {
-        // compute multi-index for pos
-        size_t rem = pos;
-        size_t idx[64]; // support up to 64 dims (practical)
-        if (x->ndim > 64) { free(centers); value_free(out); RUNTIME_ERROR(interp, "CONV: too many dimensions", line, col); }
-        for (size_t d = 0; d < x->ndim; d++) {
-            idx[d] = rem / x->strides[d];
-            rem = rem % x->strides[d];
-        }
-
-        if (out_decl == TYPE_INT) {
-            int64_t acc = 0;
-            for (size_t kpos = 0; kpos < k->length; kpos++) {
-                // kernel multi-index
-                size_t krem = kpos;
-                size_t kidx[64];
-                for (size_t d = 0; d < k->ndim; d++) {
-                    kidx[d] = krem / k->strides[d];
-                    krem = krem % k->strides[d];
-                }
-                // compute input index with replicate padding
-                size_t in_offset = 0;
-                for (size_t d = 0; d < x->ndim; d++) {
-                    int64_t rel = (int64_t)idx[d] + (int64_t)kidx[d] - (int64_t)centers[d];
-                    if (rel < 0) rel = 0;
-                    if ((size_t)rel >= x->shape[d]) rel = (int64_t)x->shape[d] - 1;
-                    in_offset += (size_t)rel * x->strides[d];
-                }
-                Value vx = x->data[in_offset];
-                Value vk = k->data[kpos];
-                if (vx.type != VAL_INT || vk.type != VAL_INT) { free(centers); value_free(out); RUNTIME_ERROR(interp, "CONV integer-mode requires INT elements", line, col); }
-                acc += vx.as.i * vk.as.i;
-            }
-            ot->data[pos] = value_int(acc);
-        } else {
-            double acc = 0.0;
-            for (size_t kpos = 0; kpos < k->length; kpos++) {
-                size_t krem = kpos;
-                size_t kidx[64];
-                for (size_t d = 0; d < k->ndim; d++) {
-                    kidx[d] = krem / k->strides[d];
-                    krem = krem % k->strides[d];
-                }
-                size_t in_offset = 0;
-                for (size_t d = 0; d < x->ndim; d++) {
-                    int64_t rel = (int64_t)idx[d] + (int64_t)kidx[d] - (int64_t)centers[d];
-                    if (rel < 0) rel = 0;
-                    if ((size_t)rel >= x->shape[d]) rel = (int64_t)x->shape[d] - 1;
-                    in_offset += (size_t)rel * x->strides[d];
-                }
-                Value vx = x->data[in_offset];
-                Value vk = k->data[kpos];
-                double aval = (vx.type == VAL_FLT) ? vx.as.f : (double)vx.as.i;
-                double kval = (vk.type == VAL_FLT) ? vk.as.f : (double)vk.as.i;
-                acc += aval * kval;
-            }
-            ot->data[pos] = value_flt(acc);
-        }
-    }
-
-    free(centers);
+    if (x->length == 0) return out;
+
+    TnsBuffer xb, kb;
+    void* xown = NULL;
+    void* kown = NULL;
+    const void* xdata = NULL;
+    const void* kdata = NULL;
+    if (!conv_operand(&args[0], as_int, &xb, &xown, &xdata)) {
+        value_free(out);
+        RUNTIME_ERROR(interp, as_int ? "CONV integer-mode requires INT elements" : "CONV only supports INT or FLT element types", line, col);
+    }
+    if (!conv_operand(&args[1], as_int, &kb, &kown, &kdata)) {
+        value_tns_release(&xb);
+        free(xown);
+        value_free(out);
+        RUNTIME_ERROR(interp, as_int ? "CONV integer-mode requires INT elements" : "CONV only supports INT or FLT element types", line, col);
+    }
+
+    ConvJob job;
+    memset(&job, 0, sizeof(job));
+    job.ndim = x->ndim;
+    job.shape = ot->shape;
+    job.strides = ot->strides;
+    job.kshape = k->shape;
+    job.klength = k->length;
+    job.as_int = as_int;
+    job.xi = (const int64_t*)xdata;
+    job.xf = (const double*)xdata;
+    job.ki = (const int64_t*)kdata;
+    job.kf = (const double*)kdata;
+    job.oi = ot->ints;
+    job.of = ot->flts;
+
+    // A rank-1 kernel needs sum(kshape) taps per element instead of
+    // prod(kshape).  FLT results then round once per pass.
+    size_t ksum = 0;
+    for (size_t d = 0; d < k->ndim; d++) ksum += k->shape[d];
+    bool done = false;
+    if (k->ndim > 1 && ksum < k->length) {
+        int64_t* fi = as_int ? malloc(sizeof(int64_t) * ksum) : NULL;
+        double* ff = as_int ? NULL : malloc(sizeof(double) * ksum);
+        if ((fi || ff) && conv_separate(&job, fi, ff)) done = conv_separable(&job, x->length, fi, ff);
+        free(fi);
+        free(ff);
+    }
+    if (!done) conv_run(&job, x->length);
+
+    value_tns_release(&xb);
+    value_tns_release(&kb);
+    free(xown);
+    free(kown);
     return out;
 }
 
@@ -2984,7 +3720,7 @@ static Value builtin_tflip(Interpreter* interp, Value* args, int argc, Expr** ar
             size_t flip_pos = (d == dim) ? (t->shape[d] - 1 - pos) : pos;
             dst_offset += flip_pos * t->strides[d];
         }
-        ot->data[dst_offset] = value_copy(t->data[src]);
+        value_tns_set_elem(ot, dst_offset, value_copy(value_tns_elem(t, src)));
     }
     return out;
 }
@@ -3001,7 +3737,7 @@ static Value builtin_fill(Interpreter* interp, Value* args, int argc, Expr** arg
     Value fill = args[1];
     // Ensure element runtime types match the fill value's type
     for (size_t i = 0; i < t->length; i++) {
-        if (t->data[i].type != fill.type) {
+        if (value_tns_elem(t, i).type != fill.type) {
             RUNTIME_ERROR(interp, "FILL value type must match existing tensor element types", line, col);
         }
     }
@@ -3009,7 +3745,7 @@ static Value builtin_fill(Interpreter* interp, Value* args, int argc, Expr** arg
     Value out = value_tns_new(t->elem_type, t->ndim, t->shape);
     Tensor* ot = out.as.tns;
     for (size_t i = 0; i < t->length; i++) {
-        ot->data[i] = value_copy(fill);
+        value_tns_set_elem(ot, i, value_copy(fill));
     }
     return out;
 }
@@ -3050,8 +3786,8 @@ static Value builtin_scat(Interpreter* interp, Value* args, int argc, Expr** arg
     for (size_t d = 0; d < rank; d++) {
         // index into ind: row d, col 0 and 1 -> linear index = d*ind->strides[0] + col*ind->strides[1]
         size_t base = d * ind->strides[0];
-        Value vlo = ind->data[base + 0 * ind->strides[1]];
-        Value vhi = ind->data[base + 1 * ind->strides[1]];
+        Value vlo = value_tns_elem(ind, base + 0 * ind->strides[1]);
+        Value vhi = value_tns_elem(ind, base + 1 * ind->strides[1]);
         if (vlo.type != VAL_INT || vhi.type != VAL_INT) {
             free(lo); free(hi);
             RUNTIME_ERROR(interp, "SCAT indices must be INT", line, col);
@@ -3096,9 +3832,9 @@ static Value builtin_scat(Interpreter* interp, Value* args, int argc, Expr** arg
             dst_offset += idx * dst->strides[d];
         }
         if (inside) {
-            ot->data[dst_offset] = value_copy(src->data[src_offset]);
+            value_tns_set_elem(ot, dst_offset, value_copy(value_tns_elem(src, src_offset)));
         } else {
-            ot->data[dst_offset] = value_copy(dst->data[dst_offset]);
+            value_tns_set_elem(ot, dst_offset, value_copy(value_tns_elem(dst, dst_offset)));
         }
     }
 
@@ -3130,32 +3866,33 @@ static Value builtin_mop(Interpreter* interp, Value* args, int argc, Expr** arg_
     }
 
     Value out = value_tns_new(ta->elem_type, ta->ndim, ta->shape);
+    PACKED_ELEMWISE_OR_FALLTHROUGH(out, ta, args[0], tb, args[1], op, interp, line, col);
     Tensor* ot = out.as.tns;
 
     for (size_t i = 0; i < ta->length; i++) {
-        Value va = ta->data[i];
-        Value vb = tb->data[i];
+        Value va = value_tns_elem(ta, i);
+        Value vb = value_tns_elem(tb, i);
         // Expect scalar numeric elements
         if (va.type != vb.type) { value_free(out); RUNTIME_ERROR(interp, "M* element type mismatch", line, col); }
         if (va.type == VAL_INT) {
             int64_t a = va.as.i;
             int64_t b = vb.as.i;
-            if (op == 0) ot->data[i] = value_int(a + b);
-            else if (op == 1) ot->data[i] = value_int(a - b);
-            else if (op == 2) ot->data[i] = value_int(a * b);
+            if (op == 0) value_tns_set_elem(ot, i, value_int(a + b));
+            else if (op == 1) value_tns_set_elem(ot, i, value_int(a - b));
+            else if (op == 2) value_tns_set_elem(ot, i, value_int(a * b));
             else if (op == 3) {
                 if (b == 0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); }
-                ot->data[i] = value_int(a / b);
+                value_tns_set_elem(ot, i, value_int(a / b));
             }
         } else if (va.type == VAL_FLT) {
             double a = va.as.f;
             double b = vb.as.f;
-            if (op == 0) ot->data[i] = value_flt(a + b);
-            else if (op == 1) ot->data[i] = value_flt(a - b);
-            else if (op == 2) ot->data[i] = value_flt(a * b);
+            if (op == 0) value_tns_set_elem(ot, i, value_flt(a + b));
+            else if (op == 1) value_tns_set_elem(ot, i, value_flt(a - b));
+            else if (op == 2) value_tns_set_elem(ot, i, value_flt(a * b));
             else if (op == 3) {
                 if (b == 0.0) { value_free(out); RUNTIME_ERROR(interp, "Division by zero", line, col); }
-                ot->data[i] = value_flt(a / b);
+                value_tns_set_elem(ot, i, value_flt(a / b));
             }
         } else {
             value_free(out);
@@ -3178,6 +3915,15 @@ static Value builtin_mdiv(Interpreter* interp, Value* args, int argc, Expr** arg
     return builtin_mop(interp, args, argc, arg_nodes, env, line, col, 3);
 }
 
+// True if every tensor argument uses the given packed storage, flat.
+static bool tensors_share_storage(Value* args, int argc, TnsStorage storage) {
+    if (storage == TNS_STORAGE_BOXED) return false;
+    for (int j = 0; j < argc; j++) {
+        if (args[j].as.tns->storage != storage || args[j].as.tns->steps) return false;
+    }
+    return true;
+}
+
 // MSUM: elementwise sum across N tensors
 static Value builtin_msum(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
@@ -3211,23 +3957,37 @@ static Value builtin_msum(Interpreter* interp, Value* args, int argc, Expr** arg
 
     Value out = value_tns_new(t0->elem_type, t0->ndim, t0->shape);
     Tensor* ot = out.as.tns;
+    if (tensors_share_storage(args, argc, ot->storage)) {
+        // Packed fast path: fold each operand buffer into the output
+        for (int j = 0; j < argc; j++) {
+            Tensor* tj = args[j].as.tns;
+            if (ot->storage == TNS_STORAGE_INT) {
+                if (j == 0) memcpy(ot->ints, tj->ints, sizeof(int64_t) * ot->length);
+                else simd_i64_binop(SIMD_OP_ADD, ot->ints, 1, tj->ints, 1, ot->ints, ot->length);
+            } else {
+                if (j == 0) memcpy(ot->flts, tj->flts, sizeof(double) * ot->length);
+                else simd_f64_binop(SIMD_OP_ADD, ot->flts, 1, tj->flts, 1, ot->flts, ot->length);
+            }
+        }
+        return out;
+    }
     for (size_t i = 0; i < t0->length; i++) {
         if (t0->elem_type == TYPE_INT) {
             int64_t acc = 0;
             for (int j = 0; j < argc; j++) {
-                Value v = args[j].as.tns->data[i];
+                Value v = value_tns_elem(args[j].as.tns, i);
                 if (v.type != VAL_INT) { value_free(out); RUNTIME_ERROR(interp, "MSUM element type mismatch", line, col); }
                 acc += v.as.i;
             }
-            ot->data[i] = value_int(acc);
+            value_tns_set_elem(ot, i, value_int(acc));
         } else {
             double acc = 0.0;
             for (int j = 0; j < argc; j++) {
-                Value v = args[j].as.tns->data[i];
+                Value v = value_tns_elem(args[j].as.tns, i);
                 if (v.type != VAL_FLT) { value_free(out); RUNTIME_ERROR(interp, "MSUM element type mismatch", line, col); }
                 acc += v.as.f;
             }
-            ot->data[i] = value_flt(acc);
+            value_tns_set_elem(ot, i, value_flt(acc));
         }
     }
     return out;
@@ -3265,23 +4025,37 @@ static Value builtin_mprod(Interpreter* interp, Value* args, int argc, Expr** ar
 
     Value out = value_tns_new(t0->elem_type, t0->ndim, t0->shape);
     Tensor* ot = out.as.tns;
+    if (tensors_share_storage(args, argc, ot->storage)) {
+        // Packed fast path: fold each operand buffer into the output
+        for (int j = 0; j < argc; j++) {
+            Tensor* tj = args[j].as.tns;
+            if (ot->storage == TNS_STORAGE_INT) {
+                if (j == 0) memcpy(ot->ints, tj->ints, sizeof(int64_t) * ot->length);
+                else simd_i64_binop(SIMD_OP_MUL, ot->ints, 1, tj->ints, 1, ot->ints, ot->length);
+            } else {
+                if (j == 0) memcpy(ot->flts, tj->flts, sizeof(double) * ot->length);
+                else simd_f64_binop(SIMD_OP_MUL, ot->flts, 1, tj->flts, 1, ot->flts, ot->length);
+            }
+        }
+        return out;
+    }
     for (size_t i = 0; i < t0->length; i++) {
         if (t0->elem_type == TYPE_INT) {
             int64_t acc = 1;
             for (int j = 0; j < argc; j++) {
-                Value v = args[j].as.tns->data[i];
+                Value v = value_tns_elem(args[j].as.tns, i);
                 if (v.type != VAL_INT) { value_free(out); RUNTIME_ERROR(interp, "MPROD element type mismatch", line, col); }
                 acc *= v.as.i;
             }
-            ot->data[i] = value_int(acc);
+            value_tns_set_elem(ot, i, value_int(acc));
         } else {
             double acc = 1.0;
             for (int j = 0; j < argc; j++) {
-                Value v = args[j].as.tns->data[i];
+                Value v = value_tns_elem(args[j].as.tns, i);
                 if (v.type != VAL_FLT) { value_free(out); RUNTIME_ERROR(interp, "MPROD element type mismatch", line, col); }
                 acc *= v.as.f;
             }
-            ot->data[i] = value_flt(acc);
+            value_tns_set_elem(ot, i, value_flt(acc));
         }
     }
     return out;
@@ -3548,7 +4322,7 @@ static int value_deep_eq_impl(Value a, Value b, EqSeenSet* seen) {
             return a.as.f == b.as.f ? 1 : 0;
         case VAL_STR:
             if (a.as.s == NULL || b.as.s == NULL) return (a.as.s == b.as.s) ? 1 : 0;
-            return strcmp(a.as.s, b.as.s) == 0 ? 1 : 0;
+            return value_str_eq(a.as.s, b.as.s) ? 1 : 0;
         case VAL_FUNC:
             return a.as.func == b.as.func ? 1 : 0;
         case VAL_TNS: {
@@ -3565,7 +4339,7 @@ static int value_deep_eq_impl(Value a, Value b, EqSeenSet* seen) {
             }
             if (ta->length != tb->length) return 0;
             for (size_t i = 0; i < ta->length; i++) {
-                if (!value_deep_eq_impl(ta->data[i], tb->data[i], seen)) return 0;
+                if (!value_deep_eq_impl(value_tns_elem(ta, i), value_tns_elem(tb, i), seen)) return 0;
             }
             return 1;
         }
@@ -3576,17 +4350,13 @@ static int value_deep_eq_impl(Value a, Value b, EqSeenSet* seen) {
             if (ma == mb) return 1;
             if (eq_seen_contains(seen, ma, mb, VAL_MAP)) return 1;
             eq_seen_add(seen, ma, mb, VAL_MAP);
+            value_map_compact(ma);
+            value_map_compact(mb);
             if (ma->count != mb->count) return 0;
             for (size_t i = 0; i < ma->count; i++) {
-                int found = 0;
-                for (size_t j = 0; j < mb->count; j++) {
-                    if (value_deep_eq_impl(ma->items[i].key, mb->items[j].key, seen)) {
-                        if (!value_deep_eq_impl(ma->items[i].value, mb->items[j].value, seen)) return 0;
-                        found = 1;
-                        break;
-                    }
-                }
-                if (!found) return 0;
+                const Value* other = value_map_elem(mb, ma->items[i].key);
+                if (!other) return 0;
+                if (!value_deep_eq_impl(ma->items[i].value, *other, seen)) return 0;
             }
             return 1;
         }
@@ -3950,30 +4720,32 @@ static Value builtin_bytes(Interpreter* interp, Value* args, int argc, Expr** ar
 static Value builtin_slen(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
     EXPECT_STR(args[0], "SLEN", interp, line, col);
-    return value_int((int64_t)strlen(args[0].as.s));
+    return value_int((int64_t)value_str_len(args[0].as.s));
 }
 
 static Value builtin_upper(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
     EXPECT_STR(args[0], "UPPER", interp, line, col);
-    char* s = strdup(args[0].as.s);
-    for (char* p = s; *p; p++) {
-        *p = (char)toupper((unsigned char)*p);
+    const char* src = args[0].as.s;
+    size_t len = value_str_len(src);
+    char* s;
+    Value v = value_str_alloc(len, &s);
+    for (size_t i = 0; i < len; i++) {
+        s[i] = (char)toupper((unsigned char)src[i]);
     }
-    Value v = value_str(s);
-    free(s);
     return v;
 }
 
 static Value builtin_lower(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
     EXPECT_STR(args[0], "LOWER", interp, line, col);
-    char* s = strdup(args[0].as.s);
-    for (char* p = s; *p; p++) {
-        *p = (char)tolower((unsigned char)*p);
+    const char* src = args[0].as.s;
+    size_t len = value_str_len(src);
+    char* s;
+    Value v = value_str_alloc(len, &s);
+    for (size_t i = 0; i < len; i++) {
+        s[i] = (char)tolower((unsigned char)src[i]);
     }
-    Value v = value_str(s);
-    free(s);
     return v;
 }
 
@@ -4060,28 +4832,27 @@ static Value builtin_join(Interpreter* interp, Value* args, int argc, Expr** arg
         // and join the remaining args with `sep` between them. Otherwise
         // simply concatenate all string arguments in order.
         const char* first_s = args[0].as.s;
-        size_t first_len = strlen(first_s);
+        size_t first_len = value_str_len(first_s);
         if (first_len == 1 && argc >= 3) {
-            const char* sep = first_s;
-            size_t sep_len = 1;
+            const char sep = first_s[0];
             // ensure following args are strings
             size_t total = 0;
             for (int i = 1; i < argc; ++i) {
                 if (args[i].type != VAL_STR) {
                     RUNTIME_ERROR(interp, "JOIN cannot mix integers and strings", line, col);
                 }
-                total += strlen(args[i].as.s);
-                if (i > 1) total += sep_len;
+                total += value_str_len(args[i].as.s);
+                if (i > 1) total += 1;
             }
-            char* out = malloc(total + 1);
-            if (!out) { RUNTIME_ERROR(interp, "Out of memory", line, col); }
-            out[0] = '\0';
+            char* out;
+            Value v = value_str_alloc(total, &out);
+            size_t pos = 0;
             for (int i = 1; i < argc; ++i) {
-                if (i > 1) strcat(out, sep);
-                strcat(out, args[i].as.s);
+                if (i > 1) out[pos++] = sep;
+                size_t n = value_str_len(args[i].as.s);
+                memcpy(out + pos, args[i].as.s, n);
+                pos += n;
             }
-            Value v = value_str(out);
-            free(out);
             return v;
         } else {
             // Concatenate all string arguments in order
@@ -4090,20 +4861,16 @@ static Value builtin_join(Interpreter* interp, Value* args, int argc, Expr** arg
                 if (args[i].type != VAL_STR) {
                     RUNTIME_ERROR(interp, "JOIN cannot mix integers and strings", line, col);
                 }
-                total += strlen(args[i].as.s);
+                total += value_str_len(args[i].as.s);
             }
-            char* out = malloc(total + 1);
-            if (!out) { RUNTIME_ERROR(interp, "Out of memory", line, col); }
+            char* out;
+            Value v = value_str_alloc(total, &out);
             size_t pos = 0;
             for (int i = 0; i < argc; ++i) {
-                const char* s = args[i].as.s;
-                size_t n = strlen(s);
-                memcpy(out + pos, s, n);
+                size_t n = value_str_len(args[i].as.s);
+                memcpy(out + pos, args[i].as.s, n);
                 pos += n;
             }
-            out[pos] = '\0';
-            Value v = value_str(out);
-            free(out);
             return v;
         }
     }
@@ -4200,12 +4967,8 @@ static Value builtin_split(Interpreter* interp, Value* args, int argc, Expr** ar
         char* found;
         while ((found = strstr(cur, sep)) != NULL) {
             size_t len = (size_t)(found - cur);
-            char* piece = malloc(len + 1);
-            memcpy(piece, cur, len);
-            piece[len] = '\0';
             if (count + 1 > cap) { cap *= 2; items = realloc(items, sizeof(Value) * cap); }
-            items[count++] = value_str(piece);
-            free(piece);
+            items[count++] = value_str_n(cur, len);
             cur = found + seplen;
         }
         // last piece
@@ -4260,7 +5023,7 @@ static Value builtin_in(Interpreter* interp, Value* args, int argc, Expr** arg_n
     if (!t || t->length == 0) return value_int(0);
 
     for (size_t i = 0; i < t->length; i++) {
-        if (value_deep_eq(args[0], t->data[i])) return value_int(1);
+        if (value_deep_eq(args[0], value_tns_elem(t, i))) return value_int(1);
     }
     return value_int(0);
 }
@@ -4391,23 +5154,22 @@ static Value builtin_import_path(Interpreter* interp, Value* args, int argc, Exp
 
                 env_assign(mod_env, "__MODULE_SOURCE__", value_str(cache_key), TYPE_STR, true);
 
-                Lexer lex;
-                lexer_init(&lex, srcbuf, found_path);
-                Parser parser;
-                parser_init(&parser, &lex);
-                Stmt* program = parser_parse(&parser);
-                if (parser.had_error) {
+                int parse_line = 0, parse_col = 0;
+                Stmt* program = ast_cache_parse(found_path, srcbuf, (size_t)len, &parse_line, &parse_col);
+                if (!program) {
                     free(srcbuf);
                     free(found_path);
                     free(canonical_path);
                     if (alias_dup) free(alias_dup);
                     interp->error = strdup("IMPORT_PATH: parse error");
-                    interp->error_line = parser.current_token.line;
-                    interp->error_col = parser.current_token.column;
+                    interp->error_line = parse_line;
+                    interp->error_col = parse_col;
                     return value_null();
                 }
 
                 ExecResult res = exec_program_in_env(interp, program, mod_env);
+                interpreter_forget_arena(interp, program->arena);
+                ast_arena_release(program->arena);
                 if (res.status == EXEC_ERROR) {
                     free(srcbuf);
                     free(found_path);
@@ -4512,7 +5274,7 @@ static Value builtin_slice(Interpreter* interp, Value* args, int argc, Expr** ar
         EXPECT_INT(args[1], "SLICE", interp, line, col);
         EXPECT_INT(args[2], "SLICE", interp, line, col);
         const char* s = args[0].as.s;
-        size_t len = strlen(s);
+        size_t len = value_str_len(s);
           /* Treat string slice arguments as start,end (first -> start, second -> end).
               This matches test usage where callers pass start then end positions. */
           int64_t start = args[1].as.i;
@@ -4531,13 +5293,8 @@ static Value builtin_slice(Interpreter* interp, Value* args, int argc, Expr** ar
           if (low_idx > high_idx) return value_str("");
 
         size_t result_len = (size_t)(high_idx - low_idx + 1);
-        char* result = malloc(result_len + 1);
-        if (!result) { RUNTIME_ERROR(interp, "Out of memory", line, col); }
-        memcpy(result, s + low_idx, result_len);
-        result[result_len] = '\0';
-        Value v = value_str(result);
-        free(result);
-        return v;
+        if (result_len == len) return value_copy(args[0]);
+        return value_str_n(s + low_idx, result_len);
     }
 
     RUNTIME_ERROR(interp, "SLICE expects INT or STR", line, col);
@@ -4553,12 +5310,12 @@ static Value builtin_replace(Interpreter* interp, Value* args, int argc, Expr**
     const char* needle = args[1].as.s;
     const char* replacement = args[2].as.s;
     
-    size_t needle_len = strlen(needle);
-    size_t repl_len = strlen(replacement);
-    size_t haystack_len = strlen(haystack);
+    size_t needle_len = value_str_len(needle);
+    size_t repl_len = value_str_len(replacement);
+    size_t haystack_len = value_str_len(haystack);
     
     if (needle_len == 0) {
-        return value_str(haystack);
+        return value_copy(args[0]);
     }
     
     // Count occurrences
@@ -4570,11 +5327,12 @@ static Value builtin_replace(Interpreter* interp, Value* args, int argc, Expr**
     }
     
     if (count == 0) {
-        return value_str(haystack);
+        return value_copy(args[0]);
     }
     
     size_t result_len = haystack_len + count * (repl_len - needle_len);
-    char* result = malloc(result_len + 1);
+    char* result;
+    Value v = value_str_alloc(result_len, &result);
     char* dst = result;
     p = haystack;
     const char* prev = haystack;
@@ -4587,10 +5345,8 @@ static Value builtin_replace(Interpreter* interp, Value* args, int argc, Expr**
         dst += repl_len;
         prev = p + needle_len;
     }
-    strcpy(dst, prev);
+    memcpy(dst, prev, haystack_len - (size_t)(prev - haystack));
     
-    Value v = value_str(result);
-    free(result);
     return v;
 }
 
@@ -4601,7 +5357,7 @@ static Value builtin_strip(Interpreter* interp, Value* args, int argc, Expr** ar
     
     const char* s = args[0].as.s;
     const char* chars = args[1].as.s;
-    size_t len = strlen(s);
+    size_t len = value_str_len(s);
     
     // Find start
     size_t start = 0;
@@ -4615,14 +5371,8 @@ static Value builtin_strip(Interpreter* interp, Value* args, int argc, Expr** ar
         end--;
     }
     
-    size_t result_len = end - start;
-    char* result = malloc(result_len + 1);
-    memcpy(result, s + start, result_len);
-    result[result_len] = '\0';
-    
-    Value v = value_str(result);
-    free(result);
-    return v;
+    if (start == 0 && end == len) return value_copy(args[0]);
+    return value_str_n(s + start, end - start);
 }
 
 // ============ I/O operations ============
@@ -4735,7 +5485,86 @@ static Value builtin_cl(Interpreter* interp, Value* args, int argc, Expr** arg_n
     return value_int(rc);
 }
 
-// READFILE(STR: path, STR: coding = "UTF-8"):STR
+// Files are streamed through a stack buffer of this many bytes, so no
+// builtin below holds more than one copy of a file's contents.
+#define FILE_IO_CHUNK 16384
+// stdio buffer given to each OPENFILE handle.
+#define FILE_HANDLE_BUFFER 65536
+
+// Lowercase `coding` into `out` (a 64-byte buffer), truncating.
+static void file_coding_lower(const char* coding, char out[64]) {
+    size_t clen = strlen(coding);
+    if (clen >= 64) clen = 63;
+    for (size_t i = 0; i < clen; i++) out[i] = (char)tolower((unsigned char)coding[i]);
+    out[clen] = '\0';
+}
+
+static bool file_coding_is_bytes(const char* codelb) {
+    return strcmp(codelb, "bytes") == 0 || strcmp(codelb, "raw") == 0;
+}
+
+// fread until `n` bytes or end of file; returns the count read.
+static size_t file_read_full(FILE* f, void* dst, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        size_t got = fread((unsigned char*)dst + done, 1, n - done, f);
+        if (got == 0) break;
+        done += got;
+    }
+    return done;
+}
+
+// Read up to `n` bytes of `f` into a new 1-D INT tensor of byte values.
+// The tensor is shorter than `n` when the file ends first.
+static Value file_read_bytes(FILE* f, size_t n) {
+    Value out = value_tns_new(TYPE_INT, 1, &n);
+    int64_t* dst = out.as.tns->ints;
+    unsigned char chunk[FILE_IO_CHUNK];
+    size_t done = 0;
+    while (done < n) {
+        size_t want = n - done < sizeof(chunk) ? n - done : sizeof(chunk);
+        size_t got = fread(chunk, 1, want, f);
+        for (size_t i = 0; i < got; i++) dst[done + i] = chunk[i];
+        done += got;
+        if (got < want) break;
+    }
+    if (done < n) {
+        Value shorter = value_tns_new(TYPE_INT, 1, &done);
+        if (done > 0) memcpy(shorter.as.tns->ints, dst, done * sizeof(int64_t));
+        value_free(out);
+        out = shorter;
+    }
+    return out;
+}
+
+// Write the elements of `t` (INTs in 0..255) to `f`.  Returns the number
+// of bytes written, or -1 when an element is not a byte.
+static int64_t file_write_bytes(FILE* f, const Tensor* t) {
+    unsigned char chunk[FILE_IO_CHUNK];
+    bool packed = t->storage == TNS_STORAGE_INT && !t->steps;
+    size_t done = 0;
+    while (done < t->length) {
+        size_t n = t->length - done < sizeof(chunk) ? t->length - done : sizeof(chunk);
+        for (size_t i = 0; i < n; i++) {
+            int64_t b;
+            if (packed) {
+                b = t->ints[done + i];
+            } else {
+                Value e = value_tns_elem(t, done + i);
+                if (e.type != VAL_INT) return -1;
+                b = e.as.i;
+            }
+            if (b < 0 || b > 255) return -1;
+            chunk[i] = (unsigned char)b;
+        }
+        size_t put = fwrite(chunk, 1, n, f);
+        done += put;
+        if (put < n) break;
+    }
+    return (int64_t)done;
+}
+
+// READFILE(STR: path, STR: coding = "UTF-8"):STR|TNS
 static Value builtin_readfile(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
     if (argc < 1) {
@@ -4750,10 +5579,7 @@ static Value builtin_readfile(Interpreter* interp, Value* args, int argc, Expr**
 
     // normalize coding to lowercase
     char codelb[64];
-    size_t clen = strlen(coding);
-    if (clen >= sizeof(codelb)) clen = sizeof(codelb)-1;
-    for (size_t i = 0; i < clen; i++) codelb[i] = (char)tolower((unsigned char)coding[i]);
-    codelb[clen] = '\0';
+    file_coding_lower(coding, codelb);
 
     FILE* f = fopen(args[0].as.s, "rb");
     if (!f) {
@@ -4763,91 +5589,137 @@ static Value builtin_readfile(Interpreter* interp, Value* args, int argc, Expr**
     long sz = ftell(f);
     if (sz < 0) { fclose(f); RUNTIME_ERROR(interp, "READFILE: ftell failed", line, col); }
     rewind(f);
-    unsigned char* buf = malloc((size_t)sz + 1);
-    if (!buf) { fclose(f); RUNTIME_ERROR(interp, "Out of memory", line, col); }
-    size_t got = fread(buf, 1, (size_t)sz, f);
-    fclose(f);
-    (void)got; // allow binary files smaller than reported on some platforms
+    size_t n = (size_t)sz;
+
+    // bytes -> 1-D INT tensor of byte values
+    if (file_coding_is_bytes(codelb)) {
+        Value v = file_read_bytes(f, n);
+        fclose(f);
+        return v;
+    }
 
     // binary -> return bitstring
     if (strcmp(codelb, "binary") == 0 || strcmp(codelb, "bin") == 0) {
-        // each byte -> 8 chars
-        size_t outlen = (size_t)sz * 8;
-        char* out = malloc(outlen + 1);
-        if (!out) { free(buf); RUNTIME_ERROR(interp, "Out of memory", line, col); }
-        size_t p = 0;
-        for (size_t i = 0; i < (size_t)sz; i++) {
-            unsigned char b = buf[i];
-            for (int bit = 7; bit >= 0; bit--) {
-                out[p++] = ((b >> bit) & 1) ? '1' : '0';
-            }
-        }
-        out[p] = '\0';
-        free(buf);
-        Value v = value_str(out);
-        free(out);
+        // each byte -> 8 chars, encoded chunk by chunk into the result
+        char* out;
+        Value v = value_str_alloc(n * 8, &out);
+        unsigned char chunk[FILE_IO_CHUNK];
+        size_t done = 0;
+        while (done < n) {
+            size_t got = fread(chunk, 1, n - done < sizeof(chunk) ? n - done : sizeof(chunk), f);
+            if (got == 0) break;
+            for (size_t i = 0; i < got; i++) {
+                unsigned char b = chunk[i];
+                char* p = out + (done + i) * 8;
+                for (int bit = 7; bit >= 0; bit--) {
+                    *p++ = ((b >> bit) & 1) ? '1' : '0';
+                }
+            }
+            done += got;
+        }
+        fclose(f);
+        if (done < n) {
+            Value shorter = value_str_n(out, done * 8);
+            value_free(v);
+            v = shorter;
+        }
         return v;
     }
 
     // hex -> lowercase hex string
     if (strcmp(codelb, "hex") == 0 || strcmp(codelb, "hexadecimal") == 0) {
         static const char* hex = "0123456789abcdef";
-        size_t outlen = (size_t)sz * 2;
-        char* out = malloc(outlen + 1);
-        if (!out) { free(buf); RUNTIME_ERROR(interp, "Out of memory", line, col); }
-        size_t p = 0;
-        for (size_t i = 0; i < (size_t)sz; i++) {
-            unsigned char b = buf[i];
-            out[p++] = hex[(b >> 4) & 0xf];
-            out[p++] = hex[b & 0xf];
-        }
-        out[p] = '\0';
-        free(buf);
-        Value v = value_str(out);
-        free(out);
+        char* out;
+        Value v = value_str_alloc(n * 2, &out);
+        unsigned char chunk[FILE_IO_CHUNK];
+        size_t done = 0;
+        while (done < n) {
+            size_t got = fread(chunk, 1, n - done < sizeof(chunk) ? n - done : sizeof(chunk), f);
+            if (got == 0) break;
+            for (size_t i = 0; i < got; i++) {
+                unsigned char b = chunk[i];
+                out[(done + i) * 2] = hex[(b >> 4) & 0xf];
+                out[(done + i) * 2 + 1] = hex[b & 0xf];
+            }
+            done += got;
+        }
+        fclose(f);
+        if (done < n) {
+            Value shorter = value_str_n(out, done * 2);
+            value_free(v);
+            v = shorter;
+        }
         return v;
     }
 
     // Text modes: handle UTF-8 BOM strip
     size_t start = 0;
-    if ((strcmp(codelb, "utf-8-bom") == 0 || strcmp(codelb, "utf-8 bom") == 0) && sz >= 3) {
-        if (buf[0] == 0xEF && buf[1] == 0xBB && buf[2] == 0xBF) start = 3;
-    } else if (strcmp(codelb, "utf-8") == 0 && sz >= 3) {
-        if (buf[0] == 0xEF && buf[1] == 0xBB && buf[2] == 0xBF) start = 3;
+    if ((strcmp(codelb, "utf-8-bom") == 0 || strcmp(codelb, "utf-8 bom") == 0 || strcmp(codelb, "utf-8") == 0) && n >= 3) {
+        unsigned char head[3];
+        if (file_read_full(f, head, 3) == 3 && head[0] == 0xEF && head[1] == 0xBB && head[2] == 0xBF) {
+            start = 3;
+        } else {
+            rewind(f);
+        }
     }
 
     // For other encodings (ANSI, UTF-16 LE/BE) we fall back to returning raw bytes as-is.
-    size_t tlen = (size_t)sz - start;
-    char* out = malloc(tlen + 1);
-    if (!out) { free(buf); RUNTIME_ERROR(interp, "Out of memory", line, col); }
-    memcpy(out, buf + start, tlen);
-    out[tlen] = '\0';
-    free(buf);
-    Value v = value_str(out);
-    free(out);
+    // The file is read straight into the result string, NUL bytes included,
+    // so binary SER checkpoints round-trip through WRITEFILE / READFILE.
+    size_t tlen = n - start;
+    char* out;
+    Value v = value_str_alloc(tlen, &out);
+    size_t got = file_read_full(f, out, tlen);
+    fclose(f);
+    if (got < tlen) {
+        Value shorter = value_str_n(out, got);
+        value_free(v);
+        v = shorter;
+    }
     return v;
 }
 
-// WRITEFILE(STR: blob, STR: path, STR: coding = "UTF-8"):INT
+// WRITEFILE(STR|TNS: blob, STR: path, STR: coding = "UTF-8", INT: append = 0):INT
 static Value builtin_writefile(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
     if (argc < 2) {
         RUNTIME_ERROR(interp, "WRITEFILE expects at least 2 arguments", line, col);
     }
-    EXPECT_STR(args[0], "WRITEFILE", interp, line, col);
     EXPECT_STR(args[1], "WRITEFILE", interp, line, col);
     const char* coding = "utf-8";
     if (argc >= 3) {
         EXPECT_STR(args[2], "WRITEFILE", interp, line, col);
         coding = args[2].as.s;
     }
+    bool append = false;
+    if (argc >= 4) {
+        EXPECT_INT(args[3], "WRITEFILE", interp, line, col);
+        append = args[3].as.i != 0;
+    }
+    const char* fmode = append ? "ab" : "wb";
     // normalize
     char codelb[64];
-    size_t clen = strlen(coding);
-    if (clen >= sizeof(codelb)) clen = sizeof(codelb)-1;
-    for (size_t i = 0; i < clen; i++) codelb[i] = (char)tolower((unsigned char)coding[i]);
-    codelb[clen] = '\0';
+    file_coding_lower(coding, codelb);
+
+    // bytes: a 1-D INT tensor of byte values
+    if (file_coding_is_bytes(codelb)) {
+        if (args[0].type != VAL_TNS) {
+            RUNTIME_ERROR(interp, "WRITEFILE(bytes) expects TNS of INT byte values", line, col);
+        }
+        FILE* f = fopen(args[1].as.s, fmode);
+        if (!f) {
+            fprintf(stderr, "WRITEFILE: cannot open '%s' for writing: %s\n", args[1].as.s, strerror(errno));
+            return value_int(0);
+        }
+        int64_t put = file_write_bytes(f, args[0].as.tns);
+        fclose(f);
+        if (put < 0) {
+            RUNTIME_ERROR(interp, "WRITEFILE(bytes) expects INT values in 0..255", line, col);
+        }
+        return value_int((size_t)put == args[0].as.tns->length ? 1 : 0);
+    }
 
+    EXPECT_STR(args[0], "WRITEFILE", interp, line, col);
     const char* blob = args[0].as.s ? args[0].as.s : "";
 
     // binary
@@ -4856,7 +5728,7 @@ static Value builtin_writefile(Interpreter* interp, Value* args, int argc, Expr*
         if (blen % 8 != 0) {
             RUNTIME_ERROR(interp, "WRITEFILE(binary) expects bitstring length multiple of 8", line, col);
         }
-        FILE* f = fopen(args[1].as.s, "wb");
+        FILE* f = fopen(args[1].as.s, fmode);
         if (!f) {
             fprintf(stderr, "WRITEFILE: cannot open '%s' for writing: %s\n", args[1].as.s, strerror(errno));
             return value_int(0);
@@ -4878,7 +5750,7 @@ static Value builtin_writefile(Interpreter* interp, Value* args, int argc, Expr*
     if (strcmp(codelb, "hex") == 0 || strcmp(codelb, "hexadecimal") == 0) {
         size_t blen = strlen(blob);
         if (blen % 2 != 0) RUNTIME_ERROR(interp, "WRITEFILE(hex) expects even-length hex string", line, col);
-        FILE* f = fopen(args[1].as.s, "wb");
+        FILE* f = fopen(args[1].as.s, fmode);
         if (!f) {
             fprintf(stderr, "WRITEFILE: cannot open '%s' for writing: %s\n", args[1].as.s, strerror(errno));
             return value_int(0);
@@ -4896,21 +5768,22 @@ static Value builtin_writefile(Interpreter* interp, Value* args, int argc, Expr*
     }
 
     // Text encodings: write raw bytes; for utf-8-bom emit BOM
-    FILE* f = fopen(args[1].as.s, "wb");
+    FILE* f = fopen(args[1].as.s, fmode);
     if (!f) {
         // Try text mode as a fallback (may succeed on some platforms)
-        fprintf(stderr, "WRITEFILE: open('%s','wb') failed: %s; trying text mode...\n", args[1].as.s, strerror(errno));
-        f = fopen(args[1].as.s, "w");
+        fprintf(stderr, "WRITEFILE: open('%s','%s') failed: %s; trying text mode...\n", args[1].as.s, fmode, strerror(errno));
+        f = fopen(args[1].as.s, append ? "a" : "w");
         if (!f) {
             fprintf(stderr, "WRITEFILE: cannot open '%s' for writing: %s\n", args[1].as.s, strerror(errno));
             return value_int(0);
         }
     }
-    if (strcmp(codelb, "utf-8-bom") == 0 || strcmp(codelb, "utf-8 bom") == 0) {
+    // An appended chunk continues the file, so only a fresh file gets a BOM.
+    if (!append && (strcmp(codelb, "utf-8-bom") == 0 || strcmp(codelb, "utf-8 bom") == 0)) {
         unsigned char bom[3] = {0xEF,0xBB,0xBF};
         if (fwrite(bom, 1, 3, f) != 3) { fclose(f); return value_int(0); }
     }
-    size_t towrite = strlen(blob);
+    size_t towrite = args[0].as.s ? value_str_len(blob) : 0;
     if (towrite > 0) {
         if (fwrite(blob, 1, towrite, f) != towrite) { fclose(f); return value_int(0); }
     }
@@ -4918,6 +5791,241 @@ static Value builtin_writefile(Interpreter* interp, Value* args, int argc, Expr*
     return value_int(1);
 }
 
+// ---- File handles ----
+// OPENFILE returns handle h, which names slot h - 1 of g_files; CLOSEFILE
+// empties the slot for reuse.  g_files_lock only guards the table and the
+// handles' reference counts, so it is never held across I/O.  Each handle
+// has its own lock, held for the whole of one operation on it: a read
+// blocked on one pipe or slow file stalls only that handle.
+
+typedef struct FileHandle {
+    FILE* f;       // NULL once closed
+    mtx_t lock;    // held for each operation on f
+    size_t refs;   // table slot plus operations in flight, under g_files_lock
+} FileHandle;
+
+static FileHandle** g_files = NULL;
+static size_t g_file_count = 0;
+static mtx_t g_files_lock;
+
+static void file_handle_release(FileHandle* h) {
+    mtx_lock(&g_files_lock);
+    bool last = --h->refs == 0;
+    mtx_unlock(&g_files_lock);
+    if (last) {
+        mtx_destroy(&h->lock);
+        free(h);
+    }
+}
+
+// Look up handle `v` and return it with its lock held (release with
+// file_handle_done); NULL if it is not open.  A CLOSEFILE that wins the
+// race leaves the handle with f == NULL, which counts as not open.
+static FileHandle* file_handle_acquire(Value v) {
+    FileHandle* h = NULL;
+    mtx_lock(&g_files_lock);
+    if (v.type == VAL_INT && v.as.i >= 1 && (uint64_t)v.as.i <= g_file_count) {
+        h = g_files[v.as.i - 1];
+        if (h) h->refs++;
+    }
+    mtx_unlock(&g_files_lock);
+    if (!h) return NULL;
+    mtx_lock(&h->lock);
+    if (!h->f) {
+        mtx_unlock(&h->lock);
+        file_handle_release(h);
+        return NULL;
+    }
+    return h;
+}
+
+static void file_handle_done(FileHandle* h) {
+    mtx_unlock(&h->lock);
+    file_handle_release(h);
+}
+
+#ifdef _MSC_VER
+#define file_lock_stream(f) _lock_file(f)
+#define file_unlock_stream(f) _unlock_file(f)
+#define file_getc_locked(f) _getc_nolock(f)
+#else
+#define file_lock_stream(f) flockfile(f)
+#define file_unlock_stream(f) funlockfile(f)
+#define file_getc_locked(f) getc_unlocked(f)
+#endif
+
+// Read one line of `f`, through its '\n' or to end of file, into the
+// growable `*buf`.  Embedded NUL bytes are kept.  Returns the length read
+// (0 at end of file) or -1 when out of memory.
+static int64_t file_read_line(FILE* f, char** buf, size_t* cap) {
+    size_t len = 0;
+    int64_t result = 0;
+    file_lock_stream(f);
+    for (;;) {
+        int c = file_getc_locked(f);
+        if (c == EOF) break;
+        if (len == *cap) {
+            size_t grown_cap = *cap ? *cap * 2 : 256;
+            char* grown = realloc(*buf, grown_cap);
+            if (!grown) { result = -1; break; }
+            *buf = grown;
+            *cap = grown_cap;
+        }
+        (*buf)[len++] = (char)c;
+        if (c == '\n') break;
+    }
+    file_unlock_stream(f);
+    return result < 0 ? result : (int64_t)len;
+}
+
+// OPENFILE(STR: path, STR: mode = "r"):INT
+static Value builtin_openfile(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    (void)arg_nodes; (void)env;
+    EXPECT_STR(args[0], "OPENFILE", interp, line, col);
+    const char* mode = "r";
+    if (argc >= 2) {
+        EXPECT_STR(args[1], "OPENFILE", interp, line, col);
+        mode = args[1].as.s;
+    }
+    const char* fmode = NULL;
+    if (strcmp(mode, "r") == 0) fmode = "rb";
+    else if (strcmp(mode, "w") == 0) fmode = "wb";
+    else if (strcmp(mode, "a") == 0) fmode = "ab";
+    else RUNTIME_ERROR(interp, "OPENFILE mode must be \"r\", \"w\" or \"a\"", line, col);
+
+    FileHandle* h = calloc(1, sizeof(FileHandle));
+    if (!h || mtx_init(&h->lock, mtx_plain) != thrd_success) {
+        free(h);
+        RUNTIME_ERROR(interp, "Out of memory", line, col);
+    }
+    FILE* f = fopen(args[0].as.s, fmode);
+    if (!f) {
+        mtx_destroy(&h->lock);
+        free(h);
+        RUNTIME_ERROR(interp, "OPENFILE: cannot open file", line, col);
+    }
+    setvbuf(f, NULL, _IOFBF, FILE_HANDLE_BUFFER);
+    h->f = f;
+    h->refs = 1;
+
+    mtx_lock(&g_files_lock);
+    size_t slot = 0;
+    while (slot < g_file_count && g_files[slot]) slot++;
+    if (slot == g_file_count) {
+        FileHandle** grown = realloc(g_files, (g_file_count + 1) * sizeof(FileHandle*));
+        if (!grown) {
+            mtx_unlock(&g_files_lock);
+            fclose(f);
+            mtx_destroy(&h->lock);
+            free(h);
+            RUNTIME_ERROR(interp, "Out of memory", line, col);
+        }
+        g_files = grown;
+        g_file_count++;
+    }
+    g_files[slot] = h;
+    mtx_unlock(&g_files_lock);
+    return value_int((int64_t)slot + 1);
+}
+
+// READCHUNK(INT: handle, INT: count):TNS
+static Value builtin_readchunk(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    (void)arg_nodes; (void)env; (void)argc;
+    EXPECT_INT(args[1], "READCHUNK", interp, line, col);
+    if (args[1].as.i < 0) {
+        RUNTIME_ERROR(interp, "READCHUNK count must be non-negative", line, col);
+    }
+    FileHandle* h = file_handle_acquire(args[0]);
+    if (!h) {
+        RUNTIME_ERROR(interp, "READCHUNK: invalid file handle", line, col);
+    }
+    Value v = file_read_bytes(h->f, (size_t)args[1].as.i);
+    file_handle_done(h);
+    return v;
+}
+
+// READLINE(INT: handle):STR
+static Value builtin_readline(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    (void)arg_nodes; (void)env; (void)argc;
+    FileHandle* h = file_handle_acquire(args[0]);
+    if (!h) {
+        RUNTIME_ERROR(interp, "READLINE: invalid file handle", line, col);
+    }
+    char* buf = NULL;
+    size_t cap = 0;
+    int64_t got = file_read_line(h->f, &buf, &cap);
+    file_handle_done(h);
+    if (got < 0) {
+        free(buf);
+        RUNTIME_ERROR(interp, "Out of memory", line, col);
+    }
+    if (got == 0) {
+        free(buf);
+        RUNTIME_ERROR(interp, "READLINE: end of file", line, col);
+    }
+    size_t len = (size_t)got;
+    if (len > 0 && buf[len - 1] == '\n') len--;
+    if (len > 0 && buf[len - 1] == '\r') len--;
+    Value v = value_str_n(buf, len);
+    free(buf);
+    return v;
+}
+
+// WRITECHUNK(INT: handle, STR|TNS: data):INT
+static Value builtin_writechunk(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    (void)arg_nodes; (void)env; (void)argc;
+    if (args[1].type != VAL_STR && args[1].type != VAL_TNS) {
+        RUNTIME_ERROR(interp, "WRITECHUNK expects STR or TNS data", line, col);
+    }
+    FileHandle* h = file_handle_acquire(args[0]);
+    if (!h) {
+        RUNTIME_ERROR(interp, "WRITECHUNK: invalid file handle", line, col);
+    }
+    int64_t put;
+    if (args[1].type == VAL_STR) {
+        put = (int64_t)fwrite(args[1].as.s, 1, value_str_len(args[1].as.s), h->f);
+    } else {
+        put = file_write_bytes(h->f, args[1].as.tns);
+    }
+    file_handle_done(h);
+    if (put < 0) {
+        RUNTIME_ERROR(interp, "WRITECHUNK expects INT values in 0..255", line, col);
+    }
+    return value_int(put);
+}
+
+// ENDOFFILE(INT: handle):INT
+static Value builtin_endoffile(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    (void)arg_nodes; (void)env; (void)argc;
+    FileHandle* h = file_handle_acquire(args[0]);
+    if (!h) {
+        RUNTIME_ERROR(interp, "ENDOFFILE: invalid file handle", line, col);
+    }
+    int c = getc(h->f);
+    if (c != EOF) ungetc(c, h->f);
+    file_handle_done(h);
+    return value_int(c == EOF ? 1 : 0);
+}
+
+// CLOSEFILE(INT: handle):INT
+static Value builtin_closefile(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    (void)arg_nodes; (void)env; (void)argc;
+    FileHandle* h = file_handle_acquire(args[0]);
+    if (!h) {
+        RUNTIME_ERROR(interp, "CLOSEFILE: invalid file handle", line, col);
+    }
+    // Free the slot first so no new operation can find the handle; the
+    // table's reference moves to this call and is dropped below.
+    mtx_lock(&g_files_lock);
+    g_files[args[0].as.i - 1] = NULL;
+    h->refs--;
+    mtx_unlock(&g_files_lock);
+    int rc = fclose(h->f);
+    h->f = NULL;
+    file_handle_done(h);
+    return value_int(rc == 0 ? 1 : 0);
+}
+
 // EXISTFILE(STR: path):INT
 static Value builtin_existfile(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
@@ -5104,8 +6212,70 @@ static Value builtin_signature(Interpreter* interp, Value* args, int argc, Expr*
 
 // ============ Variable management ============
 
+typedef struct {
+    Value* keys;
+    size_t nkeys;
+    const char* error;
+} MapDelCtx;
+
+// env_update callback for DEL(map<k1, ..., kn>): walk the nested maps and
+// drop the last key in place (value_map_get_ptr unshares each map on the way).
+static void del_map_key_apply(EnvEntry* entry, void* arg) {
+    MapDelCtx* c = (MapDelCtx*)arg;
+    if (entry->frozen || entry->permafrozen) { c->error = "Cannot delete from frozen map"; return; }
+    if (!entry->initialized || entry->value.type != VAL_MAP) { c->error = "DEL index target must be a MAP"; return; }
+    Value* cur = &entry->value;
+    for (size_t i = 0; i + 1 < c->nkeys; i++) {
+        cur = value_map_get_ptr(cur, c->keys[i], false);
+        if (!cur) { c->error = "Cannot delete missing map key"; return; }
+        if (cur->type != VAL_MAP) { c->error = "DEL index target must be a MAP"; return; }
+    }
+    if (!value_map_get_ptr(cur, c->keys[c->nkeys - 1], false)) { c->error = "Cannot delete missing map key"; return; }
+    value_map_delete(cur, c->keys[c->nkeys - 1]);
+}
+
+// DEL(map<k1, ..., kn>) removes the innermost key from a (nested) map.
+static Value del_map_key(Interpreter* interp, Expr* target, Env* env, int line, int col) {
+    Expr* base = target->as.index.target;
+    ExprList* indices = &target->as.index.indices;
+    if (!base || base->type != EXPR_IDENT || indices->count == 0) {
+        RUNTIME_ERROR(interp, "DEL expects an identifier", line, col);
+    }
+    Value* keys = malloc(sizeof(Value) * indices->count);
+    if (!keys) RUNTIME_ERROR(interp, "Out of memory", line, col);
+    size_t nkeys = 0;
+    for (; nkeys < indices->count; nkeys++) {
+        keys[nkeys] = eval_expr(interp, indices->items[nkeys], env);
+        if (interp->error) {
+            for (size_t j = 0; j < nkeys; j++) value_free(keys[j]);
+            free(keys);
+            return value_null();
+        }
+        if (keys[nkeys].type != VAL_INT && keys[nkeys].type != VAL_FLT && keys[nkeys].type != VAL_STR) {
+            for (size_t j = 0; j <= nkeys; j++) value_free(keys[j]);
+            free(keys);
+            RUNTIME_ERROR(interp, "Map index must be INT, FLT or STR", line, col);
+        }
+    }
+    MapDelCtx ctx = { keys, nkeys, NULL };
+    bool found = env_update(env, base->as.ident, del_map_key_apply, &ctx);
+    for (size_t j = 0; j < nkeys; j++) value_free(keys[j]);
+    free(keys);
+    if (!found) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "Cannot delete undefined identifier '%s'", base->as.ident);
+        RUNTIME_ERROR(interp, buf, line, col);
+    }
+    if (ctx.error) RUNTIME_ERROR(interp, ctx.error, line, col);
+    return value_int(0);
+}
+
 static Value builtin_del(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)args;
+
+    if (argc == 1 && arg_nodes[0]->type == EXPR_INDEX) {
+        return del_map_key(interp, arg_nodes[0], env, line, col);
+    }
     
     if (argc != 1 || arg_nodes[0]->type != EXPR_IDENT) {
         RUNTIME_ERROR(interp, "DEL expects an identifier", line, col);
@@ -5257,6 +6427,233 @@ static Value builtin_exist(Interpreter* interp, Value* args, int argc, Expr** ar
 
 // ============ Variadic math ============
 
+// Reduction kinds for the TNS forms of SUM / PROD / MAX / MIN.
+enum { TNS_REDUCE_SUM, TNS_REDUCE_PROD, TNS_REDUCE_MAX, TNS_REDUCE_MIN };
+
+// Tensors are reduced in blocks of TNS_REDUCE_BLOCK elements, whatever the
+// number of threads, and FLT block sums / products are combined pairwise,
+// so the result only depends on the data.
+#define TNS_REDUCE_BLOCK 16384
+
+typedef struct {
+    const Tensor* t;
+    int kind;
+    bool as_int;            // reduce INT elements (else FLT)
+    bool coerce;            // ISUM / FSUM: convert the other numeric type
+    const int64_t* ints;    // packed source of the wanted type, else NULL
+    const double* flts;
+    int64_t* itmp;          // gather buffer (t->length) when not packed
+    double* ftmp;
+    int64_t* iparts;        // one result per block
+    double* fparts;
+    atomic_count_t bad;     // an element of the wrong type was seen
+} ReduceJob;
+
+static void reduce_chunk(void* arg, size_t begin, size_t end) {
+    ReduceJob* job = (ReduceJob*)arg;
+    size_t n = job->t->length;
+    for (size_t b = begin; b < end; b++) {
+        size_t lo = b * TNS_REDUCE_BLOCK;
+        size_t len = n - lo < TNS_REDUCE_BLOCK ? n - lo : TNS_REDUCE_BLOCK;
+        const int64_t* ints = job->ints ? job->ints + lo : NULL;
+        const double* flts = job->flts ? job->flts + lo : NULL;
+        if (job->as_int ? !ints : !flts) {
+            // Boxed tensors, strided views and coerced element types are
+            // gathered into this block's part of the temporary buffer.
+            for (size_t i = 0; i < len; i++) {
+                Value v = value_tns_elem(job->t, lo + i);
+                if (v.type == VAL_INT && (job->as_int || job->coerce)) {
+                    if (job->as_int) job->itmp[lo + i] = v.as.i;
+                    else job->ftmp[lo + i] = (double)v.as.i;
+                } else if (v.type == VAL_FLT && (!job->as_int || job->coerce)) {
+                    if (job->as_int) job->itmp[lo + i] = (int64_t)v.as.f;
+                    else job->ftmp[lo + i] = v.as.f;
+                } else {
+                    atomic_count_store(&job->bad, 1);
+                    return;
+                }
+            }
+            ints = job->itmp + lo;
+            flts = job->ftmp + lo;
+        }
+        if (job->as_int) {
+            switch (job->kind) {
+                case TNS_REDUCE_SUM: job->iparts[b] = simd_i64_sum(ints, len); break;
+                case TNS_REDUCE_PROD: job->iparts[b] = simd_i64_prod(ints, len); break;
+                case TNS_REDUCE_MAX: job->iparts[b] = simd_i64_max(ints, len); break;
+                default: job->iparts[b] = simd_i64_min(ints, len); break;
+            }
+        } else {
+            switch (job->kind) {
+                case TNS_REDUCE_SUM: job->fparts[b] = simd_f64_sum(flts, len); break;
+                case TNS_REDUCE_PROD: job->fparts[b] = simd_f64_prod(flts, len); break;
+                case TNS_REDUCE_MAX: job->fparts[b] = simd_f64_max(flts, len); break;
+                default: job->fparts[b] = simd_f64_min(flts, len); break;
+            }
+        }
+    }
+}
+
+// Combine block sums or products: adjacent pairs are folded level by level
+// ((p0 op p1) op (p2 op p3)) ..., an odd last part moving up unchanged.
+static double reduce_pairwise(double* parts, size_t n, bool prod) {
+    while (n > 1) {
+        size_t half = 0;
+        for (size_t i = 0; i + 1 < n; i += 2) {
+            parts[half++] = prod ? parts[i] * parts[i + 1] : parts[i] + parts[i + 1];
+        }
+        if (n & 1) parts[half++] = parts[n - 1];
+        n = half;
+    }
+    return parts[0];
+}
+
+// Reduce one non-empty tensor into *ires / *fres.  Returns false after
+// setting *bad when an element has the wrong type, or on out of memory.
+static bool reduce_tensor(const Tensor* t, int kind, bool as_int, bool coerce, int64_t* ires, double* fres, bool* bad) {
+    size_t n = t->length;
+    size_t nblocks = (n + TNS_REDUCE_BLOCK - 1) / TNS_REDUCE_BLOCK;
+    ReduceJob job;
+    memset(&job, 0, sizeof(job));
+    job.t = t;
+    job.kind = kind;
+    job.as_int = as_int;
+    job.coerce = coerce;
+    if (!t->steps && t->storage == (as_int ? TNS_STORAGE_INT : TNS_STORAGE_FLT)) {
+        job.ints = t->ints;
+        job.flts = t->flts;
+    }
+
+    int64_t iparts1;
+    double fparts1;
+    bool ok = true;
+    if (nblocks == 1) {
+        job.iparts = &iparts1;
+        job.fparts = &fparts1;
+    } else if (as_int) {
+        job.iparts = malloc(sizeof(int64_t) * nblocks);
+        ok = job.iparts != NULL;
+    } else {
+        job.fparts = malloc(sizeof(double) * nblocks);
+        ok = job.fparts != NULL;
+    }
+    if (ok && as_int && !job.ints) {
+        job.itmp = malloc(sizeof(int64_t) * n);
+        ok = job.itmp != NULL;
+    } else if (ok && !as_int && !job.flts) {
+        job.ftmp = malloc(sizeof(double) * n);
+        ok = job.ftmp != NULL;
+    }
+    if (ok) {
+        tns_parallel(nblocks, n, reduce_chunk, &job);
+        if (atomic_count_load(&job.bad)) {
+            *bad = true;
+            ok = false;
+        }
+    }
+    if (ok) {
+        if (as_int) {
+            int64_t r = job.iparts[0];
+            for (size_t b = 1; b < nblocks; b++) {
+                int64_t p = job.iparts[b];
+                switch (kind) {
+                    case TNS_REDUCE_SUM: r = (int64_t)((uint64_t)r + (uint64_t)p); break;
+                    case TNS_REDUCE_PROD: r = (int64_t)((uint64_t)r * (uint64_t)p); break;
+                    case TNS_REDUCE_MAX: if (p > r) r = p; break;
+                    default: if (p < r) r = p; break;
+                }
+            }
+            *ires = r;
+        } else if (kind == TNS_REDUCE_SUM || kind == TNS_REDUCE_PROD) {
+            *fres = reduce_pairwise(job.fparts, nblocks, kind == TNS_REDUCE_PROD);
+        } else {
+            // Same comparisons as one sequential scan: a NaN leading block
+            // 0 sticks, NaNs leading later blocks are ignored.
+            double r = job.fparts[0];
+            for (size_t b = 1; b < nblocks; b++) {
+                double p = job.fparts[b];
+                if (kind == TNS_REDUCE_MAX ? p > r : p < r) r = p;
+            }
+            *fres = r;
+        }
+    }
+    if (nblocks > 1) {
+        free(job.iparts);
+        free(job.fparts);
+    }
+    free(job.itmp);
+    free(job.ftmp);
+    return ok;
+}
+
+// SUM/PROD/MAX/MIN(TNS: t1, ..., TNS: tN) over INT or FLT elements, and
+// ISUM / FSUM over tensors (`coerce_to` TYPE_INT / TYPE_FLT, else
+// TYPE_UNKNOWN).  Each tensor is reduced block-wise by the SIMD kernels
+// (see simd.h for the in-block FLT order), on the worker pool when it is
+// large, and the per-tensor results are then combined left to right.
+static Value tensor_reduce(Interpreter* interp, Value* args, int argc, const char* name, int kind, DeclType coerce_to, int line, int col) {
+    char msg[128];
+    bool coerce = coerce_to != TYPE_UNKNOWN;
+    DeclType etype = coerce ? coerce_to : args[0].as.tns->elem_type;
+    if (!(etype == TYPE_INT || etype == TYPE_FLT)) {
+        snprintf(msg, sizeof(msg), "%s TNS form requires INT or FLT element types", name);
+        RUNTIME_ERROR(interp, msg, line, col);
+    }
+    for (int j = 0; j < argc; j++) {
+        if (args[j].type != VAL_TNS) {
+            snprintf(msg, sizeof(msg), "%s expects TNS arguments in this form", name);
+            RUNTIME_ERROR(interp, msg, line, col);
+        }
+        // The coercing forms check each element instead (mixed INT/FLT
+        // tensors are fine there).
+        if (!coerce && args[j].as.tns->elem_type != etype) {
+            snprintf(msg, sizeof(msg), "%s TNS arguments must share the same element type", name);
+            RUNTIME_ERROR(interp, msg, line, col);
+        }
+    }
+
+    bool seeded = false;
+    int64_t iacc = (kind == TNS_REDUCE_PROD) ? 1 : 0;
+    double facc = (kind == TNS_REDUCE_PROD) ? 1.0 : 0.0;
+    for (int j = 0; j < argc; j++) {
+        Tensor* tj = args[j].as.tns;
+        if (tj->length == 0) continue;
+
+        int64_t ir = 0;
+        double fr = 0.0;
+        bool bad = false;
+        if (!reduce_tensor(tj, kind, etype == TYPE_INT, coerce, &ir, &fr, &bad)) {
+            if (!bad) RUNTIME_ERROR(interp, "Out of memory", line, col);
+            if (coerce) snprintf(msg, sizeof(msg), "%s TNS elements must all be INT or FLT", name);
+            else snprintf(msg, sizeof(msg), "%s TNS elements must all be %s", name, etype == TYPE_INT ? "INT" : "FLT");
+            RUNTIME_ERROR(interp, msg, line, col);
+        }
+
+        if (etype == TYPE_INT) {
+            switch (kind) {
+                case TNS_REDUCE_SUM: iacc = (int64_t)((uint64_t)iacc + (uint64_t)ir); break;
+                case TNS_REDUCE_PROD: iacc = (int64_t)((uint64_t)iacc * (uint64_t)ir); break;
+                case TNS_REDUCE_MAX: if (!seeded || ir > iacc) iacc = ir; break;
+                default: if (!seeded || ir < iacc) iacc = ir; break;
+            }
+        } else {
+            switch (kind) {
+                case TNS_REDUCE_SUM: facc += fr; break;
+                case TNS_REDUCE_PROD: facc *= fr; break;
+                case TNS_REDUCE_MAX: if (!seeded || fr > facc) facc = fr; break;
+                default: if (!seeded || fr < facc) facc = fr; break;
+            }
+        }
+        seeded = true;
+    }
+
+    if (!seeded && (kind == TNS_REDUCE_MAX || kind == TNS_REDUCE_MIN)) {
+        snprintf(msg, sizeof(msg), "%s requires non-empty tensors", name);
+        RUNTIME_ERROR(interp, msg, line, col);
+    }
+    return (etype == TYPE_INT) ? value_int(iacc) : value_flt(facc);
+}
+
 static Value builtin_sum(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
     
@@ -5280,6 +6677,9 @@ static Value builtin_sum(Interpreter* interp, Value* args, int argc, Expr** arg_
         }
         return value_flt(sum);
     }
+    if (args[0].type == VAL_TNS) {
+        return tensor_reduce(interp, args, argc, "SUM", TNS_REDUCE_SUM, TYPE_UNKNOWN, line, col);
+    }
     RUNTIME_ERROR(interp, "SUM expects INT or FLT arguments", line, col);
 }
 
@@ -5306,6 +6706,9 @@ static Value builtin_prod(Interpreter* interp, Value* args, int argc, Expr** arg
         }
         return value_flt(prod);
     }
+    if (args[0].type == VAL_TNS) {
+        return tensor_reduce(interp, args, argc, "PROD", TNS_REDUCE_PROD, TYPE_UNKNOWN, line, col);
+    }
     RUNTIME_ERROR(interp, "PROD expects INT or FLT arguments", line, col);
 }
 
@@ -5347,10 +6750,14 @@ static Value builtin_max(Interpreter* interp, Value* args, int argc, Expr** arg_
     }
     if (args[0].type == VAL_TNS) {
         // MAX(TNS: t1, ..., tN) -> flatten tensors and return largest scalar element
-        // All tensors must have same scalar element type (INT/FLT/STR)
+        // All tensors must have same scalar element type (INT/FLT/STR);
+        // numeric tensors go through the SIMD reductions
         Tensor* t0 = args[0].as.tns;
         DeclType etype = t0->elem_type;
-        if (!(etype == TYPE_INT || etype == TYPE_FLT || etype == TYPE_STR)) {
+        if (etype == TYPE_INT || etype == TYPE_FLT) {
+            return tensor_reduce(interp, args, argc, "MAX", TNS_REDUCE_MAX, TYPE_UNKNOWN, line, col);
+        }
+        if (etype != TYPE_STR) {
             RUNTIME_ERROR(interp, "MAX TNS form requires scalar element types", line, col);
         }
         // verify all args are tensors with same element type
@@ -5368,10 +6775,8 @@ static Value builtin_max(Interpreter* interp, Value* args, int argc, Expr** arg_
         for (int j = 0; j < argc && !seeded; j++) {
             Tensor* tj = args[j].as.tns;
             for (size_t i = 0; i < tj->length; i++) {
-                Value v = tj->data[i];
-                if (etype == TYPE_INT && v.type == VAL_INT) { best = value_int(v.as.i); seeded = true; break; }
-                if (etype == TYPE_FLT && v.type == VAL_FLT) { best = value_flt(v.as.f); seeded = true; break; }
-                if (etype == TYPE_STR && v.type == VAL_STR) { best = value_str(v.as.s); seeded = true; break; }
+                Value v = value_tns_elem(tj, i);
+                if (v.type == VAL_STR) { best = value_str(v.as.s); seeded = true; break; }
                 // skip non-matching elements (elem_type check above should prevent mismatches)
                 continue;
             }
@@ -5383,17 +6788,9 @@ static Value builtin_max(Interpreter* interp, Value* args, int argc, Expr** arg_
         for (int j = 0; j < argc; j++) {
             Tensor* tj = args[j].as.tns;
             for (size_t i = 0; i < tj->length; i++) {
-                Value v = tj->data[i];
-                if (etype == TYPE_INT) {
-                    EXPECT_INT(v, "MAX", interp, line, col);
-                    if (v.as.i > best.as.i) { value_free(best); best = value_int(v.as.i); }
-                } else if (etype == TYPE_FLT) {
-                    EXPECT_FLT(v, "MAX", interp, line, col);
-                    if (v.as.f > best.as.f) { value_free(best); best = value_flt(v.as.f); }
-                } else { // STR
-                    EXPECT_STR(v, "MAX", interp, line, col);
-                    if (strlen(v.as.s) > strlen(best.as.s)) { value_free(best); best = value_str(v.as.s); }
-                }
+                Value v = value_tns_elem(tj, i);
+                EXPECT_STR(v, "MAX", interp, line, col);
+                if (strlen(v.as.s) > strlen(best.as.s)) { value_free(best); best = value_str(v.as.s); }
             }
         }
         return best;
@@ -5441,7 +6838,10 @@ static Value builtin_min(Interpreter* interp, Value* args, int argc, Expr** arg_
         // MIN(TNS: t1, ..., tN) -> flatten tensors and return smallest scalar element
         Tensor* t0 = args[0].as.tns;
         DeclType etype = t0->elem_type;
-        if (!(etype == TYPE_INT || etype == TYPE_FLT || etype == TYPE_STR)) {
+        if (etype == TYPE_INT || etype == TYPE_FLT) {
+            return tensor_reduce(interp, args, argc, "MIN", TNS_REDUCE_MIN, TYPE_UNKNOWN, line, col);
+        }
+        if (etype != TYPE_STR) {
             RUNTIME_ERROR(interp, "MIN TNS form requires scalar element types", line, col);
         }
         for (int j = 0; j < argc; j++) {
@@ -5457,10 +6857,8 @@ static Value builtin_min(Interpreter* interp, Value* args, int argc, Expr** arg_
         for (int j = 0; j < argc && !seeded; j++) {
             Tensor* tj = args[j].as.tns;
             for (size_t i = 0; i < tj->length; i++) {
-                Value v = tj->data[i];
-                if (etype == TYPE_INT && v.type == VAL_INT) { best = value_int(v.as.i); seeded = true; break; }
-                if (etype == TYPE_FLT && v.type == VAL_FLT) { best = value_flt(v.as.f); seeded = true; break; }
-                if (etype == TYPE_STR && v.type == VAL_STR) { best = value_str(v.as.s); seeded = true; break; }
+                Value v = value_tns_elem(tj, i);
+                if (v.type == VAL_STR) { best = value_str(v.as.s); seeded = true; break; }
                 // skip non-matching elements (elem_type check above should prevent mismatches)
                 continue;
             }
@@ -5471,17 +6869,9 @@ static Value builtin_min(Interpreter* interp, Value* args, int argc, Expr** arg_
         for (int j = 0; j < argc; j++) {
             Tensor* tj = args[j].as.tns;
             for (size_t i = 0; i < tj->length; i++) {
-                Value v = tj->data[i];
-                if (etype == TYPE_INT) {
-                    EXPECT_INT(v, "MIN", interp, line, col);
-                    if (v.as.i < best.as.i) { value_free(best); best = value_int(v.as.i); }
-                } else if (etype == TYPE_FLT) {
-                    EXPECT_FLT(v, "MIN", interp, line, col);
-                    if (v.as.f < best.as.f) { value_free(best); best = value_flt(v.as.f); }
-                } else {
-                    EXPECT_STR(v, "MIN", interp, line, col);
-                    if (strlen(v.as.s) < strlen(best.as.s)) { value_free(best); best = value_str(v.as.s); }
-                }
+                Value v = value_tns_elem(tj, i);
+                EXPECT_STR(v, "MIN", interp, line, col);
+                if (strlen(v.as.s) < strlen(best.as.s)) { value_free(best); best = value_str(v.as.s); }
             }
         }
         return best;
@@ -5515,6 +6905,9 @@ static Value builtin_isum(Interpreter* interp, Value* args, int argc, Expr** arg
         RUNTIME_ERROR(interp, "ISUM requires at least one argument", line, col);
     }
     
+    if (args[0].type == VAL_TNS) {
+        return tensor_reduce(interp, args, argc, "ISUM", TNS_REDUCE_SUM, TYPE_INT, line, col);
+    }
     int64_t sum = 0;
     for (int i = 0; i < argc; i++) {
         EXPECT_NUM(args[i], "ISUM", interp, line, col);
@@ -5530,6 +6923,9 @@ static Value builtin_fsum(Interpreter* interp, Value* args, int argc, Expr** arg
         RUNTIME_ERROR(interp, "FSUM requires at least one argument", line, col);
     }
     
+    if (args[0].type == VAL_TNS) {
+        return tensor_reduce(interp, args, argc, "FSUM", TNS_REDUCE_SUM, TYPE_FLT, line, col);
+    }
     double sum = 0.0;
     for (int i = 0; i < argc; i++) {
         EXPECT_NUM(args[i], "FSUM", interp, line, col);
@@ -5631,6 +7027,7 @@ static Value builtin_inv(Interpreter* interp, Value* args, int argc, Expr** arg_
         // Map inversion: values become keys, keys become values
         Map* m = args[0].as.map;
         if (!m) return value_map_new();
+        value_map_compact(m);
         Value out = value_map_new();
         for (size_t i = 0; i < m->count; i++) {
             Value key = m->items[i].key; // original key
@@ -5676,6 +7073,7 @@ static Value builtin_keys(Interpreter* interp, Value* args, int argc, Expr** arg
     (void)arg_nodes; (void)env; (void)argc;
     if (args[0].type != VAL_MAP) RUNTIME_ERROR(interp, "KEYS expects MAP argument", line, col);
     Map* m = args[0].as.map;
+    value_map_compact(m);
     size_t count = m ? m->count : 0;
     if (count == 0) {
         size_t shape[1] = {0};
@@ -5711,6 +7109,7 @@ static Value builtin_values(Interpreter* interp, Value* args, int argc, Expr** a
     (void)arg_nodes; (void)env; (void)argc;
     if (args[0].type != VAL_MAP) RUNTIME_ERROR(interp, "VALUES expects MAP argument", line, col);
     Map* m = args[0].as.map;
+    value_map_compact(m);
     size_t count = m ? m->count : 0;
     if (count == 0) {
         size_t shape[1] = {0};
@@ -5772,6 +7171,7 @@ static Value builtin_valuein(Interpreter* interp, Value* args, int argc, Expr**
     if (args[1].type != VAL_MAP) RUNTIME_ERROR(interp, "VALUEIN expects MAP as second argument", line, col);
     Map* m = args[1].as.map;
     if (!m) return value_int(0);
+    value_map_compact(m);
     for (size_t i = 0; i < m->count; i++) {
         if (value_deep_eq(args[0], m->items[i].value)) return value_int(1);
     }
@@ -5781,6 +7181,7 @@ static Value builtin_valuein(Interpreter* interp, Value* args, int argc, Expr**
 // Helper: recursive match implementation
 static int match_map_internal(Map* m, Map* tpl, int typing, int recurse, int shape) {
     if (!tpl) return 1;
+    value_map_compact(tpl);
     for (size_t i = 0; i < tpl->count; i++) {
         Value tkey = tpl->items[i].key;
         Value tval = tpl->items[i].value;
@@ -5833,8 +7234,8 @@ static Value builtin_match(Interpreter* interp, Value* args, int argc, Expr** ar
 // COPY (shallow copy for scalars)
 static Value builtin_copy(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env; (void)interp; (void)line; (void)col;
-    /* Preserve existing COPY operator behavior (shallow/aliasing). */
-    return value_alias(args[0]);
+    /* Shallow copy: nested containers stay shared with the original. */
+    return value_copy(args[0]);
 }
 
 // DEEPCOPY: return a recursive deep copy of the argument
@@ -6215,22 +7616,21 @@ static Value builtin_import(Interpreter* interp, Value* args, int argc, Expr** a
 
                 env_assign(mod_env, "__MODULE_SOURCE__", value_str(cache_key), TYPE_STR, true);
 
-                Lexer lex;
-                lexer_init(&lex, srcbuf, found_path);
-                Parser parser;
-                parser_init(&parser, &lex);
-                Stmt* program = parser_parse(&parser);
-                if (parser.had_error) {
+                int parse_line = 0, parse_col = 0;
+                Stmt* program = ast_cache_parse(found_path, srcbuf, (size_t)len, &parse_line, &parse_col);
+                if (!program) {
                     free(srcbuf);
                     free(found_path);
                     free(canonical_path);
                     interp->error = strdup("IMPORT: parse error");
-                    interp->error_line = parser.current_token.line;
-                    interp->error_col = parser.current_token.column;
+                    interp->error_line = parse_line;
+                    interp->error_col = parse_col;
                     return value_null();
                 }
 
                 ExecResult res = exec_program_in_env(interp, program, mod_env);
+                interpreter_forget_arena(interp, program->arena);
+                ast_arena_release(program->arena);
                 if (res.status == EXEC_ERROR) {
                     free(srcbuf);
                     free(found_path);
@@ -6334,7 +7734,7 @@ static Value builtin_tns(Interpreter* interp, Value* args, int argc, Expr** arg_
         if (!shape) { RUNTIME_ERROR(interp, "Out of memory", line, col); }
         size_t total = 1;
         for (size_t i = 0; i < ndim; i++) {
-            Value v = shape_t->data[i];
+            Value v = value_tns_elem(shape_t, i);
             if (v.type != VAL_INT) { free(shape); RUNTIME_ERROR(interp, "Shape entries must be INT", line, col); }
             if (v.as.i <= 0) { free(shape); RUNTIME_ERROR(interp, "Shape lengths must be positive", line, col); }
             shape[i] = (size_t)v.as.i;
@@ -6386,7 +7786,7 @@ static Value builtin_tint(Interpreter* interp, Value* args, int argc, Expr** arg
     Value* items = malloc(sizeof(Value) * n);
     if (!items) RUNTIME_ERROR(interp, "Out of memory", line, col);
     for (size_t i = 0; i < n; i++) {
-        Value elem = t->data[i];
+        Value elem = value_tns_elem(t, i);
         // Disallow nested tensors or functions
         if (elem.type == VAL_TNS || elem.type == VAL_FUNC) {
             for (size_t j = 0; j < i; j++) value_free(items[j]);
@@ -6418,7 +7818,7 @@ static Value builtin_tflt(Interpreter* interp, Value* args, int argc, Expr** arg
     Value* items = malloc(sizeof(Value) * n);
     if (!items) RUNTIME_ERROR(interp, "Out of memory", line, col);
     for (size_t i = 0; i < n; i++) {
-        Value elem = t->data[i];
+        Value elem = value_tns_elem(t, i);
         if (elem.type == VAL_TNS || elem.type == VAL_FUNC) {
             for (size_t j = 0; j < i; j++) value_free(items[j]);
             free(items);
@@ -6449,7 +7849,7 @@ static Value builtin_tstr(Interpreter* interp, Value* args, int argc, Expr** arg
     Value* items = malloc(sizeof(Value) * n);
     if (!items) RUNTIME_ERROR(interp, "Out of memory", line, col);
     for (size_t i = 0; i < n; i++) {
-        Value elem = t->data[i];
+        Value elem = value_tns_elem(t, i);
         if (elem.type == VAL_TNS || elem.type == VAL_FUNC) {
             for (size_t j = 0; j < i; j++) value_free(items[j]);
             free(items);
@@ -6502,22 +7902,20 @@ static Value builtin_run(Interpreter* interp, Value* args, int argc, Expr** arg_
 
     const char* src = args[0].as.s ? args[0].as.s : "";
 
-    // Initialize lexer/parser on the provided string
-    Lexer lex;
-    lexer_init(&lex, src, "<string>");
-    Parser parser;
-    parser_init(&parser, &lex);
-
-    Stmt* program = parser_parse(&parser);
-    if (parser.had_error) {
+    int err_line = 0, err_col = 0;
+    Stmt* program = parser_parse_source(src, "<string>", &err_line, &err_col);
+    if (!program) {
         interp->error = strdup("RUN: parse error");
-        interp->error_line = parser.current_token.line;
-        interp->error_col = parser.current_token.column;
+        interp->error_line = err_line;
+        interp->error_col = err_col;
         return value_null();
     }
 
-    // Execute parsed program in the caller's environment
+    // Execute parsed program in the caller's environment, then drop its
+    // AST (FUNCs and THRs it created keep their part of it alive).
     ExecResult res = exec_program_in_env(interp, program, env);
+    interpreter_forget_arena(interp, program->arena);
+    ast_arena_release(program->arena);
     if (res.status == EXEC_ERROR) {
         interp->error = res.error ? strdup(res.error) : strdup("Runtime error in RUN");
         interp->error_line = res.error_line;
@@ -6529,30 +7927,97 @@ static Value builtin_run(Interpreter* interp, Value* args, int argc, Expr** arg_
     return value_null();
 }
 
-// AWAIT(THR: thread):THR — block until thread is finished and return handle
+// Optional `seconds` argument of AWAIT / AWAITANY: INT or FLT, negative
+// (the default) waits without a limit.
+static bool await_seconds(Value* args, int argc, double* seconds) {
+    *seconds = -1.0;
+    if (argc < 2) return true;
+    if (args[1].type == VAL_FLT) { *seconds = args[1].as.f; return true; }
+    if (args[1].type == VAL_INT) { *seconds = (double)args[1].as.i; return true; }
+    return false;
+}
+
+// The THRs of tensor `t` as an owned array (NULL with *count 0 when some
+// element is not a THR).
+static Value* await_collect(const Tensor* t, size_t* count) {
+    *count = 0;
+    Value* thrs = malloc((t->length ? t->length : 1) * sizeof(Value));
+    if (!thrs) return NULL;
+    for (size_t i = 0; i < t->length; i++) {
+        Value e = value_tns_elem(t, i);
+        if (e.type != VAL_THR || !e.as.thr) {
+            for (size_t j = 0; j < i; j++) value_free(thrs[j]);
+            free(thrs);
+            return NULL;
+        }
+        thrs[i] = value_copy(e);
+    }
+    *count = t->length;
+    return thrs;
+}
+
+// AWAIT(THR: thread, FLT: seconds=-1):THR — block until thread is finished
+// and return the handle.  AWAIT(TNS: threads, FLT: seconds=-1):TNS waits
+// for every THR in the tensor.  Both sleep on the threads' condition
+// variables; with `seconds` >= 0 they give up after that long, and the
+// returned handle (or tensor) is still truthy.
 static Value builtin_await(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
     (void)arg_nodes; (void)env;
-    if (argc != 1) {
-        RUNTIME_ERROR(interp, "AWAIT expects 1 argument", line, col);
+    if (argc < 1 || argc > 2) {
+        RUNTIME_ERROR(interp, "AWAIT expects 1 or 2 arguments", line, col);
+    }
+    double seconds;
+    if (!await_seconds(args, argc, &seconds)) {
+        RUNTIME_ERROR(interp, "AWAIT expects FLT seconds", line, col);
+    }
+    if (args[0].type == VAL_TNS && args[0].as.tns) {
+        size_t count;
+        Value* thrs = await_collect(args[0].as.tns, &count);
+        if (!thrs) RUNTIME_ERROR(interp, "AWAIT expects TNS of THR", line, col);
+        (void)value_thr_await_many(thrs, count, true, seconds);
+        for (size_t i = 0; i < count; i++) value_free(thrs[i]);
+        free(thrs);
+        return value_copy(args[0]);
     }
     if (args[0].type != VAL_THR || !args[0].as.thr) {
         RUNTIME_ERROR(interp, "AWAIT expects THR argument", line, col);
     }
-    // Make a local copy of the thread handle to ensure the Thr
-    // struct remains alive while we wait/join (prevents a race
-    // where the worker could free the Thr between the check and
-    // the join).
+    // A reference of our own keeps the Thr alive while we wait and join.
     Value ret = value_copy(args[0]);
-    if (!value_thr_get_started(ret)) {
-        return ret;
+    (void)value_thr_await(ret, seconds);
+    return ret;
+}
+
+// AWAITANY(TNS: threads, FLT: seconds=-1):INT — block until one THR in
+// `threads` is finished; return its (flat, one-based) index, or 0 when
+// `seconds` >= 0 ran out first.
+static Value builtin_awaitany(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    (void)arg_nodes; (void)env;
+    if (argc < 1 || argc > 2) {
+        RUNTIME_ERROR(interp, "AWAITANY expects 1 or 2 arguments", line, col);
     }
-    // Wait for worker to mark finished; yield while spinning to be cooperative
-    while (!value_thr_get_finished(ret)) {
-        thrd_yield();
+    if (args[0].type != VAL_TNS || !args[0].as.tns) {
+        RUNTIME_ERROR(interp, "AWAITANY expects TNS of THR", line, col);
     }
-    // Join to reclaim thread resources; ignore join errors
-    thrd_join(ret.as.thr->thread, NULL);
-    return ret;
+    double seconds;
+    if (!await_seconds(args, argc, &seconds)) {
+        RUNTIME_ERROR(interp, "AWAITANY expects FLT seconds", line, col);
+    }
+    size_t count;
+    Value* thrs = await_collect(args[0].as.tns, &count);
+    if (!thrs || count == 0) {
+        free(thrs);
+        RUNTIME_ERROR(interp, "AWAITANY expects TNS of THR", line, col);
+    }
+    int64_t index = 0;
+    if (value_thr_await_many(thrs, count, false, seconds)) {
+        for (size_t i = 0; i < count; i++) {
+            if (value_thr_get_exited(thrs[i])) { index = (int64_t)i + 1; break; }
+        }
+    }
+    for (size_t i = 0; i < count; i++) value_free(thrs[i]);
+    free(thrs);
+    return value_int(index);
 }
 
 typedef struct {
@@ -6576,6 +8041,7 @@ static int pause_timer_worker(void* arg) {
     }
     value_free(pt->thr_val);
     free(pt);
+    value_pool_thread_exit();
     return 0;
 }
 
@@ -6697,40 +8163,48 @@ static Value builtin_restart(Interpreter* interp, Value* args, int argc, Expr**
 
 // PARALLEL(TNS: functions) or PARALLEL(FUNC, FUNC, ...):INT
 typedef struct {
-    Interpreter* interp;
-    struct Func* func;
+    Interpreter* parent;
+    Value* funcs;
     char** errors;
-    int index;
     int* err_lines;
     int* err_cols;
-} ParallelStart;
+} ParallelJob;
 
-static int parallel_worker(void* arg) {
-    ParallelStart* ps = (ParallelStart*)arg;
-    // Create a per-worker interpreter state similar to PARFOR
-    Interpreter* thr_interp = ps->interp;
+// Run functions [begin, end) on one pool thread with a scratch interpreter.
+static void parallel_chunk(void* arg, size_t begin, size_t end) {
+    ParallelJob* job = (ParallelJob*)arg;
 
-    // Prepare a call environment from the function's closure
-    Env* call_env = env_create(ps->func->closure);
+    Interpreter scratch = (Interpreter){0};
+    scratch.global_env = job->parent->global_env;
+    scratch.in_try_block = job->parent->in_try_block;
+    scratch.modules = job->parent->modules;
+    scratch.shushed = job->parent->shushed;
 
-    // Execute the function body as a program block
-    ExecResult res = exec_program_in_env(thr_interp, ps->func->body, call_env);
+    for (size_t i = begin; i < end; i++) {
+        struct Func* func = job->funcs[i].as.func;
 
-    if (res.status == EXEC_ERROR && res.error) {
-        ps->errors[ps->index] = res.error; // transfer ownership
-        if (ps->err_lines) ps->err_lines[ps->index] = res.error_line;
-        if (ps->err_cols) ps->err_cols[ps->index] = res.error_column;
-    } else {
-        if (res.status == EXEC_RETURN || res.status == EXEC_OK || res.status == EXEC_GOTO) {
+        // Prepare a call environment from the function's closure
+        Env* call_env = env_create(func->closure);
+
+        // Execute the function body as a program block
+        ExecResult res = exec_program_in_env(&scratch, func->body, call_env);
+
+        if (res.status == EXEC_ERROR && res.error) {
+            job->errors[i] = res.error; // transfer ownership
+            job->err_lines[i] = res.error_line;
+            job->err_cols[i] = res.error_column;
+        } else if (res.status == EXEC_RETURN || res.status == EXEC_OK || res.status == EXEC_GOTO) {
             value_free(res.value);
         }
-        if (res.status == EXEC_ERROR && res.error) free(res.error);
+
+        env_free(call_env);
+        if (scratch.error) { free(scratch.error); scratch.error = NULL; }
+        scratch.loop_depth = 0;
+        interpreter_reset_traceback(&scratch, NULL);
     }
 
-    env_free(call_env);
-    free(thr_interp);
-    free(ps);
-    return 0;
+    interpreter_free_call_arena(&scratch);
+    free(scratch.trace_stack);
 }
 
 static Value builtin_parallel(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
@@ -6744,7 +8218,7 @@ static Value builtin_parallel(Interpreter* interp, Value* args, int argc, Expr**
         n = t->length;
         elems = malloc(sizeof(Value) * n);
         if (!elems) RUNTIME_ERROR(interp, "Out of memory", line, col);
-        for (size_t i = 0; i < n; i++) elems[i] = value_copy(t->data[i]);
+        for (size_t i = 0; i < n; i++) elems[i] = value_copy(value_tns_elem(t, i));
     } else {
         if (argc < 1) {
             RUNTIME_ERROR(interp, "PARALLEL expects at least 1 argument", line, col);
@@ -6764,59 +8238,28 @@ static Value builtin_parallel(Interpreter* interp, Value* args, int argc, Expr**
         }
     }
 
-    // Prepare shared error collection and thread handles
-    char** errors = calloc(n, sizeof(char*));
-    int* err_lines = calloc(n, sizeof(int));
-    int* err_cols = calloc(n, sizeof(int));
-    thrd_t* threads = malloc(sizeof(thrd_t) * n);
-    if (!errors || !err_lines || !err_cols || !threads) {
+    // Prepare shared error collection
+    char** errors = calloc(n ? n : 1, sizeof(char*));
+    int* err_lines = calloc(n ? n : 1, sizeof(int));
+    int* err_cols = calloc(n ? n : 1, sizeof(int));
+    if (!errors || !err_lines || !err_cols) {
         if (errors) free(errors);
         if (err_lines) free(err_lines);
         if (err_cols) free(err_cols);
-        if (threads) free(threads);
         for (size_t i = 0; i < n; i++) value_free(elems[i]);
         free(elems);
         RUNTIME_ERROR(interp, "Out of memory", line, col);
     }
 
-    for (size_t i = 0; i < n; i++) {
-        ParallelStart* ps = malloc(sizeof(ParallelStart));
-        Interpreter* thr_interp = malloc(sizeof(Interpreter));
-        if (!ps || !thr_interp) {
-            if (ps) free(ps);
-            if (thr_interp) free(thr_interp);
-            errors[i] = strdup("Failed to allocate worker");
-            continue;
-        }
-        *thr_interp = (Interpreter){0};
-        thr_interp->global_env = interp->global_env;
-        thr_interp->loop_depth = 0;
-        thr_interp->error = NULL;
-        thr_interp->error_line = 0;
-        thr_interp->error_col = 0;
-        thr_interp->in_try_block = interp->in_try_block;
-        thr_interp->modules = interp->modules;
-        thr_interp->shushed = interp->shushed;
-
-        ps->interp = thr_interp;
-        ps->func = elems[i].as.func;
-        ps->errors = errors;
-        ps->index = (int)i;
-        ps->err_lines = err_lines;
-        ps->err_cols = err_cols;
-
-        if (thrd_create(&threads[i], parallel_worker, ps) != thrd_success) {
-            // record failure as error string and clean up
-            errors[i] = strdup("Failed to start PARALLEL worker");
-            free(thr_interp);
-            free(ps);
-        }
-    }
-
-    // Join threads
-    for (size_t i = 0; i < n; i++) {
-        thrd_join(threads[i], NULL);
-    }
+    // One function per chunk: PARALLEL bodies are typically long-running
+    // and uneven, so let idle pool threads pick them up individually.
+    ParallelJob job;
+    job.parent = interp;
+    job.funcs = elems;
+    job.errors = errors;
+    job.err_lines = err_lines;
+    job.err_cols = err_cols;
+    thread_pool_run(n, 1, parallel_chunk, &job);
 
     // Find first error
     char* first_err = NULL;
@@ -6832,7 +8275,6 @@ static Value builtin_parallel(Interpreter* interp, Value* args, int argc, Expr**
     free(errors);
     free(err_lines);
     free(err_cols);
-    free(threads);
 
     if (first_err) {
         interp->error = strdup(first_err);
@@ -6850,9 +8292,13 @@ static const char* builtin_params_round[] = {"x", "ndigits", "mode"};
 static const char* builtin_params_bytes[] = {"x", "endian"};
 static const char* builtin_params_split[] = {"s", "delimiter"};
 static const char* builtin_params_match[] = {"value", "template", "typing", "recurse", "shape"};
+static const char* builtin_params_ser[] = {"obj", "format"};
 static const char* builtin_params_readfile[] = {"path", "coding"};
-static const char* builtin_params_writefile[] = {"data", "path", "coding"};
+static const char* builtin_params_writefile[] = {"data", "path", "coding", "append"};
+static const char* builtin_params_openfile[] = {"path", "mode"};
 static const char* builtin_params_pause[] = {"thr", "seconds"};
+static const char* builtin_params_await[] = {"thr", "seconds"};
+static const char* builtin_params_awaitany[] = {"threads", "seconds"};
 
 static BuiltinFunction builtins_table[] = {
     // Arithmetic
@@ -6937,7 +8383,7 @@ static BuiltinFunction builtins_table[] = {
     {"FLT", 1, 1, builtin_flt},
     {"STR", 1, 1, builtin_str},
     {"BYTES", 1, 2, builtin_bytes, builtin_params_bytes, 2},
-    {"SER", 1, 1, builtin_ser},
+    {"SER", 1, 2, builtin_ser, builtin_params_ser, 2},
     {"UNSER", 1, 1, builtin_unser},
 
     // Type checking
@@ -6973,14 +8419,21 @@ static BuiltinFunction builtins_table[] = {
     {"SHUSH", 0, 0, builtin_shush},
     {"UNSHUSH", 0, 0, builtin_unshush},
     {"READFILE", 1, 2, builtin_readfile, builtin_params_readfile, 2},
-    {"WRITEFILE", 2, 3, builtin_writefile, builtin_params_writefile, 3},
+    {"WRITEFILE", 2, 4, builtin_writefile, builtin_params_writefile, 4},
+    {"OPENFILE", 1, 2, builtin_openfile, builtin_params_openfile, 2},
+    {"READCHUNK", 2, 2, builtin_readchunk},
+    {"READLINE", 1, 1, builtin_readline},
+    {"WRITECHUNK", 2, 2, builtin_writechunk},
+    {"ENDOFFILE", 1, 1, builtin_endoffile},
+    {"CLOSEFILE", 1, 1, builtin_closefile},
     {"CL", 1, 1, builtin_cl},
     {"EXISTFILE", 1, 1, builtin_existfile},
     {"DELETEFILE", 1, 1, builtin_deletefile},
     {"RUN", 1, 1, builtin_run},
     {"ARGV", 0, 0, builtin_argv},
     {"PARALLEL", 1, -1, builtin_parallel},
-    {"AWAIT", 1, 1, builtin_await},
+    {"AWAIT", 1, 2, builtin_await, builtin_params_await, 2},
+    {"AWAITANY", 1, 2, builtin_awaitany, builtin_params_awaitany, 2},
     {"PAUSE", 1, 2, builtin_pause, builtin_params_pause, 2},
     {"RESUME", 1, 1, builtin_resume},
     {"PAUSED", 1, 1, builtin_paused},
@@ -7034,13 +8487,139 @@ typedef struct DynamicBuiltin {
 
 static DynamicBuiltin* g_dynamic_builtins = NULL;
 
+// Perfect hash over builtins_table, built once by builtins_init() with the
+// hash-and-displace scheme: the unseeded hash of a name picks a bucket, and
+// that bucket's seed (searched at init so every name lands in a slot of its
+// own) picks the slot.  A lookup is two hashes and a single strcmp.
+static BuiltinFunction** g_builtin_slots = NULL;
+static uint32_t* g_builtin_seeds = NULL;
+static uint32_t g_builtin_slot_mask = 0;
+static uint32_t g_builtin_bucket_mask = 0;
+
+// Bumped by builtins_register_operator() and builtins_reset_dynamic() so
+// call-site caches notice a changed builtin set.
+static unsigned g_builtins_epoch = 1;
+
+static uint32_t builtin_name_hash(const char* name, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    return h;
+}
+
+static void* builtin_hash_alloc(size_t size) {
+    void* p = calloc(1, size);
+    if (!p) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    return p;
+}
+
+static uint32_t builtin_pow2_at_least(size_t n) {
+    uint32_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// Try to place every bucket with `nslots` slots; false if some bucket
+// found no collision-free seed.
+static bool builtin_hash_try(const int* entries, size_t n, uint32_t nslots, uint32_t nbuckets,
+                             BuiltinFunction** slots, uint32_t* seeds) {
+    memset(slots, 0, nslots * sizeof(*slots));
+    memset(seeds, 0, nbuckets * sizeof(*seeds));
+    int* bucket_of = builtin_hash_alloc((n ? n : 1) * sizeof(int));
+    size_t* size_of = builtin_hash_alloc(nbuckets * sizeof(size_t));
+    uint32_t* placed = builtin_hash_alloc((n ? n : 1) * sizeof(uint32_t));
+    size_t largest = 0;
+    for (size_t i = 0; i < n; i++) {
+        bucket_of[i] = (int)(builtin_name_hash(builtins_table[entries[i]].name, 0) & (nbuckets - 1));
+        if (++size_of[bucket_of[i]] > largest) largest = size_of[bucket_of[i]];
+    }
+    bool ok = true;
+    // Largest buckets first, while the table is still mostly empty.
+    for (size_t size = largest; ok && size > 0; size--) {
+        for (uint32_t b = 0; ok && b < nbuckets; b++) {
+            if (size_of[b] != size) continue;
+            bool found = false;
+            for (uint32_t seed = 1; !found && seed < 0x10000u; seed++) {
+                size_t k = 0;
+                bool clash = false;
+                for (size_t i = 0; i < n && !clash; i++) {
+                    if (bucket_of[i] != (int)b) continue;
+                    uint32_t slot = builtin_name_hash(builtins_table[entries[i]].name, seed) & (nslots - 1);
+                    if (slots[slot]) clash = true;
+                    for (size_t j = 0; j < k && !clash; j++) {
+                        if (placed[j] == slot) clash = true;
+                    }
+                    placed[k++] = slot;
+                }
+                if (clash) continue;
+                k = 0;
+                for (size_t i = 0; i < n; i++) {
+                    if (bucket_of[i] == (int)b) slots[placed[k++]] = &builtins_table[entries[i]];
+                }
+                seeds[b] = seed;
+                found = true;
+            }
+            if (!found) ok = false;
+        }
+    }
+    free(placed);
+    free(size_of);
+    free(bucket_of);
+    return ok;
+}
+
+static void builtin_hash_build(void) {
+    size_t total = 0;
+    while (builtins_table[total].name != NULL) total++;
+    // Distinct names only; the first entry of a duplicated name wins, as
+    // with a linear scan.
+    int* entries = builtin_hash_alloc((total ? total : 1) * sizeof(int));
+    size_t n = 0;
+    for (size_t i = 0; i < total; i++) {
+        bool dup = false;
+        for (size_t j = 0; j < n && !dup; j++) {
+            dup = strcmp(builtins_table[entries[j]].name, builtins_table[i].name) == 0;
+        }
+        if (!dup) entries[n++] = (int)i;
+    }
+    uint32_t nbuckets = builtin_pow2_at_least(n / 4 + 1);
+    uint32_t nslots = builtin_pow2_at_least(n + n / 2 + 1);
+    for (;;) {
+        BuiltinFunction** slots = builtin_hash_alloc(nslots * sizeof(*slots));
+        uint32_t* seeds = builtin_hash_alloc(nbuckets * sizeof(*seeds));
+        if (builtin_hash_try(entries, n, nslots, nbuckets, slots, seeds)) {
+            g_builtin_slots = slots;
+            g_builtin_seeds = seeds;
+            g_builtin_slot_mask = nslots - 1;
+            g_builtin_bucket_mask = nbuckets - 1;
+            break;
+        }
+        free(slots);
+        free(seeds);
+        nslots <<= 1;
+    }
+    free(entries);
+}
+
 static BuiltinFunction* builtin_lookup_static(const char* name) {
-    for (int i = 0; builtins_table[i].name != NULL; i++) {
-        if (strcmp(builtins_table[i].name, name) == 0) {
-            return &builtins_table[i];
+    if (!g_builtin_slots) {
+        // Before builtins_init() (or in an extension's private copy of
+        // this table): plain scan.
+        for (int i = 0; builtins_table[i].name != NULL; i++) {
+            if (strcmp(builtins_table[i].name, name) == 0) {
+                return &builtins_table[i];
+            }
         }
+        return NULL;
     }
-    return NULL;
+    uint32_t seed = g_builtin_seeds[builtin_name_hash(name, 0) & g_builtin_bucket_mask];
+    BuiltinFunction* b = g_builtin_slots[builtin_name_hash(name, seed) & g_builtin_slot_mask];
+    return (b && strcmp(b->name, name) == 0) ? b : NULL;
 }
 
 static BuiltinFunction* builtin_lookup_dynamic(const char* name) {
@@ -7067,6 +8646,7 @@ void builtins_reset_dynamic(void) {
         n = next;
     }
     g_dynamic_builtins = NULL;
+    g_builtins_epoch++;
 }
 
 int builtins_register_operator(const char* name, BuiltinImplFn impl, int min_args, int max_args, const char** param_names, int param_count) {
@@ -7119,11 +8699,16 @@ int builtins_register_operator(const char* name, BuiltinImplFn impl, int min_arg
 
     node->next = g_dynamic_builtins;
     g_dynamic_builtins = node;
+    g_builtins_epoch++;
     return 0;
 }
 
 void builtins_init(void) {
-    // Nothing to initialize for now, table is static
+    if (!g_builtin_slots) {
+        builtin_hash_build();
+        mtx_init(&g_files_lock, mtx_plain);
+        value_thr_init();
+    }
 }
 
 BuiltinFunction* builtin_lookup(const char* name) {
@@ -7136,6 +8721,36 @@ bool is_builtin(const char* name) {
     return builtin_lookup(name) != NULL;
 }
 
+unsigned builtin_arg_quote_mask(const char* name) {
+    unsigned mask = 0;
+    if (strcmp(name, "DEL") == 0 || strcmp(name, "EXIST") == 0 ||
+        strcmp(name, "ASSIGN") == 0 || strcmp(name, "IMPORT") == 0) {
+        mask |= 1u;
+    }
+    if (strcmp(name, "IMPORT") == 0 || strcmp(name, "IMPORT_PATH") == 0) {
+        mask |= 2u;
+    }
+    return mask;
+}
+
+BuiltinFunction* builtin_lookup_call(Expr* call) {
+    // Threads running the same call site may fill it concurrently; they
+    // store the same builtin, and the epoch is published last, so a
+    // reader that sees the current epoch also sees its builtin.
+    unsigned epoch = g_builtins_epoch;
+    if (ast_cache_load_acquire(&call->as.call.cached_epoch) == epoch) {
+        return ast_cache_load_ptr(&call->as.call.cached_builtin);
+    }
+    BuiltinFunction* b = builtin_lookup(call->as.call.callee->as.ident);
+    ast_cache_store_ptr(&call->as.call.cached_builtin, b);
+    ast_cache_store_release(&call->as.call.cached_epoch, epoch);
+    return b;
+}
+
+unsigned builtins_epoch(void) {
+    return g_builtins_epoch;
+}
+
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
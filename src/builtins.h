@@ -10,7 +10,7 @@ typedef struct Interpreter Interpreter;
 
 typedef Value (*BuiltinImplFn)(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col);
 
-typedef struct {
+typedef struct BuiltinFunction {
     const char* name;
     int min_args;
     int max_args;  // -1 for variadic
@@ -33,6 +33,23 @@ BuiltinFunction* builtin_lookup(const char* name);
 // Check if a name is a builtin
 bool is_builtin(const char* name);
 
+// Bit i is set when positional argument i of a call to `name` is left
+// unevaluated for the builtin to inspect through its node (DEL, EXIST,
+// ASSIGN and IMPORT take an identifier, IMPORT/IMPORT_PATH an alias).
+unsigned builtin_arg_quote_mask(const char* name);
+
+// Resolve the identifier callee of EXPR_CALL `call` through its call-site
+// cache, returning NULL for a non-builtin name.  The cache is refilled
+// whenever the builtin set changed since it was written (see
+// builtins_epoch()); call->as.call.quote_mask applies when this returns
+// non-NULL.
+BuiltinFunction* builtin_lookup_call(Expr* call);
+
+// Counter bumped by every change to the builtin set (registration or reset
+// of runtime operators); never 0.  The set only changes while no other
+// thread is running a program (extension loading, interpreter reset).
+unsigned builtins_epoch(void);
+
 // Register a runtime builtin operator (used by extensions).
 // Returns 0 on success, -1 on failure (duplicate/invalid input/oom).
 int builtins_register_operator(const char* name, BuiltinImplFn impl, int min_args, int max_args, const char** param_names, int param_count);
@@ -7,8 +7,16 @@
  * is active, falling back to the _direct path otherwise.
  *
  * Internal read helpers (_raw) never touch the buffer and are safe to
- * call from within _direct functions (which execute on the prepare
- * thread while it already holds the env-access lock).
+ * call from within _direct functions.
+ *
+ * Concurrency: each Env carries its own reader/writer lock.  While the
+ * buffer is active the prepare thread is the only writer, so _direct
+ * functions search without locking and take the write lock of just the
+ * one Env whose storage they mutate.  Public readers take read locks Env
+ * by Env as they walk the parent chain and never hold more than one at
+ * a time, so readers of unrelated scopes never wait on each other or on
+ * writes elsewhere.  When the buffer is inactive (single-threaded) no
+ * locks are taken at all.
  */
 
 #include "env.h"
@@ -45,10 +53,7 @@ static _Thread_local size_t g_entry_snap_idx = 0;
 
 static void env_entry_snap_clear(EnvEntry* e) {
     if (!e) return;
-    if (e->name) {
-        free(e->name);
-        e->name = NULL;
-    }
+    e->name = NULL;
     if (e->alias_target) {
         free(e->alias_target);
         e->alias_target = NULL;
@@ -74,7 +79,7 @@ static void env_entry_snap_from_raw(EnvEntry* dst, const EnvEntry* src) {
         return;
     }
 
-    dst->name = src->name ? strdup(src->name) : NULL;
+    dst->name = src->name;
     dst->decl_type = src->decl_type;
     dst->initialized = src->initialized;
     dst->frozen = src->frozen;
@@ -97,6 +102,14 @@ static void* env_alloc(size_t size) {
     return ptr;
 }
 
+// `sync` is sampled once per public call (ns_buffer_active()) and passed
+// down so a lock and its matching unlock always agree, even if the last
+// worker exits in between.
+static void env_rdlock(Env* env, bool sync) { if (sync) rwl_rdlock(&env->lock); }
+static void env_rdunlock(Env* env, bool sync) { if (sync) rwl_rdunlock(&env->lock); }
+static void env_wrlock(Env* env, bool sync) { if (sync) rwl_wrlock(&env->lock); }
+static void env_wrunlock(Env* env, bool sync) { if (sync) rwl_wrunlock(&env->lock); }
+
 /* ================================================================== */
 /*  Lifecycle (not buffered)                                           */
 /* ================================================================== */
@@ -105,6 +118,7 @@ Env* env_create(Env* parent) {
     Env* env = env_alloc(sizeof(Env));
     env->parent = parent;
     env->refcount = 1;
+    rwl_init(&env->lock);
     return env;
 }
 
@@ -113,11 +127,8 @@ void env_retain(Env* env) {
     env->refcount++;
 }
 
-void env_free(Env* env) {
-    if (!env) return;
-    if (--env->refcount > 0) return;
+static void env_release_entries(Env* env) {
     for (size_t i = 0; i < env->count; i++) {
-        free(env->entries[i].name);
         if (env->entries[i].initialized) {
             value_free(env->entries[i].value);
         }
@@ -125,7 +136,32 @@ void env_free(Env* env) {
             free(env->entries[i].alias_target);
         }
     }
+}
+
+void env_clear(Env* env) {
+    if (!env) return;
+    env_release_entries(env);
+    env->count = 0;
+    env->name_bloom = 0;
+}
+
+void env_reserve(Env* env, size_t capacity) {
+    if (!env || capacity <= env->capacity) return;
+    EnvEntry* grown = realloc(env->entries, capacity * sizeof(EnvEntry));
+    if (!grown) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    env->entries = grown;
+    env->capacity = capacity;
+}
+
+void env_free(Env* env) {
+    if (!env) return;
+    if (--env->refcount > 0) return;
+    env_release_entries(env);
     free(env->entries);
+    rwl_destroy(&env->lock);
     free(env);
 }
 
@@ -133,66 +169,152 @@ void env_free(Env* env) {
 /*  Raw internal lookup helpers (no buffer interaction)                */
 /* ================================================================== */
 
+uint64_t env_name_bit(const char* name) {
+    // FNV-1a folded onto one of 64 bloom bits
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return 1ULL << ((h ^ (h >> 32)) & 63);
+}
+
+// Entry names are interned, so an interned `name` matches by pointer; any
+// other string falls back to strcmp.
 static EnvEntry* env_find_local(Env* env, const char* name) {
     for (size_t i = 0; i < env->count; i++) {
-        if (strcmp(env->entries[i].name, name) == 0) {
+        if (env->entries[i].name == name || strcmp(env->entries[i].name, name) == 0) {
             return &env->entries[i];
         }
     }
     return NULL;
 }
 
-static EnvEntry* env_get_entry_raw(Env* env, const char* name) {
-    for (Env* e = env; e != NULL; e = e->parent) {
-        EnvEntry* entry = env_find_local(e, name);
-        if (entry) return entry;
+// Locate the nearest binding of `name` starting at `env`.  When `sync`
+// is set each Env is read-locked while it is examined, and the owning Env
+// is returned *still read-locked*; the caller must env_rdunlock() it.
+// Returns NULL (nothing locked) if the name is not bound.
+//
+// With a SlotRef the cached coordinate is tried first.  A hit at
+// (depth, slot) is only accepted when every Env below `depth` provably
+// lacks the name (bloom bit clear), so it is the nearest binding exactly
+// as the by-name walk would have found.  On a miss the walk records the
+// new coordinate in `ref`.  A resolved ref carries the interned name, so
+// entries are matched by pointer alone.
+static Env* env_locate(Env* env, const char* name, SlotRef* ref,
+                       EnvEntry** out_entry, bool sync) {
+    uint64_t bit = 0;
+    const char* iname = NULL;
+    int ref_depth, ref_slot;
+    if (ref) {
+        bit = ref->bit ? ref->bit : env_name_bit(name);
+        iname = ref->name;
+    }
+    if (ref && slot_ref_get(ref, &ref_depth, &ref_slot)) {
+        Env* e = env;
+        for (int d = 0; e && d < ref_depth; d++) {
+            env_rdlock(e, sync);
+            bool maybe_here = (e->name_bloom & bit) != 0;
+            env_rdunlock(e, sync);
+            if (maybe_here) { e = NULL; break; }
+            e = e->parent;
+        }
+        if (e) {
+            env_rdlock(e, sync);
+            if (ref_slot >= 0 && (size_t)ref_slot < e->count &&
+                (iname ? e->entries[ref_slot].name == iname
+                       : strcmp(e->entries[ref_slot].name, name) == 0)) {
+                *out_entry = &e->entries[ref_slot];
+                return e;
+            }
+            env_rdunlock(e, sync);
+        }
+    }
+    int depth = 0;
+    for (Env* e = env; e != NULL; e = e->parent, depth++) {
+        env_rdlock(e, sync);
+        if (!bit || (e->name_bloom & bit)) {
+            for (size_t i = 0; i < e->count; i++) {
+                if (iname ? e->entries[i].name == iname
+                          : strcmp(e->entries[i].name, name) == 0) {
+                    if (ref) slot_ref_set(ref, depth, (int)i);
+                    *out_entry = &e->entries[i];
+                    return e;
+                }
+            }
+        }
+        env_rdunlock(e, sync);
     }
     return NULL;
 }
 
-static bool env_get_raw(Env* env, const char* name,
-                        Value* out_value, DeclType* out_type,
-                        bool* out_initialized) {
-    for (Env* e = env; e != NULL; e = e->parent) {
-        EnvEntry* entry = env_find_local(e, name);
-        if (entry) {
-            /* Follow alias chain to the final target */
-            EnvEntry* cur = entry;
-            int depth = 0;
-            while (cur && cur->alias_target) {
-                if (depth++ > 256) return false; /* cycle or too deep */
-                cur = env_get_entry_raw(env, cur->alias_target);
-            }
-            if (!cur) return false;
-            if (out_value)       *out_value = value_copy(cur->value);
-            if (out_type)        *out_type  = cur->decl_type;
-            if (out_initialized) *out_initialized = cur->initialized;
-            return true;
+// Unlocked lookup for the writer side (_direct functions), which runs on
+// the only thread allowed to mutate Env storage.  Optionally reports the
+// owning Env so the caller can write-lock it around the mutation.
+static EnvEntry* env_lookup_raw(Env* env, const char* name, SlotRef* ref, Env** out_owner) {
+    EnvEntry* entry = NULL;
+    Env* owner = env_locate(env, name, ref, &entry, false);
+    if (out_owner) *out_owner = owner;
+    return owner ? entry : NULL;
+}
+
+static EnvEntry* env_get_entry_raw(Env* env, const char* name) {
+    return env_lookup_raw(env, name, NULL, NULL);
+}
+
+// Follow the alias chain of `name` and copy out the final binding.
+static bool env_get_ref_raw(Env* env, const char* name, SlotRef* ref,
+                            Value* out_value, DeclType* out_type,
+                            bool* out_initialized, bool sync) {
+    EnvEntry* entry = NULL;
+    Env* owner = env_locate(env, name, ref, &entry, sync);
+    int depth = 0;
+    while (owner && entry->alias_target) {
+        /* Aliases resolve by name from the starting Env */
+        if (depth++ > 256) { /* cycle or too deep */
+            env_rdunlock(owner, sync);
+            return false;
         }
+        char* target = strdup(entry->alias_target);
+        env_rdunlock(owner, sync);
+        owner = env_locate(env, target, NULL, &entry, sync);
+        free(target);
     }
-    return false;
+    if (!owner) return false;
+    if (out_value)       *out_value = value_copy(entry->value);
+    if (out_type)        *out_type  = entry->decl_type;
+    if (out_initialized) *out_initialized = entry->initialized;
+    env_rdunlock(owner, sync);
+    return true;
 }
 
-static bool env_exists_raw(Env* env, const char* name) {
+static bool env_exists_raw(Env* env, const char* name, bool sync) {
     for (Env* e = env; e != NULL; e = e->parent) {
+        env_rdlock(e, sync);
         EnvEntry* entry = env_find_local(e, name);
-        if (entry && entry->initialized) return true;
+        bool found = entry && entry->initialized;
+        env_rdunlock(e, sync);
+        if (found) return true;
     }
     return false;
 }
 
-static int env_frozen_state_raw(Env* env, const char* name) {
-    EnvEntry* entry = env_get_entry_raw(env, name);
-    if (!entry) return 0;
-    if (entry->permafrozen) return -1;
-    if (entry->frozen) return 1;
-    return 0;
+static int env_frozen_state_raw(Env* env, const char* name, bool sync) {
+    EnvEntry* entry = NULL;
+    Env* owner = env_locate(env, name, NULL, &entry, sync);
+    if (!owner) return 0;
+    int r = entry->permafrozen ? -1 : (entry->frozen ? 1 : 0);
+    env_rdunlock(owner, sync);
+    return r;
 }
 
-static int env_permafrozen_raw(Env* env, const char* name) {
-    EnvEntry* entry = env_get_entry_raw(env, name);
-    if (!entry) return 0;
-    return entry->permafrozen ? 1 : 0;
+static int env_permafrozen_raw(Env* env, const char* name, bool sync) {
+    EnvEntry* entry = NULL;
+    Env* owner = env_locate(env, name, NULL, &entry, sync);
+    if (!owner) return 0;
+    int r = entry->permafrozen ? 1 : 0;
+    env_rdunlock(owner, sync);
+    return r;
 }
 
 static DeclType env_decl_type_from_value(Value value) {
@@ -214,7 +336,10 @@ static DeclType env_decl_type_from_value(Value value) {
 /* ================================================================== */
 
 bool env_define_direct(Env* env, const char* name, DeclType type) {
-    if (env_find_local(env, name) != NULL) return false;
+    const char* owned = value_str_intern(name);
+    if (env_find_local(env, owned) != NULL) return false;
+    bool sync = ns_buffer_active();
+    env_wrlock(env, sync);
     if (env->count + 1 > env->capacity) {
         size_t new_cap = env->capacity == 0 ? 8 : env->capacity * 2;
         env->entries = realloc(env->entries, new_cap * sizeof(EnvEntry));
@@ -225,56 +350,65 @@ bool env_define_direct(Env* env, const char* name, DeclType type) {
         env->capacity = new_cap;
     }
     EnvEntry* entry = &env->entries[env->count++];
-    entry->name = strdup(name);
+    entry->name = owned;
+    env->name_bloom |= env_name_bit(name);
     entry->decl_type = type;
     entry->initialized = false;
     entry->frozen = false;
     entry->permafrozen = false;
     entry->alias_target = NULL;
     entry->value = value_null();
+    env_wrunlock(env, sync);
     return true;
 }
 
-bool env_assign_direct(Env* env, const char* name, Value value,
-                       DeclType type, bool declare_if_missing) {
-    for (Env* e = env; e != NULL; e = e->parent) {
-        EnvEntry* entry = env_find_local(e, name);
-        if (entry) {
-            /* Route through alias chain */
-            if (entry->alias_target) {
-                const char* target_name = entry->alias_target;
-                EnvEntry* target = env_get_entry_raw(env, target_name);
-                if (!target) return false;
-                if (type != TYPE_UNKNOWN && target->decl_type != type) return false;
-                DeclType actual_type = env_decl_type_from_value(value);
-                if (target->decl_type != TYPE_UNKNOWN && actual_type != TYPE_UNKNOWN &&
-                    target->decl_type != actual_type) {
-                    return false;
-                }
-                if (target->frozen || target->permafrozen) return false;
-                if (target->initialized) value_free(target->value);
-                target->value = value_copy(value);
-                target->initialized = true;
-                return true;
-            }
-
-            /* Respect frozen / permafrozen bindings */
-            if (entry->frozen || entry->permafrozen) return false;
-
-            if (type != TYPE_UNKNOWN && entry->decl_type != type) return false;
-
-            DeclType actual_type = env_decl_type_from_value(value);
-            if (entry->decl_type != TYPE_UNKNOWN && actual_type != TYPE_UNKNOWN &&
-                entry->decl_type != actual_type) {
-                return false;
-            }
-
-            if (entry->initialized) value_free(entry->value);
-            entry->value = value_copy(value);
-            entry->initialized = true;
-            return true;
+// Store `value` into an already-located binding, routing through aliases.
+// `owner` is the Env holding `entry`.
+static bool env_store_entry_raw(Env* env, Env* owner, EnvEntry* entry,
+                                Value value, DeclType type, bool sync) {
+    /* Route through alias chain */
+    if (entry->alias_target) {
+        const char* target_name = entry->alias_target;
+        EnvEntry* target = env_lookup_raw(env, target_name, NULL, &owner);
+        if (!target) return false;
+        if (type != TYPE_UNKNOWN && target->decl_type != type) return false;
+        DeclType actual_type = env_decl_type_from_value(value);
+        if (target->decl_type != TYPE_UNKNOWN && actual_type != TYPE_UNKNOWN &&
+            target->decl_type != actual_type) {
+            return false;
+        }
+        if (target->frozen || target->permafrozen) return false;
+        entry = target;
+    } else {
+        /* Respect frozen / permafrozen bindings */
+        if (entry->frozen || entry->permafrozen) return false;
+
+        if (type != TYPE_UNKNOWN && entry->decl_type != type) return false;
+
+        DeclType actual_type = env_decl_type_from_value(value);
+        if (entry->decl_type != TYPE_UNKNOWN && actual_type != TYPE_UNKNOWN &&
+            entry->decl_type != actual_type) {
+            return false;
         }
     }
+
+    Value stored = value_copy(value);
+    env_wrlock(owner, sync);
+    Value old = entry->initialized ? entry->value : value_null();
+    entry->value = stored;
+    entry->initialized = true;
+    env_wrunlock(owner, sync);
+    value_free(old);
+    return true;
+}
+
+static bool env_assign_ref_direct(Env* env, const char* name, SlotRef* ref,
+                                  Value value, DeclType type,
+                                  bool declare_if_missing) {
+    bool sync = ns_buffer_active();
+    Env* owner = NULL;
+    EnvEntry* entry = env_lookup_raw(env, name, ref, &owner);
+    if (entry) return env_store_entry_raw(env, owner, entry, value, type, sync);
     if (!declare_if_missing) return false;
     if (type == TYPE_UNKNOWN) return false;
     DeclType actual_type = env_decl_type_from_value(value);
@@ -282,35 +416,60 @@ bool env_assign_direct(Env* env, const char* name, Value value,
         return false;
     }
     if (!env_define_direct(env, name, type)) return false;
-    EnvEntry* entry = env_find_local(env, name);
-    if (!entry) return false;
-    entry->value = value_copy(value);
+    Value stored = value_copy(value);
+    env_wrlock(env, sync);
+    entry = &env->entries[env->count - 1];
+    if (ref) slot_ref_set(ref, 0, (int)(env->count - 1));
+    entry->value = stored;
     entry->initialized = true;
+    env_wrunlock(env, sync);
     return true;
 }
 
-bool env_delete_direct(Env* env, const char* name) {
-    for (Env* e = env; e != NULL; e = e->parent) {
-        EnvEntry* entry = env_find_local(e, name);
-        if (entry) {
-            if (entry->frozen || entry->permafrozen) return false;
-            if (entry->initialized) value_free(entry->value);
-            if (entry->alias_target) {
-                free(entry->alias_target);
-                entry->alias_target = NULL;
-            }
-            entry->initialized = false;
-            entry->value = value_null();
-            return true;
-        }
+bool env_assign_direct(Env* env, const char* name, Value value,
+                       DeclType type, bool declare_if_missing) {
+    return env_assign_ref_direct(env, name, NULL, value, type, declare_if_missing);
+}
+
+bool env_update_direct(Env* env, const char* name, EnvUpdateFn fn, void* ctx) {
+    bool sync = ns_buffer_active();
+    Env* owner = NULL;
+    EnvEntry* entry = env_lookup_raw(env, name, NULL, &owner);
+    int depth = 0;
+    while (entry && entry->alias_target) {
+        if (depth++ > 256) return false; /* cycle or too deep */
+        entry = env_lookup_raw(env, entry->alias_target, NULL, &owner);
     }
-    return false;
+    if (!entry) return false;
+    env_wrlock(owner, sync);
+    fn(entry, ctx);
+    env_wrunlock(owner, sync);
+    return true;
+}
+
+bool env_delete_direct(Env* env, const char* name) {
+    bool sync = ns_buffer_active();
+    Env* owner = NULL;
+    EnvEntry* entry = env_lookup_raw(env, name, NULL, &owner);
+    if (!entry) return false;
+    if (entry->frozen || entry->permafrozen) return false;
+    env_wrlock(owner, sync);
+    Value old = entry->initialized ? entry->value : value_null();
+    char* old_alias = entry->alias_target;
+    entry->alias_target = NULL;
+    entry->initialized = false;
+    entry->value = value_null();
+    env_wrunlock(owner, sync);
+    value_free(old);
+    free(old_alias);
+    return true;
 }
 
 bool env_set_alias_direct(Env* env, const char* name,
                           const char* target_name, DeclType type,
                           bool declare_if_missing) {
     if (!env || !name || !target_name) return false;
+    bool sync = ns_buffer_active();
 
     /* Ensure the target exists */
     EnvEntry* target = env_get_entry_raw(env, target_name);
@@ -342,49 +501,66 @@ bool env_set_alias_direct(Env* env, const char* name,
         if (!env_define_direct(env, name, type)) return false;
         entry = env_find_local(env, name);
         if (!entry) return false;
+        /* env_define_direct may have moved the entry table */
+        cur = env_get_entry_raw(env, target_name);
+        while (cur && cur->alias_target) cur = env_get_entry_raw(env, cur->alias_target);
+        if (!cur) return false;
     }
 
     /* Respect frozen state on the entry itself */
     if (entry->frozen || entry->permafrozen) return false;
 
+    char* new_alias = strdup(cur->name);
+    env_wrlock(env, sync);
     /* Overwrite declared type with target's type */
     entry->decl_type = cur->decl_type;
 
     /* Clear any stored value and set alias */
-    if (entry->initialized) {
-        value_free(entry->value);
-        entry->initialized = false;
-        entry->value = value_null();
-    }
-    if (entry->alias_target) {
-        free(entry->alias_target);
-        entry->alias_target = NULL;
-    }
-    entry->alias_target = strdup(cur->name);
+    Value old = entry->initialized ? entry->value : value_null();
+    char* old_alias = entry->alias_target;
+    entry->value = value_null();
+    entry->alias_target = new_alias;
     entry->initialized = true; /* alias is considered initialised */
+    env_wrunlock(env, sync);
+    value_free(old);
+    free(old_alias);
     return true;
 }
 
+// Flag updates are single-field stores; the write lock keeps them from
+// interleaving with a reader's snapshot of the same table.
 int env_freeze_direct(Env* env, const char* name) {
-    EnvEntry* entry = env_get_entry_raw(env, name);
+    bool sync = ns_buffer_active();
+    Env* owner = NULL;
+    EnvEntry* entry = env_lookup_raw(env, name, NULL, &owner);
     if (!entry) return -1;
+    env_wrlock(owner, sync);
     entry->frozen = true;
+    env_wrunlock(owner, sync);
     return 0;
 }
 
 int env_thaw_direct(Env* env, const char* name) {
-    EnvEntry* entry = env_get_entry_raw(env, name);
+    bool sync = ns_buffer_active();
+    Env* owner = NULL;
+    EnvEntry* entry = env_lookup_raw(env, name, NULL, &owner);
     if (!entry) return -1;
     if (entry->permafrozen) return -2;
+    env_wrlock(owner, sync);
     entry->frozen = false;
+    env_wrunlock(owner, sync);
     return 0;
 }
 
 int env_permafreeze_direct(Env* env, const char* name) {
-    EnvEntry* entry = env_get_entry_raw(env, name);
+    bool sync = ns_buffer_active();
+    Env* owner = NULL;
+    EnvEntry* entry = env_lookup_raw(env, name, NULL, &owner);
     if (!entry) return -1;
+    env_wrlock(owner, sync);
     entry->permafrozen = true;
     entry->frozen = true;
+    env_wrunlock(owner, sync);
     return 0;
 }
 
@@ -406,6 +582,19 @@ bool env_assign(Env* env, const char* name, Value value,
     return env_assign_direct(env, name, value, type, declare_if_missing);
 }
 
+bool env_assign_ref(Env* env, const char* name, SlotRef* ref, Value value,
+                    DeclType type, bool declare_if_missing) {
+    if (ns_buffer_active())
+        return ns_buffer_assign(env, name, value, type, declare_if_missing);
+    return env_assign_ref_direct(env, name, ref, value, type, declare_if_missing);
+}
+
+bool env_update(Env* env, const char* name, EnvUpdateFn fn, void* ctx) {
+    if (ns_buffer_active())
+        return ns_buffer_update(env, name, fn, ctx);
+    return env_update_direct(env, name, fn, ctx);
+}
+
 bool env_delete(Env* env, const char* name) {
     if (ns_buffer_active())
         return ns_buffer_delete(env, name);
@@ -441,73 +630,65 @@ int env_permafreeze(Env* env, const char* name) {
 
 /* ================================================================== */
 /*  Public API – read operations                                       */
-/*  Block until the queried symbol's pending writes are drained, then  */
-/*  acquire the env-access lock for a safe read.                       */
+/*  Wait until the queried symbol's pending writes are drained, then   */
+/*  read under the per-Env read locks.                                 */
 /* ================================================================== */
 
 EnvEntry* env_get_entry(Env* env, const char* name) {
     EnvEntry* snap = env_entry_snap_alloc();
-    if (ns_buffer_active()) {
-        ns_buffer_read_lock(name);
-        EnvEntry* entry = env_get_entry_raw(env, name);
-        env_entry_snap_from_raw(snap, entry);
-        ns_buffer_read_unlock();
-        if (!entry) {
-            env_entry_snap_clear(snap);
-            return NULL;
-        }
-        return snap;
-    }
-
-    EnvEntry* entry = env_get_entry_raw(env, name);
-    env_entry_snap_from_raw(snap, entry);
-    if (!entry) {
+    bool sync = ns_buffer_active();
+    if (sync) ns_buffer_read_wait(name);
+    EnvEntry* entry = NULL;
+    Env* owner = env_locate(env, name, NULL, &entry, sync);
+    if (!owner) {
         // Clear to a canonical empty state and return NULL for not-found.
         env_entry_snap_clear(snap);
         return NULL;
     }
+    env_entry_snap_from_raw(snap, entry);
+    env_rdunlock(owner, sync);
     return snap;
 }
 
 bool env_get(Env* env, const char* name, Value* out_value,
              DeclType* out_type, bool* out_initialized) {
-    if (ns_buffer_active()) {
-        ns_buffer_read_lock(name);
-        bool r = env_get_raw(env, name, out_value, out_type, out_initialized);
-        ns_buffer_read_unlock();
-        return r;
-    }
-    return env_get_raw(env, name, out_value, out_type, out_initialized);
+    return env_get_ref(env, name, NULL, out_value, out_type, out_initialized);
+}
+
+bool env_get_ref(Env* env, const char* name, SlotRef* ref, Value* out_value,
+                 DeclType* out_type, bool* out_initialized) {
+    bool sync = ns_buffer_active();
+    if (sync) ns_buffer_read_wait(name);
+    return env_get_ref_raw(env, name, ref, out_value, out_type, out_initialized, sync);
+}
+
+bool env_decl_type_ref(Env* env, const char* name, SlotRef* ref, DeclType* out_type) {
+    bool sync = ns_buffer_active();
+    if (sync) ns_buffer_read_wait(name);
+    EnvEntry* entry = NULL;
+    Env* owner = env_locate(env, name, ref, &entry, sync);
+    if (!owner) return false;
+    if (out_type) *out_type = entry->decl_type;
+    env_rdunlock(owner, sync);
+    return true;
 }
 
 bool env_exists(Env* env, const char* name) {
-    if (ns_buffer_active()) {
-        ns_buffer_read_lock(name);
-        bool r = env_exists_raw(env, name);
-        ns_buffer_read_unlock();
-        return r;
-    }
-    return env_exists_raw(env, name);
+    bool sync = ns_buffer_active();
+    if (sync) ns_buffer_read_wait(name);
+    return env_exists_raw(env, name, sync);
 }
 
 int env_frozen_state(Env* env, const char* name) {
-    if (ns_buffer_active()) {
-        ns_buffer_read_lock(name);
-        int r = env_frozen_state_raw(env, name);
-        ns_buffer_read_unlock();
-        return r;
-    }
-    return env_frozen_state_raw(env, name);
+    bool sync = ns_buffer_active();
+    if (sync) ns_buffer_read_wait(name);
+    return env_frozen_state_raw(env, name, sync);
 }
 
 int env_permafrozen(Env* env, const char* name) {
-    if (ns_buffer_active()) {
-        ns_buffer_read_lock(name);
-        int r = env_permafrozen_raw(env, name);
-        ns_buffer_read_unlock();
-        return r;
-    }
-    return env_permafrozen_raw(env, name);
+    bool sync = ns_buffer_active();
+    if (sync) ns_buffer_read_wait(name);
+    return env_permafrozen_raw(env, name, sync);
 }
 
 /* ================================================================== */
@@ -4,7 +4,7 @@
 #include "value.h"
 
 typedef struct EnvEntry {
-    char* name;
+    const char* name;   // interned (value_str_intern), never freed
     DeclType decl_type;
     Value value;
     bool initialized;
@@ -20,11 +20,24 @@ typedef struct Env {
     size_t count;
     size_t capacity;
     int refcount;
+    // One bit per env_name_bit() of every name ever defined here.  Entries
+    // are never removed (DEL only uninitialises them), so a clear bit
+    // proves a name is absent without scanning entries.
+    uint64_t name_bloom;
+    // Guards entries/count/capacity and entry contents while the namespace
+    // buffer is active (see env.c for the locking protocol).
+    rwl_t lock;
 } Env;
 
 Env* env_create(Env* parent);
 void env_retain(Env* env);
 void env_free(Env* env);
+// Drop every binding but keep the entry storage, so a scratch Env can be
+// reused.  Only valid while the caller is the sole user of `env`.
+void env_clear(Env* env);
+// Grow the entry storage to hold at least `capacity` bindings.  Only valid
+// while the caller is the sole user of `env`.
+void env_reserve(Env* env, size_t capacity);
 
 bool env_define(Env* env, const char* name, DeclType type);
 bool env_assign(Env* env, const char* name, Value value, DeclType type, bool declare_if_missing);
@@ -38,6 +51,24 @@ bool env_exists(Env* env, const char* name);
 // Returns NULL if not found.
 EnvEntry* env_get_entry(Env* env, const char* name);
 
+// Slot-cached variants of env_get / env_assign used by the interpreter for
+// resolved identifiers (see SlotRef in ast.h).  `ref` is validated before
+// use and refreshed from the by-name walk on a miss; aliases always take
+// the by-name path.  Passing ref == NULL behaves like the plain call.
+uint64_t env_name_bit(const char* name);
+bool env_get_ref(Env* env, const char* name, SlotRef* ref, Value* out_value, DeclType* out_type, bool* out_initialized);
+bool env_assign_ref(Env* env, const char* name, SlotRef* ref, Value value, DeclType type, bool declare_if_missing);
+// Look up the binding itself (without following aliases) and report its
+// declared type.  Returns false if no binding exists in the chain.
+bool env_decl_type_ref(Env* env, const char* name, SlotRef* ref, DeclType* out_type);
+
+// Atomic read-modify-write of a binding.  `fn` runs with exclusive access
+// to the final binding (aliases followed) and may change its value and
+// initialized flag in place.  It must not call back into env_* or
+// evaluate expressions.  Returns false if `name` is not bound.
+typedef void (*EnvUpdateFn)(EnvEntry* entry, void* ctx);
+bool env_update(Env* env, const char* name, EnvUpdateFn fn, void* ctx);
+
 // Create or update an alias (pointer) binding: `name` will become an alias to `target_name`.
 // If declare_if_missing is true, `name` will be defined if absent. Returns true on success.
 bool env_set_alias(Env* env, const char* name, const char* target_name, DeclType type, bool declare_if_missing);
@@ -69,6 +100,7 @@ int env_permafrozen(Env* env, const char* name);
 
 bool env_define_direct(Env* env, const char* name, DeclType type);
 bool env_assign_direct(Env* env, const char* name, Value value, DeclType type, bool declare_if_missing);
+bool env_update_direct(Env* env, const char* name, EnvUpdateFn fn, void* ctx);
 bool env_delete_direct(Env* env, const char* name);
 bool env_set_alias_direct(Env* env, const char* name, const char* target_name, DeclType type, bool declare_if_missing);
 int  env_freeze_direct(Env* env, const char* name);
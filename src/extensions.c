@@ -1,6 +1,7 @@
 #include "extensions.h"
 #include "prefix_extension.h"
 #include "builtins.h"
+#include "thread_pool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -253,6 +254,18 @@ static int ctx_register_repl_handler(prefix_repl_fn repl_fn) {
     return 0;
 }
 
+static int ctx_tns_acquire(Value* tensor, int flags, TnsBuffer* out) {
+    return value_tns_acquire(tensor, flags, out) ? 0 : -1;
+}
+
+static Value ctx_tns_alloc(DeclType elem_type, size_t ndim, const size_t* shape, TnsBuffer* out) {
+    memset(out, 0, sizeof(*out));
+    if (elem_type != TYPE_INT && elem_type != TYPE_FLT) return value_null();
+    Value v = value_tns_new(elem_type, ndim, shape);
+    value_tns_acquire(&v, TNS_ACQUIRE_WRITE, out);
+    return v;
+}
+
 static DynLibHandle dyn_open_library(const char* path) {
 #ifdef _WIN32
     return LoadLibraryExA(path, NULL, 0);
@@ -346,6 +359,10 @@ int extensions_load_library(const char* path, const char* base_dir, char** error
     ctx.register_periodic_hook = ctx_register_periodic_hook;
     ctx.register_event_handler = ctx_register_event_handler;
     ctx.register_repl_handler = ctx_register_repl_handler;
+    ctx.tns_acquire = ctx_tns_acquire;
+    ctx.tns_release = value_tns_release;
+    ctx.tns_alloc = ctx_tns_alloc;
+    ctx.parallel_for = thread_pool_run;
 
     g_loading_extension_name = ext_name;
     init_fn(&ctx);
@@ -1,6 +1,9 @@
 #include "interpreter.h"
 #include "builtins.h"
 #include "ns_buffer.h"
+#include "optimizer.h"
+#include "thread_pool.h"
+#include "vm.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,22 +13,18 @@
 #endif
 
 // Forward declarations
-static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap* labels);
 static ExecResult exec_stmt_list(Interpreter* interp, StmtList* list, Env* env, LabelMap* labels);
 
-static void wait_if_paused(Interpreter* interp) {
+void wait_if_paused(Interpreter* interp) {
     if (!interp || !interp->current_thr) return;
     Thr* th = interp->current_thr;
     if (!th) return;
     Value thv;
     thv.type = VAL_THR;
     thv.as.thr = th;
-    while (value_thr_get_paused(thv) && !value_thr_get_finished(thv)) {
-        thrd_yield();
-    }
+    value_thr_wait_unpaused(thv);
 }
 
-static mtx_t g_tns_lock;
 static mtx_t g_parfor_merge_lock;
 
 static const char* stmt_type_name(StmtType type) {
@@ -87,30 +86,50 @@ static void trace_pop_frame(Interpreter* interp) {
     interp->trace_stack_count--;
 }
 
-static void trace_log_step(Interpreter* interp, Stmt* stmt, Env* env) {
-    if (!interp || !stmt) return;
-    if (interp->private_mode) return;
+void trace_log_step_slow(Interpreter* interp, Stmt* stmt, Env* env) {
+    if (!interp || !stmt || interp->private_mode) return;
     if (interp->trace_stack_count == 0) {
         if (trace_push_frame(interp, "<top-level>", env ? env : interp->global_env, 0, 0, 0) != 0) return;
     }
 
     TraceFrame* frame = &interp->trace_stack[interp->trace_stack_count - 1];
     frame->env = env;
-    frame->last_step_index = interp->trace_next_step_index;
-    snprintf(frame->state_id, sizeof(frame->state_id), "s_%06d", interp->trace_next_step_index);
-    frame->has_state_entry = 1;
-    frame->last_line = stmt->line;
-    frame->last_col = stmt->column;
-    if (stmt && stmt->src_text && stmt->src_text[0]) {
-        // store a short snippet of the original source line
-        snprintf(frame->last_statement, sizeof(frame->last_statement), "%s", stmt->src_text);
-    } else {
-        snprintf(frame->last_statement, sizeof(frame->last_statement), "%s", stmt_type_name(stmt->type));
+    frame->last_stmt = stmt;
+    frame->last_step_index = interp->trace_next_step_index++;
+    interp->trace_last_stmt = stmt;
+
+    if (interp->trace_ring && --interp->trace_sample_countdown <= 0) {
+        interp->trace_sample_countdown = interp->trace_sample_every;
+        TraceSample* sample = &interp->trace_ring[interp->trace_ring_count++ % TRACE_RING_SIZE];
+        sample->step_index = frame->last_step_index;
+        sample->depth = interp->trace_stack_count;
+        sample->stmt = stmt;
     }
+}
+
+int interpreter_set_trace_sampling(Interpreter* interp, int every) {
+    if (!interp) return -1;
+    if (every <= 0) {
+        free(interp->trace_ring);
+        interp->trace_ring = NULL;
+        interp->trace_sample_every = 0;
+        return 0;
+    }
+    if (!interp->trace_ring) {
+        interp->trace_ring = calloc(TRACE_RING_SIZE, sizeof(TraceSample));
+        if (!interp->trace_ring) return -1;
+    }
+    interp->trace_ring_count = 0;
+    interp->trace_sample_every = every;
+    interp->trace_sample_countdown = every;
+    return 0;
+}
 
-    snprintf(interp->trace_last_state_id, sizeof(interp->trace_last_state_id), "%s", frame->state_id);
-    snprintf(interp->trace_last_rule, sizeof(interp->trace_last_rule), "%s", stmt_type_name(stmt->type));
-    interp->trace_next_step_index++;
+// One-line excerpt of a statement: its source text, or failing that its
+// kind.  Long lines are cut as the state log always has.
+static void trace_stmt_excerpt(char* out, size_t size, const Stmt* stmt) {
+    if (stmt->src_text && stmt->src_text[0]) snprintf(out, size, "%.63s", stmt->src_text);
+    else snprintf(out, size, "%s", stmt_type_name(stmt->type));
 }
 
 static void trace_append(char** dst, size_t* len, size_t* cap, const char* text) {
@@ -164,7 +183,7 @@ char* interpreter_format_traceback(Interpreter* interp, const char* error_msg, i
     for (size_t i = 0; i < interp->trace_stack_count; i++) {
         TraceFrame* frame = &interp->trace_stack[i];
         int frame_line = 0;
-        if (frame->has_state_entry) frame_line = frame->last_line;
+        if (frame->last_stmt) frame_line = frame->last_stmt->line;
         else if (frame->has_call_location) frame_line = frame->call_line;
         else frame_line = line;
 
@@ -172,10 +191,12 @@ char* interpreter_format_traceback(Interpreter* interp, const char* error_msg, i
         snprintf(row, sizeof(row), "  File \"%s\", line %d, in %s\n", file, frame_line > 0 ? frame_line : 0, frame->name ? frame->name : "<frame>");
         trace_append(&out, &len, &cap, row);
 
-        if (frame->has_state_entry && frame->last_statement[0] != '\0') {
-            snprintf(row, sizeof(row), "    %s\n", frame->last_statement);
+        if (frame->last_stmt) {
+            char excerpt[64];
+            trace_stmt_excerpt(excerpt, sizeof(excerpt), frame->last_stmt);
+            snprintf(row, sizeof(row), "    %s\n", excerpt);
             trace_append(&out, &len, &cap, row);
-            snprintf(row, sizeof(row), "    State log index: %d  State id: %s\n", frame->last_step_index, frame->state_id);
+            snprintf(row, sizeof(row), "    State log index: %d  State id: s_%06d\n", frame->last_step_index, frame->last_step_index);
             trace_append(&out, &len, &cap, row);
             if (interp->verbose && !interp->private_mode) {
                 char* snap = trace_env_snapshot(frame->env);
@@ -189,22 +210,54 @@ char* interpreter_format_traceback(Interpreter* interp, const char* error_msg, i
         }
     }
 
+    if (interp->trace_ring && interp->trace_ring_count > 0) {
+        size_t kept = interp->trace_ring_count < TRACE_RING_SIZE ? interp->trace_ring_count : TRACE_RING_SIZE;
+        char row[512];
+        snprintf(row, sizeof(row), "Sampled steps (every %d, most recent last):\n", interp->trace_sample_every);
+        trace_append(&out, &len, &cap, row);
+        for (size_t k = interp->trace_ring_count - kept; k < interp->trace_ring_count; k++) {
+            TraceSample* sample = &interp->trace_ring[k % TRACE_RING_SIZE];
+            if (!sample->stmt) continue;  // its program is gone
+            char excerpt[64];
+            trace_stmt_excerpt(excerpt, sizeof(excerpt), sample->stmt);
+            snprintf(row, sizeof(row), "  s_%06d  line %d  depth %zu: %s\n",
+                     sample->step_index, sample->stmt->line, sample->depth, excerpt);
+            trace_append(&out, &len, &cap, row);
+        }
+    }
+
     char tail[512];
     snprintf(tail, sizeof(tail), "RuntimeError: %s (rewrite: %s)",
              error_msg ? error_msg : "runtime error",
-             interp->trace_last_rule[0] ? interp->trace_last_rule : "runtime");
+             interp->trace_last_stmt ? stmt_type_name(interp->trace_last_stmt->type) : "runtime");
     trace_append(&out, &len, &cap, tail);
 
     if (!out) return strdup(error_msg ? error_msg : "Runtime error");
     return out;
 }
 
+void interpreter_forget_arena(Interpreter* interp, const AstArena* arena) {
+    if (!interp || !arena) return;
+    for (size_t i = 0; i < interp->trace_stack_count; i++) {
+        TraceFrame* frame = &interp->trace_stack[i];
+        if (frame->last_stmt && frame->last_stmt->arena == arena) frame->last_stmt = NULL;
+    }
+    if (interp->trace_last_stmt && interp->trace_last_stmt->arena == arena) interp->trace_last_stmt = NULL;
+    if (interp->trace_ring) {
+        for (size_t k = 0; k < TRACE_RING_SIZE; k++) {
+            TraceSample* sample = &interp->trace_ring[k];
+            if (sample->stmt && sample->stmt->arena == arena) sample->stmt = NULL;
+        }
+    }
+}
+
 void interpreter_reset_traceback(Interpreter* interp, Env* top_env) {
     if (!interp) return;
     while (interp->trace_stack_count > 0) trace_pop_frame(interp);
     interp->trace_next_step_index = 0;
-    snprintf(interp->trace_last_state_id, sizeof(interp->trace_last_state_id), "seed");
-    interp->trace_last_rule[0] = '\0';
+    interp->trace_last_stmt = NULL;
+    interp->trace_ring_count = 0;
+    interp->trace_sample_countdown = interp->trace_sample_every;
     if (top_env && !interp->private_mode) {
         (void)trace_push_frame(interp, "<top-level>", top_env, 0, 0, 0);
     }
@@ -221,11 +274,12 @@ static int thr_worker(void* arg) {
     ThrStart* start = (ThrStart*)arg;
     LabelMap labels = {0};
     start->interp->current_thr = start->thr_val.as.thr;
+    profile_thread_begin();
     ExecResult res = exec_stmt(start->interp, start->body, start->env, &labels);
+    profile_thread_end();
 
     // Clean up labels
-    for (size_t i = 0; i < labels.count; i++) value_free(labels.items[i].key);
-    free(labels.items);
+    label_map_free(&labels);
 
     if (res.status == EXEC_RETURN || res.status == EXEC_OK || res.status == EXEC_GOTO) {
         value_free(res.value);
@@ -234,41 +288,107 @@ static int thr_worker(void* arg) {
         free(res.error);
     }
 
-    value_thr_set_finished(start->thr_val, 1);
+    value_thr_set_exited(start->thr_val);
     value_free(start->thr_val);
     /* `start->env` points at the caller's environment (shared); the
      * worker must not free it. Ownership remains with the parent
      * interpreter which will free the env when appropriate.
      */
+    interpreter_free_call_arena(start->interp);
     free(start->interp);
     free(start);
+    ns_buffer_worker_exit();
+    value_pool_thread_exit();
     return 0;
 }
 
+// What one pool chunk of a PARFOR leaves behind: the last binding of each
+// name its iterations declared, and its first error.  Chunks with
+// neither record nothing.
+typedef struct ParforChunk {
+    size_t begin;           // first iteration of the chunk
+    EnvEntry* bindings;     // owned values and alias targets, no counter
+    size_t count;
+    size_t capacity;
+    size_t last_bound;      // latest iteration that contributed a binding
+    char* error;            // first error of the chunk, or NULL
+    size_t err_index;
+    int err_line;
+    int err_col;
+    struct ParforChunk* next;
+} ParforChunk;
+
+// Shared state of one PARFOR statement, handed to every pool chunk.
 typedef struct {
-    Interpreter* interp;
-    Env* env;
+    Interpreter* parent;
+    Env* env;            // enclosing env of the PARFOR
     Stmt* body;
-    char** errors; // shared array, one slot per iteration
-    int index; // iteration index
-    Value thr_val;
-    int* err_lines;
-    int* err_cols;
     const char* counter_name;
-} ParforStart;
+    ParforChunk* chunks; // finished chunks, any order (g_parfor_merge_lock)
+} ParforJob;
+
+// Keep `src` as the chunk's binding for its name, taking ownership of its
+// value and alias target.  A later iteration's binding replaces an
+// earlier one, except that a declaration without a value leaves an
+// earlier value in place, as merging the two in order would.
+static void parfor_chunk_bind(ParforChunk* chunk, EnvEntry* src) {
+    for (size_t i = 0; i < chunk->count; i++) {
+        EnvEntry* kept = &chunk->bindings[i];
+        if (strcmp(kept->name, src->name) != 0) continue;
+        if (!src->initialized && !src->alias_target && !kept->alias_target) return;
+        if (kept->initialized) value_free(kept->value);
+        free(kept->alias_target);
+        *kept = *src;
+        return;
+    }
+    if (chunk->count == chunk->capacity) {
+        size_t cap = chunk->capacity ? chunk->capacity * 2 : 8;
+        EnvEntry* grown = realloc(chunk->bindings, cap * sizeof(EnvEntry));
+        if (!grown) { fprintf(stderr, "Out of memory\n"); exit(1); }
+        chunk->bindings = grown;
+        chunk->capacity = cap;
+    }
+    chunk->bindings[chunk->count++] = *src;
+}
 
-static int parfor_merge_iteration_env(ParforStart* start, char** merge_error) {
-    if (merge_error) *merge_error = NULL;
-    if (!start || !start->env || !start->env->parent) return 0;
+// Move the bindings iteration `index` declared in `iter_env` into the
+// chunk.  `iter_env` is left empty when the caller is its only user and
+// is copied from otherwise (a closure made in the body still refers to
+// it).
+static void parfor_chunk_collect(ParforChunk* chunk, Env* iter_env, const char* counter_name, size_t index) {
+    bool move = iter_env->refcount == 1;
+    for (size_t i = 0; i < iter_env->count; i++) {
+        EnvEntry* entry = &iter_env->entries[i];
+        if (!entry->name || strcmp(entry->name, counter_name) == 0) continue;
+        EnvEntry kept = *entry;
+        if (move) {
+            entry->initialized = false;
+            entry->alias_target = NULL;
+        } else {
+            if (kept.initialized) kept.value = value_copy(kept.value);
+            if (kept.alias_target) kept.alias_target = strdup(kept.alias_target);
+        }
+        parfor_chunk_bind(chunk, &kept);
+    }
+    chunk->last_bound = index;
+}
 
-    Env* iter_env = start->env;
-    Env* parent_env = iter_env->parent;
+static void parfor_chunk_free(ParforChunk* chunk) {
+    for (size_t i = 0; i < chunk->count; i++) {
+        if (chunk->bindings[i].initialized) value_free(chunk->bindings[i].value);
+        free(chunk->bindings[i].alias_target);
+    }
+    free(chunk->bindings);
+    free(chunk->error);
+    free(chunk);
+}
+
+static int parfor_merge_bindings(Env* parent_env, const EnvEntry* bindings, size_t count, char** merge_error) {
+    if (merge_error) *merge_error = NULL;
 
     mtx_lock(&g_parfor_merge_lock);
-    for (size_t i = 0; i < iter_env->count; i++) {
-        EnvEntry* entry = &iter_env->entries[i];
-        if (!entry->name) continue;
-        if (start->counter_name && strcmp(entry->name, start->counter_name) == 0) continue;
+    for (size_t i = 0; i < count; i++) {
+        const EnvEntry* entry = &bindings[i];
 
         if (entry->alias_target) {
             if (!env_set_alias(parent_env, entry->name, entry->alias_target, entry->decl_type, true)) {
@@ -302,49 +422,98 @@ static int parfor_merge_iteration_env(ParforStart* start, char** merge_error) {
     return 0;
 }
 
-static int parfor_worker(void* arg) {
-    ParforStart* start = (ParforStart*)arg;
-    LabelMap labels = {0};
-    start->interp->current_thr = start->thr_val.as.thr;
-    ExecResult res = exec_stmt(start->interp, start->body, start->env, &labels);
+static int parfor_chunk_order(const void* a, const void* b) {
+    size_t x = (*(ParforChunk* const*)a)->begin;
+    size_t y = (*(ParforChunk* const*)b)->begin;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
 
-    char* merge_error = NULL;
-    if (res.status != EXEC_ERROR) {
-        (void)parfor_merge_iteration_env(start, &merge_error);
-    }
+// Run PARFOR iterations [begin, end) on one pool thread.  The chunk keeps
+// one scratch Interpreter and one iteration Env, cleared between
+// iterations, so a later iteration never observes an earlier one's
+// locals.  What the iterations declared is folded into a ParforChunk as
+// they finish and merged into the enclosing Env once every chunk is
+// done, so memory grows with the number of names, not of iterations.
+static void parfor_chunk(void* arg, size_t begin, size_t end) {
+    ParforJob* job = (ParforJob*)arg;
+
+    Interpreter scratch = (Interpreter){0};
+    scratch.global_env = job->parent->global_env;
+    scratch.in_try_block = job->parent->in_try_block;
+    scratch.modules = job->parent->modules;
+    scratch.shushed = job->parent->shushed;
+    scratch.isolate_env_writes = true;
+
+    ParforChunk* chunk = calloc(1, sizeof(ParforChunk));
+    if (!chunk) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    chunk->begin = begin;
+
+    Env* iter_env = NULL;
+    for (size_t i = begin; i < end; i++) {
+        if (!iter_env) iter_env = env_create(job->env);
+        int64_t idx = (int64_t)i + 1; /* iterations are 1-based */
+        /* Always define the counter locally so it shadows any
+           same-named binding in a parent env. */
+        env_define(iter_env, job->counter_name, TYPE_INT);
+        if (!env_assign(iter_env, job->counter_name, value_int(idx), TYPE_INT, false)) {
+            if (!chunk->error) {
+                char buf[256];
+                snprintf(buf, sizeof(buf), "Cannot assign to frozen identifier '%s'", job->counter_name);
+                chunk->error = strdup(buf);
+                chunk->err_index = i;
+            }
+            env_clear(iter_env);
+            continue;
+        }
 
-    for (size_t i = 0; i < labels.count; i++) value_free(labels.items[i].key);
-    free(labels.items);
+        LabelMap labels = {0};
+        ExecResult res = exec_stmt(&scratch, job->body, iter_env, &labels);
 
-    if (res.status == EXEC_ERROR && res.error) {
-        // Transfer ownership of the error string into shared array
-        start->errors[start->index] = res.error;
-        /* record original error location so parent can report/handle it */
-        if (start->err_lines) start->err_lines[start->index] = res.error_line;
-        if (start->err_cols) start->err_cols[start->index] = res.error_column;
-    } else if (merge_error) {
-        if (res.status == EXEC_RETURN || res.status == EXEC_OK || res.status == EXEC_GOTO) {
+        label_map_free(&labels);
+
+        if (res.status == EXEC_ERROR && res.error) {
+            /* keep the chunk's first error and its original location */
+            if (!chunk->error) {
+                chunk->error = res.error;
+                chunk->err_index = i;
+                chunk->err_line = res.error_line;
+                chunk->err_col = res.error_column;
+            } else {
+                free(res.error);
+            }
+        } else if (res.status == EXEC_RETURN || res.status == EXEC_OK || res.status == EXEC_GOTO) {
             value_free(res.value);
         }
-        if (res.status == EXEC_ERROR && res.error) free(res.error);
-        start->errors[start->index] = merge_error;
-    } else {
-        if (res.status == EXEC_RETURN || res.status == EXEC_OK || res.status == EXEC_GOTO) {
-            value_free(res.value);
+
+        /* Reset the scratch state for the next iteration. */
+        if (scratch.error) { free(scratch.error); scratch.error = NULL; }
+        scratch.error_line = 0;
+        scratch.error_col = 0;
+        scratch.loop_depth = 0;
+        interpreter_reset_traceback(&scratch, NULL);
+        if (res.status != EXEC_ERROR && iter_env->count > 1) {
+            parfor_chunk_collect(chunk, iter_env, job->counter_name, i);
+        }
+        if (iter_env->refcount == 1) {
+            env_clear(iter_env);
+        } else {
+            env_free(iter_env);
+            iter_env = NULL;
         }
-        if (res.status == EXEC_ERROR && res.error) free(res.error);
     }
 
-    value_thr_set_finished(start->thr_val, 1);
-    /* Null out env on the Thr handle before freeing so the handle
-       (which may still be referenced until the join completes) does
-       not carry a dangling pointer. */
-    if (start->thr_val.as.thr) start->thr_val.as.thr->env = NULL;
-    value_free(start->thr_val);
-    env_free(start->env);
-    free(start->interp);
-    free(start);
-    return 0;
+    env_free(iter_env);
+    interpreter_free_call_arena(&scratch);
+    free(scratch.trace_stack);
+
+    if (!chunk->error && chunk->count == 0) {
+        parfor_chunk_free(chunk);
+        return;
+    }
+    mtx_lock(&g_parfor_merge_lock);
+    chunk->next = job->chunks;
+    job->chunks = chunk;
+    mtx_unlock(&g_parfor_merge_lock);
 }
 
 // ============ Helper functions ============
@@ -363,11 +532,15 @@ static Func* create_runtime_function(const char* name,
                                      DeclType return_type,
                                      ParamList* src_params,
                                      Stmt* body,
+                                     size_t frame_size,
                                      Env* closure) {
     Func* f = safe_malloc(sizeof(Func));
     f->name = name ? strdup(name) : NULL;
     f->return_type = return_type;
     f->body = body;
+    f->arena = body ? body->arena : NULL;
+    ast_arena_retain(f->arena);
+    f->frame_size = frame_size;
     f->params.count = src_params ? src_params->count : 0;
     f->params.items = NULL;
     f->params.capacity = src_params ? src_params->capacity : 0;
@@ -392,9 +565,113 @@ static void free_runtime_function(Func* f) {
     }
     free(f->params.items);
     env_free(f->closure);
+    ast_arena_release(f->arena);
     free(f);
 }
 
+// ============ Call-frame arena ============
+//
+// User-function calls take their call Env and argument vector from the
+// calling Interpreter instead of the heap.  Argument vectors are pushed on a
+// LIFO stack of chunks (a call's arguments are released before its body
+// runs, and nested calls made while evaluating them release theirs first).
+// Call Envs are recycled through a free list once the call returns, unless
+// something still holds a reference -- a LAMBDA or FUNC created in the body
+// retains its closure -- in which case the Env stays on the heap with its
+// remaining owners and is freed by the last of them.
+
+#define CALL_ARGS_CHUNK 256     // Values per argument stack chunk
+#define CALL_FRAME_POOL_MAX 64  // recycled call Envs kept per Interpreter
+
+typedef struct CallArgChunk {
+    struct CallArgChunk* prev;
+    size_t used;
+    size_t capacity;
+    Value* items;
+} CallArgChunk;
+
+// Reserve `n` argument slots initialised to null; NULL when n == 0.
+static Value* call_args_push(Interpreter* interp, size_t n) {
+    if (n == 0) return NULL;
+    CallArgChunk* c = interp->arg_chunk;
+    if (!c || c->capacity - c->used < n) {
+        CallArgChunk* fresh = interp->arg_spare;
+        if (fresh && fresh->capacity >= n) {
+            interp->arg_spare = NULL;
+        } else {
+            size_t cap = n > CALL_ARGS_CHUNK ? n : CALL_ARGS_CHUNK;
+            fresh = safe_malloc(sizeof(CallArgChunk) + cap * sizeof(Value));
+            fresh->capacity = cap;
+            fresh->items = (Value*)(fresh + 1);
+        }
+        fresh->used = 0;
+        fresh->prev = c;
+        interp->arg_chunk = c = fresh;
+    }
+    Value* out = c->items + c->used;
+    c->used += n;
+    for (size_t i = 0; i < n; i++) out[i] = value_null();
+    return out;
+}
+
+// Release the `n` slots of the most recent call_args_push.
+static void call_args_pop(Interpreter* interp, size_t n) {
+    if (n == 0) return;
+    CallArgChunk* c = interp->arg_chunk;
+    c->used -= n;
+    if (c->used == 0 && c->prev) {
+        interp->arg_chunk = c->prev;
+        free(interp->arg_spare);
+        interp->arg_spare = c;
+    }
+}
+
+// A call Env for `f`, sized for its parameters and locals.
+static Env* call_env_acquire(Interpreter* interp, Func* f) {
+    size_t want = f->frame_size > f->params.count ? f->frame_size : f->params.count;
+    Env* env;
+    if (interp->frame_pool_count > 0) {
+        env = interp->frame_pool[--interp->frame_pool_count];
+        env->parent = f->closure;
+    } else {
+        env = env_create(f->closure);
+    }
+    env_reserve(env, want);
+    return env;
+}
+
+static void call_env_release(Interpreter* interp, Env* env) {
+    if (env->refcount != 1 || interp->frame_pool_count >= CALL_FRAME_POOL_MAX) {
+        env_free(env);
+        return;
+    }
+    env_clear(env);
+    env->parent = NULL;
+    if (interp->frame_pool_count == interp->frame_pool_capacity) {
+        size_t cap = interp->frame_pool_capacity ? interp->frame_pool_capacity * 2 : 8;
+        Env** grown = realloc(interp->frame_pool, cap * sizeof(Env*));
+        if (!grown) { env_free(env); return; }
+        interp->frame_pool = grown;
+        interp->frame_pool_capacity = cap;
+    }
+    interp->frame_pool[interp->frame_pool_count++] = env;
+}
+
+void interpreter_free_call_arena(Interpreter* interp) {
+    for (size_t i = 0; i < interp->frame_pool_count; i++) env_free(interp->frame_pool[i]);
+    free(interp->frame_pool);
+    interp->frame_pool = NULL;
+    interp->frame_pool_count = 0;
+    interp->frame_pool_capacity = 0;
+    while (interp->arg_chunk) {
+        CallArgChunk* prev = interp->arg_chunk->prev;
+        free(interp->arg_chunk);
+        interp->arg_chunk = prev;
+    }
+    free(interp->arg_spare);
+    interp->arg_spare = NULL;
+}
+
 static int builtin_param_index(BuiltinFunction* builtin, const char* kw) {
     if (!builtin || !kw) return -1;
     if (!builtin->param_names || builtin->param_count <= 0) return -1;
@@ -405,7 +682,108 @@ static int builtin_param_index(BuiltinFunction* builtin, const char* kw) {
     return -1;
 }
 
-static void label_map_add(LabelMap* map, Value key, int index) {
+// ============ GOTOPOINT tables ============
+
+// The GOTOPOINTs of one statement list, found on its first execution and
+// kept on the StmtList.  Literal INT/STR targets are hashed once here;
+// only computed targets are evaluated each time the list runs.
+struct LabelTable {
+    const StmtList* list;
+    LabelEntry* entries;    // literal targets, in statement order
+    size_t count;
+    int* slots;             // open-addressed index into entries, -1 = empty
+    size_t slot_mask;
+    size_t* dynamic;        // statement indices of computed targets
+    size_t dynamic_count;
+};
+
+static uint64_t label_key_hash(Value key) {
+    if (key.type == VAL_STR) return value_str_hash(key.as.s);
+    uint64_t h = (uint64_t)key.as.i * 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 29);
+}
+
+static bool label_key_eq(Value a, Value b) {
+    if (a.type != b.type) return false;
+    if (a.type == VAL_INT) return a.as.i == b.as.i;
+    if (a.type == VAL_STR) return value_str_eq(a.as.s, b.as.s);
+    return false;
+}
+
+static LabelTable* label_table_build(const StmtList* list) {
+    size_t literal = 0, dynamic = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        Stmt* stmt = list->items[i];
+        if (stmt->type != STMT_GOTOPOINT) continue;
+        Expr* target = stmt->as.gotopoint_stmt.target;
+        if (target && (target->type == EXPR_INT || target->type == EXPR_STR)) literal++;
+        else dynamic++;
+    }
+    if (literal == 0 && dynamic == 0) return NULL;
+
+    LabelTable* table = calloc(1, sizeof(LabelTable));
+    size_t cap = 8;
+    while (cap < literal * 2) cap *= 2;
+    if (table) {
+        table->entries = malloc((literal ? literal : 1) * sizeof(LabelEntry));
+        table->slots = malloc(cap * sizeof(int));
+        table->dynamic = malloc((dynamic ? dynamic : 1) * sizeof(size_t));
+    }
+    if (!table || !table->entries || !table->slots || !table->dynamic) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    table->list = list;
+    table->slot_mask = cap - 1;
+    for (size_t s = 0; s < cap; s++) table->slots[s] = -1;
+
+    for (size_t i = 0; i < list->count; i++) {
+        Stmt* stmt = list->items[i];
+        if (stmt->type != STMT_GOTOPOINT) continue;
+        Expr* target = stmt->as.gotopoint_stmt.target;
+        if (!target || (target->type != EXPR_INT && target->type != EXPR_STR)) {
+            table->dynamic[table->dynamic_count++] = i;
+            continue;
+        }
+        Value key = target->type == EXPR_INT ? value_int(target->as.int_value)
+                                             : value_str_interned(target->as.str_value);
+        size_t s = (size_t)label_key_hash(key) & table->slot_mask;
+        bool duplicate = false;
+        while (table->slots[s] >= 0) {
+            if (label_key_eq(table->entries[table->slots[s]].key, key)) { duplicate = true; break; }
+            s = (s + 1) & table->slot_mask;
+        }
+        if (duplicate) continue;  // the first GOTOPOINT for a target wins
+        table->entries[table->count].key = key;
+        table->entries[table->count].index = (int)i;
+        table->entries[table->count].list = list;
+        table->slots[s] = (int)table->count++;
+    }
+    return table;
+}
+
+void label_table_free(LabelTable* table) {
+    if (!table) return;
+    free(table->entries);  // keys are INTs and interned strings
+    free(table->slots);
+    free(table->dynamic);
+    free(table);
+}
+
+// labels_ready: 0 = not built, 1 = being built, 2 = built.  A list may be
+// entered by several threads at once, so exactly one of them builds it.
+static const LabelTable* label_table_get(StmtList* list) {
+    if (atomic_count_load(&list->labels_ready) == 2) return list->labels;
+    if (atomic_count_cas(&list->labels_ready, 0, 1)) {
+        list->labels = label_table_build(list);
+        atomic_count_store(&list->labels_ready, 2);
+        return list->labels;
+    }
+    while (atomic_count_load(&list->labels_ready) != 2) thrd_yield();
+    return list->labels;
+}
+
+static void label_map_add(LabelMap* map, Value key, int index, const StmtList* list) {
     if (map->count + 1 > map->capacity) {
         size_t new_cap = map->capacity == 0 ? 8 : map->capacity * 2;
         map->items = realloc(map->items, new_cap * sizeof(LabelEntry));
@@ -414,19 +792,62 @@ static void label_map_add(LabelMap* map, Value key, int index) {
     }
     map->items[map->count].key = value_copy(key);
     map->items[map->count].index = index;
+    map->items[map->count].list = list;
     map->count++;
 }
 
-static int label_map_find(LabelMap* map, Value key) {
-    for (size_t i = 0; i < map->count; i++) {
-        if (map->items[i].key.type == key.type) {
-            if (key.type == VAL_INT && map->items[i].key.as.i == key.as.i) return map->items[i].index;
-            if (key.type == VAL_STR && strcmp(map->items[i].key.as.s, key.as.s) == 0) return map->items[i].index;
+static void label_map_push_table(LabelMap* map, const LabelTable* table) {
+    if (map->table_count + 1 > map->table_capacity) {
+        size_t new_cap = map->table_capacity == 0 ? 8 : map->table_capacity * 2;
+        map->tables = realloc(map->tables, new_cap * sizeof(LabelTable*));
+        if (!map->tables) { fprintf(stderr, "Out of memory\n"); exit(1); }
+        map->table_capacity = new_cap;
+    }
+    map->tables[map->table_count++] = table;
+}
+
+// Find `key` among the GOTOPOINTs of the lists currently executing,
+// innermost list first.  Returns the statement index and sets *list_out,
+// or returns -1.  The computed targets of those lists are stacked on
+// map->items in the same order as map->tables.
+static int label_map_find(LabelMap* map, Value key, const StmtList** list_out) {
+    if (key.type != VAL_INT && key.type != VAL_STR) return -1;
+    uint64_t h = label_key_hash(key);
+    size_t dyn = map->count;
+    for (size_t t = map->table_count; t-- > 0;) {
+        const LabelTable* table = map->tables[t];
+        if (table->count > 0) {
+            size_t s = (size_t)h & table->slot_mask;
+            while (table->slots[s] >= 0) {
+                const LabelEntry* e = &table->entries[table->slots[s]];
+                if (label_key_eq(e->key, key)) {
+                    *list_out = e->list;
+                    return e->index;
+                }
+                s = (s + 1) & table->slot_mask;
+            }
         }
+        size_t lo = dyn;
+        while (lo > 0 && map->items[lo - 1].list == table->list) lo--;
+        for (size_t i = lo; i < dyn; i++) {
+            if (label_key_eq(map->items[i].key, key)) {
+                *list_out = table->list;
+                return map->items[i].index;
+            }
+        }
+        dyn = lo;
     }
     return -1;
 }
 
+void label_map_free(LabelMap* map) {
+    if (!map) return;
+    for (size_t i = 0; i < map->count; i++) value_free(map->items[i].key);
+    free(map->items);
+    free(map->tables);
+    memset(map, 0, sizeof(*map));
+}
+
 // ============ Module registry ============
 
 typedef struct ModuleEntry {
@@ -500,7 +921,7 @@ int value_truthiness(Value v) {
             Tensor* t = v.as.tns;
             if (!t || t->length == 0) return 0;
             for (size_t i = 0; i < t->length; i++) {
-                Value e = t->data[i];
+                Value e = value_tns_elem(t, i);
                 switch (e.type) {
                     case VAL_INT:
                         if (e.as.i != 0) return 1;
@@ -522,6 +943,7 @@ int value_truthiness(Value v) {
                     case VAL_MAP: {
                         struct Map* m = e.as.map;
                         if (m) {
+                            value_map_compact(m);
                             for (size_t j = 0; j < m->count; j++) {
                                 if (value_truthiness(m->items[j].value)) return 1;
                             }
@@ -683,6 +1105,28 @@ static void clear_error(Interpreter* interp) {
 
 // ============ Expression evaluation ============
 
+// A builtin call tagged by the optimizer with a typed fast path (always two
+// positional arguments).  When the runtime types differ from the static
+// ones the builtin itself runs, so errors read exactly as untyped calls'.
+static Value eval_typed_call(Interpreter* interp, Expr* expr, Env* env) {
+    Value args[2];
+    args[0] = eval_expr(interp, expr->as.call.args.items[0], env);
+    if (interp->error) return value_null();
+    args[1] = eval_expr(interp, expr->as.call.args.items[1], env);
+    if (interp->error) {
+        value_free(args[0]);
+        return value_null();
+    }
+    Value out;
+    if (call_typed_apply(expr->as.call.typed_op, args[0], args[1], &out)) return out;
+
+    BuiltinFunction* builtin = builtin_lookup_call(expr);
+    out = builtin->impl(interp, args, 2, expr->as.call.args.items, env, expr->line, expr->column);
+    value_free(args[0]);
+    value_free(args[1]);
+    return out;
+}
+
 Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
     if (!expr) return value_null();
     
@@ -694,13 +1138,13 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
             return value_flt(expr->as.flt_value);
             
         case EXPR_STR:
-            return value_str(expr->as.str_value);
+            return value_str_interned(expr->as.str_value);
             
         case EXPR_IDENT: {
             Value v;
             DeclType dtype;
             bool initialized;
-            if (!env_get(env, expr->as.ident, &v, &dtype, &initialized)) {
+            if (!env_get_ref(env, expr->as.ident, &expr->ref, &v, &dtype, &initialized)) {
                 char buf[128];
                 snprintf(buf, sizeof(buf), "Undefined identifier '%s'", expr->as.ident);
                 interp->error = strdup(buf);
@@ -747,11 +1191,15 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                                               expr->as.lambda.return_type,
                                               &expr->as.lambda.params,
                                               expr->as.lambda.body,
+                                              expr->as.lambda.frame_size,
                                               env);
             return value_func(f);
         }
         
         case EXPR_CALL: {
+            // The profiler counts builtin calls, so it takes the generic path.
+            if (expr->as.call.typed_op && !g_profile_enabled) return eval_typed_call(interp, expr, env);
+
             // Get the callee
             const char* func_name = NULL;
             Func* user_func = NULL;
@@ -759,8 +1207,8 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
             if (expr->as.call.callee->type == EXPR_IDENT) {
                 func_name = expr->as.call.callee->as.ident;
                 
-                // Check builtins first
-                BuiltinFunction* builtin = builtin_lookup(func_name);
+                // Check builtins first (cached on the call node)
+                BuiltinFunction* builtin = builtin_lookup_call(expr);
                 if (builtin) {
                     int pos_argc = (int)expr->as.call.args.count;
                     int kwc = (int)expr->as.call.kw_count;
@@ -812,10 +1260,10 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                         for (int i = 0; i < max_slot; i++) { args[i] = value_null(); arg_nodes[i] = NULL; }
 
                         // Evaluate positional args
+                        unsigned quote_mask = expr->as.call.quote_mask;
                         for (int i = 0; i < pos_argc; i++) {
                             arg_nodes[i] = expr->as.call.args.items[i];
-                            if (((strcmp(func_name, "DEL") == 0 || strcmp(func_name, "EXIST") == 0 || strcmp(func_name, "IMPORT") == 0 || strcmp(func_name, "ASSIGN") == 0) && i == 0)
-                                || ((strcmp(func_name, "IMPORT") == 0 || strcmp(func_name, "IMPORT_PATH") == 0) && i == 1)) {
+                            if (i < 32 && (quote_mask & (1u << i))) {
                                 // leave as null placeholder
                                 continue;
                             }
@@ -914,7 +1362,9 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                     }
 
                     // Call builtin
+                    if (g_profile_enabled) profile_enter(builtin->name, true);
                     Value result = builtin->impl(interp, args, effective_argc, arg_nodes, env, expr->line, expr->column);
+                    if (g_profile_enabled) profile_exit();
 
                     // Clean up
                     if (args) {
@@ -926,11 +1376,13 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                     return result;
                 }
                 
-                // Check user-defined functions in the shared namespace
+                // Check user-defined functions in the shared namespace.  The
+                // callee's SlotRef caches where the name was last bound and is
+                // revalidated on every call, so a rebinding is always seen.
                 Value v;
                 DeclType dtype;
                 bool initialized;
-                if (env_get(env, func_name, &v, &dtype, &initialized)) {
+                if (env_get_ref(env, func_name, &expr->as.call.callee->ref, &v, &dtype, &initialized)) {
                     if (initialized && v.type == VAL_FUNC) {
                         user_func = v.as.func;
                     }
@@ -964,49 +1416,38 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
             int pos_argc = (int)expr->as.call.args.count;
             int kwc = (int)expr->as.call.kw_count;
 
+            // Argument values live on the interpreter's argument stack
+            // (positional first, then keywords in source order) until they
+            // are bound; a slot is reset to null once its value has moved
+            // into the call Env, so the failure path frees what is left.
+            size_t nargs = (size_t)pos_argc + (size_t)kwc;
+            Value* pos_vals = call_args_push(interp, nargs);
+            Value* kw_vals = pos_vals ? pos_vals + pos_argc : NULL;
+            unsigned char kw_used_buf[16];
+            unsigned char* kw_used = kw_used_buf;
+            if (kwc > (int)sizeof(kw_used_buf)) kw_used = safe_malloc((size_t)kwc);
+            if (kwc > 0) memset(kw_used, 0, (size_t)kwc);
+            Env* call_env = NULL;
+
             // Evaluate positional arguments first (left-to-right)
-            Value* pos_vals = NULL;
-            if (pos_argc > 0) {
-                pos_vals = safe_malloc(sizeof(Value) * pos_argc);
-                for (int i = 0; i < pos_argc; i++) {
-                    pos_vals[i] = eval_expr(interp, expr->as.call.args.items[i], env);
-                    if (interp->error) {
-                        for (int j = 0; j <= i; j++) value_free(pos_vals[j]);
-                        free(pos_vals);
-                        return value_null();
-                    }
-                }
+            for (int i = 0; i < pos_argc; i++) {
+                pos_vals[i] = eval_expr(interp, expr->as.call.args.items[i], env);
+                if (interp->error) goto call_fail;
             }
 
             // Evaluate keyword argument expressions in source order
-            Value* kw_vals = NULL;
-            int* kw_used = NULL;
-            if (kwc > 0) {
-                kw_vals = safe_malloc(sizeof(Value) * kwc);
-                kw_used = calloc(kwc, sizeof(int));
-                for (int k = 0; k < kwc; k++) {
-                    // detect duplicate keyword names in source (runtime error)
-                    for (int m = 0; m < k; m++) {
-                        if (strcmp(expr->as.call.kw_names[m], expr->as.call.kw_names[k]) == 0) {
-                            interp->error = strdup("Duplicate keyword argument");
-                            interp->error_line = expr->line;
-                            interp->error_col = expr->column;
-                            for (int t = 0; t < (pos_argc); t++) value_free(pos_vals[t]);
-                            free(pos_vals);
-                            for (int t = 0; t < k; t++) value_free(kw_vals[t]);
-                            free(kw_vals);
-                            return value_null();
-                        }
-                    }
-                    kw_vals[k] = eval_expr(interp, expr->as.call.kw_args.items[k], env);
-                    if (interp->error) {
-                        for (int t = 0; t < pos_argc; t++) value_free(pos_vals[t]);
-                        free(pos_vals);
-                        for (int t = 0; t < k; t++) value_free(kw_vals[t]);
-                        free(kw_vals);
-                        return value_null();
+            for (int k = 0; k < kwc; k++) {
+                // detect duplicate keyword names in source (runtime error)
+                for (int m = 0; m < k; m++) {
+                    if (strcmp(expr->as.call.kw_names[m], expr->as.call.kw_names[k]) == 0) {
+                        interp->error = strdup("Duplicate keyword argument");
+                        interp->error_line = expr->line;
+                        interp->error_col = expr->column;
+                        goto call_fail;
                     }
                 }
+                kw_vals[k] = eval_expr(interp, expr->as.call.kw_args.items[k], env);
+                if (interp->error) goto call_fail;
             }
 
             // Count positional-only parameters (those without a default value).
@@ -1026,26 +1467,22 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                 interp->error = strdup(buf);
                 interp->error_line = expr->line;
                 interp->error_col = expr->column;
-                for (int t = 0; t < pos_argc; t++) value_free(pos_vals[t]);
-                free(pos_vals);
-                for (int t = 0; t < kwc; t++) value_free(kw_vals[t]);
-                free(kw_vals);
-                if (kw_used) free(kw_used);
-                return value_null();
+                goto call_fail;
             }
 
             // Create new environment for function call
-            Env* call_env = env_create(user_func->closure);
+            call_env = call_env_acquire(interp, user_func);
 
             // Bind parameters in order, evaluating defaults in call_env after earlier params are bound
             for (size_t i = 0; i < user_func->params.count; i++) {
                 Param* param = &user_func->params.items[i];
                 Value arg_val = value_null();
+                Value* arg_slot = NULL;
 
                 bool provided = false;
                 // positional provided?
                 if ((int)i < pos_argc) {
-                    arg_val = pos_vals[i];
+                    arg_slot = &pos_vals[i];
                     provided = true;
                     // check if a keyword also provided for same name -> error
                     for (int k = 0; k < kwc; k++) {
@@ -1053,13 +1490,7 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                             interp->error = strdup("Duplicate argument for parameter");
                             interp->error_line = expr->line;
                             interp->error_col = expr->column;
-                            // cleanup
-                            for (int t = 0; t < pos_argc; t++) if (t != i) value_free(pos_vals[t]);
-                            free(pos_vals);
-                            for (int t = 0; t < kwc; t++) value_free(kw_vals[t]);
-                            free(kw_vals);
-                            env_free(call_env);
-                            return value_null();
+                            goto call_fail;
                         }
                     }
                 } else {
@@ -1074,31 +1505,22 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                             interp->error = strdup("Parameter is not keyword-capable");
                             interp->error_line = expr->line;
                             interp->error_col = expr->column;
-                            for (int t = 0; t < pos_argc; t++) value_free(pos_vals[t]);
-                            free(pos_vals);
-                            for (int t = 0; t < kwc; t++) if (t != found_kw) value_free(kw_vals[t]);
-                            free(kw_vals);
-                            free(kw_used);
-                            env_free(call_env);
-                            return value_null();
+                            goto call_fail;
                         }
-                        arg_val = kw_vals[found_kw];
+                        arg_slot = &kw_vals[found_kw];
                         kw_used[found_kw] = 1;
                         provided = true;
                     } else if (param->default_value) {
                         // evaluate default in call_env (after earlier params bound)
                         arg_val = eval_expr(interp, param->default_value, call_env);
-                        if (interp->error) {
-                            for (int t = 0; t < pos_argc; t++) value_free(pos_vals[t]);
-                            free(pos_vals);
-                            for (int t = 0; t < kwc; t++) value_free(kw_vals[t]);
-                            free(kw_vals);
-                            env_free(call_env);
-                            return value_null();
-                        }
+                        if (interp->error) goto call_fail;
                         provided = true;
                     }
                 }
+                if (arg_slot) {
+                    arg_val = *arg_slot;
+                    *arg_slot = value_null();
+                }
 
                 if (!provided) {
                     char buf[128];
@@ -1106,12 +1528,7 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                     interp->error = strdup(buf);
                     interp->error_line = expr->line;
                     interp->error_col = expr->column;
-                    for (int t = 0; t < pos_argc; t++) value_free(pos_vals[t]);
-                    free(pos_vals);
-                    for (int t = 0; t < kwc; t++) value_free(kw_vals[t]);
-                    free(kw_vals);
-                    env_free(call_env);
-                    return value_null();
+                    goto call_fail;
                 }
 
                 // Type check
@@ -1121,18 +1538,8 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                     interp->error = strdup(buf);
                     interp->error_line = expr->line;
                     interp->error_col = expr->column;
-                    // free val resources
-                    if ((int)i < pos_argc) {
-                        // pos_vals[i] will be freed below when cleaning pos_vals array
-                    } else {
-                        // arg_val came from kw_vals or default; if from kw_vals we will free kw_vals array later
-                    }
-                    for (int t = 0; t < pos_argc; t++) value_free(pos_vals[t]);
-                    free(pos_vals);
-                    for (int t = 0; t < kwc; t++) value_free(kw_vals[t]);
-                    free(kw_vals);
-                    env_free(call_env);
-                    return value_null();
+                    value_free(arg_val);
+                    goto call_fail;
                 }
 
                 env_define(call_env, param->name, param->type);
@@ -1142,40 +1549,26 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                     interp->error = strdup(buf);
                     interp->error_line = expr->line;
                     interp->error_col = expr->column;
-                    for (int t = 0; t < pos_argc; t++) value_free(pos_vals[t]);
-                    free(pos_vals);
-                    for (int t = 0; t < kwc; t++) value_free(kw_vals[t]);
-                    free(kw_vals);
-                    env_free(call_env);
-                    return value_null();
+                    value_free(arg_val);
+                    goto call_fail;
                 }
                 // Free the temporary argument value now that it's been copied into the callee env
                 value_free(arg_val);
             }
 
             // Check for any unmatched keyword args
-            if (kwc > 0) {
-                for (int k = 0; k < kwc; k++) {
-                    if (!kw_used[k]) {
-                        interp->error = strdup("Unknown keyword argument");
-                        interp->error_line = expr->line;
-                        interp->error_col = expr->column;
-                        // cleanup
-                        for (int t = 0; t < pos_argc; t++) value_free(pos_vals[t]);
-                        free(pos_vals);
-                        for (int t = 0; t < kwc; t++) if (!kw_used[t]) value_free(kw_vals[t]);
-                        free(kw_vals);
-                        free(kw_used);
-                        env_free(call_env);
-                        return value_null();
-                    }
+            for (int k = 0; k < kwc; k++) {
+                if (!kw_used[k]) {
+                    interp->error = strdup("Unknown keyword argument");
+                    interp->error_line = expr->line;
+                    interp->error_col = expr->column;
+                    goto call_fail;
                 }
             }
 
-            // free temporary evaluated argument arrays (their Value contents are now copied into env or freed by env_assign)
-            if (pos_vals) free(pos_vals);
-            if (kw_vals) free(kw_vals);
-            if (kw_used) free(kw_used);
+            // Every argument is now bound (or freed); release the stack slots.
+            call_args_pop(interp, nargs);
+            if (kw_used != kw_used_buf) free(kw_used);
             
             // Execute function body
             if (trace_push_frame(interp,
@@ -1184,7 +1577,7 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                                  expr->line,
                                  expr->column,
                                  1) != 0) {
-                env_free(call_env);
+                call_env_release(interp, call_env);
                 interp->error = strdup("Out of memory");
                 interp->error_line = expr->line;
                 interp->error_col = expr->column;
@@ -1192,13 +1585,16 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
             }
 
             LabelMap local_labels = {0};
+            // Left as soon as the body returns: an error keeps its traceback
+            // frame pushed, so trace_pop_frame is no place for the exit hook.
+            if (g_profile_enabled) profile_enter(user_func->name, false);
             ExecResult res = exec_stmt(interp, user_func->body, call_env, &local_labels);
+            if (g_profile_enabled) profile_exit();
             
             // Clean up labels
-            for (size_t i = 0; i < local_labels.count; i++) value_free(local_labels.items[i].key);
-            free(local_labels.items);
+            label_map_free(&local_labels);
             
-            env_free(call_env);
+            call_env_release(interp, call_env);
             
             if (res.status == EXEC_ERROR) {
                 /* Copy the error message into the interpreter-owned slot and
@@ -1256,6 +1652,14 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                 default:
                     return value_null();
             }
+
+        call_fail:
+            // Argument evaluation or binding failed before the body ran.
+            for (size_t t = 0; t < nargs; t++) value_free(pos_vals[t]);
+            call_args_pop(interp, nargs);
+            if (kw_used != kw_used_buf) free(kw_used);
+            if (call_env) call_env_release(interp, call_env);
+            return value_null();
         }
         case EXPR_TNS: {
             // Compute shape
@@ -1304,7 +1708,7 @@ Value eval_expr(Interpreter* interp, Expr* expr, Env* env) {
                             goto tns_eval_fail;
                         }
                     }
-                    for (size_t k = 0; k < ct->length; k++) items[pos++] = value_copy(ct->data[k]);
+                    for (size_t k = 0; k < ct->length; k++) items[pos++] = value_copy(value_tns_elem(ct, k));
                     value_free(cv);
                 } else {
                     Value v = eval_expr(interp, it, env);
@@ -1371,12 +1775,15 @@ tns_eval_fail:
             start->thr_val = thr_for_worker;
 
             /* record body/env on the Thr so restart is possible */
-            thr_for_worker.as.thr->body = start->body;
+            value_thr_set_body(thr_for_worker, start->body);
             thr_for_worker.as.thr->env = start->env;
             value_thr_set_started(thr_for_worker, 1);
 
+            ns_buffer_worker_enter();
             if (thrd_create(&thr_for_worker.as.thr->thread, thr_worker, start) != thrd_success) {
+                ns_buffer_worker_exit();
                 value_thr_set_finished(thr_for_worker, 1);
+                value_thr_set_started(thr_for_worker, 0);
                 value_free(thr_for_worker);
                 free(thr_interp);
                 free(start);
@@ -1694,67 +2101,66 @@ static ExecResult assign_map_nested(Interpreter* interp, Env* env, Value* map_pt
     return make_ok(value_null());
 }
 
-ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Value rhs, int stmt_line, int stmt_col) {
-    // Collect index nodes from outermost -> innermost, and require base to be an identifier.
-    size_t chain_len = 0;
-    Expr* walker = idx_expr;
-    while (walker && walker->type == EXPR_INDEX) {
-        chain_len++;
-        walker = walker->as.index.target;
-    }
+// One pre-evaluated index of an indexed-assignment chain.
+typedef enum { ASSIGN_IDX_VALUE, ASSIGN_IDX_RANGE, ASSIGN_IDX_WILDCARD } AssignIdxKind;
 
-    if (!walker || walker->type != EXPR_IDENT) {
-        return make_error("Indexed assignment base must be an identifier", stmt_line, stmt_col);
-    }
+typedef struct {
+    Expr* expr;          // index expression (for error locations)
+    AssignIdxKind kind;
+    Value v;             // ASSIGN_IDX_VALUE: evaluated index / key
+    Value lo, hi;        // ASSIGN_IDX_RANGE: evaluated endpoints
+} AssignIdx;
 
-    const char* base_name = walker->as.ident;
-    Value base_val = value_null();
-    DeclType base_type = TYPE_UNKNOWN;
-    bool base_initialized = false;
+// State shared between assign_index_chain and the in-place update callback.
+typedef struct {
+    Expr** nodes;        // outermost -> innermost EXPR_INDEX nodes
+    AssignIdx** idx;     // idx[n][i]: i-th index of nodes[n]
+    size_t chain_len;
+    Value rhs;
+    int stmt_line;
+    int stmt_col;
+    ExecResult out;
+} AssignChainCtx;
+
+// Apply a fully evaluated index chain to the stored binding.  Runs under
+// env_update, i.e. with exclusive access to the binding, so concurrent
+// PARFOR iterations writing disjoint elements of one shared container
+// cannot lose each other's updates.  Must not evaluate expressions.
+static void assign_index_apply(EnvEntry* entry, void* arg) {
+    AssignChainCtx* c = (AssignChainCtx*)arg;
+    Value rhs = c->rhs;
+    int stmt_line = c->stmt_line;
+    int stmt_col = c->stmt_col;
+    ExecResult out;
 
-    if (!env_get(env, base_name, &base_val, &base_type, &base_initialized)) {
-        char buf[256];
-        snprintf(buf, sizeof(buf), "Cannot assign to undeclared identifier '%s'", base_name);
-        return make_error(buf, stmt_line, stmt_col);
+    if (entry->frozen || entry->permafrozen) {
+        c->out = make_error("Cannot write back to identifier (frozen?)", stmt_line, stmt_col);
+        return;
     }
 
-    // If uninitialized (or NULL), default to MAP (matches previous behaviour),
-    // and persist that into the environment via env_assign.
-    if (!base_initialized || base_val.type == VAL_NULL) {
-        Value nm = value_map_new();
-        if (!env_assign(env, base_name, nm, TYPE_UNKNOWN, false)) {
-            value_free(nm);
-            value_free(base_val);
-            return make_error("Cannot assign to identifier (frozen?)", stmt_line, stmt_col);
+    // If uninitialized (or NULL), default to MAP (matches previous behaviour).
+    if (!entry->initialized || entry->value.type == VAL_NULL) {
+        if (entry->decl_type != TYPE_UNKNOWN && entry->decl_type != TYPE_MAP) {
+            c->out = make_error("Cannot assign to identifier (frozen?)", stmt_line, stmt_col);
+            return;
         }
-        value_free(base_val);
-        base_val = nm;
-        base_initialized = true;
-    }
-
-    Expr** nodes = malloc(sizeof(Expr*) * (chain_len ? chain_len : 1));
-    if (!nodes) {
-        value_free(base_val);
-        return make_error("Out of memory", stmt_line, stmt_col);
+        value_free(entry->value);
+        entry->value = value_map_new();
+        entry->initialized = true;
     }
 
-    walker = idx_expr;
-    for (size_t i = 0; i < chain_len; i++) {
-        nodes[i] = walker;
-        walker = walker->as.index.target;
-    }
+    // Every container on the path is edited in place, so each one is
+    // unshared before it is touched (see "Sharing" in value.h).
+    value_unshare(&entry->value);
 
-    ExecResult out;
-    Value* cur = &base_val;
+    Value* base = &entry->value;
+    Value* cur = base;
 
     // Process from innermost -> outermost
-    for (int ni = (int)chain_len - 1; ni >= 0; ni--) {
-        Expr* node = nodes[ni];
+    for (int ni = (int)c->chain_len - 1; ni >= 0; ni--) {
+        Expr* node = c->nodes[ni];
         ExprList* indices = &node->as.index.indices;
-        if (indices->count == 0) {
-            out = make_error("Empty index list", node->line, node->column);
-            goto cleanup;
-        }
+        AssignIdx* idx = c->idx[ni];
 
         // Auto-promote NULL to MAP when assigning through indexes.
         if (cur->type == VAL_NULL) {
@@ -1762,6 +2168,7 @@ ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Val
         }
 
         if (cur->type == VAL_TNS) {
+            value_unshare(cur);
             Tensor* t = cur->as.tns;
 
             // Allow indexing with ranges/wildcards or integers. Indices may be fewer than ndim.
@@ -1771,45 +2178,34 @@ ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Val
             if (!starts || !ends) {
                 free(starts); free(ends);
                 out = make_error("Out of memory", stmt_line, stmt_col);
-                goto cleanup;
+                goto done;
             }
 
             // default full spans
             for (size_t i = 0; i < t->ndim; i++) { starts[i] = 1; ends[i] = (int64_t)t->shape[i]; }
 
             // fill from provided indices
-            for (size_t i = 0; i < indices->count; i++) {
-                Expr* it = indices->items[i];
-                if (it->type == EXPR_WILDCARD) {
+            for (size_t i = 0; i < indices->count && i < t->ndim; i++) {
+                Expr* it = idx[i].expr;
+                if (idx[i].kind == ASSIGN_IDX_WILDCARD) {
                     starts[i] = 1; ends[i] = (int64_t)t->shape[i];
                     continue;
                 }
-                if (it->type == EXPR_RANGE) {
-                    // range node holds start and end expressions as children
-                    Expr* rs = it->as.range.start;
-                    Expr* re = it->as.range.end;
-                    Value vs = eval_expr(interp, rs, env);
-                    if (interp->error) { ExecResult err = make_error(interp->error, interp->error_line, interp->error_col); clear_error(interp); free(starts); free(ends); out = err; goto cleanup; }
-                    Value ve = eval_expr(interp, re, env);
-                    if (interp->error) { ExecResult err = make_error(interp->error, interp->error_line, interp->error_col); clear_error(interp); value_free(vs); free(starts); free(ends); out = err; goto cleanup; }
-                    if (vs.type != VAL_INT || ve.type != VAL_INT) { value_free(vs); value_free(ve); free(starts); free(ends); out = make_error("Range endpoints must evaluate to INT", it->line, it->column); goto cleanup; }
-                    starts[i] = vs.as.i; ends[i] = ve.as.i;
-                    value_free(vs); value_free(ve);
+                if (idx[i].kind == ASSIGN_IDX_RANGE) {
+                    if (idx[i].lo.type != VAL_INT || idx[i].hi.type != VAL_INT) { free(starts); free(ends); out = make_error("Range endpoints must evaluate to INT", it->line, it->column); goto done; }
+                    starts[i] = idx[i].lo.as.i; ends[i] = idx[i].hi.as.i;
                     continue;
                 }
 
                 // single index expression
-                Value vi = eval_expr(interp, it, env);
-                if (interp->error) { ExecResult err = make_error(interp->error, interp->error_line, interp->error_col); clear_error(interp); free(starts); free(ends); out = err; goto cleanup; }
-                if (vi.type != VAL_INT) { value_free(vi); free(starts); free(ends); out = make_error("Index expression must evaluate to INT", it->line, it->column); goto cleanup; }
-                starts[i] = vi.as.i; ends[i] = vi.as.i; // fixed single element
-                value_free(vi);
+                if (idx[i].v.type != VAL_INT) { free(starts); free(ends); out = make_error("Index expression must evaluate to INT", it->line, it->column); goto done; }
+                starts[i] = idx[i].v.as.i; ends[i] = idx[i].v.as.i; // fixed single element
             }
 
             // Normalize negative indices and clamp; compute lengths
             size_t new_ndim = 0;
             int* orig_to_out = malloc(sizeof(int) * t->ndim);
-            if (!orig_to_out) { free(starts); free(ends); out = make_error("Out of memory", stmt_line, stmt_col); goto cleanup; }
+            if (!orig_to_out) { free(starts); free(ends); out = make_error("Out of memory", stmt_line, stmt_col); goto done; }
             for (size_t i = 0; i < t->ndim; i++) {
                 int64_t s = starts[i];
                 int64_t e = ends[i];
@@ -1836,19 +2232,20 @@ ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Val
                 if (rhs.type != VAL_TNS && value_type_to_decl(rhs.type) != t->elem_type) {
                     free(starts); free(ends); free(orig_to_out);
                     out = make_error("Element type mismatch", stmt_line, stmt_col);
-                    goto cleanup;
+                    goto done;
                 }
 
                 mtx_lock(&t->lock);
-                value_free(t->data[src_offset]);
-                if (rhs.type == VAL_TNS) {
-                    // RHS is a tensor but single-element selection: copy whole RHS value
-                    t->data[src_offset] = value_copy(rhs);
-                } else {
-                    t->data[src_offset] = value_copy(rhs);
-                }
+                // Chaining further needs a stable Value* into the tensor
+                if (ni > 0) value_tns_box(t);
+                // RHS may be a tensor even for a single-element selection: copy whole RHS value
+                value_tns_set_elem(t, src_offset, value_copy(rhs));
                 mtx_unlock(&t->lock);
                 free(starts); free(ends); free(orig_to_out);
+                if (ni == 0) {
+                    out = make_ok(value_null());
+                    goto done;
+                }
                 // Set cur to point at this element for further chaining
                 cur = &t->data[src_offset];
                 continue;
@@ -1856,7 +2253,7 @@ ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Val
 
             // Build output shape and validate RHS
             size_t* out_shape = malloc(sizeof(size_t) * new_ndim);
-            if (!out_shape) { free(starts); free(ends); free(orig_to_out); out = make_error("Out of memory", stmt_line, stmt_col); goto cleanup; }
+            if (!out_shape) { free(starts); free(ends); free(orig_to_out); out = make_error("Out of memory", stmt_line, stmt_col); goto done; }
             for (size_t i = 0; i < t->ndim; i++) {
                 if (orig_to_out[i] >= 0) {
                     out_shape[orig_to_out[i]] = (size_t)(ends[i] - starts[i] + 1);
@@ -1866,27 +2263,27 @@ ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Val
             if (rhs.type != VAL_TNS) {
                 free(starts); free(ends); free(orig_to_out); free(out_shape);
                 out = make_error("Right-hand side must be a TNS matching slice shape", node->line, node->column);
-                goto cleanup;
+                goto done;
             }
 
             Tensor* rt = rhs.as.tns;
             if (rt->ndim != new_ndim) {
                 free(starts); free(ends); free(orig_to_out); free(out_shape);
                 out = make_error("Right-hand side tensor dimensionality mismatch", node->line, node->column);
-                goto cleanup;
+                goto done;
             }
             for (size_t d = 0; d < new_ndim; d++) {
                 if (rt->shape[d] != out_shape[d]) {
                     free(starts); free(ends); free(orig_to_out); free(out_shape);
                     out = make_error("Right-hand side tensor shape mismatch", node->line, node->column);
-                    goto cleanup;
+                    goto done;
                 }
             }
 
             if (rt->elem_type != t->elem_type) {
                 free(starts); free(ends); free(orig_to_out); free(out_shape);
                 out = make_error("Element type mismatch", stmt_line, stmt_col);
-                goto cleanup;
+                goto done;
             }
 
             // Write RHS elements into target tensor region
@@ -1916,32 +2313,28 @@ ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Val
 
                 // assign element
                 mtx_lock(&t->lock);
-                value_free(t->data[src_offset]);
-                t->data[src_offset] = value_copy(rt->data[out_idx]);
+                value_tns_set_elem(t, src_offset, value_copy(value_tns_elem(rt, out_idx)));
                 mtx_unlock(&t->lock);
             }
 
             free(out_shape);
             free(starts); free(ends); free(orig_to_out);
             // After slice assignment, set cur to base (no further chaining into this node)
-            cur = &base_val;
+            cur = base;
             continue;
         }
 
         if (cur->type == VAL_MAP) {
             for (size_t i = 0; i < indices->count; i++) {
-                Expr* it = indices->items[i];
-                Value key = eval_expr(interp, it, env);
-                if (interp->error) {
-                    ExecResult err = make_error(interp->error, interp->error_line, interp->error_col);
-                    clear_error(interp);
-                    out = err;
-                    goto cleanup;
+                Expr* it = idx[i].expr;
+                if (idx[i].kind != ASSIGN_IDX_VALUE) {
+                    out = make_error("Unknown expression type", it->line, it->column);
+                    goto done;
                 }
+                Value key = idx[i].v;
                 if (!(key.type == VAL_INT || key.type == VAL_STR || key.type == VAL_FLT)) {
-                    value_free(key);
                     out = make_error("Map index must be INT, FLT or STR", it->line, it->column);
-                    goto cleanup;
+                    goto done;
                 }
 
                 bool last_key_in_node = (i + 1 == indices->count);
@@ -1950,27 +2343,25 @@ ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Val
                 if (last_node_in_chain && last_key_in_node) {
                     // Final destination: assign rhs here.
                     Value* slot = value_map_get_ptr(cur, key, true);
-                    value_free(key);
                     if (!slot) {
                         out = make_error("Internal error assigning to map", stmt_line, stmt_col);
-                        goto cleanup;
+                        goto done;
                     }
                     if (slot->type != VAL_NULL && value_type_to_decl(slot->type) != value_type_to_decl(rhs.type)) {
                         out = make_error("Map entry type mismatch", stmt_line, stmt_col);
-                        goto cleanup;
+                        goto done;
                     }
                     value_free(*slot);
                     *slot = value_copy(rhs);
                     out = make_ok(value_null());
-                    goto cleanup;
+                    goto done;
                 }
 
                 // Descend into slot.
                 Value* slot = value_map_get_ptr(cur, key, true);
-                value_free(key);
                 if (!slot) {
                     out = make_error("Internal error indexing map", stmt_line, stmt_col);
-                    goto cleanup;
+                    goto done;
                 }
 
                 if (slot->type == VAL_NULL) {
@@ -1985,40 +2376,238 @@ ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Val
 
         // Unsupported type for indexed assignment
         out = make_error("Indexing assignment is supported only on tensors and maps", node->line, node->column);
-        goto cleanup;
+        goto done;
     }
 
     // If we get here, the chain ended after resolving to a tensor element (e.g. a<1> = rhs)
     if (cur->type != VAL_NULL && value_type_to_decl(cur->type) != value_type_to_decl(rhs.type)) {
         out = make_error("Element type mismatch", stmt_line, stmt_col);
-        goto cleanup;
+        goto done;
     }
-    mtx_lock(&g_tns_lock);
+    // Only a slice at the end of the chain gets here, with `cur` back at
+    // the binding, which env_update gives us exclusively.
     value_free(*cur);
     *cur = value_copy(rhs);
-    mtx_unlock(&g_tns_lock);
 
     out = make_ok(value_null());
 
-cleanup:
-    free(nodes);
-    // If assignment succeeded, write back the possibly-modified base value
-    // into the environment so that atomic container semantics persist.
-    if (out.status == EXEC_OK) {
-        if (!env_assign(env, base_name, base_val, TYPE_UNKNOWN, false)) {
-            out = make_error("Cannot write back to identifier (frozen?)", stmt_line, stmt_col);
+done:
+    c->out = out;
+}
+
+ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Value rhs, int stmt_line, int stmt_col) {
+    // Collect index nodes from outermost -> innermost, and require base to be an identifier.
+    size_t chain_len = 0;
+    Expr* walker = idx_expr;
+    while (walker && walker->type == EXPR_INDEX) {
+        chain_len++;
+        walker = walker->as.index.target;
+    }
+
+    if (!walker || walker->type != EXPR_IDENT) {
+        return make_error("Indexed assignment base must be an identifier", stmt_line, stmt_col);
+    }
+
+    const char* base_name = walker->as.ident;
+    if (!env_decl_type_ref(env, base_name, &walker->ref, NULL)) {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "Cannot assign to undeclared identifier '%s'", base_name);
+        return make_error(buf, stmt_line, stmt_col);
+    }
+
+    AssignChainCtx ctx;
+    ctx.nodes = malloc(sizeof(Expr*) * (chain_len ? chain_len : 1));
+    ctx.idx = calloc(chain_len ? chain_len : 1, sizeof(AssignIdx*));
+    ctx.chain_len = chain_len;
+    ctx.rhs = rhs;
+    ctx.stmt_line = stmt_line;
+    ctx.stmt_col = stmt_col;
+    ctx.out = make_ok(value_null());
+    if (!ctx.nodes || !ctx.idx) {
+        free(ctx.nodes); free(ctx.idx);
+        return make_error("Out of memory", stmt_line, stmt_col);
+    }
+
+    walker = idx_expr;
+    for (size_t i = 0; i < chain_len; i++) {
+        ctx.nodes[i] = walker;
+        walker = walker->as.index.target;
+    }
+
+    // Evaluate every index up front (innermost -> outermost, left to right)
+    // so the update itself runs without touching the environment.
+    ExecResult out = make_ok(value_null());
+    bool failed = false;
+    for (int ni = (int)chain_len - 1; ni >= 0 && !failed; ni--) {
+        Expr* node = ctx.nodes[ni];
+        ExprList* indices = &node->as.index.indices;
+        if (indices->count == 0) {
+            out = make_error("Empty index list", node->line, node->column);
+            failed = true;
+            break;
         }
+        ctx.idx[ni] = calloc(indices->count, sizeof(AssignIdx));
+        if (!ctx.idx[ni]) { out = make_error("Out of memory", stmt_line, stmt_col); failed = true; break; }
+        for (size_t i = 0; i < indices->count; i++) {
+            Expr* it = indices->items[i];
+            AssignIdx* ai = &ctx.idx[ni][i];
+            ai->expr = it;
+            ai->v = value_null();
+            ai->lo = value_null();
+            ai->hi = value_null();
+            if (it->type == EXPR_WILDCARD) {
+                ai->kind = ASSIGN_IDX_WILDCARD;
+                continue;
+            }
+            if (it->type == EXPR_RANGE) {
+                ai->kind = ASSIGN_IDX_RANGE;
+                ai->lo = eval_expr(interp, it->as.range.start, env);
+                if (!interp->error) ai->hi = eval_expr(interp, it->as.range.end, env);
+            } else {
+                ai->kind = ASSIGN_IDX_VALUE;
+                ai->v = eval_expr(interp, it, env);
+            }
+            if (interp->error) {
+                out = make_error(interp->error, interp->error_line, interp->error_col);
+                clear_error(interp);
+                failed = true;
+                break;
+            }
+        }
+    }
+
+    if (!failed) {
+        if (!env_update(env, base_name, assign_index_apply, &ctx)) {
+            char buf[256];
+            snprintf(buf, sizeof(buf), "Cannot assign to undeclared identifier '%s'", base_name);
+            out = make_error(buf, stmt_line, stmt_col);
+        } else {
+            out = ctx.out;
+        }
+    }
+
+    for (size_t n = 0; n < chain_len; n++) {
+        if (!ctx.idx[n]) continue;
+        size_t cnt = ctx.nodes[n]->as.index.indices.count;
+        for (size_t i = 0; i < cnt; i++) {
+            value_free(ctx.idx[n][i].v);
+            value_free(ctx.idx[n][i].lo);
+            value_free(ctx.idx[n][i].hi);
+        }
+        free(ctx.idx[n]);
     }
-    value_free(base_val);
+    free(ctx.idx);
+    free(ctx.nodes);
     return out;
 }
 
-static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap* labels) {
+// Store an evaluated right-hand side `v` (ownership is taken) into the
+// target of the STMT_ASSIGN `stmt`: indexed targets go through
+// assign_index_chain, plain names through the typed/untyped binding rules.
+ExecResult exec_assign_value(Interpreter* interp, Stmt* stmt, Env* env, Value v) {
+    // If this assignment has an expression target (indexed assignment), handle specially
+    if (stmt->as.assign.target) {
+        if (stmt->as.assign.target->type != EXPR_INDEX) {
+            value_free(v);
+            return make_error("Can only assign to indexed targets or identifiers", stmt->line, stmt->column);
+        }
+
+        ExecResult ar = assign_index_chain(interp, env, stmt->as.assign.target, v, stmt->line, stmt->column);
+        if (ar.status == EXEC_ERROR) {
+            value_free(v);
+            return ar;
+        }
+
+        value_free(v);
+        return make_ok(value_null());
+    }
+
+    if (stmt->as.assign.has_type) {
+        DeclType expected = stmt->as.assign.decl_type;
+        DeclType actual = value_type_to_decl(v.type);
+
+        if (expected != actual) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "Type mismatch: expected %s but got %s",
+                     expected == TYPE_INT ? "INT" :
+                     expected == TYPE_FLT ? "FLT" :
+                     expected == TYPE_STR ? "STR" :
+                     expected == TYPE_TNS ? "TNS" :
+                     expected == TYPE_MAP ? "MAP" :
+                     expected == TYPE_FUNC ? "FUNC" :
+                     expected == TYPE_THR ? "THR" : "UNKNOWN",
+                     value_type_name(v));
+            value_free(v);
+            return make_error(buf, stmt->line, stmt->column);
+        }
+
+        DeclType existing_type = TYPE_UNKNOWN;
+        bool existing = env_decl_type_ref(env, stmt->as.assign.name, &stmt->as.assign.ref, &existing_type);
+        if (existing && existing_type != expected) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "Type mismatch: expected %s but got %s",
+                     decl_type_name(existing_type), decl_type_name(expected));
+            value_free(v);
+            return make_error(buf, stmt->line, stmt->column);
+        }
+        Env* assign_env = env;
+        if (!interp->isolate_env_writes && !existing && env->parent) {
+            assign_env = env->parent;
+        }
+        if (!existing) {
+            env_define(assign_env, stmt->as.assign.name, expected);
+        }
+        // The cached ref is relative to `env`; a first definition in
+        // the parent scope goes by name and is picked up next time.
+        SlotRef* ref = (assign_env == env) ? &stmt->as.assign.ref : NULL;
+        if (!env_assign_ref(assign_env, stmt->as.assign.name, ref, v, expected, true)) {
+            EnvEntry* echeck = env_get_entry(assign_env, stmt->as.assign.name);
+            if (echeck && echeck->decl_type != actual) {
+                char buf[128];
+                snprintf(buf, sizeof(buf), "Type mismatch: expected %s but got %s",
+                         decl_type_name(echeck->decl_type), value_type_name(v));
+                value_free(v);
+                return make_error(buf, stmt->line, stmt->column);
+            }
+            char buf[256];
+            snprintf(buf, sizeof(buf), "Cannot assign to frozen identifier '%s'", stmt->as.assign.name);
+            value_free(v);
+            return make_error(buf, stmt->line, stmt->column);
+        }
+    } else {
+        if (!env_assign_ref(env, stmt->as.assign.name, &stmt->as.assign.ref, v, TYPE_UNKNOWN, false)) {
+            EnvEntry* echeck = env_get_entry(env, stmt->as.assign.name);
+            if (echeck) {
+                DeclType actual = value_type_to_decl(v.type);
+                if (echeck->decl_type != TYPE_UNKNOWN && echeck->decl_type != actual) {
+                    char buf[128];
+                    snprintf(buf, sizeof(buf), "Type mismatch: expected %s but got %s",
+                             decl_type_name(echeck->decl_type), value_type_name(v));
+                    value_free(v);
+                    return make_error(buf, stmt->line, stmt->column);
+                }
+                char buf[256];
+                snprintf(buf, sizeof(buf), "Cannot assign to frozen identifier '%s'", stmt->as.assign.name);
+                value_free(v);
+                return make_error(buf, stmt->line, stmt->column);
+            }
+            char buf[128];
+            snprintf(buf, sizeof(buf), "Cannot assign to undeclared identifier '%s'", stmt->as.assign.name);
+            value_free(v);
+            return make_error(buf, stmt->line, stmt->column);
+        }
+    }
+    value_free(v);
+    return make_ok(value_null());
+}
+
+ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap* labels) {
     if (!stmt) return make_ok(value_null());
     trace_log_step(interp, stmt, env);
 
     switch (stmt->type) {
         case STMT_BLOCK:
+            if (stmt->code) return vm_exec(interp, stmt, env, labels);
             return exec_stmt_list(interp, &stmt->as.block, env, labels);
 
         case STMT_EXPR: {
@@ -2073,96 +2662,7 @@ static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap*
                 return err;
             }
 
-            // If this assignment has an expression target (indexed assignment), handle specially
-            if (stmt->as.assign.target) {
-                if (stmt->as.assign.target->type != EXPR_INDEX) {
-                    value_free(v);
-                    return make_error("Can only assign to indexed targets or identifiers", stmt->line, stmt->column);
-                }
-
-                ExecResult ar = assign_index_chain(interp, env, stmt->as.assign.target, v, stmt->line, stmt->column);
-                if (ar.status == EXEC_ERROR) {
-                    value_free(v);
-                    return ar;
-                }
-
-                value_free(v);
-                return make_ok(value_null());
-            }
-
-            if (stmt->as.assign.has_type) {
-                DeclType expected = stmt->as.assign.decl_type;
-                DeclType actual = value_type_to_decl(v.type);
-
-                if (expected != actual) {
-                    char buf[128];
-                    snprintf(buf, sizeof(buf), "Type mismatch: expected %s but got %s",
-                             expected == TYPE_INT ? "INT" :
-                             expected == TYPE_FLT ? "FLT" :
-                             expected == TYPE_STR ? "STR" :
-                             expected == TYPE_TNS ? "TNS" :
-                             expected == TYPE_MAP ? "MAP" :
-                             expected == TYPE_FUNC ? "FUNC" :
-                             expected == TYPE_THR ? "THR" : "UNKNOWN",
-                             value_type_name(v));
-                    value_free(v);
-                    return make_error(buf, stmt->line, stmt->column);
-                }
-
-                EnvEntry* existing = env_get_entry(env, stmt->as.assign.name);
-                if (existing && existing->decl_type != expected) {
-                    char buf[128];
-                    snprintf(buf, sizeof(buf), "Type mismatch: expected %s but got %s",
-                             decl_type_name(existing->decl_type), decl_type_name(expected));
-                    value_free(v);
-                    return make_error(buf, stmt->line, stmt->column);
-                }
-                Env* assign_env = env;
-                if (!interp->isolate_env_writes && !existing && env->parent) {
-                    assign_env = env->parent;
-                }
-                if (!existing) {
-                    env_define(assign_env, stmt->as.assign.name, expected);
-                }
-                if (!env_assign(assign_env, stmt->as.assign.name, v, expected, true)) {
-                    EnvEntry* echeck = env_get_entry(assign_env, stmt->as.assign.name);
-                    if (echeck && echeck->decl_type != actual) {
-                        char buf[128];
-                        snprintf(buf, sizeof(buf), "Type mismatch: expected %s but got %s",
-                                 decl_type_name(echeck->decl_type), value_type_name(v));
-                        value_free(v);
-                        return make_error(buf, stmt->line, stmt->column);
-                    }
-                    char buf[256];
-                    snprintf(buf, sizeof(buf), "Cannot assign to frozen identifier '%s'", stmt->as.assign.name);
-                    value_free(v);
-                    return make_error(buf, stmt->line, stmt->column);
-                }
-            } else {
-                if (!env_assign(env, stmt->as.assign.name, v, TYPE_UNKNOWN, false)) {
-                    EnvEntry* echeck = env_get_entry(env, stmt->as.assign.name);
-                    if (echeck) {
-                        DeclType actual = value_type_to_decl(v.type);
-                        if (echeck->decl_type != TYPE_UNKNOWN && echeck->decl_type != actual) {
-                            char buf[128];
-                            snprintf(buf, sizeof(buf), "Type mismatch: expected %s but got %s",
-                                     decl_type_name(echeck->decl_type), value_type_name(v));
-                            value_free(v);
-                            return make_error(buf, stmt->line, stmt->column);
-                        }
-                        char buf[256];
-                        snprintf(buf, sizeof(buf), "Cannot assign to frozen identifier '%s'", stmt->as.assign.name);
-                        value_free(v);
-                        return make_error(buf, stmt->line, stmt->column);
-                    }
-                    char buf[128];
-                    snprintf(buf, sizeof(buf), "Cannot assign to undeclared identifier '%s'", stmt->as.assign.name);
-                    value_free(v);
-                    return make_error(buf, stmt->line, stmt->column);
-                }
-            }
-            value_free(v);
-            return make_ok(value_null());
+            return exec_assign_value(interp, stmt, env, v);
         }
 
         case STMT_FUNC: {
@@ -2171,6 +2671,7 @@ static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap*
                                               stmt->as.func_stmt.return_type,
                                               &stmt->as.func_stmt.params,
                                               stmt->as.func_stmt.body,
+                                              stmt->as.func_stmt.frame_size,
                                               env);
 
             if (builtin_lookup(f->name)) {
@@ -2389,12 +2890,15 @@ static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap*
             start->thr_val = thr_for_worker;
 
             /* record body/env on the Thr so restart is possible */
-            thr_for_worker.as.thr->body = start->body;
+            value_thr_set_body(thr_for_worker, start->body);
             thr_for_worker.as.thr->env = start->env;
             value_thr_set_started(thr_for_worker, 1);
 
+            ns_buffer_worker_enter();
             if (thrd_create(&thr_for_worker.as.thr->thread, thr_worker, start) != thrd_success) {
+                ns_buffer_worker_exit();
                 value_thr_set_finished(thr_for_worker, 1);
+                value_thr_set_started(thr_for_worker, 0);
                 value_free(thr_for_worker);
                 free(thr_interp);
                 free(start);
@@ -2425,12 +2929,15 @@ static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap*
             start->thr_val = thr_for_worker;
 
             /* record body/env on the Thr so restart is possible */
-            thr_for_worker.as.thr->body = start->body;
+            value_thr_set_body(thr_for_worker, start->body);
             thr_for_worker.as.thr->env = start->env;
             value_thr_set_started(thr_for_worker, 1);
 
+            ns_buffer_worker_enter();
             if (thrd_create(&thr_for_worker.as.thr->thread, thr_worker, start) != thrd_success) {
+                ns_buffer_worker_exit();
                 value_thr_set_finished(thr_for_worker, 1);
+                value_thr_set_started(thr_for_worker, 0);
                 value_free(thr_for_worker);
                 free(thr_interp);
                 free(start);
@@ -2550,7 +3057,7 @@ static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap*
                 }
 
                 // Bind or assign the loop counter in the current environment
-                if (!env_assign(env, stmt->as.for_stmt.counter, value_int(idx), TYPE_INT, true)) {
+                if (!env_assign_ref(env, stmt->as.for_stmt.counter, &stmt->as.for_stmt.ref, value_int(idx), TYPE_INT, true)) {
                     char buf[256];
                     snprintf(buf, sizeof(buf), "Cannot assign to frozen identifier '%s'", stmt->as.for_stmt.counter);
                     return make_error(buf, stmt->line, stmt->column);
@@ -2581,8 +3088,6 @@ static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap*
 
         case STMT_PARFOR: {
             interp->loop_depth++;
-            int iteration_count = 0;
-            const int max_iterations = 100000;
 
             Value target = eval_expr(interp, stmt->as.parfor_stmt.target, env);
             if (interp->error) {
@@ -2606,114 +3111,54 @@ static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap*
                 return make_error("PARFOR target must be non-negative", stmt->line, stmt->column);
             }
 
-            // Spawn worker threads for each iteration
+            // Hand the iterations to the shared pool
             size_t n = (size_t)limit;
-            char** errors = calloc(n, sizeof(char*));
-            int* err_lines = calloc(n, sizeof(int));
-            int* err_cols = calloc(n, sizeof(int));
-            Value* thr_vals = malloc(sizeof(Value) * n);
-            ParforStart** starts = malloc(sizeof(ParforStart*) * n);
-
-            for (size_t i = 0; i < n; i++) {
-                if (++iteration_count > max_iterations) {
-                    interp->loop_depth--;
-                    // cleanup
-                    for (size_t j = 0; j < i; j++) value_free(thr_vals[j]);
-                    free(thr_vals);
-                    free(starts);
-                    for (size_t j = 0; j < n; j++) free(errors[j]);
-                    free(errors);
-                    free(err_lines);
-                    free(err_cols);
-                    return make_error("Infinite loop detected", stmt->line, stmt->column);
-                }
-
-                thr_vals[i] = value_thr_new();
-
-                ParforStart* start = safe_malloc(sizeof(ParforStart));
-                Interpreter* thr_interp = safe_malloc(sizeof(Interpreter));
-                *thr_interp = (Interpreter){0};
-                thr_interp->global_env = interp->global_env;
-                thr_interp->loop_depth = 0;
-                thr_interp->error = NULL;
-                thr_interp->error_line = 0;
-                thr_interp->error_col = 0;
-                thr_interp->in_try_block = interp->in_try_block;
-                thr_interp->modules = interp->modules;
-                thr_interp->shushed = interp->shushed;
-                thr_interp->isolate_env_writes = true;
-
-                start->interp = thr_interp;
-                /* Create a per-iteration child env so each PARFOR iteration
-                   gets its own counter binding and does not race with others. */
-                Env* thread_env = env_create(env);
-                int64_t idx = (int64_t)i + 1; /* iterations are 1-based */
-                /* Always define the counter locally so it shadows any
-                   same-named binding in a parent env. */
-                env_define(thread_env, stmt->as.parfor_stmt.counter, TYPE_INT);
-                if (!env_assign(thread_env, stmt->as.parfor_stmt.counter, value_int(idx), TYPE_INT, false)) {
-                    char buf[256];
-                    snprintf(buf, sizeof(buf), "Cannot assign to frozen identifier '%s'", stmt->as.parfor_stmt.counter);
-                    errors[i] = strdup(buf);
-                    env_free(thread_env);
-                    free(thr_interp);
-                    free(start);
-                    /* Mark this iteration as finished and continue launching others */
-                    value_thr_set_finished(thr_vals[i], 1);
-                    continue;
-                }
-                start->env = thread_env;
-                start->body = stmt->as.parfor_stmt.body;
-                start->errors = errors;
-                start->err_lines = err_lines;
-                start->err_cols = err_cols;
-                start->index = (int)i;
-                start->counter_name = stmt->as.parfor_stmt.counter;
-                start->thr_val = value_copy(thr_vals[i]);
-                starts[i] = start;
-
-                /* record body/env on Thr so restart is possible */
-                thr_vals[i].as.thr->body = start->body;
-                thr_vals[i].as.thr->env = start->env; /* points to per-iteration env */
-
-                if (thrd_create(&thr_vals[i].as.thr->thread, parfor_worker, start) != thrd_success) {
-                    /* mark finished and leave thr_vals[i] intact so later cleanup is safe */
-                    value_thr_set_finished(thr_vals[i], 1);
-                    free(thr_interp);
-                    free(start);
-                    errors[i] = strdup("Failed to start PARFOR iteration");
-                    /* continue launching others */
-                } else {
-                    /* only mark started after successful thread creation */
-                    value_thr_set_started(thr_vals[i], 1);
-                }
-            }
-
-            // Join only threads that were actually started
-            for (size_t i = 0; i < n; i++) {
-                if (thr_vals[i].type == VAL_THR && thr_vals[i].as.thr && value_thr_get_started(thr_vals[i])) {
-                    if (thrd_join(thr_vals[i].as.thr->thread, NULL) != thrd_success) {
-                        // ignore join failures but mark finished
-                    }
-                }
-            }
-
-            // Collect first error if any (and its original location)
+            ParforJob job;
+            job.parent = interp;
+            job.env = env;
+            job.body = stmt->as.parfor_stmt.body;
+            job.counter_name = stmt->as.parfor_stmt.counter;
+            job.chunks = NULL;
+            thread_pool_run(n, 0, parfor_chunk, &job);
+
+            size_t chunk_count = 0;
+            for (ParforChunk* c = job.chunks; c; c = c->next) chunk_count++;
+            ParforChunk** chunks = malloc((chunk_count ? chunk_count : 1) * sizeof(ParforChunk*));
+            if (!chunks) { fprintf(stderr, "Out of memory\n"); exit(1); }
+            chunk_count = 0;
+            for (ParforChunk* c = job.chunks; c; c = c->next) chunks[chunk_count++] = c;
+            qsort(chunks, chunk_count, sizeof(ParforChunk*), parfor_chunk_order);
+
+            // Merge iteration-declared bindings back in iteration order
+            // (last writer wins) and keep the error of the lowest
+            // iteration, with its original location.
             char* first_err = NULL;
+            size_t first_err_index = 0;
             int first_err_line = 0;
             int first_err_col = 0;
-            for (size_t i = 0; i < n; i++) {
-                if (errors[i]) { first_err = errors[i]; first_err_line = err_lines[i]; first_err_col = err_cols[i]; break; }
+            for (size_t k = 0; k < chunk_count; k++) {
+                ParforChunk* c = chunks[k];
+                char* merge_error = NULL;
+                (void)parfor_merge_bindings(env, c->bindings, c->count, &merge_error);
+                if (merge_error && (!c->error || c->last_bound < c->err_index)) {
+                    free(c->error);
+                    c->error = merge_error;
+                    c->err_index = c->last_bound;
+                    c->err_line = 0;
+                    c->err_col = 0;
+                } else {
+                    free(merge_error);
+                }
+                if (c->error && (!first_err || c->err_index < first_err_index)) {
+                    first_err = c->error;
+                    first_err_index = c->err_index;
+                    first_err_line = c->err_line;
+                    first_err_col = c->err_col;
+                }
             }
-
-            // Cleanup thr values
-            for (size_t i = 0; i < n; i++) value_free(thr_vals[i]);
-            free(thr_vals);
-            free(starts);
-            for (size_t i = 0; i < n; i++) if (errors[i] && errors[i] != first_err) free(errors[i]);
-            free(errors);
-            free(err_lines);
-            free(err_cols);
+            if (first_err) first_err = strdup(first_err);
+            for (size_t k = 0; k < chunk_count; k++) parfor_chunk_free(chunks[k]);
+            free(chunks);
 
             interp->loop_depth--;
 
@@ -2739,42 +3184,52 @@ static ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap*
 }
 
 static ExecResult exec_stmt_list(Interpreter* interp, StmtList* list, Env* env, LabelMap* labels) {
-    // First pass: collect gotopoints
-    for (size_t i = 0; i < list->count; i++) {
-        Stmt* stmt = list->items[i];
-        if (stmt->type == STMT_GOTOPOINT) {
+    // Register this list's GOTOPOINTs: literal targets come from the cached
+    // table, computed ones are evaluated on every entry.
+    const LabelTable* table = label_table_get(list);
+    size_t label_mark = labels->count;
+    ExecResult res = make_ok(value_null());
+    if (table) {
+        for (size_t d = 0; d < table->dynamic_count; d++) {
+            Stmt* stmt = list->items[table->dynamic[d]];
             Value target = eval_expr(interp, stmt->as.gotopoint_stmt.target, env);
             if (interp->error) {
-                return make_error(interp->error, interp->error_line, interp->error_col);
+                res = make_error(interp->error, interp->error_line, interp->error_col);
+                clear_error(interp);
+                goto unwind;
             }
-            label_map_add(labels, target, (int)i);
+            label_map_add(labels, target, (int)table->dynamic[d], list);
             value_free(target);
         }
+        label_map_push_table(labels, table);
     }
-    
-    // Second pass: execute statements
+
     size_t i = 0;
     while (i < list->count) {
         wait_if_paused(interp);
-        ExecResult res = exec_stmt(interp, list->items[i], env, labels);
-        
-        if (res.status == EXEC_ERROR || res.status == EXEC_RETURN || 
+        res = exec_stmt(interp, list->items[i], env, labels);
+
+        if (res.status == EXEC_ERROR || res.status == EXEC_RETURN ||
             res.status == EXEC_BREAK || res.status == EXEC_CONTINUE) {
-            return res;
+            break;
         }
-        
+
         if (res.status == EXEC_GOTO) {
             if (res.jump_index >= 0 && res.jump_index < (int)list->count) {
                 i = (size_t)res.jump_index;
                 continue;
             }
-            return res;  // Propagate upward if target not in this block
+            break;  // Propagate upward if target not in this block
         }
-        
+
         i++;
     }
-    
-    return make_ok(value_null());
+    if (res.status == EXEC_OK) res = make_ok(value_null());
+    if (table) labels->table_count--;
+
+unwind:
+    while (labels->count > label_mark) value_free(labels->items[--labels->count].key);
+    return res;
 }
 
 // ============ Main entry point ============
@@ -2795,8 +3250,7 @@ void interpreter_init(Interpreter* interp, const char* source_path, bool verbose
     interp->trace_stack_count = 0;
     interp->trace_stack_capacity = 0;
     interp->trace_next_step_index = 0;
-    snprintf(interp->trace_last_state_id, sizeof(interp->trace_last_state_id), "seed");
-    interp->trace_last_rule[0] = '\0';
+    interp->trace_last_stmt = NULL;
 
     if (!interp->private_mode) {
         if (trace_push_frame(interp, "<top-level>", interp->global_env, 0, 0, 0) != 0) {
@@ -2806,9 +3260,9 @@ void interpreter_init(Interpreter* interp, const char* source_path, bool verbose
     }
 
     builtins_init();
-    mtx_init(&g_tns_lock, 0);
     mtx_init(&g_parfor_merge_lock, 0);
     ns_buffer_init();
+    thread_pool_init();
 
     if (source_path && source_path[0] != '\0') {
         char* canonical = NULL;
@@ -2858,9 +3312,13 @@ void interpreter_destroy(Interpreter* interp) {
     free(interp->trace_stack);
     interp->trace_stack = NULL;
     interp->trace_stack_capacity = 0;
+    free(interp->trace_ring);
+    interp->trace_ring = NULL;
+
+    interpreter_free_call_arena(interp);
 
+    thread_pool_shutdown();
     ns_buffer_shutdown();
-    mtx_destroy(&g_tns_lock);
     mtx_destroy(&g_parfor_merge_lock);
 }
 
@@ -2869,7 +3327,8 @@ ExecResult exec_program(Stmt* program, const char* source_path) {
     interpreter_init(&interp, source_path, false, false);
     
     LabelMap labels = {0};
-    ExecResult res = exec_stmt_list(&interp, &program->as.block, interp.global_env, &labels);
+    ExecResult res = program->code ? vm_exec(&interp, program, interp.global_env, &labels)
+                                   : exec_stmt_list(&interp, &program->as.block, interp.global_env, &labels);
 
     if (res.status == EXEC_ERROR) {
         char* tb = interpreter_format_traceback(&interp, res.error, res.error_line, res.error_column);
@@ -2878,8 +3337,7 @@ ExecResult exec_program(Stmt* program, const char* source_path) {
     }
     
     // Clean up
-    for (size_t i = 0; i < labels.count; i++) value_free(labels.items[i].key);
-    free(labels.items);
+    label_map_free(&labels);
     
     interpreter_destroy(&interp);
     return res;
@@ -2921,8 +3379,11 @@ int interpreter_restart_thread(Interpreter* interp, Value thr_val, int line, int
     value_thr_set_finished(thr_val, 0);
     value_thr_set_paused(thr_val, 0);
     value_thr_set_started(thr_val, 1);
+    ns_buffer_worker_enter();
     if (thrd_create(&th->thread, thr_worker, start) != thrd_success) {
+        ns_buffer_worker_exit();
         value_thr_set_finished(thr_val, 1);
+        value_thr_set_started(thr_val, 0);
         value_free(start->thr_val);
         free(thr_interp);
         free(start);
@@ -2947,7 +3408,8 @@ ExecResult exec_program_in_env(Interpreter* interp, Stmt* program, Env* env) {
     }
 
     LabelMap labels = {0};
-    ExecResult res = exec_stmt_list(interp, &program->as.block, env, &labels);
+    ExecResult res = program->code ? vm_exec(interp, program, env, &labels)
+                                   : exec_stmt_list(interp, &program->as.block, env, &labels);
 
     if (res.status == EXEC_ERROR) {
         char* tb = interpreter_format_traceback(interp, res.error, res.error_line, res.error_column);
@@ -2955,8 +3417,7 @@ ExecResult exec_program_in_env(Interpreter* interp, Stmt* program, Env* env) {
         res.error = tb;
     }
 
-    for (size_t i = 0; i < labels.count; i++) value_free(labels.items[i].key);
-    free(labels.items);
+    label_map_free(&labels);
 
     return res;
 }
@@ -3,6 +3,7 @@
 
 #include "ast.h"
 #include "env.h"
+#include "profile.h"
 
 typedef struct {
     DeclType type;
@@ -21,7 +22,12 @@ struct Func {
     DeclType return_type;
     ParamList params;
     Stmt* body;
+    // Reference on the AST arena `body` and the parameter defaults live in.
+    AstArena* arena;
     Env* closure;
+    // Bindings a call Env is expected to hold (parameters plus locals, as
+    // counted by the resolver); 0 if unknown.
+    size_t frame_size;
 };
 
 typedef struct Func Func;
@@ -48,12 +54,21 @@ typedef struct {
 typedef struct {
     Value key;
     int index;
+    const StmtList* list;   // the list `index` refers to
 } LabelEntry;
 
+typedef struct LabelTable LabelTable;
+
+// GOTOPOINTs visible to one function (or the top level): the label tables
+// of the statement lists currently executing, innermost last, and the
+// registered GOTOPOINTs whose target is computed at run time.
 typedef struct {
     LabelEntry* items;
     size_t count;
     size_t capacity;
+    const LabelTable** tables;
+    size_t table_count;
+    size_t table_capacity;
 } LabelMap;
 
 typedef struct {
@@ -68,13 +83,19 @@ typedef struct {
     int call_col;
     int has_call_location;
     int last_step_index;
-    char state_id[24];
-    int has_state_entry;
-    int last_line;
-    int last_col;
-    char last_statement[64];
+    // Statement of the frame's last step (NULL before its first one).  Only
+    // the pointer is recorded; interpreter_format_traceback renders it.
+    Stmt* last_stmt;
 } TraceFrame;
 
+// One step kept by the sampled trace (-trace-sample=N).
+#define TRACE_RING_SIZE 64
+typedef struct {
+    int step_index;
+    size_t depth;   // traceback frames live at the time
+    Stmt* stmt;
+} TraceSample;
+
 // Interpreter state
 typedef struct Interpreter {
     Env* global_env;
@@ -100,14 +121,35 @@ typedef struct Interpreter {
     size_t trace_stack_count;
     size_t trace_stack_capacity;
     int trace_next_step_index;
-    char trace_last_state_id[24];
-    char trace_last_rule[32];
+    Stmt* trace_last_stmt;
+    // Sampled trace: every trace_sample_every-th step is copied into a ring
+    // of TRACE_RING_SIZE entries that the traceback prints (0 = off).
+    int trace_sample_every;
+    int trace_sample_countdown;
+    TraceSample* trace_ring;
+    size_t trace_ring_count;
+    // Call-frame arena (interpreter.c): recycled call Envs and the stack of
+    // argument vectors used by user-function calls.
+    Env** frame_pool;
+    size_t frame_pool_count;
+    size_t frame_pool_capacity;
+    struct CallArgChunk* arg_chunk;
+    struct CallArgChunk* arg_spare;
 } Interpreter;
 
 // Initialize/destroy a reusable interpreter session.
 // `source_path` sets the primary module source label (e.g. script path or "<repl>").
 void interpreter_init(Interpreter* interp, const char* source_path, bool verbose, bool private_mode);
 void interpreter_destroy(Interpreter* interp);
+// Keep every `every`-th state-log step in a ring printed with tracebacks
+// (0 turns sampling off).  Returns 0, or -1 when out of memory.
+int interpreter_set_trace_sampling(Interpreter* interp, int every);
+// Release a LabelMap's storage, and a StmtList's label table (ast.c).
+void label_map_free(LabelMap* map);
+void label_table_free(LabelTable* table);
+// Release the call-frame arena of a scratch or thread Interpreter that is
+// discarded without interpreter_destroy().
+void interpreter_free_call_arena(Interpreter* interp);
 
 // Main entry point
 ExecResult exec_program(Stmt* program, const char* source_path);
@@ -126,11 +168,39 @@ char* interpreter_format_traceback(Interpreter* interp, const char* error_msg, i
 // Reset traceback stack for interactive recovery while preserving the current
 // top-level frame.
 void interpreter_reset_traceback(Interpreter* interp, Env* top_env);
+// Drop the traceback's references to statements of `arena` before a RUN,
+// IMPORT or REPL program that ran on `interp` is released.
+void interpreter_forget_arena(Interpreter* interp, const AstArena* arena);
 // Functions needed by builtins.c
 Value eval_expr(Interpreter* interp, Expr* expr, Env* env);
 int value_truthiness(Value v);
 // Expose indexed-assignment helper so builtins can reuse it
 ExecResult assign_index_chain(Interpreter* interp, Env* env, Expr* idx_expr, Value rhs, int stmt_line, int stmt_col);
+
+// Tree-walker entry points shared with the bytecode VM (vm.c)
+ExecResult exec_stmt(Interpreter* interp, Stmt* stmt, Env* env, LabelMap* labels);
+// Finish a STMT_ASSIGN whose right-hand side `v` has been evaluated.
+// Takes ownership of `v`.
+ExecResult exec_assign_value(Interpreter* interp, Stmt* stmt, Env* env, Value v);
+// Record `stmt` as the current step of the innermost traceback frame.
+// Inline so the common case is a few stores; the slow path pushes the
+// first frame and takes samples.
+void trace_log_step_slow(Interpreter* interp, Stmt* stmt, Env* env);
+static inline void trace_log_step(Interpreter* interp, Stmt* stmt, Env* env) {
+    profile_step(stmt);
+    if (interp->private_mode) return;
+    if (interp->trace_stack_count == 0 || interp->trace_sample_every) {
+        trace_log_step_slow(interp, stmt, env);
+        return;
+    }
+    TraceFrame* frame = &interp->trace_stack[interp->trace_stack_count - 1];
+    frame->env = env;
+    frame->last_stmt = stmt;
+    frame->last_step_index = interp->trace_next_step_index++;
+    interp->trace_last_stmt = stmt;
+}
+// Block while the current THR is paused (no-op on the main thread).
+void wait_if_paused(Interpreter* interp);
 // Restart a finished thread `thr_val` by re-launching its stored body/env.
 // Returns 0 on success, -1 on failure. On failure, sets interp->error/message.
 int interpreter_restart_thread(Interpreter* interp, Value thr_val, int line, int col);
@@ -1,13 +1,10 @@
 #include "lexer.h"
+#include "ast.h"
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
 
-#ifdef _MSC_VER
-#define strdup _strdup
-#endif
-
 // Memory hardening helpers
 static void* safe_malloc(size_t size) {
     void* ptr = malloc(size);
@@ -27,14 +24,13 @@ static void* safe_realloc(void* ptr, size_t size) {
     return new_ptr;
 }
 
-static char* safe_strdup(const char* str) {
-    if (str == NULL) return NULL;
-    char* copy = strdup(str);
-    if (copy == NULL) {
-        fprintf(stderr, "Fatal error: Out of memory.\n");
-        exit(1);
-    }
-    return copy;
+// Token literals live in the current AST arena (ast.h) along with the
+// nodes built from them.  Scanners that assemble a literal (escapes, line
+// continuations) do so in a heap scratch buffer and keep an arena copy.
+static char* lex_keep(char* scratch, size_t len) {
+    char* out = ast_strndup(scratch, len);
+    free(scratch);
+    return out;
 }
 
 // Helper functions declarations
@@ -84,35 +80,42 @@ void lexer_init(Lexer* lexer, const char* source, const char* filename) {
     lexer->current = 0;
     lexer->line = 1;
     lexer->column = 1;
+    lexer->lines = NULL;
+    lexer->line_count = 0;
 }
 
-char* lexer_get_line(Lexer* lexer, int line_num) {
-    if (!lexer || !lexer->source || line_num <= 0) return strdup("");
-    size_t idx = 0;
-    int cur_line = 1;
-    size_t start = 0;
-    // Advance to the start of the requested line
-    while (idx < lexer->source_len && cur_line < line_num) {
-        if (lexer->source[idx] == '\n') cur_line++;
-        idx++;
-    }
-    if (cur_line != line_num || idx >= lexer->source_len) {
-        // Requested line is past end; return empty string
-        return strdup("");
+// One arena copy of the source, cut into NUL-terminated lines with the
+// trailing whitespace trimmed, indexed by line number.
+static void build_line_table(Lexer* lexer) {
+    int count = 1;
+    for (size_t i = 0; i < lexer->source_len; i++) {
+        if (lexer->source[i] == '\n') count++;
     }
-    start = idx;
-    size_t end = start;
-    while (end < lexer->source_len && lexer->source[end] != '\n' && lexer->source[end] != '\r') end++;
-    size_t len = end - start;
-    char* out = (char*)malloc(len + 1);
-    if (!out) return strdup("");
-    memcpy(out, lexer->source + start, len);
-    out[len] = '\0';
-    // Trim trailing whitespace
-    while (len > 0 && (out[len-1] == ' ' || out[len-1] == '\t' || out[len-1] == '\r' || out[len-1] == '\n')) {
-        out[--len] = '\0';
+    char* text = ast_strndup(lexer->source, lexer->source_len);
+    const char** lines = ast_alloc(sizeof(char*) * (size_t)count);
+    int n = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= lexer->source_len; i++) {
+        if (i < lexer->source_len && text[i] != '\n') continue;
+        size_t end = i;
+        // A line ends at its first CR too, as it always has.
+        for (size_t j = start; j < end; j++) {
+            if (text[j] == '\r') { end = j; break; }
+        }
+        while (end > start && (text[end - 1] == ' ' || text[end - 1] == '\t')) end--;
+        text[end] = '\0';
+        lines[n++] = text + start;
+        start = i + 1;
     }
-    return out;
+    lexer->lines = lines;
+    lexer->line_count = n;
+}
+
+const char* lexer_get_line(Lexer* lexer, int line_num) {
+    if (!lexer || !lexer->source || line_num <= 0) return "";
+    if (!lexer->lines) build_line_table(lexer);
+    if (line_num > lexer->line_count) return "";
+    return lexer->lines[line_num - 1];
 }
 
 static bool is_at_end(Lexer* lexer) {
@@ -146,11 +149,9 @@ static Token make_token(Lexer* lexer, PTokenType type, const char* start, size_t
     token.line = lexer->line;
     token.column = lexer->column - (int)length; // Approximate start column
     if (length == 0 && start != NULL) {
-        token.literal = safe_strdup(start);
+        token.literal = ast_strdup(start);
     } else if (start != NULL) {
-        token.literal = (char*)safe_malloc(length + 1);
-        memcpy(token.literal, start, length);
-        token.literal[length] = '\0';
+        token.literal = ast_strndup(start, length);
     } else {
         token.literal = NULL;
     }
@@ -162,7 +163,7 @@ static Token error_token(Lexer* lexer, const char* message) {
     token.type = TOKEN_ERROR;
     token.line = lexer->line;
     token.column = lexer->column;
-    token.literal = safe_strdup(message);
+    token.literal = ast_strdup(message);
     return token;
 }
 
@@ -214,12 +215,12 @@ Token lexer_next_token(Lexer* lexer) {
         }
         if (c == '\n') {
             advance(lexer);
-            Token t = {TOKEN_NEWLINE, safe_strdup("\n"), lexer->line - 1, lexer->column}; 
+            Token t = {TOKEN_NEWLINE, ast_strndup("\n", 1), lexer->line - 1, lexer->column}; 
             return t;
         }
         if (c == ';') {
             advance(lexer);
-            Token t = {TOKEN_NEWLINE, safe_strdup("\n"), lexer->line, lexer->column};
+            Token t = {TOKEN_NEWLINE, ast_strndup("\n", 1), lexer->line, lexer->column};
             return t;
         }
         if (c == '!') {
@@ -267,7 +268,7 @@ Token lexer_next_token(Lexer* lexer) {
                 }
                 // found a non-whitespace previous char
                 if (pc == '0' || pc == '1' || isalnum((unsigned char)pc) || pc == ']' || pc == ')' || pc == '}' ) {
-                    Token t = {TOKEN_DASH, safe_strdup("-"), start_line, start_col};
+                    Token t = {TOKEN_DASH, ast_strndup("-", 1), start_line, start_col};
                     return t;
                 }
                 break;
@@ -284,7 +285,7 @@ Token lexer_next_token(Lexer* lexer) {
                    return number_token(lexer, true);
             }
 
-            Token t = {TOKEN_DASH, safe_strdup("-"), start_line, start_col};
+            Token t = {TOKEN_DASH, ast_strndup("-", 1), start_line, start_col};
             return t;
         }
 
@@ -321,8 +322,7 @@ static Token string_token(Lexer* lexer, char quote_char) {
         
         if (c == quote_char) {
             advance(lexer);
-            value[len_val] = '\0';
-            Token t = {TOKEN_STRING, value, start_line, start_col};
+            Token t = {TOKEN_STRING, lex_keep(value, len_val), start_line, start_col};
             return t;
         }
         
@@ -473,7 +473,7 @@ static Token identifier_token(Lexer* lexer) {
     
     Token t;
     t.type = type;
-    t.literal = value;
+    t.literal = lex_keep(value, len_val);
     t.line = start_line;
     t.column = start_col;
     return t;
@@ -535,17 +535,14 @@ static Token number_token(Lexer* lexer, bool is_negative_start) {
             lexer->line = saved_line;
             lexer->column = saved_col;
             len_val = frac_start_len;
-            value[len_val] = '\0';
-            Token t = {TOKEN_NUMBER, value, start_line, start_col};
+            Token t = {TOKEN_NUMBER, lex_keep(value, len_val), start_line, start_col};
             return t;
         }
         
-        value[len_val] = '\0';
-        Token t = {TOKEN_FLOAT, value, start_line, start_col};
+        Token t = {TOKEN_FLOAT, lex_keep(value, len_val), start_line, start_col};
         return t;
     }
     
-    value[len_val] = '\0';
-    Token t = {TOKEN_NUMBER, value, start_line, start_col};
+    Token t = {TOKEN_NUMBER, lex_keep(value, len_val), start_line, start_col};
     return t;
 }
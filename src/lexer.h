@@ -10,12 +10,20 @@ typedef struct {
     size_t current;
     int line;
     int column;
+    // Source lines for lexer_get_line, built on its first call.
+    const char** lines;
+    int line_count;
 } Lexer;
 
 void lexer_init(Lexer* lexer, const char* source, const char* filename);
 Token lexer_next_token(Lexer* lexer);
-// Return a newly-allocated string containing the requested 1-based line from the
-// lexer's source (without trailing newline). Caller must free the returned string.
-char* lexer_get_line(Lexer* lexer, int line);
+// Token literals and the lines returned by lexer_get_line are allocated
+// from the AST arena entered when they are produced (ast.h).
+
+// Return the requested 1-based line of the lexer's source, without its line
+// break and trailing whitespace ("" past the end).  The first call copies
+// the source into the current AST arena once; every line is a slice of
+// that copy, valid as long as the arena.
+const char* lexer_get_line(Lexer* lexer, int line);
 
 #endif // LEXER_H
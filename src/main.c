@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 // platform-specific chdir
 #ifdef _MSC_VER
 #include <direct.h>
@@ -12,9 +13,14 @@
 
 #include "lexer.h"
 #include "parser.h"
+#include "ast_cache.h"
 #include "interpreter.h"
+#include "profile.h"
 #include "builtins.h"
 #include "extensions.h"
+#include "simd.h"
+#include "thread_pool.h"
+#include "vm.h"
 
 static int ends_with_case_insensitive(const char* s, const char* suffix) {
     if (!s || !suffix) return 0;
@@ -204,9 +210,14 @@ static void repl_update_line_state(const char* line, int* brace_depth, int* line
     *line_continuation = (end > 0 && line[end - 1] == '^') ? 1 : 0;
 }
 
-static int run_repl(int verbose, int private_flag) {
+static int run_repl(int verbose, int private_flag, int trace_sample) {
     Interpreter interp;
     interpreter_init(&interp, "<repl>", verbose != 0, private_flag != 0);
+    if (interpreter_set_trace_sampling(&interp, trace_sample) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        interpreter_destroy(&interp);
+        return PREFIX_ERROR_MEMORY;
+    }
 
     char* entry = NULL;
     size_t entry_len = 0;
@@ -248,20 +259,18 @@ static int run_repl(int verbose, int private_flag) {
             break;
         }
 
-        Lexer lex;
-        lexer_init(&lex, entry, "<repl>");
-
-        Parser parser;
-        parser_init(&parser, &lex);
-        Stmt* program = parser_parse(&parser);
-
-        if (!parser.had_error) {
+        // Each entry gets its own AST arena, dropped once it has run (FUNCs
+        // and THRs it defined keep it alive).
+        Stmt* program = parser_parse_source(entry, "<repl>", NULL, NULL);
+        if (program) {
             ExecResult res = exec_program_in_env(&interp, program, interp.global_env);
             if (res.status == EXEC_ERROR) {
                 fprintf(stderr, "%s\n", res.error ? res.error : "RuntimeError");
                 if (res.error) free(res.error);
                 interpreter_reset_traceback(&interp, interp.global_env);
             }
+            interpreter_forget_arena(&interp, program->arena);
+            ast_arena_release(program->arena);
         }
 
         entry_len = 0;
@@ -282,6 +291,7 @@ int main(int argc, char** argv) {
     int source_mode = 0;
     char* source_text = NULL;
     int verbose_flag = 0;
+    int trace_sample = 0;
     int private_flag = 0;
     int explicit_ext_count = 0;
 
@@ -312,6 +322,65 @@ int main(int argc, char** argv) {
             continue;
         }
 
+        if (strcmp(arg, "-vm") == 0) {
+            vm_set_enabled(true);
+            continue;
+        }
+
+        if (strncmp(arg, "-trace-sample=", 14) == 0) {
+            char* end = NULL;
+            long every = strtol(arg + 14, &end, 10);
+            if (end == arg + 14 || *end != '\0' || every <= 0 || every > INT_MAX) {
+                fprintf(stderr, "Invalid -trace-sample interval '%s' (expected a positive integer)\n", arg + 14);
+                extensions_shutdown();
+                builtins_reset_dynamic();
+                return PREFIX_ERROR_IO;
+            }
+            trace_sample = (int)every;
+            continue;
+        }
+
+        // Files are opened now, before the working directory changes to
+        // the script's.
+        if (strcmp(arg, "-profile") == 0 || strncmp(arg, "-profile=", 9) == 0) {
+            char* err = NULL;
+            if (profile_start(arg[8] == '=' ? arg + 9 : NULL, &err) != 0) {
+                fprintf(stderr, "%s\n", err ? err : "Failed to start profiler");
+                free(err);
+                extensions_shutdown();
+                builtins_reset_dynamic();
+                return PREFIX_ERROR_IO;
+            }
+            continue;
+        }
+
+        if (strncmp(arg, "-threads=", 9) == 0) {
+            char* end = NULL;
+            long threads = strtol(arg + 9, &end, 10);
+            if (end == arg + 9 || *end != '\0' || threads <= 0 || threads > 4096) {
+                fprintf(stderr, "Invalid -threads count '%s' (expected a positive integer)\n", arg + 9);
+                extensions_shutdown();
+                builtins_reset_dynamic();
+                return PREFIX_ERROR_IO;
+            }
+            thread_pool_set_size((size_t)threads);
+            continue;
+        }
+
+        if (strncmp(arg, "-simd=", 6) == 0) {
+            const char* lv = arg + 6;
+            if (strcmp(lv, "scalar") == 0) simd_set_max_level(SIMD_SCALAR);
+            else if (strcmp(lv, "sse2") == 0) simd_set_max_level(SIMD_SSE2);
+            else if (strcmp(lv, "avx2") == 0) simd_set_max_level(SIMD_AVX2);
+            else {
+                fprintf(stderr, "Unknown -simd level '%s' (expected scalar, sse2 or avx2)\n", lv);
+                extensions_shutdown();
+                builtins_reset_dynamic();
+                return PREFIX_ERROR_IO;
+            }
+            continue;
+        }
+
         if (strcmp(arg, "-source") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Missing argument for -source\n");
@@ -441,7 +510,7 @@ int main(int argc, char** argv) {
     }
 
     if (!path && !source_mode) {
-        int repl_rc = run_repl(verbose_flag, private_flag);
+        int repl_rc = run_repl(verbose_flag, private_flag, trace_sample);
         extensions_shutdown();
         builtins_reset_dynamic();
         return repl_rc;
@@ -503,14 +572,14 @@ int main(int argc, char** argv) {
         fclose(f);
     }
 
-    Lexer lex;
-    lexer_init(&lex, src, source_label);
-
-    Parser parser;
-    parser_init(&parser, &lex);
-
-    Stmt* program = parser_parse(&parser);
-    if (parser.had_error) {
+    // Scripts read from a file go through the module AST cache.
+    Stmt* program = NULL;
+    if (source_mode) {
+        program = parser_parse_source(src, source_label, NULL, NULL);
+    } else {
+        program = ast_cache_parse(source_label, src, strlen(src), NULL, NULL);
+    }
+    if (!program) {
         free(src);
         if (source_text) free(source_text);
         extensions_shutdown();
@@ -537,6 +606,16 @@ int main(int argc, char** argv) {
 
     Interpreter interp;
     interpreter_init(&interp, source_label, verbose_flag != 0, private_flag != 0);
+    if (interpreter_set_trace_sampling(&interp, trace_sample) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        interpreter_destroy(&interp);
+        free(src);
+        if (source_label) free(source_label);
+        if (source_text) free(source_text);
+        extensions_shutdown();
+        builtins_reset_dynamic();
+        return PREFIX_ERROR_MEMORY;
+    }
     ExecResult res = exec_program_in_env(&interp, program, interp.global_env);
     interpreter_destroy(&interp);
     if (res.status == EXEC_ERROR) {
@@ -20,8 +20,14 @@
  *      │      "x"      │ │      "y"      │ │      "z"      │
  *      └───────────────┘ └───────────────┘ └───────────────┘
  *
- * Read requests block until the queried symbol's buffer is empty,
- * then acquire a global env-access mutex for safe reading.
+ * Read requests block until the queried symbol's buffer is empty and
+ * then read under the target Env's own reader/writer lock; the prepare
+ * thread write-locks only the Env an op actually mutates (see env.c).
+ *
+ * The buffer is only engaged while interpreter worker threads exist
+ * (tracked by ns_buffer_worker_enter/exit).  A single-threaded program
+ * never pays for the queue round trip: env.c sees ns_buffer_active()
+ * return false and performs every read and write inline.
  */
 
 #include "ns_buffer.h"
@@ -83,7 +89,7 @@ static SymbolThread* find_or_create_symbol_thread(NsBuffer* buf, const char* nam
 
 /* ------------------------------------------------------------------ */
 /*  Execute a single NsOp against the real environment.                */
-/*  Called on the prepare thread while holding buf->env_mtx.           */
+/*  Called on the prepare thread; _direct takes the per-Env locks.     */
 /* ------------------------------------------------------------------ */
 
 static void execute_op(NsOp* op) {
@@ -112,6 +118,10 @@ static void execute_op(NsOp* op) {
     case NS_OP_PERMAFREEZE:
         op->result_int = env_permafreeze_direct(op->env, op->name);
         break;
+    case NS_OP_UPDATE:
+        op->result_ok = env_update_direct(op->env, op->name,
+                                          op->update_fn, op->update_ctx);
+        break;
     }
 }
 
@@ -152,9 +162,7 @@ static int prepare_thread_func(void* arg) {
         mtx_unlock(&st->lock);
 
         /* ---- Phase 3: execute (as the symbol's logical thread) ---- */
-        mtx_lock(&buf->env_mtx);
         execute_op(op);
-        mtx_unlock(&buf->env_mtx);
 
         /* ---- Phase 4: remove from symbol thread & signal drain ---- */
         mtx_lock(&st->lock);
@@ -184,9 +192,7 @@ static int prepare_thread_func(void* arg) {
         SymbolThread* st = find_or_create_symbol_thread(buf, op->name);
         mtx_unlock(&buf->symbols_mtx);
 
-        mtx_lock(&buf->env_mtx);
         execute_op(op);
-        mtx_unlock(&buf->env_mtx);
 
         mtx_lock(&st->lock);
         if (st->pending_count > 0) st->pending_count--;
@@ -202,6 +208,7 @@ static int prepare_thread_func(void* arg) {
     }
     mtx_unlock(&buf->queue_mtx);
 
+    value_pool_thread_exit();
     return 0;
 }
 
@@ -220,7 +227,8 @@ void ns_buffer_init(void) {
     buf->symbols = NULL;
     mtx_init(&buf->symbols_mtx, 0);
 
-    mtx_init(&buf->env_mtx, 0);
+    buf->workers = 0;
+    mtx_init(&buf->workers_mtx, 0);
 
     buf->running = 1;
 
@@ -258,20 +266,42 @@ void ns_buffer_shutdown(void) {
     mtx_destroy(&buf->queue_mtx);
     cnd_destroy(&buf->queue_cnd);
     mtx_destroy(&buf->symbols_mtx);
-    mtx_destroy(&buf->env_mtx);
+    mtx_destroy(&buf->workers_mtx);
     free(buf);
     g_ns_buf = NULL;
 }
 
 bool ns_buffer_active(void) {
-    return g_ns_buf != NULL && g_ns_buf->running;
+    /* A worker always observes its own registration (the parent's
+       increment happens before thrd_create), and a stale non-zero count
+       only sends the caller down the buffered path, which is always
+       correct, so an unlocked read is sufficient here. */
+    return g_ns_buf != NULL && g_ns_buf->running && g_ns_buf->workers > 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Public: worker tracking                                            */
+/* ------------------------------------------------------------------ */
+
+void ns_buffer_worker_enter(void) {
+    if (!g_ns_buf) return;
+    mtx_lock(&g_ns_buf->workers_mtx);
+    g_ns_buf->workers++;
+    mtx_unlock(&g_ns_buf->workers_mtx);
+}
+
+void ns_buffer_worker_exit(void) {
+    if (!g_ns_buf) return;
+    mtx_lock(&g_ns_buf->workers_mtx);
+    if (g_ns_buf->workers > 0) g_ns_buf->workers--;
+    mtx_unlock(&g_ns_buf->workers_mtx);
 }
 
 /* ------------------------------------------------------------------ */
 /*  Public: read-side synchronisation                                  */
 /* ------------------------------------------------------------------ */
 
-void ns_buffer_read_lock(const char* name) {
+void ns_buffer_read_wait(const char* name) {
     if (!g_ns_buf || !g_ns_buf->running) return;
     NsBuffer* buf = g_ns_buf;
 
@@ -286,15 +316,6 @@ void ns_buffer_read_lock(const char* name) {
             cnd_wait(&st->drain_cnd, &st->lock);
         mtx_unlock(&st->lock);
     }
-
-    /* Acquire the global env-access lock so the reader is safe from
-       concurrent structural mutations (e.g. realloc in env_define). */
-    mtx_lock(&buf->env_mtx);
-}
-
-void ns_buffer_read_unlock(void) {
-    if (!g_ns_buf) return;
-    mtx_unlock(&g_ns_buf->env_mtx);
 }
 
 /* ------------------------------------------------------------------ */
@@ -419,3 +440,15 @@ int ns_buffer_permafreeze(struct Env* env, const char* name) {
     free_op(op);
     return r;
 }
+
+bool ns_buffer_update(struct Env* env, const char* name,
+                      void (*fn)(struct EnvEntry* entry, void* ctx), void* ctx) {
+    NsOp* op = make_op(NS_OP_UPDATE, env, name);
+    op->update_fn = fn;
+    op->update_ctx = ctx;
+    enqueue_op(op);
+    wait_op(op);
+    bool r = op->result_ok;
+    free_op(op);
+    return r;
+}
@@ -15,7 +15,8 @@ typedef enum {
     NS_OP_ALIAS,
     NS_OP_FREEZE,
     NS_OP_THAW,
-    NS_OP_PERMAFREEZE
+    NS_OP_PERMAFREEZE,
+    NS_OP_UPDATE
 } NsOpType;
 
 // A single write operation enqueued in the central buffer.
@@ -27,6 +28,8 @@ typedef struct NsOp {
     DeclType decl_type;     // for DEFINE / ASSIGN / ALIAS
     bool declare_if_missing;// for ASSIGN / ALIAS
     char* target_name;      // for ALIAS  (owned copy)
+    void (*update_fn)(struct EnvEntry* entry, void* ctx); // for UPDATE
+    void* update_ctx;       // for UPDATE
 
     // Result fields – filled by the prepare thread after execution
     bool result_ok;         // true = success (for bool-returning ops)
@@ -63,13 +66,14 @@ typedef struct NsBuffer {
     SymbolThread* symbols;
     mtx_t symbols_mtx;
 
-    // Global env-access mutex – held by the prepare thread during writes
-    // and by readers during reads to prevent structural races (e.g. realloc).
-    mtx_t env_mtx;
-
     // Prepare thread (hardware thread)
     thrd_t prepare_thrd;
     volatile int running;   // using int for volatile-safe reads
+
+    // Number of live interpreter worker threads.  Writes are buffered
+    // only while this is non-zero; see ns_buffer_worker_enter().
+    volatile int workers;
+    mtx_t workers_mtx;
 } NsBuffer;
 
 // ---------- Public API ----------
@@ -83,16 +87,27 @@ void ns_buffer_init(void);
 // direct (unbuffered) execution.
 void ns_buffer_shutdown(void);
 
-// Returns true if the buffer system is active.
+// Returns true if env_* calls must currently go through the buffer:
+// the system is initialised and at least one worker thread is live.
+// While the process is single-threaded this is false and env.c runs
+// the _direct implementations inline without any locking.
 bool ns_buffer_active(void);
 
-// Block the calling thread until all pending writes for `name` have
-// been processed.  Then acquire the env-access lock so the caller can
-// safely read.  The caller MUST call ns_buffer_read_unlock() when done.
-void ns_buffer_read_lock(const char* name);
+// ---------- Worker tracking ----------
+// Every interpreter worker thread (THR, ASYNC, PARFOR, PARALLEL) is
+// bracketed by these calls.  The parent calls ns_buffer_worker_enter()
+// before thrd_create so buffered mode is on before the new thread runs;
+// the worker calls ns_buffer_worker_exit() as its last action (or the
+// parent does, if thrd_create fails).  When the count drops back to zero
+// every buffered op has already completed, so inline writes are safe again.
+void ns_buffer_worker_enter(void);
+void ns_buffer_worker_exit(void);
 
-// Release the env-access lock acquired by ns_buffer_read_lock().
-void ns_buffer_read_unlock(void);
+// Block the calling thread until all pending writes for `name` have
+// been processed.  The read itself is then guarded by the per-Env
+// reader/writer locks in env.c, so readers of one scope never wait on
+// writes applied to another.
+void ns_buffer_read_wait(const char* name);
 
 // ---------- Buffered write entry points ----------
 // Each function enqueues the operation, blocks until completion, and
@@ -108,5 +123,7 @@ bool ns_buffer_set_alias(struct Env* env, const char* name,
 int  ns_buffer_freeze(struct Env* env, const char* name);
 int  ns_buffer_thaw(struct Env* env, const char* name);
 int  ns_buffer_permafreeze(struct Env* env, const char* name);
+bool ns_buffer_update(struct Env* env, const char* name,
+                      void (*fn)(struct EnvEntry* entry, void* ctx), void* ctx);
 
 #endif // NS_BUFFER_H
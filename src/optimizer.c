@@ -0,0 +1,497 @@
+/*
+ * optimizer.c – Constant folding and typed builtin calls.
+ *
+ * Runs once over a resolved program, in two walks:
+ *
+ *   1. Collect the declared type of every name the program binds: typed
+ *      assignments and declarations, FUNC / LAMBDA parameters, FOR and
+ *      PARFOR counters.  A name declared with two different types, or
+ *      rebound behind the declarations' back (DEL, ASSIGN, an @pointer
+ *      argument, a CATCH or POP name), is recorded as TYPE_UNKNOWN.  The
+ *      table is per program rather than per scope, which only makes it
+ *      more conservative.
+ *
+ *   2. Bottom-up over every expression: fold calls to pure builtins whose
+ *      arguments are all literals, and tag the remaining two-argument
+ *      arithmetic and comparisons whose arguments have a known matching
+ *      type with a CallTyped fast path (see optimizer.h).
+ *
+ * Folding evaluates the builtin itself, on a scratch Interpreter, so a
+ * folded literal is exactly what the call would have produced; a call
+ * that raises an error is kept.  Only static builtins are considered, and
+ * those can be neither redefined by FUNC nor replaced by an extension.
+ */
+
+#include "optimizer.h"
+#include "builtins.h"
+#include "interpreter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Builtins with no side effects whose result depends on their arguments
+// only.  Every one of them returns INT, FLT or STR for scalar arguments.
+static const char* const pure_builtins[] = {
+    "ADD", "SUB", "MUL", "DIV", "MOD", "POW", "NEG", "ABS", "ROOT", "IROOT",
+    "FROOT", "LOG", "CLOG", "GCD", "LCM", "INV",
+    "IADD", "ISUB", "IMUL", "IDIV", "CDIV", "IPOW",
+    "FADD", "FSUB", "FMUL", "FDIV", "FPOW",
+    "EQ", "NEQ", "GT", "LT", "GTE", "LTE",
+    "AND", "OR", "XOR", "NOT", "BOOL",
+    "BAND", "BOR", "BXOR", "BNOT", "SHL", "SHR",
+    "INT", "FLT", "STR", "ISINT", "ISFLT", "ISSTR",
+    "SLEN", "UPPER", "LOWER", "FLIP", "SLICE", "REPLACE", "STRIP",
+    NULL
+};
+
+#define FOLD_MAX_ARGS 3
+
+typedef struct {
+    const char* name;
+    CallTyped int_op;
+    CallTyped flt_op;
+    bool compare;       // result is INT whatever the argument type
+} TypedBuiltin;
+
+static const TypedBuiltin typed_builtins[] = {
+    {"ADD", CALL_TYPED_IADD, CALL_TYPED_FADD, false},
+    {"SUB", CALL_TYPED_ISUB, CALL_TYPED_FSUB, false},
+    {"MUL", CALL_TYPED_IMUL, CALL_TYPED_FMUL, false},
+    {"EQ", CALL_TYPED_IEQ, CALL_TYPED_FEQ, true},
+    {"NEQ", CALL_TYPED_INEQ, CALL_TYPED_FNEQ, true},
+    {"LT", CALL_TYPED_ILT, CALL_TYPED_FLT, true},
+    {"GT", CALL_TYPED_IGT, CALL_TYPED_FGT, true},
+    {"LTE", CALL_TYPED_ILTE, CALL_TYPED_FLTE, true},
+    {"GTE", CALL_TYPED_IGTE, CALL_TYPED_FGTE, true},
+    {NULL, CALL_TYPED_NONE, CALL_TYPED_NONE, false}
+};
+
+// ============ Name types ============
+
+typedef struct {
+    const char* name;   // points into the AST; NULL = empty slot
+    DeclType type;
+} NameType;
+
+typedef struct {
+    NameType* slots;
+    size_t cap;         // power of two
+    size_t count;
+} NameTypes;
+
+static void* opt_alloc(size_t size) {
+    void* p = calloc(1, size);
+    if (!p) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint32_t name_hash(const char* s) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)s; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static NameType* names_find(const NameTypes* t, const char* name) {
+    if (!t->slots) return NULL;
+    size_t mask = t->cap - 1;
+    for (size_t i = name_hash(name) & mask;; i = (i + 1) & mask) {
+        NameType* slot = &t->slots[i];
+        if (!slot->name) return NULL;
+        if (strcmp(slot->name, name) == 0) return slot;
+    }
+}
+
+// Record that `name` is bound with `type`; TYPE_UNKNOWN poisons the name.
+static void names_note(NameTypes* t, const char* name, DeclType type) {
+    if (!name) return;
+    NameType* slot = names_find(t, name);
+    if (slot) {
+        if (slot->type != type) slot->type = TYPE_UNKNOWN;
+        return;
+    }
+    if ((t->count + 1) * 2 > t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 64;
+        NameType* slots = opt_alloc(cap * sizeof(NameType));
+        for (size_t i = 0; i < t->cap; i++) {
+            if (!t->slots[i].name) continue;
+            size_t j = name_hash(t->slots[i].name) & (cap - 1);
+            while (slots[j].name) j = (j + 1) & (cap - 1);
+            slots[j] = t->slots[i];
+        }
+        free(t->slots);
+        t->slots = slots;
+        t->cap = cap;
+    }
+    size_t mask = t->cap - 1;
+    size_t i = name_hash(name) & mask;
+    while (t->slots[i].name) i = (i + 1) & mask;
+    t->slots[i].name = name;
+    t->slots[i].type = type;
+    t->count++;
+}
+
+static DeclType names_type(const NameTypes* t, const char* name) {
+    NameType* slot = names_find(t, name);
+    return slot ? slot->type : TYPE_UNKNOWN;
+}
+
+// ============ Walk 1: collect declarations ============
+
+static void collect_expr(NameTypes* t, Expr* expr);
+static void collect_stmt(NameTypes* t, Stmt* stmt);
+
+static void collect_expr_list(NameTypes* t, ExprList* list) {
+    for (size_t i = 0; i < list->count; i++) collect_expr(t, list->items[i]);
+}
+
+static void collect_stmt_list(NameTypes* t, StmtList* list) {
+    for (size_t i = 0; i < list->count; i++) collect_stmt(t, list->items[i]);
+}
+
+static void collect_params(NameTypes* t, ParamList* params) {
+    for (size_t i = 0; i < params->count; i++) {
+        names_note(t, params->items[i].name, params->items[i].type);
+        collect_expr(t, params->items[i].default_value);
+    }
+}
+
+static void collect_expr(NameTypes* t, Expr* expr) {
+    if (!expr) return;
+    switch (expr->type) {
+        case EXPR_PTR:
+            names_note(t, expr->as.ptr_name, TYPE_UNKNOWN);
+            break;
+        case EXPR_CALL: {
+            Expr* callee = expr->as.call.callee;
+            if (callee->type == EXPR_IDENT && expr->as.call.args.count > 0 &&
+                (strcmp(callee->as.ident, "DEL") == 0 || strcmp(callee->as.ident, "ASSIGN") == 0)) {
+                Expr* target = expr->as.call.args.items[0];
+                if (target->type == EXPR_IDENT) names_note(t, target->as.ident, TYPE_UNKNOWN);
+            }
+            collect_expr(t, callee);
+            collect_expr_list(t, &expr->as.call.args);
+            collect_expr_list(t, &expr->as.call.kw_args);
+            break;
+        }
+        case EXPR_ASYNC:
+            collect_stmt(t, expr->as.async.block);
+            break;
+        case EXPR_TNS:
+            collect_expr_list(t, &expr->as.tns_items);
+            break;
+        case EXPR_MAP:
+            collect_expr_list(t, &expr->as.map_items.keys);
+            collect_expr_list(t, &expr->as.map_items.values);
+            break;
+        case EXPR_INDEX:
+            collect_expr(t, expr->as.index.target);
+            collect_expr_list(t, &expr->as.index.indices);
+            break;
+        case EXPR_RANGE:
+            collect_expr(t, expr->as.range.start);
+            collect_expr(t, expr->as.range.end);
+            break;
+        case EXPR_LAMBDA:
+            collect_params(t, &expr->as.lambda.params);
+            collect_stmt(t, expr->as.lambda.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static void collect_stmt(NameTypes* t, Stmt* stmt) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case STMT_BLOCK:
+            collect_stmt_list(t, &stmt->as.block);
+            break;
+        case STMT_ASYNC:
+            collect_stmt(t, stmt->as.async_stmt.body);
+            break;
+        case STMT_EXPR:
+            collect_expr(t, stmt->as.expr_stmt.expr);
+            break;
+        case STMT_ASSIGN:
+            if (stmt->as.assign.has_type && !stmt->as.assign.target) {
+                names_note(t, stmt->as.assign.name, stmt->as.assign.decl_type);
+            }
+            collect_expr(t, stmt->as.assign.target);
+            collect_expr(t, stmt->as.assign.value);
+            break;
+        case STMT_DECL:
+            names_note(t, stmt->as.decl.name, stmt->as.decl.decl_type);
+            break;
+        case STMT_IF:
+            collect_expr(t, stmt->as.if_stmt.condition);
+            collect_stmt(t, stmt->as.if_stmt.then_branch);
+            collect_expr_list(t, &stmt->as.if_stmt.elif_conditions);
+            collect_stmt_list(t, &stmt->as.if_stmt.elif_blocks);
+            collect_stmt(t, stmt->as.if_stmt.else_branch);
+            break;
+        case STMT_WHILE:
+            collect_expr(t, stmt->as.while_stmt.condition);
+            collect_stmt(t, stmt->as.while_stmt.body);
+            break;
+        case STMT_FOR:
+            names_note(t, stmt->as.for_stmt.counter, TYPE_INT);
+            collect_expr(t, stmt->as.for_stmt.target);
+            collect_stmt(t, stmt->as.for_stmt.body);
+            break;
+        case STMT_PARFOR:
+            names_note(t, stmt->as.parfor_stmt.counter, TYPE_INT);
+            collect_expr(t, stmt->as.parfor_stmt.target);
+            collect_stmt(t, stmt->as.parfor_stmt.body);
+            break;
+        case STMT_FUNC:
+            names_note(t, stmt->as.func_stmt.name, TYPE_FUNC);
+            collect_params(t, &stmt->as.func_stmt.params);
+            collect_stmt(t, stmt->as.func_stmt.body);
+            break;
+        case STMT_RETURN:
+            collect_expr(t, stmt->as.return_stmt.value);
+            break;
+        case STMT_BREAK:
+            collect_expr(t, stmt->as.break_stmt.value);
+            break;
+        case STMT_THR:
+            names_note(t, stmt->as.thr_stmt.name, TYPE_THR);
+            collect_stmt(t, stmt->as.thr_stmt.body);
+            break;
+        case STMT_POP:
+            names_note(t, stmt->as.pop_stmt.name, TYPE_UNKNOWN);
+            break;
+        case STMT_TRY:
+            names_note(t, stmt->as.try_stmt.catch_name, TYPE_UNKNOWN);
+            collect_stmt(t, stmt->as.try_stmt.try_block);
+            collect_stmt(t, stmt->as.try_stmt.catch_block);
+            break;
+        case STMT_GOTO:
+            collect_expr(t, stmt->as.goto_stmt.target);
+            break;
+        case STMT_GOTOPOINT:
+            collect_expr(t, stmt->as.gotopoint_stmt.target);
+            break;
+        default:
+            break;
+    }
+}
+
+// ============ Walk 2: fold and specialize ============
+
+static bool is_literal(const Expr* expr) {
+    return expr->type == EXPR_INT || expr->type == EXPR_FLT || expr->type == EXPR_STR;
+}
+
+static bool is_pure_builtin(const char* name) {
+    for (size_t i = 0; pure_builtins[i]; i++) {
+        if (strcmp(pure_builtins[i], name) == 0) return true;
+    }
+    return false;
+}
+
+// Replace `call` (a pure builtin with literal arguments) by its value.
+static bool fold_call(Expr* call) {
+    size_t argc = call->as.call.args.count;
+    const char* name = call->as.call.callee->as.ident;
+    if (argc > FOLD_MAX_ARGS || !is_pure_builtin(name)) return false;
+    BuiltinFunction* fn = builtin_lookup(name);
+    if (!fn || (int)argc < fn->min_args || (fn->max_args >= 0 && (int)argc > fn->max_args)) return false;
+
+    Value args[FOLD_MAX_ARGS];
+    for (size_t i = 0; i < argc; i++) {
+        Expr* arg = call->as.call.args.items[i];
+        if (arg->type == EXPR_INT) args[i] = value_int(arg->as.int_value);
+        else if (arg->type == EXPR_FLT) args[i] = value_flt(arg->as.flt_value);
+        else args[i] = value_str_interned(arg->as.str_value);
+    }
+
+    Interpreter scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    Value v = fn->impl(&scratch, argc ? args : NULL, (int)argc, argc ? call->as.call.args.items : NULL,
+                       NULL, call->line, call->column);
+    for (size_t i = 0; i < argc; i++) value_free(args[i]);
+    if (scratch.error) {
+        free(scratch.error);
+        value_free(v);
+        return false;
+    }
+
+    Expr* lit = NULL;
+    if (v.type == VAL_INT) {
+        lit = expr_int(v.as.i, call->line, call->column);
+    } else if (v.type == VAL_FLT) {
+        lit = expr_flt(v.as.f, call->line, call->column);
+    } else if (v.type == VAL_STR && v.as.s && strlen(v.as.s) == value_str_len(v.as.s)) {
+        lit = expr_str(v.as.s, call->line, call->column);
+    }
+    value_free(v);
+    if (!lit) return false;
+
+    // The parent points at `call`, so the literal moves into that node; the
+    // old call subtree and the spare node are reclaimed with the arena.
+    *call = *lit;
+    return true;
+}
+
+static void choose_typed(Expr* call, DeclType a, DeclType b, DeclType* result) {
+    if (a != b || (a != TYPE_INT && a != TYPE_FLT)) return;
+    for (size_t i = 0; typed_builtins[i].name; i++) {
+        const TypedBuiltin* tb = &typed_builtins[i];
+        if (strcmp(tb->name, call->as.call.callee->as.ident) != 0) continue;
+        call->as.call.typed_op = (unsigned char)(a == TYPE_INT ? tb->int_op : tb->flt_op);
+        *result = tb->compare ? TYPE_INT : a;
+        return;
+    }
+}
+
+static DeclType opt_expr(const NameTypes* t, Expr* expr);
+static void opt_stmt(const NameTypes* t, Stmt* stmt);
+
+static void opt_expr_list(const NameTypes* t, ExprList* list) {
+    for (size_t i = 0; i < list->count; i++) opt_expr(t, list->items[i]);
+}
+
+static void opt_stmt_list(const NameTypes* t, StmtList* list) {
+    for (size_t i = 0; i < list->count; i++) opt_stmt(t, list->items[i]);
+}
+
+static void opt_params(const NameTypes* t, ParamList* params) {
+    for (size_t i = 0; i < params->count; i++) opt_expr(t, params->items[i].default_value);
+}
+
+// Returns the static type of `expr`, TYPE_UNKNOWN when not known.
+static DeclType opt_expr(const NameTypes* t, Expr* expr) {
+    if (!expr) return TYPE_UNKNOWN;
+    switch (expr->type) {
+        case EXPR_INT:
+            return TYPE_INT;
+        case EXPR_FLT:
+            return TYPE_FLT;
+        case EXPR_STR:
+            return TYPE_STR;
+        case EXPR_IDENT:
+            return names_type(t, expr->as.ident);
+        case EXPR_CALL: {
+            Expr* callee = expr->as.call.callee;
+            if (callee->type != EXPR_IDENT) opt_expr(t, callee);
+            size_t argc = expr->as.call.args.count;
+            DeclType types[2] = { TYPE_UNKNOWN, TYPE_UNKNOWN };
+            bool literals = true;
+            for (size_t i = 0; i < argc; i++) {
+                DeclType at = opt_expr(t, expr->as.call.args.items[i]);
+                if (i < 2) types[i] = at;
+                if (!is_literal(expr->as.call.args.items[i])) literals = false;
+            }
+            opt_expr_list(t, &expr->as.call.kw_args);
+            if (callee->type != EXPR_IDENT || expr->as.call.kw_count > 0) return TYPE_UNKNOWN;
+            if (literals && fold_call(expr)) return opt_expr(t, expr);
+
+            DeclType result = TYPE_UNKNOWN;
+            if (argc == 2) choose_typed(expr, types[0], types[1], &result);
+            return result;
+        }
+        case EXPR_ASYNC:
+            opt_stmt(t, expr->as.async.block);
+            break;
+        case EXPR_TNS:
+            opt_expr_list(t, &expr->as.tns_items);
+            break;
+        case EXPR_MAP:
+            opt_expr_list(t, &expr->as.map_items.keys);
+            opt_expr_list(t, &expr->as.map_items.values);
+            break;
+        case EXPR_INDEX:
+            opt_expr(t, expr->as.index.target);
+            opt_expr_list(t, &expr->as.index.indices);
+            break;
+        case EXPR_RANGE:
+            opt_expr(t, expr->as.range.start);
+            opt_expr(t, expr->as.range.end);
+            break;
+        case EXPR_LAMBDA:
+            opt_params(t, &expr->as.lambda.params);
+            opt_stmt(t, expr->as.lambda.body);
+            break;
+        default:
+            break;
+    }
+    return TYPE_UNKNOWN;
+}
+
+static void opt_stmt(const NameTypes* t, Stmt* stmt) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case STMT_BLOCK:
+            opt_stmt_list(t, &stmt->as.block);
+            break;
+        case STMT_ASYNC:
+            opt_stmt(t, stmt->as.async_stmt.body);
+            break;
+        case STMT_EXPR:
+            opt_expr(t, stmt->as.expr_stmt.expr);
+            break;
+        case STMT_ASSIGN:
+            opt_expr(t, stmt->as.assign.target);
+            opt_expr(t, stmt->as.assign.value);
+            break;
+        case STMT_IF:
+            opt_expr(t, stmt->as.if_stmt.condition);
+            opt_stmt(t, stmt->as.if_stmt.then_branch);
+            opt_expr_list(t, &stmt->as.if_stmt.elif_conditions);
+            opt_stmt_list(t, &stmt->as.if_stmt.elif_blocks);
+            opt_stmt(t, stmt->as.if_stmt.else_branch);
+            break;
+        case STMT_WHILE:
+            opt_expr(t, stmt->as.while_stmt.condition);
+            opt_stmt(t, stmt->as.while_stmt.body);
+            break;
+        case STMT_FOR:
+            opt_expr(t, stmt->as.for_stmt.target);
+            opt_stmt(t, stmt->as.for_stmt.body);
+            break;
+        case STMT_PARFOR:
+            opt_expr(t, stmt->as.parfor_stmt.target);
+            opt_stmt(t, stmt->as.parfor_stmt.body);
+            break;
+        case STMT_FUNC:
+            opt_params(t, &stmt->as.func_stmt.params);
+            opt_stmt(t, stmt->as.func_stmt.body);
+            break;
+        case STMT_RETURN:
+            opt_expr(t, stmt->as.return_stmt.value);
+            break;
+        case STMT_BREAK:
+            opt_expr(t, stmt->as.break_stmt.value);
+            break;
+        case STMT_THR:
+            opt_stmt(t, stmt->as.thr_stmt.body);
+            break;
+        case STMT_TRY:
+            opt_stmt(t, stmt->as.try_stmt.try_block);
+            opt_stmt(t, stmt->as.try_stmt.catch_block);
+            break;
+        case STMT_GOTO:
+            opt_expr(t, stmt->as.goto_stmt.target);
+            break;
+        case STMT_GOTOPOINT:
+            opt_expr(t, stmt->as.gotopoint_stmt.target);
+            break;
+        default:
+            break;
+    }
+}
+
+void optimize_program(Stmt* program) {
+    NameTypes names = { NULL, 0, 0 };
+    collect_stmt(&names, program);
+    opt_stmt(&names, program);
+    free(names.slots);
+}
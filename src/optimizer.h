@@ -0,0 +1,67 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ast.h"
+#include "value.h"
+
+// Rewrite `program` (already resolved, not yet compiled for -vm):
+//
+//   - a call to a pure builtin (ADD, MUL, POW, EQ, AND, UPPER, ...) whose
+//     arguments are all INT, FLT or STR literals is replaced by the literal
+//     it evaluates to, bottom-up, so nested constant arithmetic collapses
+//     to one node.  A call that would raise an error is left alone and
+//     raises it at run time as before.
+//   - ADD, SUB, MUL and the comparisons whose two arguments are statically
+//     both INT or both FLT get a CallTyped tag, which both engines evaluate
+//     without building an argument array or dispatching to the builtin.
+//
+// A variable counts as statically typed only when every declaration of
+// its name in the program (typed assignments, declarations, parameters,
+// loop counters) agrees on INT or FLT and the name is never passed to
+// DEL, ASSIGN or as an @pointer.  The typed paths still check the runtime
+// types and fall back to the builtin on a mismatch, so a wrong guess only
+// costs speed.  Builtin names cannot be shadowed by user functions or
+// extension operators, which keeps the folding sound.  Safe to call more
+// than once.
+void optimize_program(Stmt* program);
+
+// Evaluate typed call `op` on `a` and `b` into *out.  False, without
+// touching *out, when the arguments do not have the expected types.
+static inline bool call_typed_apply(unsigned op, Value a, Value b, Value* out) {
+    if (op < (unsigned)CALL_TYPED_FADD) {
+        if (a.type != VAL_INT || b.type != VAL_INT) return false;
+        uint64_t x = (uint64_t)a.as.i, y = (uint64_t)b.as.i;
+        int64_t r;
+        switch ((CallTyped)op) {
+            case CALL_TYPED_IADD: r = (int64_t)(x + y); break;
+            case CALL_TYPED_ISUB: r = (int64_t)(x - y); break;
+            case CALL_TYPED_IMUL: r = (int64_t)(x * y); break;
+            case CALL_TYPED_IEQ: r = a.as.i == b.as.i; break;
+            case CALL_TYPED_INEQ: r = a.as.i != b.as.i; break;
+            case CALL_TYPED_ILT: r = a.as.i < b.as.i; break;
+            case CALL_TYPED_IGT: r = a.as.i > b.as.i; break;
+            case CALL_TYPED_ILTE: r = a.as.i <= b.as.i; break;
+            case CALL_TYPED_IGTE: r = a.as.i >= b.as.i; break;
+            default: return false;
+        }
+        out->type = VAL_INT;
+        out->as.i = r;
+        return true;
+    }
+    if (a.type != VAL_FLT || b.type != VAL_FLT) return false;
+    double x = a.as.f, y = b.as.f;
+    switch ((CallTyped)op) {
+        case CALL_TYPED_FADD: out->type = VAL_FLT; out->as.f = x + y; return true;
+        case CALL_TYPED_FSUB: out->type = VAL_FLT; out->as.f = x - y; return true;
+        case CALL_TYPED_FMUL: out->type = VAL_FLT; out->as.f = x * y; return true;
+        case CALL_TYPED_FEQ: out->type = VAL_INT; out->as.i = x == y; return true;
+        case CALL_TYPED_FNEQ: out->type = VAL_INT; out->as.i = x != y; return true;
+        case CALL_TYPED_FLT: out->type = VAL_INT; out->as.i = x < y; return true;
+        case CALL_TYPED_FGT: out->type = VAL_INT; out->as.i = x > y; return true;
+        case CALL_TYPED_FLTE: out->type = VAL_INT; out->as.i = x <= y; return true;
+        case CALL_TYPED_FGTE: out->type = VAL_INT; out->as.i = x >= y; return true;
+        default: return false;
+    }
+}
+
+#endif // OPTIMIZER_H
@@ -1,4 +1,7 @@
 #include "parser.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "vm.h"
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
@@ -220,10 +223,7 @@ static Expr* parse_primary(Parser* parser) {
     if (parser->current_token.type == TOKEN_IDENT) {
         Token idtok = parser->current_token;
         // Build possibly-dotted identifier by concatenating IDENT (DOT IDENT)*
-        size_t len0 = idtok.literal ? strlen(idtok.literal) : 0;
-        char* name = malloc(len0 + 1);
-        if (!name) { fprintf(stderr, "Out of memory\n"); exit(1); }
-        if (len0) memcpy(name, idtok.literal, len0 + 1); else name[0] = '\0';
+        char* name = idtok.literal ? idtok.literal : ast_strndup("", 0);
         advance(parser); // consume first IDENT
         while (parser->current_token.type == TOKEN_DOT && parser->next_token.type == TOKEN_IDENT) {
             advance(parser); // consume DOT
@@ -231,13 +231,11 @@ static Expr* parse_primary(Parser* parser) {
             const char* part = parser->current_token.literal ? parser->current_token.literal : "";
             size_t part_len = strlen(part);
             size_t cur_len = strlen(name);
-            size_t newlen = cur_len + 1 + part_len + 1;
-            char* tmp = realloc(name, newlen);
-            if (!tmp) { free(name); fprintf(stderr, "Out of memory\n"); exit(1); }
-            name = tmp;
-            name[cur_len] = '.';
-            if (part_len) memcpy(name + cur_len + 1, part, part_len);
-            name[cur_len + 1 + part_len] = '\0';
+            char* joined = ast_alloc(cur_len + 1 + part_len + 1);
+            memcpy(joined, name, cur_len);
+            joined[cur_len] = '.';
+            memcpy(joined + cur_len + 1, part, part_len + 1);
+            name = joined;
             advance(parser); // consume IDENT
         }
         return expr_ident(name, idtok.line, idtok.column);
@@ -408,9 +406,7 @@ static Stmt* parse_block(Parser* parser) {
     while (parser->current_token.type != TOKEN_RBRACE && parser->current_token.type != TOKEN_EOF) {
         Stmt* stmt = parse_statement(parser);
         if (stmt) {
-            char* line_text = lexer_get_line(parser->lexer, stmt->line);
-            stmt_set_src(stmt, line_text);
-            free(line_text);
+            stmt_set_src(stmt, lexer_get_line(parser->lexer, stmt->line));
             stmt_list_add(&block->as.block, stmt);
         }
         skip_newlines(parser);
@@ -790,9 +786,7 @@ Stmt* parser_parse(Parser* parser) {
     while (parser->current_token.type != TOKEN_EOF) {
         Stmt* stmt = parse_statement(parser);
         if (stmt) {
-            char* line_text = lexer_get_line(parser->lexer, stmt->line);
-            stmt_set_src(stmt, line_text);
-            free(line_text);
+            stmt_set_src(stmt, lexer_get_line(parser->lexer, stmt->line));
             stmt_list_add(&program->as.block, stmt);
             skip_newlines(parser);
             continue;
@@ -804,10 +798,9 @@ Stmt* parser_parse(Parser* parser) {
            state so callers (e.g. RUN/IMPORT) don't treat it as a fatal
            top-level parse failure. */
         if (parser->error_msg) {
-            char* msg_dup = strdup(parser->error_msg);
-            Expr* callee = expr_ident(strdup("THROW"), parser->error_line, parser->error_col);
+            Expr* callee = expr_ident(ast_strdup("THROW"), parser->error_line, parser->error_col);
             Expr* call = expr_call(callee, parser->error_line, parser->error_col);
-            Expr* arg = expr_str(msg_dup, parser->error_line, parser->error_col);
+            Expr* arg = expr_str(parser->error_msg, parser->error_line, parser->error_col);
             expr_list_add(&call->as.call.args, arg);
             Stmt* err_stmt = stmt_expr(call, parser->error_line, parser->error_col);
             stmt_list_add(&program->as.block, err_stmt);
@@ -825,5 +818,27 @@ Stmt* parser_parse(Parser* parser) {
         }
         skip_newlines(parser);
     }
+    resolve_program(program);
+    optimize_program(program);
+    if (vm_enabled()) vm_compile_program(program);
+    return program;
+}
+
+Stmt* parser_parse_source(const char* src, const char* filename, int* err_line, int* err_col) {
+    AstArena* arena = ast_arena_new();
+    AstArena* previous = ast_arena_enter(arena);
+    Lexer lex;
+    lexer_init(&lex, src, filename);
+    Parser parser;
+    parser_init(&parser, &lex);
+    Stmt* program = parser_parse(&parser);
+    ast_arena_leave(previous);
+    free(parser.error_msg);
+    if (parser.had_error) {
+        if (err_line) *err_line = parser.current_token.line;
+        if (err_col) *err_col = parser.current_token.column;
+        ast_arena_release(arena);
+        return NULL;
+    }
     return program;
 }
@@ -17,7 +17,16 @@ typedef struct {
     int error_col;
 } Parser;
 
+// Tokens and nodes are allocated from the AST arena entered by the caller
+// (ast.h); parser_parse_source below manages one itself.
 void parser_init(Parser* parser, Lexer* lexer);
 Stmt* parser_parse(Parser* parser);
 
+// Lex and parse `src` into a fresh AST arena.  The returned program holds
+// the arena's first reference; drop it with
+// ast_arena_release(program->arena).  On a parse error returns NULL with
+// the position of the offending token in *err_line / *err_col (either may
+// be NULL); the arena is released then.
+Stmt* parser_parse_source(const char* src, const char* filename, int* err_line, int* err_col);
+
 #endif // PARSER_H
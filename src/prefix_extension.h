@@ -7,7 +7,10 @@
 extern "C" {
 #endif
 
-#define PREFIX_EXTENSION_API_VERSION 1
+// Layout version of prefix_ext_context.  A new version only appends
+// fields, so an extension checks ctx->api_version >= the oldest version
+// that has every field it uses, and keeps loading under later hosts.
+#define PREFIX_EXTENSION_API_VERSION 2
 #define PREFIX_EXTENSION_ASMODULE 1
 
 struct Interpreter;
@@ -22,6 +25,12 @@ typedef struct prefix_ext_context prefix_ext_context;
 typedef Value (*prefix_operator_fn)(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col);
 typedef void (*prefix_event_fn)(Interpreter* interp, const char* event_name);
 typedef int (*prefix_repl_fn)(void);
+// Processes items [begin, end) of a parallel_for job.
+typedef void (*prefix_parallel_fn)(void* ctx, size_t begin, size_t end);
+
+// tns_acquire flags (see value_tns_acquire in value.h).
+#define PREFIX_TNS_WRITE TNS_ACQUIRE_WRITE
+#define PREFIX_TNS_CONTIGUOUS TNS_ACQUIRE_CONTIGUOUS
 
 struct prefix_ext_context {
     int api_version;
@@ -31,6 +40,24 @@ struct prefix_ext_context {
     int (*register_periodic_hook)(int n, prefix_event_fn fn);
     int (*register_event_handler)(const char* event_name, prefix_event_fn fn);
     int (*register_repl_handler)(prefix_repl_fn repl_fn);
+
+    // Version 2: the packed buffers of INT / FLT tensors, so element data
+    // moves in and out without boxing each element in a Value.  `ctx` only
+    // lives for the init call; keep copies of the pointers.
+    //
+    // tns_acquire: 0 with *out filled (and pinned until tns_release), -1
+    // when `*tensor` is not an all-INT or all-FLT tensor.  With
+    // PREFIX_TNS_WRITE, `*tensor` may be replaced by its unshared copy.
+    int (*tns_acquire)(Value* tensor, int flags, TnsBuffer* out);
+    void (*tns_release)(TnsBuffer* buf);
+    // A new zero-filled packed tensor of TYPE_INT or TYPE_FLT, acquired
+    // for writing into *out; release it before returning the Value.
+    Value (*tns_alloc)(DeclType elem_type, size_t ndim, const size_t* shape, TnsBuffer* out);
+    // Run `fn` over items [0, count) on the interpreter's thread pool
+    // (chunk 0 picks a chunk size) and return once every item is done.
+    // `fn` runs concurrently on disjoint ranges and must only touch
+    // acquired buffers and its own data, not interpreter state.
+    void (*parallel_for)(size_t count, size_t chunk, prefix_parallel_fn fn, void* ctx);
 };
 
 typedef void (*prefix_extension_init_fn)(prefix_ext_context* ctx);
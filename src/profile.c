@@ -0,0 +1,527 @@
+#include "profile.h"
+#include "ast.h"
+#include "value.h"
+#include "win32_shim.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _MSC_VER
+#define strdup _strdup
+#endif
+
+bool g_profile_enabled = false;
+
+// Statements listed in the report, most frequently hit first.
+#define PROFILE_TOP_LINES 40
+
+static uint64_t profile_now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void* profile_xrealloc(void* p, size_t size) {
+    void* q = realloc(p, size);
+    if (!q) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    return q;
+}
+
+// ---------- Per-thread tables ----------
+
+// A user function or builtin, identified by kind and name.
+typedef struct {
+    char* name;
+    bool builtin;
+    uint64_t calls;
+    uint64_t incl_ns;
+    uint64_t excl_ns;
+    int active;         // frames of this symbol on the stack (recursion)
+} ProfSym;
+
+// A statement and the number of times it ran.
+typedef struct {
+    const Stmt* stmt;
+    int line;
+    char* text;
+    uint64_t hits;
+} ProfLine;
+
+// A distinct call stack: `sym` called from stack `parent` (-1 = root).
+typedef struct {
+    int32_t parent;
+    int32_t sym;
+    uint64_t self_ns;
+} ProfNode;
+
+typedef struct {
+    int32_t sym;
+    int32_t node;
+    uint64_t start_ns;
+    uint64_t child_ns;
+} ProfFrame;
+
+// Open-addressed index from a hash to an entry id; the caller compares
+// the entries themselves.
+typedef struct {
+    uint64_t* hashes;
+    int32_t* ids;       // -1 = empty
+    size_t cap;         // power of two
+    size_t count;
+} ProfIndex;
+
+typedef struct ProfThread {
+    const char* label;
+    atomic_count_t live;    // inside a THR body (see profile_thread_begin)
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t root_child_ns; // time spent in outermost calls
+
+    ProfSym* syms;
+    size_t sym_count, sym_cap;
+    ProfIndex sym_index;
+
+    ProfLine* lines;
+    size_t line_count, line_cap;
+    ProfIndex line_index;
+
+    ProfNode* nodes;
+    size_t node_count, node_cap;
+    ProfIndex node_index;
+
+    ProfFrame* stack;
+    size_t depth, stack_cap;
+
+    uint64_t alloc_count[PROFILE_ALLOC_KINDS];
+    uint64_t alloc_bytes[PROFILE_ALLOC_KINDS];
+
+    struct ProfThread* next;
+} ProfThread;
+
+static mtx_t g_profile_lock;
+static ProfThread* g_profile_threads;
+static ProfThread* g_profile_main;
+static FILE* g_profile_report;
+static FILE* g_profile_folded;
+static _Thread_local ProfThread* t_profile;
+
+static uint64_t profile_hash_bytes(const char* s, uint64_t seed) {
+    uint64_t h = 1469598103934665603ULL ^ seed;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t profile_hash_u64(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static void index_grow(ProfIndex* ix) {
+    size_t cap = ix->cap ? ix->cap * 2 : 64;
+    uint64_t* hashes = profile_xrealloc(NULL, cap * sizeof(uint64_t));
+    int32_t* ids = profile_xrealloc(NULL, cap * sizeof(int32_t));
+    for (size_t i = 0; i < cap; i++) ids[i] = -1;
+    for (size_t i = 0; i < ix->cap; i++) {
+        if (ix->ids[i] < 0) continue;
+        size_t j = (size_t)ix->hashes[i] & (cap - 1);
+        while (ids[j] >= 0) j = (j + 1) & (cap - 1);
+        hashes[j] = ix->hashes[i];
+        ids[j] = ix->ids[i];
+    }
+    free(ix->hashes);
+    free(ix->ids);
+    ix->hashes = hashes;
+    ix->ids = ids;
+    ix->cap = cap;
+}
+
+// First slot to probe for `hash`, growing the index beforehand so an
+// insertion after a failed probe always has room.
+static size_t index_probe_start(ProfIndex* ix, uint64_t hash) {
+    if ((ix->count + 1) * 2 > ix->cap) index_grow(ix);
+    return (size_t)hash & (ix->cap - 1);
+}
+
+static void index_insert_at(ProfIndex* ix, size_t slot, uint64_t hash, int32_t id) {
+    ix->hashes[slot] = hash;
+    ix->ids[slot] = id;
+    ix->count++;
+}
+
+static void index_free(ProfIndex* ix) {
+    free(ix->hashes);
+    free(ix->ids);
+}
+
+static int32_t thread_sym(ProfThread* t, const char* name, bool builtin) {
+    uint64_t hash = profile_hash_bytes(name, builtin ? 1 : 0);
+    ProfIndex* ix = &t->sym_index;
+    size_t i = index_probe_start(ix, hash);
+    for (; ix->ids[i] >= 0; i = (i + 1) & (ix->cap - 1)) {
+        ProfSym* s = &t->syms[ix->ids[i]];
+        if (ix->hashes[i] == hash && s->builtin == builtin && strcmp(s->name, name) == 0) return ix->ids[i];
+    }
+    if (t->sym_count == t->sym_cap) {
+        t->sym_cap = t->sym_cap ? t->sym_cap * 2 : 32;
+        t->syms = profile_xrealloc(t->syms, t->sym_cap * sizeof(ProfSym));
+    }
+    int32_t id = (int32_t)t->sym_count++;
+    ProfSym* s = &t->syms[id];
+    memset(s, 0, sizeof(*s));
+    s->name = strdup(name);
+    if (!s->name) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    s->builtin = builtin;
+    index_insert_at(ix, i, hash, id);
+    return id;
+}
+
+// First line of a statement's source, cut to 63 characters.
+static char* stmt_text_dup(const Stmt* stmt) {
+    char buf[64];
+    const char* src = stmt->src_text ? stmt->src_text : "";
+    size_t n = 0;
+    while (src[n] && src[n] != '\n' && src[n] != '\r' && n < sizeof(buf) - 1) {
+        buf[n] = src[n];
+        n++;
+    }
+    buf[n] = '\0';
+    char* out = strdup(buf);
+    if (!out) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    return out;
+}
+
+static ProfLine* thread_line(ProfThread* t, const Stmt* stmt, int line, const char* text) {
+    uint64_t hash = profile_hash_u64((uint64_t)(uintptr_t)stmt);
+    ProfIndex* ix = &t->line_index;
+    size_t i = index_probe_start(ix, hash);
+    for (; ix->ids[i] >= 0; i = (i + 1) & (ix->cap - 1)) {
+        ProfLine* l = &t->lines[ix->ids[i]];
+        if (l->stmt == stmt) return l;
+    }
+    if (t->line_count == t->line_cap) {
+        t->line_cap = t->line_cap ? t->line_cap * 2 : 64;
+        t->lines = profile_xrealloc(t->lines, t->line_cap * sizeof(ProfLine));
+    }
+    int32_t id = (int32_t)t->line_count++;
+    ProfLine* l = &t->lines[id];
+    // Lines are keyed by address, so the statement's arena (a RUN string or
+    // REPL entry is released after it runs) must not be reused before the
+    // report; it is deliberately never released.
+    ast_arena_retain(stmt->arena);
+    l->stmt = stmt;
+    l->line = line;
+    l->text = text ? strdup(text) : stmt_text_dup(stmt);
+    if (!l->text) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    l->hits = 0;
+    index_insert_at(ix, i, hash, id);
+    return l;
+}
+
+static int32_t thread_node(ProfThread* t, int32_t parent, int32_t sym) {
+    uint64_t hash = profile_hash_u64(((uint64_t)(uint32_t)parent << 32) | (uint32_t)sym);
+    ProfIndex* ix = &t->node_index;
+    size_t i = index_probe_start(ix, hash);
+    for (; ix->ids[i] >= 0; i = (i + 1) & (ix->cap - 1)) {
+        ProfNode* n = &t->nodes[ix->ids[i]];
+        if (n->parent == parent && n->sym == sym) return ix->ids[i];
+    }
+    if (t->node_count == t->node_cap) {
+        t->node_cap = t->node_cap ? t->node_cap * 2 : 64;
+        t->nodes = profile_xrealloc(t->nodes, t->node_cap * sizeof(ProfNode));
+    }
+    int32_t id = (int32_t)t->node_count++;
+    t->nodes[id].parent = parent;
+    t->nodes[id].sym = sym;
+    t->nodes[id].self_ns = 0;
+    index_insert_at(ix, i, hash, id);
+    return id;
+}
+
+static ProfThread* thread_new(const char* label) {
+    ProfThread* t = calloc(1, sizeof(ProfThread));
+    if (!t) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    t->label = label;
+    mtx_lock(&g_profile_lock);
+    t->next = g_profile_threads;
+    g_profile_threads = t;
+    mtx_unlock(&g_profile_lock);
+    return t;
+}
+
+// Tables of the calling thread.  Threads that never call
+// profile_thread_begin (pool workers, the namespace prepare thread) get
+// theirs on first use.
+static ProfThread* profile_thread(void) {
+    if (!t_profile) t_profile = thread_new("<worker>");
+    return t_profile;
+}
+
+// ---------- Hooks ----------
+
+void profile_thread_begin(void) {
+    if (!g_profile_enabled) return;
+    ProfThread* t = profile_thread();
+    t->label = "<thr>";
+    t->start_ns = profile_now_ns();
+    atomic_count_store(&t->live, 1);
+}
+
+void profile_thread_end(void) {
+    if (!g_profile_enabled) return;
+    ProfThread* t = profile_thread();
+    t->end_ns = profile_now_ns();
+    atomic_count_store(&t->live, 0);
+}
+
+void profile_enter(const char* name, bool builtin) {
+    ProfThread* t = profile_thread();
+    int32_t sym = thread_sym(t, name ? name : "<lambda>", builtin);
+    int32_t parent = t->depth ? t->stack[t->depth - 1].node : -1;
+    if (t->depth == t->stack_cap) {
+        t->stack_cap = t->stack_cap ? t->stack_cap * 2 : 64;
+        t->stack = profile_xrealloc(t->stack, t->stack_cap * sizeof(ProfFrame));
+    }
+    ProfFrame* f = &t->stack[t->depth++];
+    f->sym = sym;
+    f->node = thread_node(t, parent, sym);
+    f->child_ns = 0;
+    t->syms[sym].calls++;
+    t->syms[sym].active++;
+    f->start_ns = profile_now_ns();
+}
+
+static void frame_close(ProfThread* t, uint64_t now) {
+    ProfFrame* f = &t->stack[--t->depth];
+    uint64_t elapsed = now - f->start_ns;
+    uint64_t self = elapsed > f->child_ns ? elapsed - f->child_ns : 0;
+    ProfSym* s = &t->syms[f->sym];
+    s->excl_ns += self;
+    if (--s->active == 0) s->incl_ns += elapsed;
+    t->nodes[f->node].self_ns += self;
+    if (t->depth) t->stack[t->depth - 1].child_ns += elapsed;
+    else t->root_child_ns += elapsed;
+}
+
+void profile_exit(void) {
+    uint64_t now = profile_now_ns();
+    ProfThread* t = profile_thread();
+    if (t->depth) frame_close(t, now);
+}
+
+void profile_step_slow(const Stmt* stmt) {
+    if (stmt->type == STMT_BLOCK) return;  // counted through its statements
+    ProfThread* t = profile_thread();
+    thread_line(t, stmt, stmt->line, NULL)->hits++;
+}
+
+void profile_alloc(ProfileAllocKind kind, size_t bytes) {
+    ProfThread* t = profile_thread();
+    t->alloc_count[kind]++;
+    t->alloc_bytes[kind] += bytes;
+}
+
+// ---------- Report ----------
+
+static int cmp_sym_excl(const void* a, const void* b) {
+    const ProfSym* x = (const ProfSym*)a;
+    const ProfSym* y = (const ProfSym*)b;
+    uint64_t ka = x->builtin ? x->incl_ns : x->excl_ns;
+    uint64_t kb = y->builtin ? y->incl_ns : y->excl_ns;
+    if (ka != kb) return ka < kb ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+static int cmp_line_hits(const void* a, const void* b) {
+    const ProfLine* x = (const ProfLine*)a;
+    const ProfLine* y = (const ProfLine*)b;
+    if (x->hits != y->hits) return x->hits < y->hits ? 1 : -1;
+    return x->line - y->line;
+}
+
+static double ms(uint64_t ns) {
+    return (double)ns / 1e6;
+}
+
+// Append the frames of `node` to `buf`, root first.
+static void folded_path(const ProfThread* t, int32_t node, char* buf, size_t size, size_t* len) {
+    if (node < 0) return;
+    folded_path(t, t->nodes[node].parent, buf, size, len);
+    if (*len < size) {
+        int n = snprintf(buf + *len, size - *len, ";%s", t->syms[t->nodes[node].sym].name);
+        if (n > 0) *len += (size_t)n;
+    }
+}
+
+static void write_folded(FILE* out, const ProfThread* t) {
+    if (t->end_ns > t->start_ns && t->start_ns) {
+        uint64_t total = t->end_ns - t->start_ns;
+        uint64_t self = total > t->root_child_ns ? total - t->root_child_ns : 0;
+        if (self / 1000) fprintf(out, "%s %llu\n", t->label, (unsigned long long)(self / 1000));
+    }
+    char buf[4096];
+    for (size_t i = 0; i < t->node_count; i++) {
+        uint64_t us = t->nodes[i].self_ns / 1000;
+        if (us == 0) continue;
+        size_t len = (size_t)snprintf(buf, sizeof(buf), "%s", t->label);
+        folded_path(t, (int32_t)i, buf, sizeof(buf), &len);
+        fprintf(out, "%s %llu\n", buf, (unsigned long long)us);
+    }
+}
+
+static void write_report(FILE* out, ProfThread* all, size_t threads, size_t skipped, uint64_t wall_ns) {
+    fprintf(out, "Profile: %.3f ms wall, %zu thread%s", ms(wall_ns), threads, threads == 1 ? "" : "s");
+    if (skipped) fprintf(out, " (%zu still running, not included)", skipped);
+    fprintf(out, "\n\n");
+
+    qsort(all->syms, all->sym_count, sizeof(ProfSym), cmp_sym_excl);
+    fprintf(out, "Functions           calls     incl ms     excl ms\n");
+    for (size_t i = 0; i < all->sym_count; i++) {
+        const ProfSym* s = &all->syms[i];
+        if (s->builtin) continue;
+        fprintf(out, "  %-16s %8llu %11.3f %11.3f\n", s->name, (unsigned long long)s->calls, ms(s->incl_ns), ms(s->excl_ns));
+    }
+    fprintf(out, "\nBuiltins            calls     time ms\n");
+    for (size_t i = 0; i < all->sym_count; i++) {
+        const ProfSym* s = &all->syms[i];
+        if (!s->builtin) continue;
+        fprintf(out, "  %-16s %8llu %11.3f\n", s->name, (unsigned long long)s->calls, ms(s->incl_ns));
+    }
+
+    qsort(all->lines, all->line_count, sizeof(ProfLine), cmp_line_hits);
+    fprintf(out, "\nLines                hits\n");
+    for (size_t i = 0; i < all->line_count && i < PROFILE_TOP_LINES; i++) {
+        const ProfLine* l = &all->lines[i];
+        fprintf(out, "  %6d %12llu  %s\n", l->line, (unsigned long long)l->hits, l->text);
+    }
+    if (all->line_count > PROFILE_TOP_LINES) {
+        fprintf(out, "  ... %zu more statements\n", all->line_count - PROFILE_TOP_LINES);
+    }
+
+    static const char* const kinds[PROFILE_ALLOC_KINDS] = {"TNS", "MAP", "STR"};
+    fprintf(out, "\nAllocations         count       bytes\n");
+    for (int k = 0; k < PROFILE_ALLOC_KINDS; k++) {
+        fprintf(out, "  %-12s %12llu %11llu\n", kinds[k], (unsigned long long)all->alloc_count[k], (unsigned long long)all->alloc_bytes[k]);
+    }
+
+    // Container pools (see value.h): blocks carved, shared-list traffic
+    // and the most blocks in use at once.
+    fprintf(out, "\nPools        block    reserved   refills   flushes   peak live\n");
+    for (size_t i = 0; i < VALUE_POOL_COUNT; i++) {
+        ValuePoolStats ps;
+        value_pool_stats(i, &ps);
+        fprintf(out, "  %-8s %8zu %11zu %9zu %9zu %11ld\n", ps.name, ps.block_size, ps.reserved, ps.refills, ps.flushes, ps.peak_live);
+    }
+}
+
+// atexit handler.  The per-thread tables are left allocated: a pool
+// worker may still be unwinding while the process exits.
+static void profile_finish(void) {
+    uint64_t now = profile_now_ns();
+    g_profile_enabled = false;
+
+    // EXIT or a runtime error can leave calls open on the exiting thread.
+    ProfThread* self = t_profile;
+    if (self) {
+        while (self->depth) frame_close(self, now);
+        if (self->end_ns == 0 || atomic_count_load(&self->live)) self->end_ns = now;
+    }
+
+    ProfThread all;
+    memset(&all, 0, sizeof(all));
+    size_t threads = 0;
+    size_t skipped = 0;
+    uint64_t wall_ns = 0;
+
+    mtx_lock(&g_profile_lock);
+    for (ProfThread* t = g_profile_threads; t; t = t->next) {
+        if (t != self && atomic_count_load(&t->live)) {
+            skipped++;
+            continue;
+        }
+        threads++;
+        if (t == g_profile_main) wall_ns = now - t->start_ns;
+        for (size_t i = 0; i < t->sym_count; i++) {
+            const ProfSym* s = &t->syms[i];
+            int32_t id = thread_sym(&all, s->name, s->builtin);
+            ProfSym* d = &all.syms[id];
+            d->calls += s->calls;
+            d->incl_ns += s->incl_ns;
+            d->excl_ns += s->excl_ns;
+        }
+        for (size_t i = 0; i < t->line_count; i++) {
+            const ProfLine* l = &t->lines[i];
+            thread_line(&all, l->stmt, l->line, l->text)->hits += l->hits;
+        }
+        for (int k = 0; k < PROFILE_ALLOC_KINDS; k++) {
+            all.alloc_count[k] += t->alloc_count[k];
+            all.alloc_bytes[k] += t->alloc_bytes[k];
+        }
+        if (g_profile_folded) write_folded(g_profile_folded, t);
+    }
+
+    // `all` is only ever sorted, never probed again.
+    write_report(g_profile_report ? g_profile_report : stderr, &all, threads, skipped, wall_ns);
+
+    mtx_unlock(&g_profile_lock);
+
+    for (size_t i = 0; i < all.sym_count; i++) free(all.syms[i].name);
+    for (size_t i = 0; i < all.line_count; i++) free(all.lines[i].text);
+    free(all.syms);
+    free(all.lines);
+    index_free(&all.sym_index);
+    index_free(&all.line_index);
+
+    if (g_profile_report) fclose(g_profile_report);
+    if (g_profile_folded) fclose(g_profile_folded);
+    g_profile_report = NULL;
+    g_profile_folded = NULL;
+}
+
+int profile_start(const char* report_path, char** err) {
+    if (err) *err = NULL;
+    if (g_profile_enabled) return 0;
+
+    char folded_path_buf[4096];
+    snprintf(folded_path_buf, sizeof(folded_path_buf), "%s.folded", report_path ? report_path : "profile");
+    if (report_path) {
+        g_profile_report = fopen(report_path, "w");
+        if (!g_profile_report) {
+            char buf[4200];
+            snprintf(buf, sizeof(buf), "Cannot open profile report '%s'", report_path);
+            if (err) *err = strdup(buf);
+            return -1;
+        }
+    }
+    g_profile_folded = fopen(folded_path_buf, "w");
+    if (!g_profile_folded) {
+        char buf[4200];
+        snprintf(buf, sizeof(buf), "Cannot open profile stacks '%s'", folded_path_buf);
+        if (err) *err = strdup(buf);
+        if (g_profile_report) fclose(g_profile_report);
+        g_profile_report = NULL;
+        return -1;
+    }
+
+    mtx_init(&g_profile_lock, mtx_plain);
+    g_profile_main = thread_new("<main>");
+    g_profile_main->start_ns = profile_now_ns();
+    t_profile = g_profile_main;
+    g_profile_enabled = true;
+    atexit(profile_finish);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct Stmt;
+
+// Profiler behind the -profile command line flag.
+//
+// It counts rather than samples: every user-function and builtin call is
+// timed on entry and exit (calls, inclusive and exclusive time), every
+// statement step bumps a hit counter, and the tensor, map and string
+// allocators report what they allocate.  Each OS thread records into its
+// own tables, so THR bodies and PARFOR / PARALLEL pool workers (which run
+// on their own Interpreter copies) never share counters; the tables are
+// merged once, when the report is written at process exit.
+//
+// The report is a flat text table; alongside it a collapsed-stack file
+// (one "frame;frame;frame weight" line per distinct call stack, weights
+// in microseconds of exclusive time) can be fed to flamegraph tools.
+
+// Set by profile_start() before the program runs and never cleared.  The
+// hooks below are guarded by it, so a run without -profile pays one
+// predictable branch per event.
+extern bool g_profile_enabled;
+
+// Turn profiling on for the rest of the process.  The report goes to
+// `report_path` (stderr when NULL) and the collapsed stacks to
+// `<report_path>.folded` (`profile.folded` when NULL); both files are
+// opened here, relative to the current directory.  Both are written by an
+// atexit handler, so EXIT and runtime errors still produce a report.
+// Returns 0, or -1 with a message in *err (caller frees).
+int profile_start(const char* report_path, char** err);
+
+// Bracket the body of a THR / ASYNC worker thread.  A thread still inside
+// its body when the report is written is left out of it.
+void profile_thread_begin(void);
+void profile_thread_end(void);
+
+// A user function (`builtin` false) or builtin operator is entered / left
+// on the calling thread.  Calls must nest.
+void profile_enter(const char* name, bool builtin);
+void profile_exit(void);
+
+// A statement is about to run (called from trace_log_step).
+void profile_step_slow(const struct Stmt* stmt);
+static inline void profile_step(const struct Stmt* stmt) {
+    if (g_profile_enabled) profile_step_slow(stmt);
+}
+
+typedef enum {
+    PROFILE_ALLOC_TNS,
+    PROFILE_ALLOC_MAP,
+    PROFILE_ALLOC_STR,
+    PROFILE_ALLOC_KINDS
+} ProfileAllocKind;
+
+// One value of `kind` occupying `bytes` was allocated.
+void profile_alloc(ProfileAllocKind kind, size_t bytes);
+
+#endif // PROFILE_H
@@ -0,0 +1,239 @@
+/*
+ * resolver.c – Static identifier resolution pass.
+ *
+ * Runs once over a freshly parsed program and attaches a SlotRef to every
+ * identifier read, plain assignment target and FOR counter.  Each Env that
+ * the interpreter creates with a fixed leading layout is modelled as a
+ * scope here:
+ *
+ *   - a FUNC / LAMBDA call Env holds its parameters, in declaration order
+ *   - a PARFOR iteration Env holds the loop counter at slot 0
+ *   - a CATCH(SYMBOL: name) child Env holds the catch name at slot 0
+ *
+ * References to those names get their exact (depth, slot) up front.  Names
+ * whose Env position depends on runtime order (top-level and module
+ * globals, first-assignment declarations) are left unresolved and get
+ * cached by the first lookup in env.c.  Dynamic binding operations (DEL,
+ * EXIST, IMPORT, aliases) keep using the by-name API and never consult
+ * the cached coordinates, and every SlotRef is validated before use, so
+ * the annotations are purely an accelerator.
+ */
+
+#include "resolver.h"
+#include "env.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef struct ResolveScope {
+    struct ResolveScope* parent;
+    const char** names;
+    size_t count;
+    // Statements in this scope that may add a binding to its Env (an upper
+    // bound: typed or first assignments, declarations, FOR counters, FUNC
+    // definitions).  Used to pre-size FUNC / LAMBDA call Envs.
+    size_t bindings;
+} ResolveScope;
+
+static void resolve_expr(Expr* expr, ResolveScope* scope);
+static void resolve_stmt(Stmt* stmt, ResolveScope* scope);
+
+static void scope_init(ResolveScope* scope, ResolveScope* parent, size_t capacity) {
+    scope->parent = parent;
+    scope->count = 0;
+    scope->bindings = 0;
+    scope->names = NULL;
+    if (capacity > 0) {
+        scope->names = malloc(capacity * sizeof(const char*));
+        if (!scope->names) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+}
+
+// Mirrors env_define: a duplicate name is rejected and does not take a slot.
+static void scope_add(ResolveScope* scope, const char* name) {
+    if (!name) return;
+    for (size_t i = 0; i < scope->count; i++) {
+        if (strcmp(scope->names[i], name) == 0) return;
+    }
+    scope->names[scope->count++] = name;
+}
+
+static void scope_free(ResolveScope* scope) {
+    free(scope->names);
+    scope->names = NULL;
+    scope->count = 0;
+}
+
+static void resolve_ref(SlotRef* ref, const char* name, ResolveScope* scope) {
+    if (!ref || !name) return;
+    ref->bit = env_name_bit(name);
+    ref->name = value_str_intern(name);
+    ref->coord = 0;
+    int depth = 0;
+    for (ResolveScope* s = scope; s != NULL; s = s->parent, depth++) {
+        for (size_t i = 0; i < s->count; i++) {
+            if (strcmp(s->names[i], name) == 0) {
+                slot_ref_set(ref, depth, (int)i);
+                return;
+            }
+        }
+    }
+}
+
+static void resolve_expr_list(ExprList* list, ResolveScope* scope) {
+    for (size_t i = 0; i < list->count; i++) {
+        resolve_expr(list->items[i], scope);
+    }
+}
+
+static void resolve_stmt_list(StmtList* list, ResolveScope* scope) {
+    for (size_t i = 0; i < list->count; i++) {
+        resolve_stmt(list->items[i], scope);
+    }
+}
+
+// Parameters (and their defaults, which run inside the call Env) plus body.
+// Stores the expected number of call Env bindings in `frame_size`.
+static void resolve_function(ParamList* params, Stmt* body, size_t* frame_size, ResolveScope* scope) {
+    ResolveScope fn_scope;
+    scope_init(&fn_scope, scope, params->count);
+    for (size_t i = 0; i < params->count; i++) {
+        scope_add(&fn_scope, params->items[i].name);
+    }
+    for (size_t i = 0; i < params->count; i++) {
+        resolve_expr(params->items[i].default_value, &fn_scope);
+    }
+    resolve_stmt(body, &fn_scope);
+    *frame_size = fn_scope.count + fn_scope.bindings;
+    scope_free(&fn_scope);
+}
+
+// Body executed in a child Env whose only fixed binding is `name` at slot 0.
+static void resolve_child_scope(Stmt* body, const char* name, ResolveScope* scope) {
+    ResolveScope child;
+    scope_init(&child, scope, 1);
+    scope_add(&child, name);
+    resolve_stmt(body, &child);
+    scope_free(&child);
+}
+
+static void resolve_expr(Expr* expr, ResolveScope* scope) {
+    if (!expr) return;
+    switch (expr->type) {
+        case EXPR_IDENT:
+            resolve_ref(&expr->ref, expr->as.ident, scope);
+            break;
+        case EXPR_CALL:
+            resolve_expr(expr->as.call.callee, scope);
+            resolve_expr_list(&expr->as.call.args, scope);
+            resolve_expr_list(&expr->as.call.kw_args, scope);
+            break;
+        case EXPR_ASYNC:
+            resolve_stmt(expr->as.async.block, scope);
+            break;
+        case EXPR_TNS:
+            resolve_expr_list(&expr->as.tns_items, scope);
+            break;
+        case EXPR_MAP:
+            resolve_expr_list(&expr->as.map_items.keys, scope);
+            resolve_expr_list(&expr->as.map_items.values, scope);
+            break;
+        case EXPR_INDEX:
+            resolve_expr(expr->as.index.target, scope);
+            resolve_expr_list(&expr->as.index.indices, scope);
+            break;
+        case EXPR_RANGE:
+            resolve_expr(expr->as.range.start, scope);
+            resolve_expr(expr->as.range.end, scope);
+            break;
+        case EXPR_LAMBDA:
+            resolve_function(&expr->as.lambda.params, expr->as.lambda.body,
+                             &expr->as.lambda.frame_size, scope);
+            break;
+        default:
+            break;
+    }
+}
+
+static void resolve_stmt(Stmt* stmt, ResolveScope* scope) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case STMT_BLOCK:
+            resolve_stmt_list(&stmt->as.block, scope);
+            break;
+        case STMT_ASYNC:
+            resolve_stmt(stmt->as.async_stmt.body, scope);
+            break;
+        case STMT_EXPR:
+            resolve_expr(stmt->as.expr_stmt.expr, scope);
+            break;
+        case STMT_ASSIGN:
+            if (scope && !stmt->as.assign.target) scope->bindings++;
+            resolve_ref(&stmt->as.assign.ref, stmt->as.assign.name, scope);
+            resolve_expr(stmt->as.assign.target, scope);
+            resolve_expr(stmt->as.assign.value, scope);
+            break;
+        case STMT_IF:
+            resolve_expr(stmt->as.if_stmt.condition, scope);
+            resolve_stmt(stmt->as.if_stmt.then_branch, scope);
+            resolve_expr_list(&stmt->as.if_stmt.elif_conditions, scope);
+            resolve_stmt_list(&stmt->as.if_stmt.elif_blocks, scope);
+            resolve_stmt(stmt->as.if_stmt.else_branch, scope);
+            break;
+        case STMT_WHILE:
+            resolve_expr(stmt->as.while_stmt.condition, scope);
+            resolve_stmt(stmt->as.while_stmt.body, scope);
+            break;
+        case STMT_DECL:
+            if (scope) scope->bindings++;
+            break;
+        case STMT_FOR:
+            if (scope) scope->bindings++;
+            resolve_ref(&stmt->as.for_stmt.ref, stmt->as.for_stmt.counter, scope);
+            resolve_expr(stmt->as.for_stmt.target, scope);
+            resolve_stmt(stmt->as.for_stmt.body, scope);
+            break;
+        case STMT_PARFOR:
+            resolve_expr(stmt->as.parfor_stmt.target, scope);
+            resolve_child_scope(stmt->as.parfor_stmt.body, stmt->as.parfor_stmt.counter, scope);
+            break;
+        case STMT_FUNC:
+            if (scope) scope->bindings++;
+            resolve_function(&stmt->as.func_stmt.params, stmt->as.func_stmt.body,
+                             &stmt->as.func_stmt.frame_size, scope);
+            break;
+        case STMT_RETURN:
+            resolve_expr(stmt->as.return_stmt.value, scope);
+            break;
+        case STMT_BREAK:
+            resolve_expr(stmt->as.break_stmt.value, scope);
+            break;
+        case STMT_THR:
+            resolve_stmt(stmt->as.thr_stmt.body, scope);
+            break;
+        case STMT_TRY:
+            resolve_stmt(stmt->as.try_stmt.try_block, scope);
+            if (stmt->as.try_stmt.catch_name) {
+                resolve_child_scope(stmt->as.try_stmt.catch_block, stmt->as.try_stmt.catch_name, scope);
+            } else {
+                resolve_stmt(stmt->as.try_stmt.catch_block, scope);
+            }
+            break;
+        case STMT_GOTO:
+            resolve_expr(stmt->as.goto_stmt.target, scope);
+            break;
+        case STMT_GOTOPOINT:
+            resolve_expr(stmt->as.gotopoint_stmt.target, scope);
+            break;
+        default:
+            break;
+    }
+}
+
+void resolve_program(Stmt* program) {
+    resolve_stmt(program, NULL);
+}
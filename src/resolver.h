@@ -0,0 +1,13 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "ast.h"
+
+// Annotate every identifier read, assignment target and FOR counter in
+// `program` with a SlotRef.  Names bound at a statically known position
+// (function parameters, PARFOR counters, CATCH names) get their exact
+// (depth, slot) coordinate; everything else starts unresolved and is
+// filled in by the first runtime lookup.  Safe to call more than once.
+void resolve_program(Stmt* program);
+
+#endif // RESOLVER_H
@@ -0,0 +1,444 @@
+/*
+ * simd.c – Runtime-dispatched kernels for packed INT / FLT tensors.
+ *
+ * Each public entry point runs the widest available kernel over the bulk
+ * of the buffer and finishes the tail (and any operator without a vector
+ * form, e.g. DIV / POW on INT) with the portable C loop.  See simd.h for
+ * the numeric guarantees every level has to honour.
+ */
+
+#include "simd.h"
+
+#include <math.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_SSE2
+#endif
+
+static volatile int g_detected = -1;            // SimdLevel once detected
+static volatile int g_max_level = SIMD_AVX2;
+
+// ---------- Detection ----------
+
+#if defined(SIMD_X86)
+static void cpuid_regs(unsigned leaf, unsigned sub, unsigned r[4]) {
+#if defined(_MSC_VER)
+    int out[4];
+    __cpuidex(out, (int)leaf, (int)sub);
+    for (int i = 0; i < 4; i++) r[i] = (unsigned)out[i];
+#else
+    if (!__get_cpuid_count(leaf, sub, &r[0], &r[1], &r[2], &r[3])) {
+        r[0] = r[1] = r[2] = r[3] = 0;
+    }
+#endif
+}
+
+static unsigned long long read_xcr0(void) {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+static SimdLevel detect_level(void) {
+#if defined(SIMD_X86)
+    unsigned r[4];
+    cpuid_regs(0, 0, r);
+    unsigned max_leaf = r[0];
+    cpuid_regs(1, 0, r);
+    if (!(r[3] & (1u << 26))) return SIMD_SCALAR;           // SSE2
+    int osxsave = (r[2] & (1u << 27)) != 0;
+    int avx = (r[2] & (1u << 28)) != 0;
+    if (max_leaf >= 7 && osxsave && avx && (read_xcr0() & 0x6) == 0x6) {
+        cpuid_regs(7, 0, r);
+        if (r[1] & (1u << 5)) return SIMD_AVX2;
+    }
+    return SIMD_SSE2;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel simd_level(void) {
+    // Racing first callers compute the same answer, so no lock is needed.
+    if (g_detected < 0) g_detected = (int)detect_level();
+    return (SimdLevel)(g_detected < g_max_level ? g_detected : g_max_level);
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+void simd_set_max_level(SimdLevel level) {
+    g_max_level = (int)level;
+}
+
+// ---------- Portable kernels (reference semantics) ----------
+
+// Wrapping arithmetic: signed overflow is undefined in C, unsigned is not.
+static int64_t wrap_add(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static int64_t wrap_sub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static int64_t wrap_mul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+
+static int i64_binop_scalar(SimdOp op, const int64_t* a, size_t as, const int64_t* b, size_t bs, int64_t* o, size_t n) {
+    switch (op) {
+        case SIMD_OP_ADD: for (size_t i = 0; i < n; i++) o[i] = wrap_add(a[i * as], b[i * bs]); break;
+        case SIMD_OP_SUB: for (size_t i = 0; i < n; i++) o[i] = wrap_sub(a[i * as], b[i * bs]); break;
+        case SIMD_OP_MUL: for (size_t i = 0; i < n; i++) o[i] = wrap_mul(a[i * as], b[i * bs]); break;
+        case SIMD_OP_DIV:
+            for (size_t i = 0; i < n; i++) {
+                if (b[i * bs] == 0) return 1;
+                o[i] = a[i * as] / b[i * bs];
+            }
+            break;
+        case SIMD_OP_POW:
+            for (size_t i = 0; i < n; i++) {
+                int64_t exp = b[i * bs];
+                if (exp < 0) return 2;
+                int64_t result = 1;
+                int64_t base = a[i * as];
+                while (exp > 0) {
+                    if (exp & 1) result = wrap_mul(result, base);
+                    base = wrap_mul(base, base);
+                    exp >>= 1;
+                }
+                o[i] = result;
+            }
+            break;
+    }
+    return 0;
+}
+
+static int f64_binop_scalar(SimdOp op, const double* a, size_t as, const double* b, size_t bs, double* o, size_t n) {
+    switch (op) {
+        case SIMD_OP_ADD: for (size_t i = 0; i < n; i++) o[i] = a[i * as] + b[i * bs]; break;
+        case SIMD_OP_SUB: for (size_t i = 0; i < n; i++) o[i] = a[i * as] - b[i * bs]; break;
+        case SIMD_OP_MUL: for (size_t i = 0; i < n; i++) o[i] = a[i * as] * b[i * bs]; break;
+        case SIMD_OP_DIV:
+            for (size_t i = 0; i < n; i++) {
+                if (b[i * bs] == 0.0) return 1;
+                o[i] = a[i * as] / b[i * bs];
+            }
+            break;
+        case SIMD_OP_POW: for (size_t i = 0; i < n; i++) o[i] = pow(a[i * as], b[i * bs]); break;
+    }
+    return 0;
+}
+
+// ---------- SSE2 ----------
+
+#if defined(SIMD_X86)
+SIMD_TARGET_SSE2 static __m128i mul_epi64_sse2(__m128i a, __m128i b) {
+    // (ah*2^32 + al) * (bh*2^32 + bl) mod 2^64 = al*bl + ((al*bh + ah*bl) << 32)
+    __m128i lo = _mm_mul_epu32(a, b);
+    __m128i cross = _mm_add_epi64(_mm_mul_epu32(a, _mm_srli_epi64(b, 32)),
+                                  _mm_mul_epu32(_mm_srli_epi64(a, 32), b));
+    return _mm_add_epi64(lo, _mm_slli_epi64(cross, 32));
+}
+
+// Vector part of an INT ADD/SUB/MUL; returns the number of elements done.
+SIMD_TARGET_SSE2 static size_t i64_binop_sse2(SimdOp op, const int64_t* a, size_t as, const int64_t* b, size_t bs, int64_t* o, size_t n) {
+    __m128i ab = _mm_set1_epi64x(a[0]);
+    __m128i bb = _mm_set1_epi64x(b[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i va = as ? _mm_loadu_si128((const __m128i*)(a + i)) : ab;
+        __m128i vb = bs ? _mm_loadu_si128((const __m128i*)(b + i)) : bb;
+        __m128i r;
+        if (op == SIMD_OP_ADD) r = _mm_add_epi64(va, vb);
+        else if (op == SIMD_OP_SUB) r = _mm_sub_epi64(va, vb);
+        else r = mul_epi64_sse2(va, vb);
+        _mm_storeu_si128((__m128i*)(o + i), r);
+    }
+    return i;
+}
+
+SIMD_TARGET_SSE2 static size_t f64_binop_sse2(SimdOp op, const double* a, size_t as, const double* b, size_t bs, double* o, size_t n, int* err) {
+    __m128d ab = _mm_set1_pd(a[0]);
+    __m128d bb = _mm_set1_pd(b[0]);
+    __m128d zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d va = as ? _mm_loadu_pd(a + i) : ab;
+        __m128d vb = bs ? _mm_loadu_pd(b + i) : bb;
+        __m128d r;
+        if (op == SIMD_OP_ADD) r = _mm_add_pd(va, vb);
+        else if (op == SIMD_OP_SUB) r = _mm_sub_pd(va, vb);
+        else if (op == SIMD_OP_MUL) r = _mm_mul_pd(va, vb);
+        else {
+            if (_mm_movemask_pd(_mm_cmpeq_pd(vb, zero))) { *err = 1; return i; }
+            r = _mm_div_pd(va, vb);
+        }
+        _mm_storeu_pd(o + i, r);
+    }
+    return i;
+}
+
+SIMD_TARGET_SSE2 static int64_t i64_reduce_sse2(const int64_t* a, size_t n, int prod, size_t* done) {
+    __m128i acc = prod ? _mm_set1_epi64x(1) : _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(a + i));
+        acc = prod ? mul_epi64_sse2(acc, v) : _mm_add_epi64(acc, v);
+    }
+    int64_t l[2];
+    _mm_storeu_si128((__m128i*)l, acc);
+    *done = i;
+    return prod ? wrap_mul(l[0], l[1]) : wrap_add(l[0], l[1]);
+}
+
+SIMD_TARGET_SSE2 static void f64_lanes_sse2(const double* a, size_t n, int prod, double l[4], size_t* done) {
+    __m128d acc01 = _mm_loadu_pd(l);
+    __m128d acc23 = _mm_loadu_pd(l + 2);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128d v01 = _mm_loadu_pd(a + i);
+        __m128d v23 = _mm_loadu_pd(a + i + 2);
+        if (prod) { acc01 = _mm_mul_pd(acc01, v01); acc23 = _mm_mul_pd(acc23, v23); }
+        else { acc01 = _mm_add_pd(acc01, v01); acc23 = _mm_add_pd(acc23, v23); }
+    }
+    _mm_storeu_pd(l, acc01);
+    _mm_storeu_pd(l + 2, acc23);
+    *done = i;
+}
+
+SIMD_TARGET_SSE2 static void f64_extreme_lanes_sse2(const double* a, size_t n, int want_max, double l[4], size_t* done) {
+    __m128d b01 = _mm_loadu_pd(l);
+    __m128d b23 = _mm_loadu_pd(l + 2);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // max_pd(v, best) == (v > best) ? v : best, NaN in either -> best
+        __m128d v01 = _mm_loadu_pd(a + i);
+        __m128d v23 = _mm_loadu_pd(a + i + 2);
+        if (want_max) { b01 = _mm_max_pd(v01, b01); b23 = _mm_max_pd(v23, b23); }
+        else { b01 = _mm_min_pd(v01, b01); b23 = _mm_min_pd(v23, b23); }
+    }
+    _mm_storeu_pd(l, b01);
+    _mm_storeu_pd(l + 2, b23);
+    *done = i;
+}
+
+// ---------- AVX2 ----------
+
+SIMD_TARGET_AVX2 static __m256i mul_epi64_avx2(__m256i a, __m256i b) {
+    __m256i lo = _mm256_mul_epu32(a, b);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)),
+                                     _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+SIMD_TARGET_AVX2 static size_t i64_binop_avx2(SimdOp op, const int64_t* a, size_t as, const int64_t* b, size_t bs, int64_t* o, size_t n) {
+    __m256i ab = _mm256_set1_epi64x(a[0]);
+    __m256i bb = _mm256_set1_epi64x(b[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i va = as ? _mm256_loadu_si256((const __m256i*)(a + i)) : ab;
+        __m256i vb = bs ? _mm256_loadu_si256((const __m256i*)(b + i)) : bb;
+        __m256i r;
+        if (op == SIMD_OP_ADD) r = _mm256_add_epi64(va, vb);
+        else if (op == SIMD_OP_SUB) r = _mm256_sub_epi64(va, vb);
+        else r = mul_epi64_avx2(va, vb);
+        _mm256_storeu_si256((__m256i*)(o + i), r);
+    }
+    return i;
+}
+
+SIMD_TARGET_AVX2 static size_t f64_binop_avx2(SimdOp op, const double* a, size_t as, const double* b, size_t bs, double* o, size_t n, int* err) {
+    __m256d ab = _mm256_set1_pd(a[0]);
+    __m256d bb = _mm256_set1_pd(b[0]);
+    __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d va = as ? _mm256_loadu_pd(a + i) : ab;
+        __m256d vb = bs ? _mm256_loadu_pd(b + i) : bb;
+        __m256d r;
+        if (op == SIMD_OP_ADD) r = _mm256_add_pd(va, vb);
+        else if (op == SIMD_OP_SUB) r = _mm256_sub_pd(va, vb);
+        else if (op == SIMD_OP_MUL) r = _mm256_mul_pd(va, vb);
+        else {
+            if (_mm256_movemask_pd(_mm256_cmp_pd(vb, zero, _CMP_EQ_OQ))) { *err = 1; return i; }
+            r = _mm256_div_pd(va, vb);
+        }
+        _mm256_storeu_pd(o + i, r);
+    }
+    return i;
+}
+
+SIMD_TARGET_AVX2 static int64_t i64_reduce_avx2(const int64_t* a, size_t n, int prod, size_t* done) {
+    __m256i acc = prod ? _mm256_set1_epi64x(1) : _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(a + i));
+        acc = prod ? mul_epi64_avx2(acc, v) : _mm256_add_epi64(acc, v);
+    }
+    int64_t l[4];
+    _mm256_storeu_si256((__m256i*)l, acc);
+    *done = i;
+    if (prod) return wrap_mul(wrap_mul(l[0], l[1]), wrap_mul(l[2], l[3]));
+    return wrap_add(wrap_add(l[0], l[1]), wrap_add(l[2], l[3]));
+}
+
+SIMD_TARGET_AVX2 static int64_t i64_extreme_avx2(const int64_t* a, size_t n, int want_max, size_t* done) {
+    __m256i best = _mm256_set1_epi64x(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i take = want_max ? _mm256_cmpgt_epi64(v, best) : _mm256_cmpgt_epi64(best, v);
+        best = _mm256_blendv_epi8(best, v, take);
+    }
+    int64_t l[4];
+    _mm256_storeu_si256((__m256i*)l, best);
+    *done = i;
+    int64_t r = l[0];
+    for (int k = 1; k < 4; k++) {
+        if (want_max ? l[k] > r : l[k] < r) r = l[k];
+    }
+    return r;
+}
+
+SIMD_TARGET_AVX2 static void f64_lanes_avx2(const double* a, size_t n, int prod, double l[4], size_t* done) {
+    __m256d acc = _mm256_loadu_pd(l);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(a + i);
+        acc = prod ? _mm256_mul_pd(acc, v) : _mm256_add_pd(acc, v);
+    }
+    _mm256_storeu_pd(l, acc);
+    *done = i;
+}
+
+SIMD_TARGET_AVX2 static void f64_extreme_lanes_avx2(const double* a, size_t n, int want_max, double l[4], size_t* done) {
+    __m256d best = _mm256_loadu_pd(l);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(a + i);
+        best = want_max ? _mm256_max_pd(v, best) : _mm256_min_pd(v, best);
+    }
+    _mm256_storeu_pd(l, best);
+    *done = i;
+}
+#endif // SIMD_X86
+
+// ---------- Public entry points ----------
+
+int simd_i64_binop(SimdOp op, const int64_t* a, size_t as, const int64_t* b, size_t bs, int64_t* o, size_t n) {
+    size_t done = 0;
+#if defined(SIMD_X86)
+    if (n > 0 && op <= SIMD_OP_MUL) {
+        SimdLevel lv = simd_level();
+        if (lv == SIMD_AVX2) done = i64_binop_avx2(op, a, as, b, bs, o, n);
+        else if (lv == SIMD_SSE2) done = i64_binop_sse2(op, a, as, b, bs, o, n);
+    }
+#endif
+    return i64_binop_scalar(op, a + done * as, as, b + done * bs, bs, o + done, n - done);
+}
+
+int simd_f64_binop(SimdOp op, const double* a, size_t as, const double* b, size_t bs, double* o, size_t n) {
+    size_t done = 0;
+#if defined(SIMD_X86)
+    if (n > 0 && op <= SIMD_OP_DIV) {
+        int err = 0;
+        SimdLevel lv = simd_level();
+        if (lv == SIMD_AVX2) done = f64_binop_avx2(op, a, as, b, bs, o, n, &err);
+        else if (lv == SIMD_SSE2) done = f64_binop_sse2(op, a, as, b, bs, o, n, &err);
+        if (err) return err;
+    }
+#endif
+    return f64_binop_scalar(op, a + done * as, as, b + done * bs, bs, o + done, n - done);
+}
+
+static int64_t i64_reduce(const int64_t* a, size_t n, int prod) {
+    int64_t acc = prod ? 1 : 0;
+    size_t done = 0;
+#if defined(SIMD_X86)
+    SimdLevel lv = simd_level();
+    if (lv == SIMD_AVX2) acc = i64_reduce_avx2(a, n, prod, &done);
+    else if (lv == SIMD_SSE2) acc = i64_reduce_sse2(a, n, prod, &done);
+#endif
+    // Wrapping add / mul are associative, so lane order cannot matter.
+    for (size_t i = done; i < n; i++) acc = prod ? wrap_mul(acc, a[i]) : wrap_add(acc, a[i]);
+    return acc;
+}
+
+int64_t simd_i64_sum(const int64_t* a, size_t n) { return i64_reduce(a, n, 0); }
+int64_t simd_i64_prod(const int64_t* a, size_t n) { return i64_reduce(a, n, 1); }
+
+static int64_t i64_extreme(const int64_t* a, size_t n, int want_max) {
+    int64_t best = a[0];
+    size_t done = 0;
+#if defined(SIMD_X86)
+    // SSE2 has no 64-bit compare, so only AVX2 is vectorised here.
+    if (simd_level() == SIMD_AVX2) best = i64_extreme_avx2(a, n, want_max, &done);
+#endif
+    for (size_t i = done; i < n; i++) {
+        if (want_max ? a[i] > best : a[i] < best) best = a[i];
+    }
+    return best;
+}
+
+int64_t simd_i64_max(const int64_t* a, size_t n) { return i64_extreme(a, n, 1); }
+int64_t simd_i64_min(const int64_t* a, size_t n) { return i64_extreme(a, n, 0); }
+
+// FLT SUM / PROD in the documented 4-lane order.
+static double f64_reduce(const double* a, size_t n, int prod) {
+    double seed = prod ? 1.0 : 0.0;
+    double l[4] = { seed, seed, seed, seed };
+    size_t done = 0;
+#if defined(SIMD_X86)
+    SimdLevel lv = simd_level();
+    if (lv == SIMD_AVX2) f64_lanes_avx2(a, n, prod, l, &done);
+    else if (lv == SIMD_SSE2) f64_lanes_sse2(a, n, prod, l, &done);
+#endif
+    for (size_t i = done; i < n; i++) {
+        if (prod) l[i & 3] *= a[i];
+        else l[i & 3] += a[i];
+    }
+    if (prod) return (l[0] * l[1]) * (l[2] * l[3]);
+    return (l[0] + l[1]) + (l[2] + l[3]);
+}
+
+double simd_f64_sum(const double* a, size_t n) { return f64_reduce(a, n, 0); }
+double simd_f64_prod(const double* a, size_t n) { return f64_reduce(a, n, 1); }
+
+static double f64_extreme(const double* a, size_t n, int want_max) {
+    double l[4] = { a[0], a[0], a[0], a[0] };
+    size_t done = 0;
+#if defined(SIMD_X86)
+    SimdLevel lv = simd_level();
+    if (lv == SIMD_AVX2) f64_extreme_lanes_avx2(a, n, want_max, l, &done);
+    else if (lv == SIMD_SSE2) f64_extreme_lanes_sse2(a, n, want_max, l, &done);
+#endif
+    double best = l[0];
+    for (int k = 1; k < 4; k++) {
+        if (want_max ? l[k] > best : l[k] < best) best = l[k];
+    }
+    for (size_t i = done; i < n; i++) {
+        if (want_max ? a[i] > best : a[i] < best) best = a[i];
+    }
+    return best;
+}
+
+double simd_f64_max(const double* a, size_t n) { return f64_extreme(a, n, 1); }
+double simd_f64_min(const double* a, size_t n) { return f64_extreme(a, n, 0); }
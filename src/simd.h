@@ -0,0 +1,62 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Vectorised kernels over packed tensor buffers (see TnsStorage).
+//
+// The instruction set is picked once at runtime from CPUID: AVX2 when the
+// CPU and OS support it, otherwise SSE2 on x86, otherwise portable C.  Every
+// level produces the same results:
+//
+// - INT kernels are bit-for-bit identical to sequential evaluation
+//   (two's-complement wrap-around on overflow).
+// - FLT elementwise kernels are exact IEEE operations, so they match too.
+// - FLT SUM/PROD use a fixed 4-lane order on every level: element i is
+//   folded into lane (i mod 4) in increasing i, lanes start at 0.0 (SUM) or
+//   1.0 (PROD), and the result is (lane0 op lane1) op (lane2 op lane3).
+// - FLT MAX/MIN keep the first element as the seed of every lane, so a
+//   leading NaN propagates and later NaNs are ignored, exactly like the
+//   sequential `if (v > best)` scan; only the sign of a 0.0 / -0.0 tie may
+//   differ from it.
+
+typedef enum {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2
+} SimdLevel;
+
+// Elementwise operators, numbered like the T* / M* builtins.
+typedef enum {
+    SIMD_OP_ADD = 0,
+    SIMD_OP_SUB = 1,
+    SIMD_OP_MUL = 2,
+    SIMD_OP_DIV = 3,
+    SIMD_OP_POW = 4
+} SimdOp;
+
+// Detected level, capped by simd_set_max_level().
+SimdLevel simd_level(void);
+const char* simd_level_name(SimdLevel level);
+// Restrict the kernels to at most `level` (the -simd= command line flag).
+void simd_set_max_level(SimdLevel level);
+
+// o[i] = a[i * as] OP b[i * bs] for i in [0, n).  `as` / `bs` are 1 for a
+// buffer or 0 to broadcast a scalar; `o` may alias an operand with stride 1.
+// Return 0 on success, 1 on division by zero and 2 on a negative INT
+// exponent (the contents of `o` are then unspecified).
+int simd_i64_binop(SimdOp op, const int64_t* a, size_t as, const int64_t* b, size_t bs, int64_t* o, size_t n);
+int simd_f64_binop(SimdOp op, const double* a, size_t as, const double* b, size_t bs, double* o, size_t n);
+
+// Reductions.  MAX / MIN require n >= 1.
+int64_t simd_i64_sum(const int64_t* a, size_t n);
+int64_t simd_i64_prod(const int64_t* a, size_t n);
+int64_t simd_i64_max(const int64_t* a, size_t n);
+int64_t simd_i64_min(const int64_t* a, size_t n);
+double simd_f64_sum(const double* a, size_t n);
+double simd_f64_prod(const double* a, size_t n);
+double simd_f64_max(const double* a, size_t n);
+double simd_f64_min(const double* a, size_t n);
+
+#endif // SIMD_H
@@ -0,0 +1,304 @@
+/*
+ * thread_pool.c – Persistent work-stealing pool for PARFOR / PARALLEL.
+ *
+ * One pool per process, sized to the hardware concurrency.  Submitting a
+ * job links it onto a FIFO of open jobs and wakes the pool threads.  The
+ * job's item range is cut into one slice per participant:
+ *
+ *     slice 0            slice 1            slice 2      ...
+ *   [next ....... end) [next ....... end) [next ....... end)
+ *    ^ owner pops       ^ owner pops
+ *      chunks here        chunks here       thieves pop chunks at `end`
+ *
+ * The submitter owns slice 0 and pool thread k owns slice k + 1.  Owners
+ * take chunks from the front of their own slice; a participant whose
+ * slice is empty steals a chunk from the back of the first non-empty one.
+ * Only the short claim is locked, never the user callback.
+ *
+ * Pool threads hold a reference on the job they are working (`helpers`)
+ * so the submitter, which owns the job storage on its stack, waits for
+ * both "all items done" and "no helper still looking at the job".
+ */
+
+#include "thread_pool.h"
+#include "ns_buffer.h"
+#include "value.h"
+#include "win32_shim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+typedef struct PoolSlice {
+    mtx_t lock;
+    size_t next;
+    size_t end;
+} PoolSlice;
+
+typedef struct PoolJob {
+    ThreadPoolFn fn;
+    void* ctx;
+    size_t chunk;
+    PoolSlice* slices;
+    size_t slice_count;
+    size_t remaining;       // items not yet processed (pool lock)
+    int helpers;            // pool threads referencing the job (pool lock)
+    bool linked;            // still on the open-job list (pool lock)
+    cnd_t done_cnd;
+    struct PoolJob* next;
+} PoolJob;
+
+typedef struct ThreadPool {
+    mtx_t lock;
+    cnd_t work_cnd;         // signalled when a job is submitted or on shutdown
+    PoolJob* jobs_head;
+    PoolJob* jobs_tail;
+    thrd_t* threads;
+    size_t thread_count;    // pool threads (the submitter is extra)
+    size_t target_count;    // pool threads to start on first use
+    bool started;
+    bool running;
+} ThreadPool;
+
+typedef struct {
+    ThreadPool* pool;
+    size_t id;              // slice index owned by this thread
+} PoolThreadArg;
+
+static ThreadPool* g_pool = NULL;
+static size_t g_requested_size = 0;     // thread_pool_set_size(), 0 = auto
+
+static size_t hardware_concurrency(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (size_t)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+#endif
+}
+
+/* Must be called with the pool lock held. */
+static void unlink_job(ThreadPool* pool, PoolJob* job) {
+    if (!job->linked) return;
+    PoolJob** pp = &pool->jobs_head;
+    PoolJob* prev = NULL;
+    while (*pp && *pp != job) { prev = *pp; pp = &(*pp)->next; }
+    if (*pp) {
+        *pp = job->next;
+        if (pool->jobs_tail == job) pool->jobs_tail = prev;
+    }
+    job->next = NULL;
+    job->linked = false;
+}
+
+/* Claim a chunk for the participant owning slice `home`: front of its own
+ * slice first, otherwise the back of any other slice.  Returns false when
+ * the whole job has been handed out. */
+static bool claim_chunk(PoolJob* job, size_t home, size_t* begin, size_t* end) {
+    PoolSlice* own = &job->slices[home % job->slice_count];
+    mtx_lock(&own->lock);
+    if (own->next < own->end) {
+        *begin = own->next;
+        *end = (own->end - own->next > job->chunk) ? own->next + job->chunk : own->end;
+        own->next = *end;
+        mtx_unlock(&own->lock);
+        return true;
+    }
+    mtx_unlock(&own->lock);
+
+    for (size_t k = 1; k < job->slice_count; k++) {
+        PoolSlice* victim = &job->slices[(home + k) % job->slice_count];
+        mtx_lock(&victim->lock);
+        if (victim->next < victim->end) {
+            *end = victim->end;
+            *begin = (victim->end - victim->next > job->chunk) ? victim->end - job->chunk : victim->next;
+            victim->end = *begin;
+            mtx_unlock(&victim->lock);
+            return true;
+        }
+        mtx_unlock(&victim->lock);
+    }
+    return false;
+}
+
+/* Process chunks until the job is drained.  Returns with the pool lock
+ * held, the job unlinked and `remaining` updated. */
+static void work_job(ThreadPool* pool, PoolJob* job, size_t home) {
+    size_t done = 0;
+    size_t begin, end;
+    while (claim_chunk(job, home, &begin, &end)) {
+        job->fn(job->ctx, begin, end);
+        done += end - begin;
+    }
+    mtx_lock(&pool->lock);
+    unlink_job(pool, job);
+    job->remaining -= done;
+}
+
+static int pool_thread_func(void* arg) {
+    PoolThreadArg* pa = (PoolThreadArg*)arg;
+    ThreadPool* pool = pa->pool;
+    size_t home = pa->id;
+    free(pa);
+
+    mtx_lock(&pool->lock);
+    for (;;) {
+        while (pool->running && !pool->jobs_head) {
+            cnd_wait(&pool->work_cnd, &pool->lock);
+        }
+        if (!pool->running) break;
+
+        PoolJob* job = pool->jobs_head;
+        job->helpers++;
+        mtx_unlock(&pool->lock);
+
+        work_job(pool, job, home);
+        job->helpers--;
+        if (job->remaining == 0 && job->helpers == 0) {
+            cnd_broadcast(&job->done_cnd);
+        }
+    }
+    mtx_unlock(&pool->lock);
+    value_pool_thread_exit();
+    return 0;
+}
+
+/* Start the pool threads on first use.  Must be called with the pool lock
+ * held.  Failing to start threads is not fatal: the submitter runs every
+ * item itself. */
+static void start_threads(ThreadPool* pool) {
+    if (pool->started) return;
+    pool->started = true;
+    if (pool->target_count == 0) return;
+
+    pool->threads = malloc(sizeof(thrd_t) * pool->target_count);
+    if (!pool->threads) return;
+    for (size_t i = 0; i < pool->target_count; i++) {
+        PoolThreadArg* pa = malloc(sizeof(PoolThreadArg));
+        if (!pa) break;
+        pa->pool = pool;
+        pa->id = i + 1;
+        if (thrd_create(&pool->threads[i], pool_thread_func, pa) != thrd_success) {
+            free(pa);
+            break;
+        }
+        pool->thread_count++;
+    }
+}
+
+void thread_pool_init(void) {
+    if (g_pool) return;
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        fprintf(stderr, "thread_pool: out of memory\n");
+        exit(1);
+    }
+    mtx_init(&pool->lock, 0);
+    cnd_init(&pool->work_cnd);
+    size_t hw = hardware_concurrency();
+    pool->target_count = hw > 1 ? hw - 1 : 1;
+    if (g_requested_size) pool->target_count = g_requested_size - 1;
+    pool->running = true;
+    g_pool = pool;
+}
+
+void thread_pool_shutdown(void) {
+    if (!g_pool) return;
+    ThreadPool* pool = g_pool;
+
+    mtx_lock(&pool->lock);
+    pool->running = false;
+    cnd_broadcast(&pool->work_cnd);
+    mtx_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        thrd_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    mtx_destroy(&pool->lock);
+    cnd_destroy(&pool->work_cnd);
+    free(pool);
+    g_pool = NULL;
+}
+
+void thread_pool_set_size(size_t threads) {
+    if (threads == 0) return;
+    g_requested_size = threads;
+    if (g_pool && !g_pool->started) g_pool->target_count = threads - 1;
+}
+
+size_t thread_pool_size(void) {
+    if (!g_pool) return 1;
+    return (g_pool->started ? g_pool->thread_count : g_pool->target_count) + 1;
+}
+
+void thread_pool_run(size_t count, size_t chunk, ThreadPoolFn fn, void* ctx) {
+    if (count == 0) return;
+    if (!g_pool) thread_pool_init();
+    ThreadPool* pool = g_pool;
+
+    mtx_lock(&pool->lock);
+    start_threads(pool);
+    size_t participants = pool->thread_count + 1;
+    mtx_unlock(&pool->lock);
+
+    if (chunk == 0) {
+        /* A few chunks per participant balances uneven iterations without
+         * making the claim lock hot. */
+        chunk = count / (participants * 4);
+        if (chunk == 0) chunk = 1;
+    }
+
+    size_t slice_count = participants < count ? participants : count;
+    PoolSlice* slices = malloc(sizeof(PoolSlice) * slice_count);
+    if (!slices) {
+        /* Degrade to running inline rather than failing the job. */
+        fn(ctx, 0, count);
+        return;
+    }
+    for (size_t i = 0; i < slice_count; i++) {
+        mtx_init(&slices[i].lock, 0);
+        slices[i].next = count * i / slice_count;
+        slices[i].end = count * (i + 1) / slice_count;
+    }
+
+    PoolJob job;
+    memset(&job, 0, sizeof(job));
+    job.fn = fn;
+    job.ctx = ctx;
+    job.chunk = chunk;
+    job.slices = slices;
+    job.slice_count = slice_count;
+    job.remaining = count;
+    cnd_init(&job.done_cnd);
+
+    ns_buffer_worker_enter();
+
+    if (slice_count > 1 && pool->thread_count > 0) {
+        mtx_lock(&pool->lock);
+        job.linked = true;
+        if (pool->jobs_tail) pool->jobs_tail->next = &job;
+        else pool->jobs_head = &job;
+        pool->jobs_tail = &job;
+        cnd_broadcast(&pool->work_cnd);
+        mtx_unlock(&pool->lock);
+    }
+
+    work_job(pool, &job, 0);
+    while (job.remaining > 0 || job.helpers > 0) {
+        cnd_wait(&job.done_cnd, &pool->lock);
+    }
+    mtx_unlock(&pool->lock);
+
+    ns_buffer_worker_exit();
+
+    for (size_t i = 0; i < slice_count; i++) mtx_destroy(&slices[i].lock);
+    free(slices);
+    cnd_destroy(&job.done_cnd);
+}
@@ -0,0 +1,41 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Persistent worker pool shared by PARFOR and PARALLEL.
+//
+// A job is `count` independent items split into chunks.  Every participant
+// (the pool threads plus the submitting thread itself) owns a slice of the
+// item range, works its slice front to back and, once it runs dry, steals
+// chunks from the back of another participant's slice.  Because the
+// submitter always takes part, a job submitted from inside a pool item
+// (nested PARFOR, PARALLEL inside PARFOR, ...) can always make progress.
+
+// Process `items[begin, end)` of a job.  Called concurrently from several
+// threads with disjoint ranges.
+typedef void (*ThreadPoolFn)(void* ctx, size_t begin, size_t end);
+
+// Initialise the pool.  Worker threads are started lazily by the first
+// thread_pool_run(), so sequential programs never spawn them.
+void thread_pool_init(void);
+
+// Stop and join all pool threads.  No job may be running.
+void thread_pool_shutdown(void);
+
+// Number of threads that work on a job: pool threads plus the caller.
+size_t thread_pool_size(void);
+
+// Use `threads` threads per job (pool threads plus the caller, so 1 runs
+// every job on the submitting thread) instead of one per hardware thread.
+// Only effective before the first job starts the pool threads.
+void thread_pool_set_size(size_t threads);
+
+// Run `fn` over items [0, count) using chunks of at most `chunk` items
+// (0 picks a chunk size from count and the pool size) and block until
+// every item has been processed.  Namespace writes are buffered for the
+// duration of the job (see ns_buffer_worker_enter).
+void thread_pool_run(size_t count, size_t chunk, ThreadPoolFn fn, void* ctx);
+
+#endif // THREAD_POOL_H
@@ -1,7 +1,10 @@
 #include "value.h"
+#include "profile.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 
 #ifdef _MSC_VER
@@ -20,8 +23,387 @@ Value value_flt(double v) {
     Value val; val.type = VAL_FLT; val.as.f = v; return val;
 }
 
+// ============ Strings ============
+//
+// Every VAL_STR's bytes follow a StrHeader in one allocation.  Ordinary
+// strings are reference counted; immortal ones (the preallocated empty and
+// one-byte strings, interned strings) ignore value_copy / value_free.
+
+#define STR_IMMORTAL 0x1u
+#define STR_INTERNED 0x2u
+
+typedef struct StrHeader {
+    atomic_count_t refcount;
+    unsigned flags;
+    size_t len;
+    uint64_t hash;      // FNV-1a of the bytes; 0 until first computed
+} StrHeader;
+
+#define STR_HEADER(s) ((StrHeader*)(s) - 1)
+
+static uint64_t str_fnv1a(const char* s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+static char* str_new(size_t len, unsigned flags) {
+    StrHeader* h = malloc(sizeof(StrHeader) + len + 1);
+    if (!h) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    if (g_profile_enabled) profile_alloc(PROFILE_ALLOC_STR, sizeof(StrHeader) + len + 1);
+    h->refcount = 1;
+    h->flags = flags;
+    h->len = len;
+    h->hash = 0;
+    char* data = (char*)(h + 1);
+    data[len] = '\0';
+    return data;
+}
+
+// Preallocated empty and one-byte strings: header plus two bytes each.
+typedef struct SmallStr {
+    StrHeader h;
+    char data[2];
+} SmallStr;
+
+static SmallStr g_small_strs[257];
+static atomic_count_t g_small_strs_ready;
+
+static void small_strs_init(void) {
+    for (int c = 0; c < 257; c++) {
+        SmallStr* e = &g_small_strs[c];
+        e->h.refcount = 1;
+        e->h.flags = STR_IMMORTAL;
+        e->h.len = c < 256 ? 1 : 0;
+        e->data[0] = c < 256 ? (char)c : '\0';
+        e->data[1] = '\0';
+        e->h.hash = str_fnv1a(e->data, e->h.len);
+    }
+}
+
+// The shared string for `len` <= 1 bytes of `s`.  "\0" is the empty string.
+static char* str_small(const char* s, size_t len) {
+    if (atomic_count_load(&g_small_strs_ready) != 2) {
+        if (atomic_count_cas(&g_small_strs_ready, 0, 1)) {
+            small_strs_init();
+            atomic_count_store(&g_small_strs_ready, 2);
+        } else {
+            while (atomic_count_load(&g_small_strs_ready) != 2) thrd_yield();
+        }
+    }
+    unsigned char c = len ? (unsigned char)s[0] : 0;
+    return g_small_strs[(len && c) ? c : 256].data;
+}
+
+Value value_str_n(const char* s, size_t len) {
+    Value val; val.type = VAL_STR;
+    if (!s) len = 0;
+    if (len <= 1) {
+        val.as.s = str_small(s, len);
+    } else {
+        char* data = str_new(len, 0);
+        memcpy(data, s, len);
+        val.as.s = data;
+    }
+    return val;
+}
+
 Value value_str(const char* s) {
-    Value val; val.type = VAL_STR; val.as.s = s ? strdup(s) : strdup(""); return val;
+    return value_str_n(s, s ? strlen(s) : 0);
+}
+
+Value value_str_alloc(size_t len, char** out) {
+    Value val; val.type = VAL_STR;
+    val.as.s = str_new(len, 0);
+    *out = val.as.s;
+    return val;
+}
+
+size_t value_str_len(const char* s) {
+    return s ? STR_HEADER(s)->len : 0;
+}
+
+uint64_t value_str_hash(const char* s) {
+    if (!s) return 0;
+    StrHeader* h = STR_HEADER(s);
+    // Racing threads all store the same value.
+    if (h->hash == 0) h->hash = str_fnv1a(s, h->len);
+    return h->hash;
+}
+
+bool value_str_eq(const char* a, const char* b) {
+    if (a == b) return true;
+    if (!a || !b) return false;
+    StrHeader* ha = STR_HEADER(a);
+    StrHeader* hb = STR_HEADER(b);
+    if ((ha->flags & hb->flags & STR_INTERNED) || ha->len != hb->len) return false;
+    if (ha->hash && hb->hash && ha->hash != hb->hash) return false;
+    return memcmp(a, b, ha->len) == 0;
+}
+
+// Intern table: open addressing over immortal strings, guarded by a spin
+// lock (interning happens while parsing and when a name is first bound).
+static const char** g_intern_slots;
+static size_t g_intern_cap;     // power of two, or 0
+static size_t g_intern_count;
+static atomic_count_t g_intern_lock;
+
+static void intern_insert_slot(const char** slots, size_t cap, const char* s) {
+    size_t i = (size_t)value_str_hash(s) & (cap - 1);
+    while (slots[i]) i = (i + 1) & (cap - 1);
+    slots[i] = s;
+}
+
+const char* value_str_intern(const char* s) {
+    if (!s) s = "";
+    size_t len = strlen(s);
+    uint64_t hash = str_fnv1a(s, len);
+    while (!atomic_count_cas(&g_intern_lock, 0, 1)) thrd_yield();
+    if ((g_intern_count + 1) * 4 > g_intern_cap * 3) {
+        size_t cap = g_intern_cap ? g_intern_cap * 2 : 256;
+        const char** slots = calloc(cap, sizeof(const char*));
+        if (!slots) { fprintf(stderr, "Out of memory\n"); exit(1); }
+        for (size_t i = 0; i < g_intern_cap; i++) {
+            if (g_intern_slots[i]) intern_insert_slot(slots, cap, g_intern_slots[i]);
+        }
+        free(g_intern_slots);
+        g_intern_slots = slots;
+        g_intern_cap = cap;
+    }
+    size_t mask = g_intern_cap - 1;
+    size_t i = (size_t)hash & mask;
+    const char* found = NULL;
+    while (g_intern_slots[i]) {
+        const char* cur = g_intern_slots[i];
+        StrHeader* h = STR_HEADER(cur);
+        if (h->hash == hash && h->len == len && memcmp(cur, s, len) == 0) {
+            found = cur;
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    if (!found) {
+        char* data = str_new(len, STR_IMMORTAL | STR_INTERNED);
+        memcpy(data, s, len);
+        STR_HEADER(data)->hash = hash;
+        g_intern_slots[i] = data;
+        g_intern_count++;
+        found = data;
+    }
+    atomic_count_store(&g_intern_lock, 0);
+    return found;
+}
+
+Value value_str_interned(const char* interned) {
+    Value val; val.type = VAL_STR; val.as.s = (char*)interned; return val;
+}
+
+static void str_retain(const char* s) {
+    StrHeader* h = STR_HEADER(s);
+    if (!(h->flags & STR_IMMORTAL)) atomic_count_inc(&h->refcount);
+}
+
+static void str_release(char* s) {
+    StrHeader* h = STR_HEADER(s);
+    if (h->flags & STR_IMMORTAL) return;
+    if (atomic_count_dec(&h->refcount) == 0) free(h);
+}
+
+// ============ Container pools ============
+//
+// Every pool hands out blocks of one size.  A thread takes blocks from
+// its own cache; an empty cache is refilled with POOL_BATCH blocks from
+// the pool's shared free list (or freshly carved ones), and a cache that
+// grows past POOL_CACHE_MAX, as on a thread that frees what others
+// allocate, gives POOL_BATCH back.  The shared lists are guarded by a
+// spin lock held for a few pointer moves at a time.
+
+#define POOL_SLAB_BLOCKS 256
+#define POOL_BATCH 32
+#define POOL_CACHE_MAX (4 * POOL_BATCH)
+
+typedef struct PoolBlock {
+    struct PoolBlock* next;     // overlays the start of a free block
+} PoolBlock;
+
+typedef struct Pool {
+    const char* name;
+    size_t size;
+    void (*block_init)(void* block);   // once per carved block
+    atomic_count_t lock;
+    PoolBlock* free;
+    char* slab;                 // uncarved rest of the newest slab
+    size_t slab_left;           // blocks
+    size_t reserved;
+    size_t refills;
+    size_t flushes;
+    atomic_count_t live;
+    atomic_count_t peak_live;
+} Pool;
+
+typedef struct PoolCache {
+    PoolBlock* free;
+    size_t count;
+} PoolCache;
+
+// Free blocks keep their locks; the link must not overlap them.
+_Static_assert(offsetof(Tensor, lock) >= sizeof(PoolBlock), "Tensor lock overlaps the pool link");
+_Static_assert(offsetof(Map, lock) >= sizeof(PoolBlock), "Map lock overlaps the pool link");
+_Static_assert(offsetof(Thr, state_lock) >= sizeof(PoolBlock), "Thr lock overlaps the pool link");
+
+static void tns_block_init(void* block) { mtx_init(&((Tensor*)block)->lock, 0); }
+static void map_block_init(void* block) { mtx_init(&((Map*)block)->lock, 0); }
+static void thr_block_init(void* block) {
+    mtx_init(&((Thr*)block)->state_lock, 0);
+    cnd_init(&((Thr*)block)->state_cond);
+}
+
+#define POOL_BLOCK_SIZE(T) ((sizeof(T) + 15) & ~(size_t)15)
+
+enum { POOL_TNS, POOL_MAP, POOL_THR };
+
+static Pool g_pools[VALUE_POOL_COUNT] = {
+    {"TNS", POOL_BLOCK_SIZE(Tensor), tns_block_init, 0, NULL, NULL, 0, 0, 0, 0, 0, 0},
+    {"MAP", POOL_BLOCK_SIZE(Map), map_block_init, 0, NULL, NULL, 0, 0, 0, 0, 0, 0},
+    {"THR", POOL_BLOCK_SIZE(Thr), thr_block_init, 0, NULL, NULL, 0, 0, 0, 0, 0, 0},
+};
+
+static _Thread_local PoolCache t_pool_cache[VALUE_POOL_COUNT];
+
+static void pool_lock(Pool* p) {
+    while (!atomic_count_cas(&p->lock, 0, 1)) thrd_yield();
+}
+
+static void pool_unlock(Pool* p) {
+    atomic_count_store(&p->lock, 0);
+}
+
+static void pool_refill(Pool* p, PoolCache* c) {
+    pool_lock(p);
+    size_t n = 0;
+    while (n < POOL_BATCH && p->free) {
+        PoolBlock* b = p->free;
+        p->free = b->next;
+        b->next = c->free;
+        c->free = b;
+        n++;
+    }
+    while (n < POOL_BATCH) {
+        if (p->slab_left == 0) {
+            p->slab = malloc(p->size * POOL_SLAB_BLOCKS);
+            if (!p->slab) { fprintf(stderr, "Out of memory\n"); exit(1); }
+            p->slab_left = POOL_SLAB_BLOCKS;
+        }
+        PoolBlock* b = (PoolBlock*)p->slab;
+        p->slab += p->size;
+        p->slab_left--;
+        p->reserved++;
+        p->block_init(b);
+        b->next = c->free;
+        c->free = b;
+        n++;
+    }
+    p->refills++;
+    pool_unlock(p);
+    c->count += n;
+}
+
+// Give all but `keep` of the cached blocks back to the shared list.
+static void pool_flush(Pool* p, PoolCache* c, size_t keep) {
+    if (c->count <= keep) return;
+    PoolBlock* head = c->free;
+    PoolBlock* tail = head;
+    for (size_t i = keep + 1; i < c->count; i++) tail = tail->next;
+    c->free = tail->next;
+    c->count = keep;
+    pool_lock(p);
+    tail->next = p->free;
+    p->free = head;
+    p->flushes++;
+    pool_unlock(p);
+}
+
+static void* pool_alloc(int pool) {
+    Pool* p = &g_pools[pool];
+    PoolCache* c = &t_pool_cache[pool];
+    if (!c->free) pool_refill(p, c);
+    PoolBlock* b = c->free;
+    c->free = b->next;
+    c->count--;
+    if (g_profile_enabled) {
+        long live = atomic_count_inc(&p->live);
+        long peak = atomic_count_load(&p->peak_live);
+        while (live > peak && !atomic_count_cas(&p->peak_live, peak, live)) peak = atomic_count_load(&p->peak_live);
+    }
+    return b;
+}
+
+static void pool_free(int pool, void* block) {
+    Pool* p = &g_pools[pool];
+    PoolCache* c = &t_pool_cache[pool];
+    PoolBlock* b = (PoolBlock*)block;
+    b->next = c->free;
+    c->free = b;
+    c->count++;
+    if (g_profile_enabled) atomic_count_dec(&p->live);
+    if (c->count > POOL_CACHE_MAX) pool_flush(p, c, POOL_CACHE_MAX - POOL_BATCH);
+}
+
+void value_pool_thread_exit(void) {
+    for (int i = 0; i < VALUE_POOL_COUNT; i++) pool_flush(&g_pools[i], &t_pool_cache[i], 0);
+}
+
+void value_pool_stats(size_t pool, ValuePoolStats* out) {
+    memset(out, 0, sizeof(*out));
+    if (pool >= VALUE_POOL_COUNT) return;
+    Pool* p = &g_pools[pool];
+    pool_lock(p);
+    out->name = p->name;
+    out->block_size = p->size;
+    out->reserved = p->reserved;
+    out->refills = p->refills;
+    out->flushes = p->flushes;
+    pool_unlock(p);
+    out->live = atomic_count_load(&p->live);
+    out->peak_live = atomic_count_load(&p->peak_live);
+}
+
+// ============ Reference counts ============
+//
+// Tensor::refcount and Map::refcount: the count plus VALUE_ALIASED (see
+// "Sharing" in value.h).  Every change is a single compare-and-swap.
+
+static long ref_count(atomic_count_t* r) { return atomic_count_load(r) & ~VALUE_ALIASED; }
+static bool ref_aliased(atomic_count_t* r) { return (atomic_count_load(r) & VALUE_ALIASED) != 0; }
+
+// Take a copy-on-write reference; false (taking none) if aliased.
+static bool ref_share(atomic_count_t* r) {
+    for (;;) {
+        long old = atomic_count_load(r);
+        if (old & VALUE_ALIASED) return false;
+        if (atomic_count_cas(r, old, old + 1)) return true;
+    }
+}
+
+// Take a reference and mark every reference as aliased.
+static void ref_alias(atomic_count_t* r) {
+    for (;;) {
+        long old = atomic_count_load(r);
+        if (atomic_count_cas(r, old, (old + 1) | VALUE_ALIASED)) return;
+    }
+}
+
+// Drop a reference; true if it was the last.  The flag goes with the
+// next-to-last one.
+static bool ref_drop(atomic_count_t* r) {
+    for (;;) {
+        long old = atomic_count_load(r);
+        long left = (old & ~VALUE_ALIASED) - 1;
+        if (atomic_count_cas(r, old, left <= 1 ? left : old - 1)) return left <= 0;
+    }
 }
 
 Value value_func(struct Func* func) {
@@ -29,74 +411,182 @@ Value value_func(struct Func* func) {
 }
 
 Value value_thr_new(void) {
-    Thr* t = malloc(sizeof(Thr));
-    if (!t) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    Thr* t = pool_alloc(POOL_THR);
     t->finished = 0;
     t->paused = 0;
     t->refcount = 1;
     t->started = 0;
     t->body = NULL;
+    t->arena = NULL;
     t->env = NULL;
-    mtx_init(&t->state_lock, 0);
+    t->exited = 0;
+    t->joined = 0;
     memset(&t->thread, 0, sizeof(thrd_t));
     Value v; v.type = VAL_THR; v.as.thr = t; return v;
 }
 
 int value_thr_is_running(Value v) {
     if (v.type != VAL_THR || !v.as.thr) return 0;
-    int finished = 0;
-    mtx_lock(&v.as.thr->state_lock);
-    finished = v.as.thr->finished;
-    mtx_unlock(&v.as.thr->state_lock);
-    return finished ? 0 : 1;
+    return atomic_count_load(&v.as.thr->finished) ? 0 : 1;
 }
 
 void value_thr_set_finished(Value v, int finished) {
     if (v.type != VAL_THR || !v.as.thr) return;
     mtx_lock(&v.as.thr->state_lock);
-    v.as.thr->finished = finished ? 1 : 0;
+    atomic_count_store(&v.as.thr->finished, finished ? 1 : 0);
+    cnd_broadcast(&v.as.thr->state_cond);
     mtx_unlock(&v.as.thr->state_lock);
 }
 
 int value_thr_get_finished(Value v) {
     if (v.type != VAL_THR || !v.as.thr) return 1;
-    int finished = 1;
-    mtx_lock(&v.as.thr->state_lock);
-    finished = v.as.thr->finished;
-    mtx_unlock(&v.as.thr->state_lock);
-    return finished;
+    return (int)atomic_count_load(&v.as.thr->finished);
 }
 
 void value_thr_set_paused(Value v, int paused) {
     if (v.type != VAL_THR || !v.as.thr) return;
     mtx_lock(&v.as.thr->state_lock);
-    v.as.thr->paused = paused ? 1 : 0;
+    atomic_count_store(&v.as.thr->paused, paused ? 1 : 0);
+    cnd_broadcast(&v.as.thr->state_cond);
     mtx_unlock(&v.as.thr->state_lock);
 }
 
 int value_thr_get_paused(Value v) {
     if (v.type != VAL_THR || !v.as.thr) return 0;
-    int paused = 0;
-    mtx_lock(&v.as.thr->state_lock);
-    paused = v.as.thr->paused;
-    mtx_unlock(&v.as.thr->state_lock);
-    return paused;
+    return (int)atomic_count_load(&v.as.thr->paused);
 }
 
 void value_thr_set_started(Value v, int started) {
     if (v.type != VAL_THR || !v.as.thr) return;
-    mtx_lock(&v.as.thr->state_lock);
-    v.as.thr->started = started ? 1 : 0;
-    mtx_unlock(&v.as.thr->state_lock);
+    Thr* th = v.as.thr;
+    mtx_lock(&th->state_lock);
+    bool detach = started && th->started && !th->joined;
+    // `started` first: value_thr_get_exited() reads `exited` before it.
+    atomic_count_store(&th->started, started ? 1 : 0);
+    if (started) {
+        if (detach) thrd_detach(th->thread);
+        atomic_count_store(&th->exited, 0);
+        atomic_count_store(&th->joined, 0);
+    }
+    cnd_broadcast(&th->state_cond);
+    mtx_unlock(&th->state_lock);
+}
+
+// Waiters on several THRs at once sleep here; every exit broadcasts.
+static mtx_t g_thr_exit_lock;
+static cnd_t g_thr_exit_cond;
+
+void value_thr_init(void) {
+    mtx_init(&g_thr_exit_lock, mtx_plain);
+    cnd_init(&g_thr_exit_cond);
+}
+
+void value_thr_set_exited(Value v) {
+    if (v.type != VAL_THR || !v.as.thr) return;
+    Thr* th = v.as.thr;
+    mtx_lock(&th->state_lock);
+    atomic_count_store(&th->finished, 1);
+    atomic_count_store(&th->exited, 1);
+    cnd_broadcast(&th->state_cond);
+    mtx_unlock(&th->state_lock);
+    // Taking the lock orders this broadcast after a waiter's last check.
+    mtx_lock(&g_thr_exit_lock);
+    cnd_broadcast(&g_thr_exit_cond);
+    mtx_unlock(&g_thr_exit_lock);
+}
+
+int value_thr_get_exited(Value v) {
+    if (v.type != VAL_THR || !v.as.thr) return 1;
+    Thr* th = v.as.thr;
+    if (atomic_count_load(&th->exited)) return 1;
+    return !atomic_count_load(&th->started);
+}
+
+void value_thr_wait_unpaused(Value v) {
+    if (v.type != VAL_THR || !v.as.thr) return;
+    Thr* th = v.as.thr;
+    mtx_lock(&th->state_lock);
+    while (th->paused && !th->finished) cnd_wait(&th->state_cond, &th->state_lock);
+    mtx_unlock(&th->state_lock);
+}
+
+// TIME_UTC deadline `seconds` from now, for cnd_timedwait.
+static struct timespec thr_deadline(double seconds) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    if (seconds > 1e9) seconds = 1e9;
+    time_t whole = (time_t)seconds;
+    long nsec = ts.tv_nsec + (long)((seconds - (double)whole) * 1e9);
+    ts.tv_sec += whole + nsec / 1000000000L;
+    ts.tv_nsec = nsec % 1000000000L;
+    return ts;
+}
+
+// Join the exited thread of the current run, once.
+static void thr_join_exited(Thr* th) {
+    mtx_lock(&th->state_lock);
+    bool join = th->started && th->exited && !th->joined;
+    if (join) atomic_count_store(&th->joined, 1);
+    thrd_t thread = th->thread;
+    mtx_unlock(&th->state_lock);
+    // The worker is past its last statement, so this returns promptly.
+    if (join) thrd_join(thread, NULL);
+}
+
+int value_thr_await(Value v, double seconds) {
+    if (v.type != VAL_THR || !v.as.thr) return 1;
+    Thr* th = v.as.thr;
+    struct timespec deadline = {0};
+    if (seconds >= 0) deadline = thr_deadline(seconds);
+    mtx_lock(&th->state_lock);
+    while (th->started && !th->exited) {
+        if (seconds < 0) {
+            cnd_wait(&th->state_cond, &th->state_lock);
+        } else if (cnd_timedwait(&th->state_cond, &th->state_lock, &deadline) == thrd_timedout) {
+            break;
+        }
+    }
+    int exited = th->exited || !th->started;
+    mtx_unlock(&th->state_lock);
+    if (exited) thr_join_exited(th);
+    return exited;
+}
+
+int value_thr_await_many(const Value* thrs, size_t count, bool all, double seconds) {
+    struct timespec deadline = {0};
+    if (seconds >= 0) deadline = thr_deadline(seconds);
+    int done = 0;
+    mtx_lock(&g_thr_exit_lock);
+    for (;;) {
+        size_t exited = 0;
+        for (size_t i = 0; i < count; i++) exited += value_thr_get_exited(thrs[i]) ? 1u : 0u;
+        if (all ? exited == count : exited > 0) { done = 1; break; }
+        if (seconds < 0) {
+            cnd_wait(&g_thr_exit_cond, &g_thr_exit_lock);
+        } else if (cnd_timedwait(&g_thr_exit_cond, &g_thr_exit_lock, &deadline) == thrd_timedout) {
+            break;
+        }
+    }
+    mtx_unlock(&g_thr_exit_lock);
+    for (size_t i = 0; i < count; i++) {
+        if (thrs[i].type == VAL_THR && thrs[i].as.thr) thr_join_exited(thrs[i].as.thr);
+    }
+    return done;
+}
+
+void value_thr_set_body(Value v, Stmt* body) {
+    if (v.type != VAL_THR || !v.as.thr) return;
+    Thr* th = v.as.thr;
+    AstArena* arena = body ? body->arena : NULL;
+    ast_arena_retain(arena);
+    ast_arena_release(th->arena);
+    th->body = body;
+    th->arena = arena;
 }
 
 int value_thr_get_started(Value v) {
     if (v.type != VAL_THR || !v.as.thr) return 0;
-    int started = 0;
-    mtx_lock(&v.as.thr->state_lock);
-    started = v.as.thr->started;
-    mtx_unlock(&v.as.thr->state_lock);
-    return started;
+    return (int)atomic_count_load(&v.as.thr->started);
 }
 
 // Create a pointer value referring to a binding name
@@ -112,38 +602,270 @@ static size_t compute_strides(const size_t* shape, size_t ndim, size_t* out_stri
     return len;
 }
 
-Value value_tns_new(DeclType elem_type, size_t ndim, const size_t* shape) {
-    Value v;
-    v.type = VAL_TNS;
-    Tensor* t = malloc(sizeof(Tensor));
-    if (!t) { fprintf(stderr, "Out of memory\n"); exit(1); }
-    t->elem_type = elem_type;
+static void* tns_buf_alloc(size_t count, size_t elem_size) {
+    void* p = calloc(count ? count : 1, elem_size);
+    if (!p) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    return p;
+}
+
+static TnsStorage tns_storage_for(DeclType elem_type) {
+    if (elem_type == TYPE_INT) return TNS_STORAGE_INT;
+    if (elem_type == TYPE_FLT) return TNS_STORAGE_FLT;
+    return TNS_STORAGE_BOXED;
+}
+
+// A pooled tensor header with `ndim` set and room for shape and strides
+// (inline for up to TNS_INLINE_DIMS dimensions).
+static Tensor* tns_header_new(size_t ndim) {
+    Tensor* t = pool_alloc(POOL_TNS);
     t->ndim = ndim;
-    t->shape = malloc(sizeof(size_t) * ndim);
-    t->strides = malloc(sizeof(size_t) * ndim);
+    if (ndim <= TNS_INLINE_DIMS) {
+        t->shape = t->dims;
+        t->strides = t->dims + TNS_INLINE_DIMS;
+    } else {
+        t->shape = malloc(sizeof(size_t) * ndim);
+        t->strides = malloc(sizeof(size_t) * ndim);
+        if (!t->shape || !t->strides) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    }
+    return t;
+}
+
+// Room for the steps of a strided view of `t`.
+static size_t* tns_steps_new(Tensor* t) {
+    if (t->ndim <= TNS_INLINE_DIMS) return t->dims + 2 * TNS_INLINE_DIMS;
+    size_t* steps = malloc(sizeof(size_t) * t->ndim);
+    if (!steps) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    return steps;
+}
+
+static void tns_steps_free(Tensor* t, size_t* steps) {
+    if (steps && t->ndim > TNS_INLINE_DIMS) free(steps);
+}
+
+// Allocate a tensor header with shape/strides and a zeroed buffer for `storage`.
+static Tensor* tns_alloc(DeclType elem_type, TnsStorage storage, size_t ndim, const size_t* shape) {
+    Tensor* t = tns_header_new(ndim);
+    t->elem_type = elem_type;
+    t->storage = storage;
     for (size_t i = 0; i < ndim; i++) t->shape[i] = shape[i];
     t->length = compute_strides(shape, ndim, t->strides);
-    t->data = malloc(sizeof(Value) * (t->length));
-    for (size_t i = 0; i < t->length; i++) t->data[i] = value_null();
+    t->data = NULL;
+    t->ints = NULL;
+    t->flts = NULL;
+    size_t elem_size = storage == TNS_STORAGE_INT ? sizeof(int64_t) : storage == TNS_STORAGE_FLT ? sizeof(double) : sizeof(Value);
+    if (storage == TNS_STORAGE_INT) t->ints = tns_buf_alloc(t->length, elem_size);
+    else if (storage == TNS_STORAGE_FLT) t->flts = tns_buf_alloc(t->length, elem_size);
+    else t->data = tns_buf_alloc(t->length, elem_size); // zeroed == VAL_NULL
+    if (g_profile_enabled) {
+        size_t dims_bytes = ndim > TNS_INLINE_DIMS ? 2 * sizeof(size_t) * ndim : 0;
+        profile_alloc(PROFILE_ALLOC_TNS, sizeof(Tensor) + dims_bytes + t->length * elem_size);
+    }
     t->refcount = 1;
-    mtx_init(&t->lock, 0);
-    v.as.tns = t;
+    t->base = NULL;
+    t->borrowed = false;
+    t->steps = NULL;
+    t->views = NULL;
+    t->view_prev = NULL;
+    t->view_next = NULL;
+    t->view_refs = 0;
+    return t;
+}
+
+// Buffer position of element `i` of a strided view.
+static size_t tns_phys(const Tensor* t, size_t i) {
+    size_t off = 0;
+    for (size_t d = 0; d < t->ndim; d++) {
+        off += (i / t->strides[d]) * t->steps[d];
+        i %= t->strides[d];
+    }
+    return off;
+}
+
+static size_t tns_step(const Tensor* t, size_t d) {
+    return t->steps ? t->steps[d] : t->strides[d];
+}
+
+// Copy the packed elements of `t` into `dst` in row-major order.
+static void tns_gather_packed(const Tensor* t, void* dst) {
+    if (t->storage == TNS_STORAGE_INT) {
+        int64_t* o = dst;
+        if (!t->steps) memcpy(o, t->ints, sizeof(int64_t) * t->length);
+        else for (size_t i = 0; i < t->length; i++) o[i] = t->ints[tns_phys(t, i)];
+    } else {
+        double* o = dst;
+        if (!t->steps) memcpy(o, t->flts, sizeof(double) * t->length);
+        else for (size_t i = 0; i < t->length; i++) o[i] = t->flts[tns_phys(t, i)];
+    }
+}
+
+// Give borrowed view `v` its own contiguous buffer.  Caller holds
+// v->base->lock.
+static void tns_materialize(Tensor* v) {
+    void* own = tns_buf_alloc(v->length, v->storage == TNS_STORAGE_INT ? sizeof(int64_t) : sizeof(double));
+    tns_gather_packed(v, own);
+    if (v->storage == TNS_STORAGE_INT) v->ints = own;
+    else v->flts = own;
+    tns_steps_free(v, v->steps);
+    v->steps = NULL;
+    v->borrowed = false;
+    if (v->view_prev) v->view_prev->view_next = v->view_next;
+    else v->base->views = v->view_next;
+    if (v->view_next) v->view_next->view_prev = v->view_prev;
+    v->view_prev = NULL;
+    v->view_next = NULL;
+}
+
+// Materialize `t` if it is a borrowed view.
+static void tns_detach(Tensor* t) {
+    // `borrowed` only ever goes from true to false, so a false read is final.
+    if (!t->base || !t->borrowed) return;
+    mtx_lock(&t->base->lock);
+    if (t->borrowed) tns_materialize(t);
+    mtx_unlock(&t->base->lock);
+}
+
+// A view of `src` selecting element first[d] of every dimension d that is
+// not kept (keep[d] < 0) and the range starting at first[d] of every
+// dimension that becomes output dimension keep[d].  `src` must be packed.
+static Value tns_view(Tensor* src, const size_t* first, const int* keep, size_t ndim, const size_t* shape) {
+    Tensor* v = tns_header_new(ndim);
+    size_t* steps = tns_steps_new(v);
+    v->elem_type = src->elem_type;
+    v->storage = src->storage;
+    for (size_t i = 0; i < ndim; i++) v->shape[i] = shape[i];
+    v->length = compute_strides(shape, ndim, v->strides);
+    v->data = NULL;
+    v->ints = NULL;
+    v->flts = NULL;
+    v->refcount = 1;
+    v->views = NULL;
+    v->view_prev = NULL;
+    v->view_next = NULL;
+    v->view_refs = 0;
+
+    // A view of a borrowed view reads the same buffer, so it hangs off the
+    // same base; the layout is read under the lock that guards it.
+    Tensor* root = (src->base && src->borrowed) ? src->base : src;
+    mtx_lock(&root->lock);
+    if (root != src && !src->borrowed) {
+        mtx_unlock(&root->lock);
+        root = src;
+        mtx_lock(&root->lock);
+    }
+    size_t rel = 0;
+    for (size_t d = 0; d < src->ndim; d++) {
+        rel += first[d] * tns_step(src, d);
+        if (keep[d] >= 0) steps[keep[d]] = tns_step(src, d);
+    }
+    bool contiguous = true;
+    for (size_t d = 0; d < ndim; d++) {
+        if (shape[d] > 1 && steps[d] != v->strides[d]) contiguous = false;
+    }
+    if (v->storage == TNS_STORAGE_INT) v->ints = src->ints + rel;
+    else v->flts = src->flts + rel;
+    v->base = root;
+    v->borrowed = true;
+    v->view_next = root->views;
+    if (root->views) root->views->view_prev = v;
+    root->views = v;
+    atomic_count_inc(&root->refcount);
+    root->view_refs++;
+    mtx_unlock(&root->lock);
+
+    if (contiguous) {
+        tns_steps_free(v, steps);
+        steps = NULL;
+    }
+    v->steps = steps;
+    Value out;
+    out.type = VAL_TNS;
+    out.as.tns = v;
+    return out;
+}
+
+Value value_tns_new(DeclType elem_type, size_t ndim, const size_t* shape) {
+    Value v;
+    v.type = VAL_TNS;
+    v.as.tns = tns_alloc(elem_type, tns_storage_for(elem_type), ndim, shape);
     return v;
 }
 
 Value value_tns_from_values(DeclType elem_type, size_t ndim, const size_t* shape, Value* items, size_t item_count) {
-    Value tval = value_tns_new(elem_type, ndim, shape);
+    TnsStorage storage = tns_storage_for(elem_type);
+    ValueType want = storage == TNS_STORAGE_INT ? VAL_INT : VAL_FLT;
+    if (storage != TNS_STORAGE_BOXED) {
+        for (size_t i = 0; i < item_count; i++) {
+            if (items[i].type != want) { storage = TNS_STORAGE_BOXED; break; }
+        }
+    }
+    Value tval;
+    tval.type = VAL_TNS;
+    tval.as.tns = tns_alloc(elem_type, storage, ndim, shape);
     Tensor* t = tval.as.tns;
-    if (item_count != t->length) {
-        // Fill with nulls if mismatched
-        size_t to_copy = item_count < t->length ? item_count : t->length;
-        for (size_t i = 0; i < to_copy; i++) t->data[i] = value_copy(items[i]);
+    // Missing items stay zero / NULL
+    size_t to_copy = item_count < t->length ? item_count : t->length;
+    if (storage == TNS_STORAGE_INT) {
+        for (size_t i = 0; i < to_copy; i++) t->ints[i] = items[i].as.i;
+    } else if (storage == TNS_STORAGE_FLT) {
+        for (size_t i = 0; i < to_copy; i++) t->flts[i] = items[i].as.f;
     } else {
-        for (size_t i = 0; i < t->length; i++) t->data[i] = value_copy(items[i]);
+        for (size_t i = 0; i < to_copy; i++) t->data[i] = value_copy(items[i]);
     }
     return tval;
 }
 
+Value value_tns_elem(const Tensor* t, size_t i) {
+    if (t->steps) i = tns_phys(t, i);
+    if (t->storage == TNS_STORAGE_INT) return value_int(t->ints[i]);
+    if (t->storage == TNS_STORAGE_FLT) return value_flt(t->flts[i]);
+    return t->data[i];
+}
+
+void value_tns_box(Tensor* t) {
+    if (t->storage == TNS_STORAGE_BOXED) return;
+    tns_detach(t);
+    Value* data = tns_buf_alloc(t->length, sizeof(Value));
+    for (size_t i = 0; i < t->length; i++) data[i] = value_tns_elem(t, i);
+    free(t->ints);
+    free(t->flts);
+    t->ints = NULL;
+    t->flts = NULL;
+    t->data = data;
+    t->storage = TNS_STORAGE_BOXED;
+}
+
+bool value_tns_pack(Tensor* t) {
+    if (t->storage != TNS_STORAGE_BOXED) {
+        if (t->steps) tns_detach(t);
+        return true;
+    }
+    TnsStorage storage = tns_storage_for(t->elem_type);
+    if (storage == TNS_STORAGE_BOXED) return false;
+    ValueType want = storage == TNS_STORAGE_INT ? VAL_INT : VAL_FLT;
+    for (size_t i = 0; i < t->length; i++) {
+        if (t->data[i].type != want) return false;
+    }
+    if (storage == TNS_STORAGE_INT) {
+        t->ints = tns_buf_alloc(t->length, sizeof(int64_t));
+        for (size_t i = 0; i < t->length; i++) t->ints[i] = t->data[i].as.i;
+    } else {
+        t->flts = tns_buf_alloc(t->length, sizeof(double));
+        for (size_t i = 0; i < t->length; i++) t->flts[i] = t->data[i].as.f;
+    }
+    free(t->data);
+    t->data = NULL;
+    t->storage = storage;
+    return true;
+}
+
+void value_tns_set_elem(Tensor* t, size_t i, Value v) {
+    if (t->storage == TNS_STORAGE_INT && v.type == VAL_INT) { t->ints[i] = v.as.i; return; }
+    if (t->storage == TNS_STORAGE_FLT && v.type == VAL_FLT) { t->flts[i] = v.as.f; return; }
+    value_tns_box(t);
+    value_free(t->data[i]);
+    t->data[i] = v;
+}
+
 Value value_tns_get(Value v, const size_t* idxs, size_t nidxs) {
     if (v.type != VAL_TNS) return value_null();
     Tensor* t = v.as.tns;
@@ -158,22 +880,31 @@ Value value_tns_get(Value v, const size_t* idxs, size_t nidxs) {
     }
     // If full indexing (nidxs == ndim) return element, else return a view (slice) as a new tensor
     if (nidxs == t->ndim) {
-        return value_copy(t->data[offset]);
+        return value_copy(value_tns_elem(t, offset));
     } else {
         // Build shape for sub-tensor
         size_t new_ndim = t->ndim - nidxs;
         size_t* new_shape = malloc(sizeof(size_t) * new_ndim);
         for (size_t i = 0; i < new_ndim; i++) new_shape[i] = t->shape[nidxs + i];
-        // Create new tensor and copy data
-        Value out = value_tns_new(t->elem_type, new_ndim, new_shape);
-        Tensor* ot = out.as.tns;
-        // Copy contiguous block segments if lower dimensions match contiguous layout
-        size_t copy_count = ot->length;
-        for (size_t i = 0; i < copy_count; i++) {
-            // compute source index in original
-            size_t src = offset + i; // works because original is row-major and subarray is contiguous
-            ot->data[i] = value_copy(t->data[src]);
+        Value out;
+        if (t->storage != TNS_STORAGE_BOXED) {
+            size_t* first = malloc(sizeof(size_t) * t->ndim);
+            int* keep = malloc(sizeof(int) * t->ndim);
+            for (size_t i = 0; i < t->ndim; i++) {
+                first[i] = i < nidxs ? idxs[i] : 0;
+                keep[i] = i < nidxs ? -1 : (int)(i - nidxs);
+            }
+            out = tns_view(t, first, keep, new_ndim, new_shape);
+            free(first);
+            free(keep);
+            free(new_shape);
+            return out;
         }
+        // Boxed: copy the elements (one contiguous block, row-major)
+        out.type = VAL_TNS;
+        out.as.tns = tns_alloc(t->elem_type, t->storage, new_ndim, new_shape);
+        Tensor* ot = out.as.tns;
+        for (size_t i = 0; i < ot->length; i++) ot->data[i] = value_copy(t->data[offset + i]);
         free(new_shape);
         return out;
     }
@@ -228,7 +959,7 @@ Value value_tns_slice(Value v, const int64_t* starts, const int64_t* ends, size_
             size_t pos = (nends[i] >= nstarts[i]) ? (size_t)(nstarts[i] - 1) : 0;
             src_offset += pos * t->strides[i];
         }
-        Value out = value_copy(t->data[src_offset]);
+        Value out = value_copy(value_tns_elem(t, src_offset));
         free(nstarts); free(nends); free(orig_to_out);
         return out;
     }
@@ -240,7 +971,24 @@ Value value_tns_slice(Value v, const int64_t* starts, const int64_t* ends, size_
         }
     }
 
-    Value out = value_tns_new(t->elem_type, new_ndim, new_shape);
+    Value out;
+    if (t->storage != TNS_STORAGE_BOXED) {
+        size_t* first = malloc(sizeof(size_t) * t->ndim);
+        for (size_t i = 0; i < t->ndim; i++) {
+            first[i] = (nends[i] >= nstarts[i]) ? (size_t)(nstarts[i] - 1) : 0;
+        }
+        out = tns_view(t, first, orig_to_out, new_ndim, new_shape);
+        free(first);
+        free(new_shape);
+        free(nstarts);
+        free(nends);
+        free(orig_to_out);
+        return out;
+    }
+
+    // Boxed: copy the selected elements
+    out.type = VAL_TNS;
+    out.as.tns = tns_alloc(t->elem_type, t->storage, new_ndim, new_shape);
     Tensor* ot = out.as.tns;
 
     // iterate over output positions and copy corresponding element
@@ -278,285 +1026,520 @@ Value value_tns_slice(Value v, const int64_t* starts, const int64_t* ends, size_
 }
 
 // Map implementation
+
+// Maps with at most this many entries are searched linearly; the hash
+// index is built the first time a map grows past it.
+#define MAP_INDEX_MIN 8
+
+typedef struct MapSlot {
+    size_t pos;             // item position + 1; 0 marks an empty slot
+    uint64_t hash;
+} MapSlot;
+
 Value value_map_new(void) {
     Value v; v.type = VAL_MAP;
-    Map* m = malloc(sizeof(Map));
-    if (!m) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    Map* m = pool_alloc(POOL_MAP);
+    if (g_profile_enabled) profile_alloc(PROFILE_ALLOC_MAP, sizeof(Map));
     m->items = NULL;
     m->count = 0;
     m->capacity = 0;
+    m->holes = 0;
+    m->index = NULL;
+    m->index_cap = 0;
     m->refcount = 1;
-    mtx_init(&m->lock, 0);
     v.as.map = m;
     return v;
 }
 
-static int map_find_index(Map* m, Value key) {
+static uint64_t map_mix64(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t map_key_hash(Value key) {
+    switch (key.type) {
+        case VAL_INT:
+            return map_mix64((uint64_t)key.as.i);
+        case VAL_FLT: {
+            double f = key.as.f;
+            if (f == 0.0) f = 0.0; // -0.0 compares equal to 0.0
+            uint64_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            return map_mix64(bits ^ 0x9e3779b97f4a7c15ULL);
+        }
+        case VAL_STR:
+            return map_mix64(value_str_hash(key.as.s));
+        default:
+            return 0;
+    }
+}
+
+static bool map_key_equal(Value a, Value b) {
+    if (a.type != b.type) return false;
+    if (a.type == VAL_INT) return a.as.i == b.as.i;
+    if (a.type == VAL_STR) return a.as.s && b.as.s && value_str_eq(a.as.s, b.as.s);
+    if (a.type == VAL_FLT) return a.as.f == b.as.f;
+    return false;
+}
+
+static void map_index_put(Map* m, size_t pos, uint64_t hash) {
+    size_t mask = m->index_cap - 1;
+    size_t i = (size_t)hash & mask;
+    while (m->index[i].pos != 0) i = (i + 1) & mask;
+    m->index[i].pos = pos + 1;
+    m->index[i].hash = hash;
+}
+
+// (Re)build the index over the live entries with room for `live` of them.
+static void map_index_rebuild(Map* m, size_t live) {
+    size_t cap = 16;
+    while (cap * 3 < live * 4 + 4) cap *= 2;
+    MapSlot* index = calloc(cap, sizeof(MapSlot));
+    if (!index) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    free(m->index);
+    m->index = index;
+    m->index_cap = cap;
     for (size_t i = 0; i < m->count; i++) {
-        MapEntry* e = &m->items[i];
-        if (e->key.type == key.type) {
-            if (key.type == VAL_INT && e->key.as.i == key.as.i) return (int)i;
-            if (key.type == VAL_STR && e->key.as.s && key.as.s && strcmp(e->key.as.s, key.as.s) == 0) return (int)i;
-            if (key.type == VAL_FLT && e->key.as.f == key.as.f) return (int)i;
+        if (m->items[i].key.type == VAL_NULL) continue;
+        map_index_put(m, i, map_key_hash(m->items[i].key));
+    }
+}
+
+// Returns the item position of `key`, or -1.  `*slot_out` receives the
+// index slot when the index is in use.
+static ptrdiff_t map_find(Map* m, Value key, uint64_t hash, size_t* slot_out) {
+    if (!m->index) {
+        for (size_t i = 0; i < m->count; i++) {
+            if (map_key_equal(m->items[i].key, key)) return (ptrdiff_t)i;
+        }
+        return -1;
+    }
+    size_t mask = m->index_cap - 1;
+    for (size_t i = (size_t)hash & mask; m->index[i].pos != 0; i = (i + 1) & mask) {
+        if (m->index[i].hash == hash && map_key_equal(m->items[m->index[i].pos - 1].key, key)) {
+            if (slot_out) *slot_out = i;
+            return (ptrdiff_t)(m->index[i].pos - 1);
         }
     }
     return -1;
 }
 
+// Append a new entry for `key` (with a NULL value) and index it.
+static MapEntry* map_append(Map* m, Value key, uint64_t hash) {
+    if (m->count + 1 > m->capacity) {
+        size_t newc = m->capacity == 0 ? 8 : m->capacity * 2;
+        m->items = realloc(m->items, sizeof(MapEntry) * newc);
+        if (!m->items) { fprintf(stderr, "Out of memory\n"); exit(1); }
+        m->capacity = newc;
+    }
+    size_t pos = m->count++;
+    m->items[pos].key = value_copy(key);
+    m->items[pos].value = value_null();
+
+    size_t live = m->count - m->holes;
+    if (m->index) {
+        if (live * 4 > m->index_cap * 3) map_index_rebuild(m, live);
+        else map_index_put(m, pos, hash);
+    } else if (live > MAP_INDEX_MIN) {
+        map_index_rebuild(m, live);
+    }
+    return &m->items[pos];
+}
+
+void value_map_compact(Map* m) {
+    if (!m || m->holes == 0) return;
+    mtx_lock(&m->lock);
+    if (m->holes > 0) {
+        size_t w = 0;
+        for (size_t r = 0; r < m->count; r++) {
+            if (m->items[r].key.type == VAL_NULL) continue;
+            m->items[w++] = m->items[r];
+        }
+        m->count = w;
+        m->holes = 0;
+        if (m->index) map_index_rebuild(m, w);
+    }
+    mtx_unlock(&m->lock);
+}
+
 void value_map_set(Value* mapval, Value key, Value val) {
     if (!mapval || mapval->type != VAL_MAP) return;
+    value_unshare(mapval);
     Map* m = mapval->as.map;
-    int idx = map_find_index(m, key);
+    uint64_t hash = map_key_hash(key);
+    ptrdiff_t idx = map_find(m, key, hash, NULL);
     if (idx >= 0) {
         // replace
         value_free(m->items[idx].value);
         m->items[idx].value = value_copy(val);
         return;
     }
-    if (m->count + 1 > m->capacity) {
-        size_t newc = m->capacity == 0 ? 8 : m->capacity * 2;
-        m->items = realloc(m->items, sizeof(MapEntry) * newc);
-        if (!m->items) { fprintf(stderr, "Out of memory\n"); exit(1); }
-        m->capacity = newc;
-    }
-    m->items[m->count].key = value_copy(key);
-    m->items[m->count].value = value_copy(val);
-    m->count++;
+    MapEntry* e = map_append(m, key, hash);
+    e->value = value_copy(val);
 }
 
 Value value_map_get(Value mapval, Value key, int* found) {
     Value out = value_null();
     if (!mapval.as.map) { if (found) *found = 0; return out; }
     Map* m = mapval.as.map;
-    int idx = map_find_index(m, key);
+    ptrdiff_t idx = map_find(m, key, map_key_hash(key), NULL);
     if (idx < 0) { if (found) *found = 0; return out; }
     if (found) *found = 1;
     return value_copy(m->items[idx].value);
 }
 
+const Value* value_map_elem(Map* m, Value key) {
+    if (!m) return NULL;
+    ptrdiff_t idx = map_find(m, key, map_key_hash(key), NULL);
+    return idx < 0 ? NULL : &m->items[idx].value;
+}
+
 void value_map_delete(Value* mapval, Value key) {
     if (!mapval || mapval->type != VAL_MAP) return;
+    value_unshare(mapval);
     Map* m = mapval->as.map;
-    int idx = map_find_index(m, key);
+    size_t slot = 0;
+    ptrdiff_t idx = map_find(m, key, map_key_hash(key), &slot);
     if (idx < 0) return;
     value_free(m->items[idx].key);
     value_free(m->items[idx].value);
-    // compact
-    for (size_t i = (size_t)idx; i + 1 < m->count; i++) m->items[i] = m->items[i+1];
-    m->count--;
+
+    if (m->index) {
+        // Backward-shift deletion: pull later members of the probe run
+        // into the gap so lookups never need tombstones.
+        size_t mask = m->index_cap - 1;
+        size_t i = slot;
+        size_t j = slot;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (m->index[j].pos == 0) break;
+            size_t home = (size_t)m->index[j].hash & mask;
+            bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+            if (stays) continue;
+            m->index[i] = m->index[j];
+            i = j;
+        }
+        m->index[i].pos = 0;
+    }
+
+    if ((size_t)idx + 1 == m->count) {
+        // Trailing entry: shrink instead of leaving a hole.
+        m->count--;
+        while (m->count > 0 && m->items[m->count - 1].key.type == VAL_NULL) {
+            m->count--;
+            m->holes--;
+        }
+        return;
+    }
+    m->items[idx].key = value_null();
+    m->items[idx].value = value_null();
+    m->holes++;
+    if (m->holes * 2 > m->count) value_map_compact(m);
 }
 
 void value_map_set_self(Value* mapval, Value key) {
     if (!mapval || mapval->type != VAL_MAP) return;
+    value_unshare(mapval);
     Map* m = mapval->as.map;
-    int idx = map_find_index(m, key);
+    uint64_t hash = map_key_hash(key);
+    ptrdiff_t idx = map_find(m, key, hash, NULL);
     if (idx >= 0) {
         value_free(m->items[idx].value);
-        m->items[idx].value = value_alias(*mapval); // alias points to the same Map
+        m->items[idx].value = value_alias(mapval); // alias points to the same Map
         return;
     }
-    if (m->count + 1 > m->capacity) {
-        size_t newc = m->capacity == 0 ? 8 : m->capacity * 2;
-        m->items = realloc(m->items, sizeof(MapEntry) * newc);
-        if (!m->items) { fprintf(stderr, "Out of memory\n"); exit(1); }
-        m->capacity = newc;
-    }
-    m->items[m->count].key = value_copy(key);
-    m->items[m->count].value = value_alias(*mapval);
-    m->count++;
+    MapEntry* e = map_append(m, key, hash);
+    e->value = value_alias(mapval);
 }
 
 Value* value_map_get_ptr(Value* mapval, Value key, bool create_if_missing) {
     if (!mapval || mapval->type != VAL_MAP) return NULL;
+    value_unshare(mapval);
     Map* m = mapval->as.map;
-    int idx = map_find_index(m, key);
+    uint64_t hash = map_key_hash(key);
+    ptrdiff_t idx = map_find(m, key, hash, NULL);
     if (idx >= 0) {
         return &m->items[idx].value;
     }
     if (!create_if_missing) return NULL;
+    return &map_append(m, key, hash)->value;
+}
 
-    if (m->count + 1 > m->capacity) {
-        size_t newc = m->capacity == 0 ? 8 : m->capacity * 2;
-        m->items = realloc(m->items, sizeof(MapEntry) * newc);
-        if (!m->items) { fprintf(stderr, "Out of memory\n"); exit(1); }
-        m->capacity = newc;
+// Duplicate the Tensor container.  Packed buffers are copied wholesale;
+// boxed elements are aliased (shallow) or deep copied.
+static Tensor* tns_clone(Tensor* t, bool deep) {
+    Tensor* t2 = tns_alloc(t->elem_type, t->storage, t->ndim, t->shape);
+    if (t->storage == TNS_STORAGE_INT) {
+        tns_gather_packed(t, t2->ints);
+    } else if (t->storage == TNS_STORAGE_FLT) {
+        tns_gather_packed(t, t2->flts);
+    } else {
+        for (size_t i = 0; i < t->length; i++) {
+            // keep element references (shallow): the copy's nested
+            // containers are the same logical objects as the original's
+            t2->data[i] = deep ? value_deep_copy(t->data[i]) : value_alias(&t->data[i]);
+        }
     }
-    m->items[m->count].key = value_copy(key);
-    m->items[m->count].value = value_null();
-    m->count++;
-    return &m->items[m->count - 1].value;
+    return t2;
 }
 
-Value* value_tns_get_ptr(Value v, const size_t* idxs, size_t nidxs) {
-    if (v.type != VAL_TNS || !v.as.tns) return NULL;
-    Tensor* t = v.as.tns;
-    if (nidxs != t->ndim) return NULL;
-    size_t offset = 0;
+// Duplicate the Map container; entries are aliased (shallow) or deep
+// copied.  Holes are dropped and the index is carried over or rebuilt.
+static Map* map_clone(Map* m, bool deep) {
+    Map* m2 = pool_alloc(POOL_MAP);
+    size_t live = m->count - m->holes;
+    m2->count = 0;
+    m2->capacity = live;
+    m2->holes = 0;
+    m2->index = NULL;
+    m2->index_cap = 0;
+    m2->items = malloc(sizeof(MapEntry) * (m2->capacity ? m2->capacity : 1));
+    if (!m2->items) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    for (size_t i = 0; i < m->count; i++) {
+        if (m->items[i].key.type == VAL_NULL) continue;
+        MapEntry* e = &m2->items[m2->count++];
+        e->key = value_copy(m->items[i].key);
+        e->value = deep ? value_deep_copy(m->items[i].value) : value_alias(&m->items[i].value);
+    }
+    if (m->index && m->holes == 0) {
+        m2->index = malloc(sizeof(MapSlot) * m->index_cap);
+        if (!m2->index) { fprintf(stderr, "Out of memory\n"); exit(1); }
+        memcpy(m2->index, m->index, sizeof(MapSlot) * m->index_cap);
+        m2->index_cap = m->index_cap;
+    } else if (m2->count > MAP_INDEX_MIN) {
+        map_index_rebuild(m2, m2->count);
+    }
+    m2->refcount = 1;
+    return m2;
+}
+
+Value* value_tns_get_ptr(Value* v, const size_t* idxs, size_t nidxs) {
+    if (!v || v->type != VAL_TNS || !v->as.tns) return NULL;
+    if (nidxs != v->as.tns->ndim) return NULL;
     for (size_t i = 0; i < nidxs; i++) {
-        size_t idx = idxs[i];
-        if (idx >= t->shape[i]) return NULL;
-        offset += idx * t->strides[i];
+        if (idxs[i] >= v->as.tns->shape[i]) return NULL;
     }
+    value_unshare(v);
+    Tensor* t = v->as.tns;
+    size_t offset = 0;
+    for (size_t i = 0; i < nidxs; i++) offset += idxs[i] * t->strides[i];
+    value_tns_box(t);
     return &t->data[offset];
 }
 
-// Shallow copy semantics: increment refcount for MAP/TNS and return aliasing Value.
+// Point `out` at the buffer `t` reads (under the lock guarding it) and
+// record the references in out->pins.  `extra` adds one on `t` itself.
+static void tns_buffer_fill(TnsBuffer* out, Tensor* t, bool extra) {
+    if (extra) atomic_count_inc(&t->refcount);
+    out->pins[0] = t;
+    Tensor* base = t->base;
+    if (base) mtx_lock(&base->lock);
+    if (base && t->borrowed && extra) {
+        // The base is written in place while its sharers are only views.
+        atomic_count_inc(&base->refcount);
+        out->pins[1] = base;
+    }
+    out->elem_type = t->storage == TNS_STORAGE_INT ? TYPE_INT : TYPE_FLT;
+    out->ints = t->ints;
+    out->flts = t->flts;
+    out->ndim = t->ndim;
+    out->shape = t->shape;
+    out->steps = t->steps ? t->steps : t->strides;
+    out->length = t->length;
+    out->contiguous = t->steps == NULL;
+    if (base) mtx_unlock(&base->lock);
+}
+
+bool value_tns_acquire(Value* slot, int flags, TnsBuffer* out) {
+    memset(out, 0, sizeof(*out));
+    if (slot->type != VAL_TNS || !slot->as.tns) return false;
+    TnsStorage storage = tns_storage_for(slot->as.tns->elem_type);
+    if (storage == TNS_STORAGE_BOXED) return false;
+
+    if (flags & TNS_ACQUIRE_WRITE) {
+        value_unshare(slot);
+        Tensor* t = slot->as.tns;
+        if (!value_tns_pack(t)) return false;
+        tns_buffer_fill(out, t, true);
+        out->writable = true;
+        return true;
+    }
+
+    Tensor* t = slot->as.tns;
+    bool aliased = ref_aliased(&t->refcount);
+    if (!aliased && t->base) {
+        mtx_lock(&t->base->lock);
+        aliased = t->borrowed && ref_aliased(&t->base->refcount);
+        mtx_unlock(&t->base->lock);
+    }
+    bool copy = aliased || t->storage == TNS_STORAGE_BOXED ||
+                ((flags & TNS_ACQUIRE_CONTIGUOUS) && t->steps);
+    if (!copy) {
+        tns_buffer_fill(out, t, true);
+        return true;
+    }
+    Tensor* own;
+    if (t->storage == TNS_STORAGE_BOXED) {
+        ValueType want = storage == TNS_STORAGE_INT ? VAL_INT : VAL_FLT;
+        for (size_t i = 0; i < t->length; i++) {
+            if (t->data[i].type != want) return false;
+        }
+        own = tns_alloc(t->elem_type, storage, t->ndim, t->shape);
+        for (size_t i = 0; i < t->length; i++) {
+            if (storage == TNS_STORAGE_INT) own->ints[i] = t->data[i].as.i;
+            else own->flts[i] = t->data[i].as.f;
+        }
+    } else {
+        own = tns_clone(t, false);
+    }
+    tns_buffer_fill(out, own, false);
+    return true;
+}
+
+void value_tns_release(TnsBuffer* buf) {
+    for (size_t i = 0; i < 2; i++) {
+        if (!buf->pins[i]) continue;
+        Value v;
+        v.type = VAL_TNS;
+        v.as.tns = buf->pins[i];
+        value_free(v);
+    }
+    memset(buf, 0, sizeof(*buf));
+}
+
 Value value_copy(Value v) {
-    // New semantics: value_copy produces an atomic (de-referenced) copy for
-    // container types (TNS and MAP): the container object is duplicated so
-    // mutations to the returned value won't affect the original. Element
-    // values inside the container remain as aliases (not deep-copied).
+    // Containers are shared copy-on-write; only a container that is
+    // already aliased has to be duplicated now (see "Sharing" in value.h).
     Value out = v;
     if (v.type == VAL_STR && v.as.s) {
-        out.as.s = strdup(v.as.s);
+        str_retain(v.as.s);
     } else if (v.type == VAL_TNS && v.as.tns) {
         Tensor* t = v.as.tns;
-        // allocate new tensor structure and copy shape/strides
-        Tensor* t2 = malloc(sizeof(Tensor));
-        if (!t2) { fprintf(stderr, "Out of memory\n"); exit(1); }
-        t2->elem_type = t->elem_type;
-        t2->ndim = t->ndim;
-        t2->shape = malloc(sizeof(size_t) * t2->ndim);
-        t2->strides = malloc(sizeof(size_t) * t2->ndim);
-        for (size_t i = 0; i < t2->ndim; i++) { t2->shape[i] = t->shape[i]; t2->strides[i] = t->strides[i]; }
-        t2->length = t->length;
-        t2->data = malloc(sizeof(Value) * t2->length);
-        for (size_t i = 0; i < t2->length; i++) {
-            // keep element references (shallow): use value_alias to preserve
-            // previous element-sharing semantics for nested containers
-            extern Value value_alias(Value v);
-            t2->data[i] = value_alias(t->data[i]);
-        }
-        t2->refcount = 1;
-        mtx_init(&t2->lock, 0);
-        out.as.tns = t2;
+        if (!ref_share(&t->refcount)) out.as.tns = tns_clone(t, false);
     } else if (v.type == VAL_MAP && v.as.map) {
         Map* m = v.as.map;
-        Map* m2 = malloc(sizeof(Map));
-        if (!m2) { fprintf(stderr, "Out of memory\n"); exit(1); }
-        m2->count = m->count;
-        m2->capacity = m->count;
-        m2->items = malloc(sizeof(MapEntry) * (m2->capacity ? m2->capacity : 1));
-        for (size_t i = 0; i < m->count; i++) {
-            extern Value value_alias(Value v);
-            m2->items[i].key = value_alias(m->items[i].key);
-            m2->items[i].value = value_alias(m->items[i].value);
-        }
-        m2->refcount = 1;
-        mtx_init(&m2->lock, 0);
-        out.as.map = m2;
+        // Shared maps stay hole-free, so readers never compact a map
+        // someone else is looking at.
+        if (m->holes > 0 && !ref_aliased(&m->refcount)) value_map_compact(m);
+        if (!ref_share(&m->refcount)) out.as.map = map_clone(m, false);
     } else if (v.type == VAL_THR && v.as.thr) {
         // threads remain shared handles
-        Thr* th = v.as.thr;
-        mtx_lock(&th->state_lock);
-        th->refcount++;
-        mtx_unlock(&th->state_lock);
-        out.as.thr = th;
+        atomic_count_inc(&v.as.thr->refcount);
     }
     return out;
 }
 
-// Alias/shallow-copy helper: preserve previous semantics where MAP/TNS
-// were reference types. This function performs the former behavior of
-// `value_copy` (increment refcounts and return aliasing container).
-Value value_alias(Value v) {
-    Value out = v;
-    if (v.type == VAL_STR && v.as.s) {
-        out.as.s = strdup(v.as.s);
-    } else if (v.type == VAL_TNS && v.as.tns) {
-        Tensor* t = v.as.tns;
+void value_unshare(Value* v) {
+    if (!v) return;
+    if (v->type == VAL_TNS && v->as.tns) {
+        Tensor* t = v->as.tns;
+        // A sole reference to a tensor that is not a view has no views
+        // either (they hold references on it): nothing to do.
+        long refs = atomic_count_load(&t->refcount);
+        if (refs == 1 && !t->base) return;
+        bool shared = false;
+        if (!(refs & VALUE_ALIASED) && refs > 1) {
+            mtx_lock(&t->lock);
+            shared = ref_count(&t->refcount) - t->view_refs > 1 && !ref_aliased(&t->refcount);
+            mtx_unlock(&t->lock);
+        }
+        if (shared) {
+            Tensor* own = tns_clone(t, false);
+            value_free(*v);
+            v->as.tns = own;
+            return;
+        }
+        // Sole owner: take our own buffer, then let the views keep theirs.
+        tns_detach(t);
         mtx_lock(&t->lock);
-        t->refcount++;
+        while (t->views) tns_materialize(t->views);
         mtx_unlock(&t->lock);
-        out.as.tns = t;
-    } else if (v.type == VAL_MAP && v.as.map) {
-        Map* m = v.as.map;
-        mtx_lock(&m->lock);
-        m->refcount++;
-        mtx_unlock(&m->lock);
-        out.as.map = m;
-    } else if (v.type == VAL_THR && v.as.thr) {
-        Thr* th = v.as.thr;
-        mtx_lock(&th->state_lock);
-        th->refcount++;
-        mtx_unlock(&th->state_lock);
-        out.as.thr = th;
+    } else if (v->type == VAL_MAP && v->as.map) {
+        Map* m = v->as.map;
+        long refs = atomic_count_load(&m->refcount);
+        if ((refs & VALUE_ALIASED) || refs <= 1) return;
+        Map* own = map_clone(m, false);
+        value_free(*v);
+        v->as.map = own;
     }
-    return out;
+}
 
+Value value_alias(Value* slot) {
+    if (slot->type == VAL_TNS && slot->as.tns) {
+        value_unshare(slot);
+        ref_alias(&slot->as.tns->refcount);
+        return *slot;
+    }
+    if (slot->type == VAL_MAP && slot->as.map) {
+        value_unshare(slot);
+        ref_alias(&slot->as.map->refcount);
+        return *slot;
+    }
+    return value_copy(*slot);
 }
 
 // Deep-copy helper: recursively duplicate container contents.
 Value value_deep_copy(Value v) {
     Value out = v;
     if (v.type == VAL_STR && v.as.s) {
-        out.as.s = strdup(v.as.s);
+        // Strings are immutable, so sharing one is as good as a copy.
+        str_retain(v.as.s);
     } else if (v.type == VAL_TNS && v.as.tns) {
-        Tensor* t = v.as.tns;
-        Tensor* t2 = malloc(sizeof(Tensor));
-        if (!t2) { fprintf(stderr, "Out of memory\n"); exit(1); }
-        t2->elem_type = t->elem_type;
-        t2->ndim = t->ndim;
-        t2->shape = malloc(sizeof(size_t) * t2->ndim);
-        t2->strides = malloc(sizeof(size_t) * t2->ndim);
-        for (size_t i = 0; i < t2->ndim; i++) { t2->shape[i] = t->shape[i]; t2->strides[i] = t->strides[i]; }
-        t2->length = t->length;
-        t2->data = malloc(sizeof(Value) * t2->length);
-        for (size_t i = 0; i < t2->length; i++) t2->data[i] = value_deep_copy(t->data[i]);
-        t2->refcount = 1;
-        mtx_init(&t2->lock, 0);
-        out.as.tns = t2;
+        out.as.tns = tns_clone(v.as.tns, true);
     } else if (v.type == VAL_MAP && v.as.map) {
-        Map* m = v.as.map;
-        Map* m2 = malloc(sizeof(Map));
-        if (!m2) { fprintf(stderr, "Out of memory\n"); exit(1); }
-        m2->count = m->count;
-        m2->capacity = m->count;
-        m2->items = malloc(sizeof(MapEntry) * (m2->capacity ? m2->capacity : 1));
-        for (size_t i = 0; i < m->count; i++) {
-            m2->items[i].key = value_deep_copy(m->items[i].key);
-            m2->items[i].value = value_deep_copy(m->items[i].value);
-        }
-        m2->refcount = 1;
-        mtx_init(&m2->lock, 0);
-        out.as.map = m2;
+        out.as.map = map_clone(v.as.map, true);
     } else if (v.type == VAL_THR && v.as.thr) {
         // Threads are not deep-copyable; preserve handle semantics (share)
-        Thr* th = v.as.thr;
-        mtx_lock(&th->state_lock);
-        th->refcount++;
-        mtx_unlock(&th->state_lock);
-        out.as.thr = th;
+        atomic_count_inc(&v.as.thr->refcount);
     }
     return out;
 }
 
 void value_free(Value v) {
     if (v.type == VAL_STR) {
-        free(v.as.s);
+        if (v.as.s) str_release(v.as.s);
     } else if (v.type == VAL_TNS && v.as.tns) {
         Tensor* t = v.as.tns;
-        int free_now = 0;
-        mtx_lock(&t->lock);
-        if (--t->refcount <= 0) free_now = 1;
-        mtx_unlock(&t->lock);
-        if (free_now) {
+        if (ref_drop(&t->refcount)) {
+            Tensor* base = t->base;
+            bool borrowed = false;
+            if (base) {
+                mtx_lock(&base->lock);
+                borrowed = t->borrowed;
+                if (borrowed) {
+                    if (t->view_prev) t->view_prev->view_next = t->view_next;
+                    else base->views = t->view_next;
+                    if (t->view_next) t->view_next->view_prev = t->view_prev;
+                }
+                base->view_refs--;
+                mtx_unlock(&base->lock);
+            }
             if (t->data) {
                 for (size_t i = 0; i < t->length; i++) value_free(t->data[i]);
                 free(t->data);
             }
-            if (t->shape) free(t->shape);
-            if (t->strides) free(t->strides);
-            mtx_destroy(&t->lock);
-            free(t);
+            if (!borrowed) {
+                free(t->ints);
+                free(t->flts);
+            }
+            tns_steps_free(t, t->steps);
+            if (t->ndim > TNS_INLINE_DIMS) {
+                free(t->shape);
+                free(t->strides);
+            }
+            pool_free(POOL_TNS, t);
+            if (base) {
+                Value bv;
+                bv.type = VAL_TNS;
+                bv.as.tns = base;
+                value_free(bv);
+            }
         }
     } else if (v.type == VAL_MAP && v.as.map) {
         Map* m = v.as.map;
-        int free_now = 0;
-        mtx_lock(&m->lock);
-        if (--m->refcount <= 0) free_now = 1;
-        mtx_unlock(&m->lock);
-        if (free_now) {
+        if (ref_drop(&m->refcount)) {
             if (m->items) {
                 for (size_t i = 0; i < m->count; i++) {
                     value_free(m->items[i].key);
@@ -564,18 +1547,17 @@ void value_free(Value v) {
                 }
                 free(m->items);
             }
-            mtx_destroy(&m->lock);
-            free(m);
+            free(m->index);
+            pool_free(POOL_MAP, m);
         }
     } else if (v.type == VAL_THR && v.as.thr) {
         Thr* th = v.as.thr;
-        int free_now = 0;
-        mtx_lock(&th->state_lock);
-        if (--th->refcount <= 0) free_now = 1;
-        mtx_unlock(&th->state_lock);
-        if (free_now) {
-            mtx_destroy(&th->state_lock);
-            free(th);
+        if (atomic_count_dec(&th->refcount) <= 0) {
+            // The last reference of a running THR is its worker's, so the
+            // thread is at its end here and nobody can join it any more.
+            if (th->started && !th->joined) thrd_detach(th->thread);
+            ast_arena_release(th->arena);
+            pool_free(POOL_THR, th);
         }
     }
 }
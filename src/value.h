@@ -22,27 +22,67 @@ typedef enum {
 struct Func;
 struct Value; // forward declare Value for Tensor.data
 
+// The state flags are atomic so they can be polled without a lock; they
+// are changed under state_lock, which waiters on state_cond hold.
 typedef struct Thr {
-    int finished; // 0 = running, 1 = finished/stopped
-    int paused;
-    int refcount;
+    atomic_count_t finished; // 0 = running, 1 = finished/stopped
+    atomic_count_t paused;
+    atomic_count_t refcount;
 #if 1
-    int started;
+    atomic_count_t started;
     struct Stmt* body;
+    AstArena* arena;  // reference on the AST arena `body` lives in
     struct Env* env;
 #endif
+    atomic_count_t exited;   // the current run's OS thread has left the body
+    atomic_count_t joined;   // ... and has been joined
     mtx_t state_lock;
+    cnd_t state_cond;  // broadcast on every finished / paused / exited change
     thrd_t thread;
 } Thr;
 
+// Element storage of a Tensor.  Homogeneous INT and FLT tensors keep their
+// elements unboxed; everything else (STR, nested, mixed) uses tagged Values.
+typedef enum {
+    TNS_STORAGE_BOXED,  // `data`
+    TNS_STORAGE_INT,    // `ints` (elem_type TYPE_INT)
+    TNS_STORAGE_FLT     // `flts` (elem_type TYPE_FLT)
+} TnsStorage;
+
+// Tensors with at most this many dimensions keep shape, strides and a
+// view's steps inside the header (Tensor::dims).
+#define TNS_INLINE_DIMS 4
+
 typedef struct Tensor {
     DeclType elem_type; // element static type
+    TnsStorage storage;
     size_t ndim;
     size_t* shape;    // length ndim
     size_t* strides;  // length ndim
     size_t length;    // total elements
-    struct Value* data;      // length elements, contiguous row-major
-    int refcount;
+    // Exactly one buffer matching `storage` is in use (NULL otherwise);
+    // all are length elements, contiguous row-major.
+    struct Value* data;
+    int64_t* ints;
+    double* flts;
+    atomic_count_t refcount;  // | VALUE_ALIASED, see "Sharing" below
+    // Views.  Partial indexing and slicing of a packed tensor return a view
+    // that reads the buffer of `base` (on which it holds a reference)
+    // instead of a copy.  `steps` is NULL for a contiguous view, whose
+    // ints / flts then index like any other tensor's; otherwise steps[d]
+    // is the buffer distance between neighbours along dimension d and
+    // elements must be read with value_tns_elem().  Before a view or its
+    // base is written the view is materialized: it gets its own
+    // contiguous buffer and `borrowed` becomes false.  The view fields of
+    // a tensor and its views are guarded by base->lock.
+    struct Tensor* base;
+    bool borrowed;
+    size_t* steps;
+    struct Tensor* views;       // live (borrowed) views of this buffer
+    struct Tensor* view_prev;
+    struct Tensor* view_next;
+    int view_refs;              // references on this tensor held by views
+    size_t dims[3 * TNS_INLINE_DIMS];  // shape, strides, steps if ndim is small
     mtx_t lock;
 } Tensor;
 
@@ -64,43 +104,186 @@ typedef struct MapEntry {
     Value value;
 } MapEntry;
 
+struct MapSlot;
+
+// Entries live in `items` in insertion order.  Deleting leaves a hole
+// (an entry whose key is VAL_NULL) until the map is compacted; code that
+// walks `items` directly must call value_map_compact() first, after which
+// `count` is the number of live entries and there are no holes.
 typedef struct Map {
     MapEntry* items;
-    size_t count;
+    size_t count;           // slots of `items` in use, holes included
     size_t capacity;
-    int refcount;
-    mtx_t lock;
+    size_t holes;           // deleted entries not yet compacted away
+    // Open-addressing hash index over `items` (linear probing, deletes by
+    // backward shift).  NULL while the map is small enough to scan.
+    struct MapSlot* index;
+    size_t index_cap;       // power of two, or 0
+    atomic_count_t refcount;  // | VALUE_ALIASED, see "Sharing" below
+    mtx_t lock;             // taken by value_map_compact()
 } Map;
 
+// Container pools.  Tensor, Map and Thr headers come from one pool per
+// type.  Each thread caches a few free blocks per pool and trades them in
+// batches with a shared free list, so the temporaries of a builtin call
+// are created and freed without malloc, free or a lock.  The locks inside
+// a block are initialized once, when the block is first carved from a
+// slab, and stay initialized while it is free.  A block may be freed on
+// a different thread from the one that allocated it.  Pool memory is kept
+// for reuse and never handed back to the C heap.
+#define VALUE_POOL_COUNT 3      // TNS, MAP, THR
+
+typedef struct ValuePoolStats {
+    const char* name;
+    size_t block_size;          // bytes
+    size_t reserved;            // blocks carved from slabs so far
+    size_t refills;             // batches taken from the shared list
+    size_t flushes;             // batches given back to it
+    long live;                  // blocks in use; only counted while
+    long peak_live;             // profiling (see profile.h)
+} ValuePoolStats;
+
+void value_pool_stats(size_t pool, ValuePoolStats* out);
+// Move the calling thread's cached blocks to the shared lists.  Threads
+// that create or free Values call this before they end.
+void value_pool_thread_exit(void);
+
+// Sharing.  A Tensor or Map with more than one reference is in one of two
+// states:
+//
+// - copy-on-write (VALUE_ALIASED clear): every reference is a separate
+//   logical copy that happens to have the same contents.  value_copy()
+//   creates these, so reading a container is O(1); whoever writes first
+//   calls value_unshare() and gets a private container.
+// - aliased (VALUE_ALIASED set): every reference is the same logical
+//   container (an element shared by shallow copies, SELF) and writes are
+//   visible through all of them.  value_copy() of such a container
+//   duplicates it eagerly.
+//
+// The flag lives in the refcount word, so taking, dropping or aliasing a
+// reference is one atomic operation and never takes the container's
+// lock.  References held by views (Tensor::view_refs) do not count as
+// sharers.  The flag is cleared when the count drops back to 1.  A
+// copy-on-write shared Map never has holes (value_copy() compacts it
+// first).
+#define VALUE_ALIASED (1L << 30)
+
 // Tensor helpers
+// New tensors of TYPE_INT / TYPE_FLT are packed and zero-filled; any other
+// element type gets boxed storage filled with NULL.
 Value value_tns_new(DeclType elem_type, size_t ndim, const size_t* shape);
+// Copies `items`; packs the result when every item is a scalar of elem_type.
 Value value_tns_from_values(DeclType elem_type, size_t ndim, const size_t* shape, Value* items, size_t item_count);
+// With fewer indices than dimensions, and for slices, the result is a
+// view of a packed tensor (see Tensor) and a copy of a boxed one.
 Value value_tns_get(Value t, const size_t* idxs, size_t nidxs);
 Value value_tns_slice(Value t, const int64_t* starts, const int64_t* ends, size_t n);
 
+// Element `i` (flat row-major offset) as a borrowed Value: scalars are
+// boxed on the fly, boxed elements are returned as stored.  Do NOT free it;
+// value_copy() it to keep it.
+Value value_tns_elem(const Tensor* t, size_t i);
+// Store `v` (ownership transferred) as element `i`, releasing the old one.
+// A value that does not fit packed storage converts the tensor to boxed.
+// `t` must be writable (see value_unshare).
+void value_tns_set_elem(Tensor* t, size_t i, Value v);
+// Convert `t` to boxed storage in place (no-op if it already is).  `t`
+// must be writable.
+void value_tns_box(Tensor* t);
+// Convert a boxed INT/FLT tensor back to packed storage when every element
+// is a scalar of its element type, and materialize a strided view.
+// Returns true if `t` is packed (with flat ints / flts) afterwards.
+bool value_tns_pack(Tensor* t);
+
+// Direct access to the packed element buffer of an INT or FLT tensor, for
+// native code (extensions get it through prefix_ext_context).  Element
+// (i0, ..., iN-1) is ints / flts[i0 * steps[0] + ... + iN-1 * steps[N-1]];
+// `contiguous` means `steps` are the row-major strides.
+typedef struct TnsBuffer {
+    DeclType elem_type;    // TYPE_INT: `ints` is set; TYPE_FLT: `flts` is
+    int64_t* ints;
+    double* flts;
+    size_t ndim;
+    const size_t* shape;
+    const size_t* steps;
+    size_t length;
+    bool contiguous;
+    bool writable;
+    struct Tensor* pins[2];  // held until value_tns_release
+} TnsBuffer;
+
+#define TNS_ACQUIRE_WRITE 1       // the buffer will be written
+#define TNS_ACQUIRE_CONTIGUOUS 2  // steps must be the row-major strides
+
+// Fill *out with the buffer of tensor `*slot`; false (with *out cleared)
+// when `*slot` is not a tensor whose elements are all INT or all FLT.
+//
+// Reading: the buffer is the tensor's own when it is packed (a strided
+// view's unless TNS_ACQUIRE_CONTIGUOUS), otherwise a packed private copy.
+// Until value_tns_release the buffer stays allocated and unchanged: the
+// tensor, and the one a view reads from, count one extra sharer, so a
+// write through any reference copies first (see "Sharing").  An aliased
+// tensor is always copied, since its writes never do.
+//
+// Writing: `*slot` is unshared like any other write target (so it may be
+// replaced), packed and made contiguous; writes through the buffer are
+// what its holders see.
+bool value_tns_acquire(Value* slot, int flags, TnsBuffer* out);
+void value_tns_release(TnsBuffer* buf);
+
 // Map helpers
 Value value_map_new(void);
 void value_map_set(Value* mapval, Value key, Value val);
 Value value_map_get(Value mapval, Value key, int* found);
+// Borrowed entry for `key` (do NOT free or modify it), or NULL.
+const Value* value_map_elem(Map* m, Value key);
 void value_map_delete(Value* mapval, Value key);
 
+// Drop the holes left by value_map_delete so `items[0..count)` holds exactly
+// the live entries in insertion order.  Cheap when there are no holes.
+void value_map_compact(Map* m);
+
 // Set map entry value to an alias pointing to the map itself (SELF semantics)
 void value_map_set_self(Value* mapval, Value key);
 
 // Pointer helpers (for lvalue/indexed assignment)
+// Both unshare `*mapval` / `*t` first, so the returned slot may be written.
 // Returns a pointer to the stored value for key, optionally creating a missing entry with NULL value.
 // Returned pointer is owned by the map; do NOT free it.
 Value* value_map_get_ptr(Value* mapval, Value key, bool create_if_missing);
 
 // Returns a pointer to a tensor element for full indexing (nidxs must equal ndim).
-// Returned pointer is owned by the tensor; do NOT free it.
-Value* value_tns_get_ptr(Value t, const size_t* idxs, size_t nidxs);
+// Returned pointer is owned by the tensor; do NOT free it.  Packed tensors
+// are converted to boxed storage first.
+Value* value_tns_get_ptr(Value* t, const size_t* idxs, size_t nidxs);
 
+// String helpers
+// `as.s` of a VAL_STR points at immutable, NUL-terminated bytes preceded by
+// a hidden header holding their length, hash and reference count, so
+// value_copy() shares a string instead of duplicating it and C code can
+// still read `as.s` as a plain C string.  Never write through or free()
+// `as.s`.  The empty string and every one-byte string are preallocated;
+// they and interned strings are never freed.
+Value value_str(const char* s);
+// The first `len` bytes of `s` (which need not be NUL-terminated).
+Value value_str_n(const char* s, size_t len);
+// A new string of `len` bytes, NUL-terminated, whose contents the caller
+// fills through `*out` before the value is used anywhere else.
+Value value_str_alloc(size_t len, char** out);
+// Length and (FNV-1a, cached) hash of a VAL_STR's `as.s`, in O(1).
+size_t value_str_len(const char* s);
+uint64_t value_str_hash(const char* s);
+// Equality of two VAL_STR `as.s`: pointer, then length and hash, then bytes.
+bool value_str_eq(const char* a, const char* b);
+// Canonical copy of `s`: equal strings intern to the same pointer, which is
+// never freed.  Used for identifier names and string literals.
+const char* value_str_intern(const char* s);
+// A VAL_STR sharing an interned string (no copy).
+Value value_str_interned(const char* interned);
 
 Value value_null(void);
 Value value_int(int64_t v);
 Value value_flt(double v);
-Value value_str(const char* s);
 Value value_func(struct Func* func);
 Value value_thr_new(void);
 int value_thr_is_running(Value v);
@@ -108,12 +291,42 @@ void value_thr_set_finished(Value v, int finished);
 int value_thr_get_finished(Value v);
 void value_thr_set_paused(Value v, int paused);
 int value_thr_get_paused(Value v);
+// Setting `started` to 1 begins a new run: an earlier run's thread that was
+// never joined is detached.  Call it just before creating the thread.
 void value_thr_set_started(Value v, int started);
 int value_thr_get_started(Value v);
+// Called by the worker as it leaves the body: marks the THR finished and
+// exited and wakes every waiter.
+void value_thr_set_exited(Value v);
+// Block the calling thread while `v` is paused and not finished.
+void value_thr_wait_unpaused(Value v);
+// Block until the run of `v` has exited (a THR that was never started
+// counts as exited), for at most `seconds` when it is >= 0.  The exited
+// thread is joined.  Returns 1 when it exited, 0 on timeout.
+int value_thr_await(Value v, double seconds);
+// The same over `count` THRs: wait until every one (`all`) or at least one
+// of them has exited.  Returns 1 when that happened, 0 on timeout.
+int value_thr_await_many(const Value* thrs, size_t count, bool all, double seconds);
+int value_thr_get_exited(Value v);
+// Must run once before the first value_thr_await_many.
+void value_thr_init(void);
+// Record the body a THR runs (and RESTART reruns), keeping its AST arena
+// alive for as long as the THR.
+void value_thr_set_body(Value v, struct Stmt* body);
 // Note: pointer semantics are implemented at the EnvEntry (alias) level; no PTR Value type.
 
+// Logical shallow copy: TNS / MAP are shared copy-on-write, elements of
+// the copy alias the original's.
 Value value_copy(Value v);
-Value value_alias(Value v);
+// Another reference to the same logical container as `*slot`.  A
+// copy-on-write shared container in `*slot` is first replaced by a private
+// copy, so the alias stays out of the other copies.
+Value value_alias(Value* slot);
+// Make `*v` safe to modify in place: a copy-on-write shared TNS / MAP is
+// replaced by a private shallow copy, and a tensor's views (its own, if
+// it is one, and those of its buffer) are materialized.  No-op for
+// anything else.
+void value_unshare(Value* v);
 Value value_deep_copy(Value v);
 void value_free(Value v);
 
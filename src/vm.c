@@ -0,0 +1,918 @@
+/*
+ * vm.c – Bytecode compiler and register VM for the -vm engine.
+ *
+ * A compiled block is a flat array of fixed-size instructions
+ *
+ *     op (16 bits) | a (16 bits) | b (32 bits) | c (32 bits)
+ *
+ * where `a` is usually a register, `b` an index into the block's
+ * reference table (the Stmt / Expr nodes an instruction needs for names,
+ * SlotRefs and error locations) and `c` a second register or a jump
+ * target.  Each expression is compiled to write its result into one
+ * register; temporaries are allocated stack-wise above it, so the
+ * arguments of a builtin call land in consecutive registers and are
+ * passed to BuiltinFunction.impl in place.
+ *
+ * Loops keep their break / continue targets on a small per-call loop
+ * stack.  This mirrors the tree walker's ExecResult protocol: BREAK(n)
+ * and CONTINUE that reach past the loops of this block (or come back
+ * from a fallback statement) unwind the local loops and leave vm_exec
+ * with EXEC_BREAK / EXEC_CONTINUE, exactly as exec_stmt_list would.
+ *
+ * Anything without a dedicated opcode is executed through OP_EXEC
+ * (exec_stmt) or OP_EVAL (eval_expr).  Blocks nested in such a fallback
+ * are compiled as separate roots, so the tree walker hands them back to
+ * the VM when it reaches them.
+ */
+
+#include "vm.h"
+#include "builtins.h"
+#include "optimizer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define strdup _strdup
+#endif
+
+// Computed-goto dispatch where the compiler supports it (GCC, Clang);
+// MSVC falls back to a switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+#define VM_MAX_REGS 0xFFFFu
+#define VM_INLINE_REGS 32
+#define VM_INLINE_LOOPS 8
+
+#define VM_OPCODES(X) \
+    X(OP_STEP)      /* a: pause check, b: Stmt -- trace_log_step */        \
+    X(OP_EXEC)      /* a: pause check, b: Stmt -- run on the tree walker */ \
+    X(OP_LOADI)     /* a: dst, b/c: low/high word of the INT */             \
+    X(OP_LOADF)     /* a: dst, b/c: low/high word of the FLT bits */        \
+    X(OP_LOADS)     /* a: dst, b: EXPR_STR */                               \
+    X(OP_GETVAR)    /* a: dst, b: EXPR_IDENT */                             \
+    X(OP_EVAL)      /* a: dst, b: Expr -- eval_expr */                      \
+    X(OP_CALLB)     /* a: dst, b: call site, c: first argument register */  \
+    X(OP_CALLT)     /* OP_CALLB of a call with a CallTyped fast path */     \
+    X(OP_DROP)      /* a: register to free */                               \
+    X(OP_ASSIGN)    /* a: value, b: STMT_ASSIGN */                          \
+    X(OP_JMP)       /* b: target */                                         \
+    X(OP_JMPF)      /* a: condition, b: target if falsy */                  \
+    X(OP_LOOP)      /* b: break target, c: continue target */               \
+    X(OP_ENDLOOP)                                                           \
+    X(OP_FORPREP)   /* a: limit (a + 1: counter), b: STMT_FOR */            \
+    X(OP_FORNEXT)   /* a: limit, b: STMT_FOR, c: exit target */             \
+    X(OP_BREAK)     /* a: count, b: STMT_BREAK */                           \
+    X(OP_CONTINUE)  /* b: STMT_CONTINUE */                                  \
+    X(OP_RETURN)    /* a: value */                                          \
+    X(OP_END)
+
+#define VM_ENUM(name) name,
+typedef enum { VM_OPCODES(VM_ENUM) VM_OP_COUNT } VmOp;
+#undef VM_ENUM
+
+typedef struct {
+    uint16_t op;
+    uint16_t a;
+    uint32_t b;
+    uint32_t c;
+} VmInstr;
+
+// A builtin call resolved at compile time.
+typedef struct {
+    BuiltinFunction* fn;
+    Expr* expr;          // the EXPR_CALL (arg nodes, name, location)
+} VmCall;
+
+struct VmCode {
+    VmInstr* code;
+    size_t count;
+    void** refs;
+    size_t nrefs;
+    VmCall* calls;
+    size_t ncalls;
+    uint32_t nregs;
+    uint32_t nloops;     // deepest loop nesting inside the block
+};
+
+typedef struct {
+    uint32_t brk;
+    uint32_t cont;
+} VmLoop;
+
+static bool g_vm_enabled = false;
+
+void vm_set_enabled(bool enabled) {
+    g_vm_enabled = enabled;
+}
+
+bool vm_enabled(void) {
+    return g_vm_enabled;
+}
+
+void vm_code_free(VmCode* code) {
+    if (!code) return;
+    free(code->code);
+    free(code->refs);
+    free(code->calls);
+    free(code);
+}
+
+// ============ Compiler ============
+
+typedef struct {
+    VmInstr* code;
+    size_t count, cap;
+    void** refs;
+    size_t nrefs, refs_cap;
+    VmCall* calls;
+    size_t ncalls, calls_cap;
+    uint32_t top;        // first free register
+    uint32_t nregs;
+    uint32_t loops;
+    uint32_t max_loops;
+    bool failed;
+} VmCompiler;
+
+static void compile_root(Stmt* stmt);
+static void scan_stmt(Stmt* stmt);
+static void scan_expr(Expr* expr);
+static void compile_stmt(VmCompiler* c, Stmt* stmt, bool pause);
+
+static void* vm_grow(void* items, size_t* cap, size_t need, size_t elem) {
+    if (need <= *cap) return items;
+    size_t new_cap = *cap ? *cap * 2 : 16;
+    while (new_cap < need) new_cap *= 2;
+    void* grown = realloc(items, new_cap * elem);
+    if (!grown) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    *cap = new_cap;
+    return grown;
+}
+
+static uint32_t emit(VmCompiler* c, VmOp op, uint32_t a, uint32_t b, uint32_t cc) {
+    c->code = vm_grow(c->code, &c->cap, c->count + 1, sizeof(VmInstr));
+    VmInstr* in = &c->code[c->count];
+    in->op = (uint16_t)op;
+    in->a = (uint16_t)a;
+    in->b = b;
+    in->c = cc;
+    return (uint32_t)c->count++;
+}
+
+static uint32_t here(VmCompiler* c) {
+    return (uint32_t)c->count;
+}
+
+static uint32_t add_ref(VmCompiler* c, void* node) {
+    c->refs = vm_grow(c->refs, &c->refs_cap, c->nrefs + 1, sizeof(void*));
+    c->refs[c->nrefs] = node;
+    return (uint32_t)c->nrefs++;
+}
+
+static uint32_t reg_alloc(VmCompiler* c) {
+    if (c->top >= VM_MAX_REGS) {
+        c->failed = true;
+        return 0;
+    }
+    uint32_t r = c->top++;
+    if (c->top > c->nregs) c->nregs = c->top;
+    return r;
+}
+
+static bool block_has_gotopoint(Stmt* block) {
+    for (size_t i = 0; i < block->as.block.count; i++) {
+        if (block->as.block.items[i]->type == STMT_GOTOPOINT) return true;
+    }
+    return false;
+}
+
+
+static void compile_expr(VmCompiler* c, Expr* expr, uint32_t dst) {
+    if (!expr) {
+        emit(c, OP_EVAL, dst, add_ref(c, NULL), 0);
+        return;
+    }
+    switch (expr->type) {
+        case EXPR_INT: {
+            uint64_t bits = (uint64_t)expr->as.int_value;
+            emit(c, OP_LOADI, dst, (uint32_t)bits, (uint32_t)(bits >> 32));
+            return;
+        }
+        case EXPR_FLT: {
+            uint64_t bits;
+            memcpy(&bits, &expr->as.flt_value, sizeof(bits));
+            emit(c, OP_LOADF, dst, (uint32_t)bits, (uint32_t)(bits >> 32));
+            return;
+        }
+        case EXPR_STR:
+            emit(c, OP_LOADS, dst, add_ref(c, expr), 0);
+            return;
+        case EXPR_IDENT:
+            emit(c, OP_GETVAR, dst, add_ref(c, expr), 0);
+            return;
+        case EXPR_CALL: {
+            Expr* callee = expr->as.call.callee;
+            BuiltinFunction* fn = NULL;
+            // Builtins with unevaluated (quoted) arguments inspect their
+            // nodes and stay on the eval_expr path.
+            if (callee->type == EXPR_IDENT && expr->as.call.kw_count == 0) {
+                fn = builtin_lookup_call(expr);
+                if (fn && expr->as.call.quote_mask) fn = NULL;
+            }
+            if (!fn) break;
+
+            size_t argc = expr->as.call.args.count;
+            uint32_t base = c->top;
+            for (size_t i = 0; i < argc; i++) {
+                uint32_t r = reg_alloc(c);
+                if (c->failed) return;
+                compile_expr(c, expr->as.call.args.items[i], r);
+            }
+            c->top = base;
+
+            c->calls = vm_grow(c->calls, &c->calls_cap, c->ncalls + 1, sizeof(VmCall));
+            c->calls[c->ncalls].fn = fn;
+            c->calls[c->ncalls].expr = expr;
+            emit(c, expr->as.call.typed_op ? OP_CALLT : OP_CALLB, dst, (uint32_t)c->ncalls++, base);
+            return;
+        }
+        default:
+            break;
+    }
+    emit(c, OP_EVAL, dst, add_ref(c, expr), 0);
+    scan_expr(expr);
+}
+
+// Compile `expr` into a fresh temporary and return it; release with
+// `c->top = r` once consumed.
+static uint32_t compile_temp(VmCompiler* c, Expr* expr) {
+    uint32_t r = reg_alloc(c);
+    if (!c->failed) compile_expr(c, expr, r);
+    return r;
+}
+
+static void compile_fallback(VmCompiler* c, Stmt* stmt, bool pause) {
+    emit(c, OP_EXEC, pause ? 1u : 0u, add_ref(c, stmt), 0);
+    scan_stmt(stmt);
+}
+
+static void compile_if(VmCompiler* c, Stmt* stmt) {
+    uint32_t* exits = malloc(sizeof(uint32_t) * (stmt->as.if_stmt.elif_conditions.count + 1));
+    if (!exits) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    size_t nexits = 0;
+
+    uint32_t r = compile_temp(c, stmt->as.if_stmt.condition);
+    uint32_t skip = emit(c, OP_JMPF, r, 0, 0);
+    c->top = r;
+    compile_stmt(c, stmt->as.if_stmt.then_branch, false);
+    exits[nexits++] = emit(c, OP_JMP, 0, 0, 0);
+    c->code[skip].b = here(c);
+
+    for (size_t i = 0; i < stmt->as.if_stmt.elif_conditions.count; i++) {
+        r = compile_temp(c, stmt->as.if_stmt.elif_conditions.items[i]);
+        skip = emit(c, OP_JMPF, r, 0, 0);
+        c->top = r;
+        compile_stmt(c, stmt->as.if_stmt.elif_blocks.items[i], false);
+        exits[nexits++] = emit(c, OP_JMP, 0, 0, 0);
+        c->code[skip].b = here(c);
+    }
+
+    if (stmt->as.if_stmt.else_branch) compile_stmt(c, stmt->as.if_stmt.else_branch, false);
+    for (size_t i = 0; i < nexits; i++) c->code[exits[i]].b = here(c);
+    free(exits);
+}
+
+static void loop_begin(VmCompiler* c) {
+    c->loops++;
+    if (c->loops > c->max_loops) c->max_loops = c->loops;
+}
+
+static void compile_while(VmCompiler* c, Stmt* stmt) {
+    uint32_t loop = emit(c, OP_LOOP, 0, 0, 0);
+    loop_begin(c);
+    uint32_t cond = here(c);
+    uint32_t r = compile_temp(c, stmt->as.while_stmt.condition);
+    uint32_t exit = emit(c, OP_JMPF, r, 0, 0);
+    c->top = r;
+    compile_stmt(c, stmt->as.while_stmt.body, false);
+    emit(c, OP_JMP, 0, cond, 0);
+    c->code[exit].b = here(c);
+    emit(c, OP_ENDLOOP, 0, 0, 0);
+    c->loops--;
+    c->code[loop].b = here(c);
+    c->code[loop].c = cond;
+}
+
+static void compile_for(VmCompiler* c, Stmt* stmt) {
+    uint32_t loop = emit(c, OP_LOOP, 0, 0, 0);
+    loop_begin(c);
+    uint32_t limit = reg_alloc(c);
+    (void)reg_alloc(c); // counter
+    if (c->failed) return;
+    compile_expr(c, stmt->as.for_stmt.target, limit);
+    uint32_t ref = add_ref(c, stmt);
+    emit(c, OP_FORPREP, limit, ref, 0);
+    uint32_t next = emit(c, OP_FORNEXT, limit, ref, 0);
+    compile_stmt(c, stmt->as.for_stmt.body, false);
+    emit(c, OP_JMP, 0, next, 0);
+    c->code[next].c = here(c);
+    emit(c, OP_ENDLOOP, 0, 0, 0);
+    c->top = limit;
+    c->loops--;
+    c->code[loop].b = here(c);
+    c->code[loop].c = next;
+}
+
+// Mirror of exec_stmt: every statement logs a trace step (and, inside a
+// statement list, first waits while the thread is paused).
+static void compile_stmt(VmCompiler* c, Stmt* stmt, bool pause) {
+    if (!stmt || c->failed) return;
+    switch (stmt->type) {
+        case STMT_BLOCK:
+            if (block_has_gotopoint(stmt)) break;
+            emit(c, OP_STEP, pause ? 1u : 0u, add_ref(c, stmt), 0);
+            for (size_t i = 0; i < stmt->as.block.count; i++) {
+                compile_stmt(c, stmt->as.block.items[i], true);
+            }
+            return;
+
+        case STMT_EXPR: {
+            emit(c, OP_STEP, pause ? 1u : 0u, add_ref(c, stmt), 0);
+            uint32_t r = compile_temp(c, stmt->as.expr_stmt.expr);
+            emit(c, OP_DROP, r, 0, 0);
+            c->top = r;
+            return;
+        }
+
+        case STMT_ASSIGN: {
+            Expr* value = stmt->as.assign.value;
+            if (value && value->type == EXPR_PTR && !stmt->as.assign.target) break;
+            emit(c, OP_STEP, pause ? 1u : 0u, add_ref(c, stmt), 0);
+            uint32_t r = compile_temp(c, value);
+            emit(c, OP_ASSIGN, r, add_ref(c, stmt), 0);
+            c->top = r;
+            scan_expr(stmt->as.assign.target);
+            return;
+        }
+
+        case STMT_IF:
+            emit(c, OP_STEP, pause ? 1u : 0u, add_ref(c, stmt), 0);
+            compile_if(c, stmt);
+            return;
+
+        case STMT_WHILE:
+            emit(c, OP_STEP, pause ? 1u : 0u, add_ref(c, stmt), 0);
+            compile_while(c, stmt);
+            return;
+
+        case STMT_FOR:
+            emit(c, OP_STEP, pause ? 1u : 0u, add_ref(c, stmt), 0);
+            compile_for(c, stmt);
+            return;
+
+        case STMT_RETURN: {
+            emit(c, OP_STEP, pause ? 1u : 0u, add_ref(c, stmt), 0);
+            uint32_t r = compile_temp(c, stmt->as.return_stmt.value);
+            emit(c, OP_RETURN, r, 0, 0);
+            c->top = r;
+            return;
+        }
+
+        case STMT_BREAK: {
+            emit(c, OP_STEP, pause ? 1u : 0u, add_ref(c, stmt), 0);
+            uint32_t r = compile_temp(c, stmt->as.break_stmt.value);
+            emit(c, OP_BREAK, r, add_ref(c, stmt), 0);
+            c->top = r;
+            return;
+        }
+
+        case STMT_CONTINUE:
+            emit(c, OP_STEP, pause ? 1u : 0u, add_ref(c, stmt), 0);
+            emit(c, OP_CONTINUE, 0, add_ref(c, stmt), 0);
+            return;
+
+        default:
+            break;
+    }
+    compile_fallback(c, stmt, pause);
+}
+
+// Compile a block the tree walker enters through exec_stmt /
+// exec_program_in_env.  Anything else it can reach is scanned for such
+// blocks instead.
+static void compile_root(Stmt* stmt) {
+    if (!stmt) return;
+    if (stmt->type != STMT_BLOCK || block_has_gotopoint(stmt)) {
+        scan_stmt(stmt);
+        return;
+    }
+    if (stmt->code) return;
+
+    VmCompiler c;
+    memset(&c, 0, sizeof(c));
+    for (size_t i = 0; i < stmt->as.block.count; i++) {
+        compile_stmt(&c, stmt->as.block.items[i], true);
+    }
+    emit(&c, OP_END, 0, 0, 0);
+
+    if (c.failed) {
+        free(c.code);
+        free(c.refs);
+        free(c.calls);
+        return;
+    }
+
+    VmCode* code = malloc(sizeof(VmCode));
+    if (!code) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    code->code = c.code;
+    code->count = c.count;
+    code->refs = c.refs;
+    code->nrefs = c.nrefs;
+    code->calls = c.calls;
+    code->ncalls = c.ncalls;
+    code->nregs = c.nregs;
+    code->nloops = c.max_loops;
+    stmt->code = code;
+}
+
+static void scan_expr_list(ExprList* list) {
+    for (size_t i = 0; i < list->count; i++) scan_expr(list->items[i]);
+}
+
+static void scan_params(ParamList* params) {
+    for (size_t i = 0; i < params->count; i++) scan_expr(params->items[i].default_value);
+}
+
+// Find the blocks below an expression that eval_expr evaluates itself.
+static void scan_expr(Expr* expr) {
+    if (!expr) return;
+    switch (expr->type) {
+        case EXPR_LAMBDA:
+            scan_params(&expr->as.lambda.params);
+            compile_root(expr->as.lambda.body);
+            break;
+        case EXPR_ASYNC:
+            compile_root(expr->as.async.block);
+            break;
+        case EXPR_CALL:
+            scan_expr(expr->as.call.callee);
+            scan_expr_list(&expr->as.call.args);
+            scan_expr_list(&expr->as.call.kw_args);
+            break;
+        case EXPR_INDEX:
+            scan_expr(expr->as.index.target);
+            scan_expr_list(&expr->as.index.indices);
+            break;
+        case EXPR_RANGE:
+            scan_expr(expr->as.range.start);
+            scan_expr(expr->as.range.end);
+            break;
+        case EXPR_MAP:
+            scan_expr_list(&expr->as.map_items.keys);
+            scan_expr_list(&expr->as.map_items.values);
+            break;
+        case EXPR_TNS:
+            scan_expr_list(&expr->as.tns_items);
+            break;
+        default:
+            break;
+    }
+}
+
+// Find the blocks below a statement that exec_stmt executes itself.
+static void scan_stmt(Stmt* stmt) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case STMT_BLOCK:
+            for (size_t i = 0; i < stmt->as.block.count; i++) compile_root(stmt->as.block.items[i]);
+            break;
+        case STMT_EXPR:
+            scan_expr(stmt->as.expr_stmt.expr);
+            break;
+        case STMT_ASSIGN:
+            scan_expr(stmt->as.assign.target);
+            scan_expr(stmt->as.assign.value);
+            break;
+        case STMT_IF:
+            scan_expr(stmt->as.if_stmt.condition);
+            compile_root(stmt->as.if_stmt.then_branch);
+            for (size_t i = 0; i < stmt->as.if_stmt.elif_conditions.count; i++) {
+                scan_expr(stmt->as.if_stmt.elif_conditions.items[i]);
+                compile_root(stmt->as.if_stmt.elif_blocks.items[i]);
+            }
+            compile_root(stmt->as.if_stmt.else_branch);
+            break;
+        case STMT_WHILE:
+            scan_expr(stmt->as.while_stmt.condition);
+            compile_root(stmt->as.while_stmt.body);
+            break;
+        case STMT_FOR:
+            scan_expr(stmt->as.for_stmt.target);
+            compile_root(stmt->as.for_stmt.body);
+            break;
+        case STMT_PARFOR:
+            scan_expr(stmt->as.parfor_stmt.target);
+            compile_root(stmt->as.parfor_stmt.body);
+            break;
+        case STMT_FUNC:
+            scan_params(&stmt->as.func_stmt.params);
+            compile_root(stmt->as.func_stmt.body);
+            break;
+        case STMT_RETURN:
+            scan_expr(stmt->as.return_stmt.value);
+            break;
+        case STMT_BREAK:
+            scan_expr(stmt->as.break_stmt.value);
+            break;
+        case STMT_ASYNC:
+            compile_root(stmt->as.async_stmt.body);
+            break;
+        case STMT_THR:
+            compile_root(stmt->as.thr_stmt.body);
+            break;
+        case STMT_TRY:
+            compile_root(stmt->as.try_stmt.try_block);
+            compile_root(stmt->as.try_stmt.catch_block);
+            break;
+        case STMT_GOTO:
+            scan_expr(stmt->as.goto_stmt.target);
+            break;
+        case STMT_GOTOPOINT:
+            scan_expr(stmt->as.gotopoint_stmt.target);
+            break;
+        default:
+            break;
+    }
+}
+
+void vm_compile_program(Stmt* program) {
+    compile_root(program);
+}
+
+// ============ Interpreter loop ============
+
+static ExecResult vm_result(ExecStatus status) {
+    ExecResult res;
+    res.status = status;
+    res.value = value_null();
+    res.break_count = 0;
+    res.jump_index = -1;
+    res.error = NULL;
+    res.error_line = 0;
+    res.error_column = 0;
+    return res;
+}
+
+static ExecResult vm_error(const char* msg, int line, int col) {
+    ExecResult res = vm_result(EXEC_ERROR);
+    res.error = strdup(msg);
+    res.error_line = line;
+    res.error_column = col;
+    return res;
+}
+
+// Move the pending expression error out of `interp`, like exec_stmt does.
+static ExecResult vm_take_error(Interpreter* interp) {
+    ExecResult res = vm_error(interp->error, interp->error_line, interp->error_col);
+    free(interp->error);
+    interp->error = NULL;
+    interp->error_line = 0;
+    interp->error_col = 0;
+    return res;
+}
+
+static Value vm_call_builtin(Interpreter* interp, const VmCall* call, Value* args, Env* env) {
+    Expr* expr = call->expr;
+    BuiltinFunction* fn = call->fn;
+    int argc = (int)expr->as.call.args.count;
+
+    if (argc < fn->min_args || (fn->max_args >= 0 && argc > fn->max_args)) {
+        char buf[128];
+        if (argc < fn->min_args) {
+            snprintf(buf, sizeof(buf), "%s expects at least %d arguments", expr->as.call.callee->as.ident, fn->min_args);
+        } else {
+            snprintf(buf, sizeof(buf), "%s expects at most %d arguments", expr->as.call.callee->as.ident, fn->max_args);
+        }
+        interp->error = strdup(buf);
+        interp->error_line = expr->line;
+        interp->error_col = expr->column;
+        return value_null();
+    }
+
+    if (g_profile_enabled) {
+        profile_enter(fn->name, true);
+        Value out = argc == 0 ? fn->impl(interp, NULL, 0, NULL, env, expr->line, expr->column)
+                              : fn->impl(interp, args, argc, expr->as.call.args.items, env, expr->line, expr->column);
+        profile_exit();
+        return out;
+    }
+    if (argc == 0) return fn->impl(interp, NULL, 0, NULL, env, expr->line, expr->column);
+    return fn->impl(interp, args, argc, expr->as.call.args.items, env, expr->line, expr->column);
+}
+
+#if VM_COMPUTED_GOTO
+#define VM_LABEL(name) &&lbl_##name,
+#define VM_CASE(name) lbl_##name:
+#define VM_NEXT() do { in = ip++; goto *dispatch[in->op]; } while (0)
+#define VM_DISPATCH() VM_NEXT();
+#else
+#define VM_CASE(name) case name:
+#define VM_NEXT() goto vm_dispatch
+#define VM_DISPATCH() vm_dispatch: in = ip++; switch ((VmOp)in->op) {
+#endif
+
+ExecResult vm_exec(Interpreter* interp, Stmt* block, Env* env, LabelMap* labels) {
+    const VmCode* code = block->code;
+    Value reg_buf[VM_INLINE_REGS];
+    VmLoop loop_buf[VM_INLINE_LOOPS];
+    Value* regs = reg_buf;
+    VmLoop* loops = loop_buf;
+    if (code->nregs > VM_INLINE_REGS) {
+        regs = malloc(sizeof(Value) * code->nregs);
+    }
+    if (code->nloops > VM_INLINE_LOOPS) {
+        loops = malloc(sizeof(VmLoop) * code->nloops);
+    }
+    if (!regs || !loops) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < code->nregs; i++) regs[i] = value_null();
+
+    uint32_t nloops = 0;
+    uint32_t breaks = 0;
+    ExecResult res = vm_result(EXEC_OK);
+    const VmInstr* base = code->code;
+    const VmInstr* ip = base;
+    const VmInstr* in;
+
+#if VM_COMPUTED_GOTO
+    static const void* const dispatch[VM_OP_COUNT] = { VM_OPCODES(VM_LABEL) };
+#endif
+
+    VM_DISPATCH()
+
+    VM_CASE(OP_STEP) {
+        if (in->a) wait_if_paused(interp);
+        trace_log_step(interp, (Stmt*)code->refs[in->b], env);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_EXEC) {
+        if (in->a) wait_if_paused(interp);
+        res = exec_stmt(interp, (Stmt*)code->refs[in->b], env, labels);
+        switch (res.status) {
+            case EXEC_OK:
+                VM_NEXT();
+            case EXEC_BREAK:
+                breaks = (uint32_t)res.break_count;
+                goto do_break;
+            case EXEC_CONTINUE:
+                goto do_continue;
+            default:
+                goto leave;
+        }
+    }
+
+    VM_CASE(OP_LOADI) {
+        regs[in->a] = value_int((int64_t)((uint64_t)in->b | ((uint64_t)in->c << 32)));
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_LOADF) {
+        uint64_t bits = (uint64_t)in->b | ((uint64_t)in->c << 32);
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        regs[in->a] = value_flt(d);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_LOADS) {
+        regs[in->a] = value_str_interned(((Expr*)code->refs[in->b])->as.str_value);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_GETVAR) {
+        Expr* e = (Expr*)code->refs[in->b];
+        DeclType dtype;
+        bool initialized;
+        if (!env_get_ref(env, e->as.ident, &e->ref, &regs[in->a], &dtype, &initialized)) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "Undefined identifier '%s'", e->as.ident);
+            res = vm_error(buf, e->line, e->column);
+            regs[in->a] = value_null();
+            goto leave;
+        }
+        if (!initialized) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "Identifier '%s' declared but not initialized", e->as.ident);
+            res = vm_error(buf, e->line, e->column);
+            value_free(regs[in->a]);
+            regs[in->a] = value_null();
+            goto leave;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_EVAL) {
+        regs[in->a] = eval_expr(interp, (Expr*)code->refs[in->b], env);
+        if (interp->error) goto expr_error;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_CALLT) {
+        // Both arguments are INT or FLT when the fast path applies, so the
+        // registers own nothing.  Otherwise (or while profiling) this is a
+        // plain builtin call.
+        Value* args = &regs[in->c];
+        if (!g_profile_enabled &&
+            call_typed_apply(code->calls[in->b].expr->as.call.typed_op, args[0], args[1], &regs[in->a])) {
+            args[0] = value_null();
+            args[1] = value_null();
+            VM_NEXT();
+        }
+        goto call_builtin;
+    }
+
+    VM_CASE(OP_CALLB) {
+    call_builtin:;
+        const VmCall* call = &code->calls[in->b];
+        Value* args = &regs[in->c];
+        Value out = vm_call_builtin(interp, call, args, env);
+        size_t argc = call->expr->as.call.args.count;
+        for (size_t i = 0; i < argc; i++) {
+            value_free(args[i]);
+            args[i] = value_null();
+        }
+        regs[in->a] = out;
+        if (interp->error) goto expr_error;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_DROP) {
+        value_free(regs[in->a]);
+        regs[in->a] = value_null();
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_ASSIGN) {
+        Value v = regs[in->a];
+        regs[in->a] = value_null();
+        res = exec_assign_value(interp, (Stmt*)code->refs[in->b], env, v);
+        if (res.status == EXEC_ERROR) goto leave;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_JMP) {
+        ip = base + in->b;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_JMPF) {
+        int truthy = value_truthiness(regs[in->a]);
+        value_free(regs[in->a]);
+        regs[in->a] = value_null();
+        if (!truthy) ip = base + in->b;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_LOOP) {
+        loops[nloops].brk = in->b;
+        loops[nloops].cont = in->c;
+        nloops++;
+        interp->loop_depth++;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_ENDLOOP) {
+        nloops--;
+        interp->loop_depth--;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_FORPREP) {
+        Stmt* s = (Stmt*)code->refs[in->b];
+        if (regs[in->a].type != VAL_INT) {
+            res = vm_error("FOR target must be INT", s->line, s->column);
+            goto leave;
+        }
+        regs[in->a + 1] = value_int(0);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_FORNEXT) {
+        int64_t idx = ++regs[in->a + 1].as.i;
+        if (idx > regs[in->a].as.i) {
+            ip = base + in->c;
+            VM_NEXT();
+        }
+        Stmt* s = (Stmt*)code->refs[in->b];
+        if (idx > 100000) {
+            res = vm_error("Infinite loop detected", s->line, s->column);
+            goto leave;
+        }
+        if (!env_assign_ref(env, s->as.for_stmt.counter, &s->as.for_stmt.ref, value_int(idx), TYPE_INT, true)) {
+            char buf[256];
+            snprintf(buf, sizeof(buf), "Cannot assign to frozen identifier '%s'", s->as.for_stmt.counter);
+            res = vm_error(buf, s->line, s->column);
+            goto leave;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_BREAK) {
+        Stmt* s = (Stmt*)code->refs[in->b];
+        Value v = regs[in->a];
+        regs[in->a] = value_null();
+        if (v.type != VAL_INT) {
+            value_free(v);
+            res = vm_error("BREAK requires INT argument", s->line, s->column);
+            goto leave;
+        }
+        if (v.as.i <= 0) {
+            res = vm_error("BREAK count must be > 0", s->line, s->column);
+            goto leave;
+        }
+        if (v.as.i > interp->loop_depth) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "BREAK count %lld exceeds current loop nesting depth %d", (long long)v.as.i, interp->loop_depth);
+            res = vm_error(buf, s->line, s->column);
+            goto leave;
+        }
+        breaks = (uint32_t)v.as.i;
+        goto do_break;
+    }
+
+    VM_CASE(OP_CONTINUE) {
+        if (interp->loop_depth == 0) {
+            Stmt* s = (Stmt*)code->refs[in->b];
+            res = vm_error("CONTINUE used outside loop", s->line, s->column);
+            goto leave;
+        }
+        goto do_continue;
+    }
+
+    VM_CASE(OP_RETURN) {
+        res = vm_result(EXEC_RETURN);
+        res.value = regs[in->a];
+        regs[in->a] = value_null();
+        goto leave;
+    }
+
+    VM_CASE(OP_END) {
+        goto leave;
+    }
+
+#if !VM_COMPUTED_GOTO
+    default:
+        goto leave;
+    }
+#endif
+
+do_break:
+    // BREAK(n) leaves n loops; the ones outside this block are left by
+    // whoever receives the EXEC_BREAK.
+    if (breaks <= nloops) {
+        nloops -= breaks;
+        interp->loop_depth -= (int)breaks;
+        ip = base + loops[nloops].brk;
+        res = vm_result(EXEC_OK);
+        VM_NEXT();
+    }
+    res = vm_result(EXEC_BREAK);
+    res.break_count = (int)(breaks - nloops);
+    goto leave;
+
+do_continue:
+    if (nloops > 0) {
+        ip = base + loops[nloops - 1].cont;
+        res = vm_result(EXEC_OK);
+        VM_NEXT();
+    }
+    res = vm_result(EXEC_CONTINUE);
+    goto leave;
+
+expr_error:
+    res = vm_take_error(interp);
+
+leave:
+    interp->loop_depth -= (int)nloops;
+    for (uint32_t i = 0; i < code->nregs; i++) value_free(regs[i]);
+    if (regs != reg_buf) free(regs);
+    if (loops != loop_buf) free(loops);
+    return res;
+}
@@ -0,0 +1,38 @@
+#ifndef VM_H
+#define VM_H
+
+#include "interpreter.h"
+
+// Bytecode compiler and register VM, the alternative to the tree walker
+// in interpreter.c (selected with the -vm command line flag).
+//
+// Every STMT_BLOCK that the tree walker would enter through exec_stmt or
+// exec_program_in_env is compiled into a VmCode once, right after parsing.
+// Expressions evaluate into numbered registers; builtin calls are resolved
+// at compile time and receive their arguments straight from the register
+// file.  Statements and expressions with no bytecode form (TRY, PARFOR,
+// THR, FUNC definitions, user-function calls, indexing, literals of
+// tensors and maps, ...) are handed back to exec_stmt / eval_expr, whose
+// nested blocks in turn run on the VM again.  Both engines share Value,
+// Env, the builtin table, ExecResult and the traceback log, so a program
+// behaves the same under either one.
+
+typedef struct VmCode VmCode;
+
+// Enable compilation of every program parsed from now on.
+void vm_set_enabled(bool enabled);
+bool vm_enabled(void);
+
+// Compile `program` (a STMT_BLOCK fresh from the parser) and every block
+// nested in it that the tree walker can reach, storing the code in
+// Stmt.code.  Blocks that cannot be compiled keep code == NULL and run on
+// the tree walker.
+void vm_compile_program(Stmt* program);
+
+// Run the compiled statement list of `block` with the semantics of
+// exec_stmt_list.  `block->code` must be non-NULL.
+ExecResult vm_exec(Interpreter* interp, Stmt* block, Env* env, LabelMap* labels);
+
+void vm_code_free(VmCode* code);
+
+#endif // VM_H
@@ -1,6 +1,8 @@
 #ifndef WIN32_SHIM_H
 #define WIN32_SHIM_H
 
+#include <stdbool.h>
+
 #if defined(_WIN32) || defined(_MSC_VER)
 
 #define WIN32_LEAN_AND_MEAN
@@ -137,10 +139,84 @@ static inline int cnd_wait(cnd_t* cnd, mtx_t* mtx) {
     return thrd_success;
 }
 
+// `abs_time` is a TIME_UTC deadline, as for C11 cnd_timedwait.
+static inline int cnd_timedwait(cnd_t* cnd, mtx_t* mtx, const struct timespec* abs_time) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    long long ms = ((long long)abs_time->tv_sec - (long long)now.tv_sec) * 1000LL +
+                   ((long long)abs_time->tv_nsec - (long long)now.tv_nsec) / 1000000LL;
+    if (ms < 0) ms = 0;
+    if (ms > INFINITE - 1) ms = INFINITE - 1;
+    if (SleepConditionVariableCS(cnd, mtx, (DWORD)ms)) return thrd_success;
+    return GetLastError() == ERROR_TIMEOUT ? thrd_timedout : thrd_error;
+}
+
 static inline void cnd_destroy(cnd_t* cnd) {
     // CONDITION_VARIABLE does not require explicit destruction on Windows
     (void)cnd;
 }
 
+// Reader/writer lock (C11 threads has none; SRWLOCK needs no cleanup)
+
+typedef SRWLOCK rwl_t;
+
+static inline int rwl_init(rwl_t* rwl) {
+    InitializeSRWLock(rwl);
+    return thrd_success;
+}
+
+static inline void rwl_rdlock(rwl_t* rwl) { AcquireSRWLockShared(rwl); }
+static inline void rwl_rdunlock(rwl_t* rwl) { ReleaseSRWLockShared(rwl); }
+static inline void rwl_wrlock(rwl_t* rwl) { AcquireSRWLockExclusive(rwl); }
+static inline void rwl_wrunlock(rwl_t* rwl) { ReleaseSRWLockExclusive(rwl); }
+
+static inline void rwl_destroy(rwl_t* rwl) {
+    (void)rwl;
+}
+
+// Atomic counters (reference counts, spin locks)
+
+typedef volatile LONG atomic_count_t;
+
+static inline long atomic_count_inc(atomic_count_t* c) { return InterlockedIncrement(c); }
+static inline long atomic_count_dec(atomic_count_t* c) { return InterlockedDecrement(c); }
+static inline long atomic_count_load(atomic_count_t* c) { return InterlockedCompareExchange(c, 0, 0); }
+static inline bool atomic_count_cas(atomic_count_t* c, long expected, long desired) {
+    return InterlockedCompareExchange(c, desired, expected) == expected;
+}
+static inline void atomic_count_store(atomic_count_t* c, long v) { InterlockedExchange(c, v); }
+
+#else // POSIX: C11 <threads.h> plus pthread reader/writer locks
+
+#include <threads.h>
+#include <pthread.h>
+
+typedef pthread_rwlock_t rwl_t;
+
+static inline int rwl_init(rwl_t* rwl) {
+    return pthread_rwlock_init(rwl, NULL) == 0 ? thrd_success : thrd_error;
+}
+
+static inline void rwl_rdlock(rwl_t* rwl) { pthread_rwlock_rdlock(rwl); }
+static inline void rwl_rdunlock(rwl_t* rwl) { pthread_rwlock_unlock(rwl); }
+static inline void rwl_wrlock(rwl_t* rwl) { pthread_rwlock_wrlock(rwl); }
+static inline void rwl_wrunlock(rwl_t* rwl) { pthread_rwlock_unlock(rwl); }
+
+static inline void rwl_destroy(rwl_t* rwl) {
+    pthread_rwlock_destroy(rwl);
+}
+
+// Atomic counters (reference counts, spin locks)
+
+typedef long atomic_count_t;
+
+static inline long atomic_count_inc(atomic_count_t* c) { return __atomic_add_fetch(c, 1, __ATOMIC_RELAXED); }
+static inline long atomic_count_dec(atomic_count_t* c) { return __atomic_sub_fetch(c, 1, __ATOMIC_ACQ_REL); }
+static inline long atomic_count_load(atomic_count_t* c) { return __atomic_load_n(c, __ATOMIC_ACQUIRE); }
+static inline bool atomic_count_cas(atomic_count_t* c, long expected, long desired) {
+    return __atomic_compare_exchange_n(c, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+static inline void atomic_count_store(atomic_count_t* c, long v) { __atomic_store_n(c, v, __ATOMIC_RELEASE); }
+
 #endif // WIN32
 #endif // WIN32_SHIM_H
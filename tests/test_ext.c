@@ -62,6 +62,76 @@ static Value op_iadd(Interpreter* interp, Value* args, int argc, Expr** arg_node
     return make_int(sum);
 }
 
+/* Tensor buffer access (API version 2); copied from the init context. */
+static int (*g_tns_acquire)(Value* tensor, int flags, TnsBuffer* out);
+static void (*g_tns_release)(TnsBuffer* buf);
+static Value (*g_tns_alloc)(DeclType elem_type, size_t ndim, const size_t* shape, TnsBuffer* out);
+static void (*g_parallel_for)(size_t count, size_t chunk, prefix_parallel_fn fn, void* ctx);
+
+/* TNS_SUM(t): sum of an INT or FLT tensor, walking its steps (views included). */
+static Value op_tns_sum(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    TnsBuffer buf;
+    size_t idx[8] = {0};
+    int64_t isum = 0;
+    double fsum = 0.0;
+    (void)interp; (void)arg_nodes; (void)env; (void)line; (void)col;
+    if (argc != 1 || g_tns_acquire(&args[0], 0, &buf) != 0 || buf.ndim > 8) {
+        return make_int(-1);
+    }
+    for (size_t n = 0; n < buf.length; n++) {
+        size_t off = 0;
+        for (size_t d = 0; d < buf.ndim; d++) off += idx[d] * buf.steps[d];
+        if (buf.elem_type == TYPE_INT) isum += buf.ints[off];
+        else fsum += buf.flts[off];
+        for (size_t d = buf.ndim; d-- > 0;) {
+            if (++idx[d] < buf.shape[d]) break;
+            idx[d] = 0;
+        }
+    }
+    DeclType type = buf.elem_type;
+    g_tns_release(&buf);
+    if (type == TYPE_INT) return make_int(isum);
+    Value out;
+    memset(&out, 0, sizeof(out));
+    out.type = VAL_FLT;
+    out.as.f = fsum;
+    return out;
+}
+
+/* TNS_SCALE(t, k): t with every INT element multiplied by k, in place. */
+static Value op_tns_scale(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    TnsBuffer buf;
+    (void)interp; (void)arg_nodes; (void)env; (void)line; (void)col;
+    if (argc != 2 || args[1].type != VAL_INT) return make_int(-1);
+    if (g_tns_acquire(&args[0], PREFIX_TNS_WRITE, &buf) != 0 || buf.elem_type != TYPE_INT) {
+        if (buf.pins[0]) g_tns_release(&buf);
+        return make_int(-1);
+    }
+    for (size_t i = 0; i < buf.length; i++) buf.ints[i] *= args[1].as.i;
+    g_tns_release(&buf);
+    /* args[0] now holds the written tensor; hand that reference back. */
+    Value out = args[0];
+    args[0] = make_int(0);
+    return out;
+}
+
+static void ramp_chunk(void* ctx, size_t begin, size_t end) {
+    int64_t* ints = ctx;
+    for (size_t i = begin; i < end; i++) ints[i] = (int64_t)i + 1;
+}
+
+/* TNS_RAMP(n): [1, 2, ..., n] filled in place on the host's thread pool. */
+static Value op_tns_ramp(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    TnsBuffer buf;
+    (void)interp; (void)arg_nodes; (void)env; (void)line; (void)col;
+    if (argc != 1 || args[0].type != VAL_INT || args[0].as.i < 1) return make_int(-1);
+    size_t n = (size_t)args[0].as.i;
+    Value out = g_tns_alloc(TYPE_INT, 1, &n, &buf);
+    g_parallel_for(n, 0, ramp_chunk, buf.ints);
+    g_tns_release(&buf);
+    return out;
+}
+
 static void on_event(Interpreter* interp, const char* event_name) {
     (void)interp;
     /* increment counter when event fires */
@@ -80,7 +150,9 @@ PREFIX_EXT_EXPORT void prefix_extension_init(prefix_ext_context* ctx) {
     if (!ctx) {
         return;
     }
-    if (ctx->api_version != PREFIX_EXTENSION_API_VERSION) {
+    /* Later API versions only append to the context, so check for the
+       oldest version each group of operators needs. */
+    if (ctx->api_version < 1) {
         return;
     }
 
@@ -88,6 +160,16 @@ PREFIX_EXT_EXPORT void prefix_extension_init(prefix_ext_context* ctx) {
     (void)ctx->register_operator("IADD", op_iadd, PREFIX_EXTENSION_ASMODULE);
     (void)ctx->register_operator("GET_COUNTER", op_get_counter, PREFIX_EXTENSION_ASMODULE);
     (void)ctx->register_operator("RESET_COUNTER", op_reset_counter, PREFIX_EXTENSION_ASMODULE);
+
+    if (ctx->api_version >= 2) {
+        g_tns_acquire = ctx->tns_acquire;
+        g_tns_release = ctx->tns_release;
+        g_tns_alloc = ctx->tns_alloc;
+        g_parallel_for = ctx->parallel_for;
+        (void)ctx->register_operator("TNS_SUM", op_tns_sum, PREFIX_EXTENSION_ASMODULE);
+        (void)ctx->register_operator("TNS_SCALE", op_tns_scale, PREFIX_EXTENSION_ASMODULE);
+        (void)ctx->register_operator("TNS_RAMP", op_tns_ramp, PREFIX_EXTENSION_ASMODULE);
+    }
     /* Test global operator registration (asmodule=0) */
     (void)ctx->register_operator("GLOBAL_PING", op_ping, 0);
 
@@ -0,0 +1,48 @@
+/* An extension written against version 1 of the extension API.
+ *
+ * It declares the version-1 layout of prefix_ext_context itself, exactly as
+ * a library compiled against the old header sees it, so loading it checks
+ * that newer hosts keep that layout as a prefix of their context. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/prefix_extension.h"
+
+#ifdef _WIN32
+#define PREFIX_EXT_EXPORT __declspec(dllexport)
+#else
+#define PREFIX_EXT_EXPORT
+#endif
+
+#define TEST_EXT_V1_API_VERSION 1
+
+typedef struct prefix_ext_context_v1 {
+    int api_version;
+    const char* extension_name;
+
+    int (*register_operator)(const char* name, prefix_operator_fn fn, int asmodule);
+    int (*register_periodic_hook)(int n, prefix_event_fn fn);
+    int (*register_event_handler)(const char* event_name, prefix_event_fn fn);
+    int (*register_repl_handler)(prefix_repl_fn repl_fn);
+} prefix_ext_context_v1;
+
+static Value op_version(Interpreter* interp, Value* args, int argc, Expr** arg_nodes, Env* env, int line, int col) {
+    (void)interp; (void)args; (void)argc; (void)arg_nodes; (void)env; (void)line; (void)col;
+    Value out;
+    memset(&out, 0, sizeof(out));
+    out.type = VAL_INT;
+    out.as.i = TEST_EXT_V1_API_VERSION;
+    return out;
+}
+
+PREFIX_EXT_EXPORT void prefix_extension_init(prefix_ext_context* host_ctx) {
+    prefix_ext_context_v1* ctx = (prefix_ext_context_v1*)host_ctx;
+    if (!ctx) {
+        return;
+    }
+    if (ctx->api_version < TEST_EXT_V1_API_VERSION) {
+        return;
+    }
+    (void)ctx->register_operator("VERSION", op_version, PREFIX_EXTENSION_ASMODULE);
+}